@@ -9,7 +9,12 @@ LOCAL_SRC_FILES:= \
     gstomx_base_filter.c    \
     gstomx_interface.c	    \
     gstomx_base_videodec.c  \
+    gstomx_convert.c        \
+    gstomx_bitstream.c      \
     gstomx_util.c           \
+    gstomx_trace.c          \
+    gstomx_metrics.c        \
+    gstomx_capture.c        \
     gstomx_dummy.c          \
     gstomx_aacdec.c         \
     gstomx_amrnbdec.c       \
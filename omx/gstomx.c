@@ -63,6 +63,7 @@
 #include "gstomx_ilbcdec.h"
 #include "gstomx_ilbcenc.h"
 #include "gstomx_jpegenc.h"
+#include "gstomx_jpegdec.h"
 #include "gstomx_audiosink.h"
 #include "gstomx_videosink.h"
 #include "gstomx_filereadersrc.h"
@@ -219,6 +220,11 @@ plugin_init (GstPlugin * plugin)
     return false;
   }
 
+  if (!gst_element_register (plugin, "omx_jpegdec", DEFAULT_RANK,
+          GST_OMX_JPEGDEC_TYPE)) {
+    return false;
+  }
+
   if (!gst_element_register (plugin, "omx_audiosink", GST_RANK_NONE,
           GST_OMX_AUDIOSINK_TYPE)) {
     return false;
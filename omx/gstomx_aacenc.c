@@ -297,24 +297,17 @@ sink_setcaps (GstPad * pad, GstCaps * caps)
 
   /* Input port configuration. */
   {
+    GOmxPort *port;
     OMX_AUDIO_PARAM_PCMMODETYPE *param;
 
-    param = calloc (1, sizeof (OMX_AUDIO_PARAM_PCMMODETYPE));
-    param->nSize = sizeof (OMX_AUDIO_PARAM_PCMMODETYPE);
-    param->nVersion.s.nVersionMajor = 1;
-    param->nVersion.s.nVersionMinor = 1;
-
-    param->nPortIndex = 0;
-    OMX_GetParameter (omx_base->gomx->omx_handle, OMX_IndexParamAudioPcm,
-        param);
+    port = g_omx_core_port (omx_base->gomx, 0);
+    param = g_omx_port_get_param (port, OMX_IndexParamAudioPcm,
+        sizeof (OMX_AUDIO_PARAM_PCMMODETYPE));
 
     param->nSamplingRate = rate;
     param->nChannels = channels;
 
-    OMX_SetParameter (omx_base->gomx->omx_handle, OMX_IndexParamAudioPcm,
-        param);
-
-    free (param);
+    g_omx_port_param_changed (port, OMX_IndexParamAudioPcm);
   }
 
   {
@@ -345,17 +338,14 @@ omx_setup (GstOmxBaseFilter * omx_base)
   GST_INFO_OBJECT (omx_base, "begin");
 
   {
+    GOmxPort *port;
     OMX_AUDIO_PARAM_AACPROFILETYPE *param;
 
-    param = calloc (1, sizeof (OMX_AUDIO_PARAM_AACPROFILETYPE));
-    param->nSize = sizeof (OMX_AUDIO_PARAM_AACPROFILETYPE);
-    param->nVersion.s.nVersionMajor = 1;
-    param->nVersion.s.nVersionMinor = 1;
-
     /* Output port configuration. */
     {
-      param->nPortIndex = 1;
-      OMX_GetParameter (gomx->omx_handle, OMX_IndexParamAudioAac, param);
+      port = g_omx_core_port (gomx, 1);
+      param = g_omx_port_get_param (port, OMX_IndexParamAudioAac,
+          sizeof (OMX_AUDIO_PARAM_AACPROFILETYPE));
 
       GST_DEBUG_OBJECT (omx_base, "setting bitrate: %i", self->bitrate);
       param->nBitRate = self->bitrate;
@@ -367,7 +357,7 @@ omx_setup (GstOmxBaseFilter * omx_base)
           self->output_format);
       param->eAACStreamFormat = self->output_format;
 
-      OMX_SetParameter (gomx->omx_handle, OMX_IndexParamAudioAac, param);
+      g_omx_port_param_changed (port, OMX_IndexParamAudioAac);
     }
   }
 
@@ -23,7 +23,6 @@
 #include "gstomx.h"
 #include "gstomx_interface.h"
 
-#include <stdlib.h>             /* For calloc, free */
 #include <string.h>             /* For memcpy */
 
 enum
@@ -32,6 +31,12 @@ enum
   ARG_COMPONENT_NAME,
   ARG_LIBRARY_NAME,
   ARG_USE_TIMESTAMPS,
+  ARG_USE_TUNNEL,
+  ARG_ASYNC_CALLBACKS,
+  ARG_PRIORITY,
+  ARG_FALLBACK_COMPONENT_NAME,
+  ARG_FALLBACK_LIBRARY_NAME,
+  ARG_CANDIDATES,
 };
 
 static GstElementClass *parent_class = NULL;
@@ -44,26 +49,77 @@ setup_ports (GstOmxBaseFilter * self)
 
   core = self->gomx;
 
-  param = calloc (1, sizeof (OMX_PARAM_PORTDEFINITIONTYPE));
-  param->nSize = sizeof (OMX_PARAM_PORTDEFINITIONTYPE);
-  param->nVersion.s.nVersionMajor = 1;
-  param->nVersion.s.nVersionMinor = 1;
-
   /* Input port configuration. */
 
-  param->nPortIndex = 0;
-  OMX_GetParameter (core->omx_handle, OMX_IndexParamPortDefinition, param);
+  param = g_omx_port_get_definition (g_omx_core_port (core, 0));
   self->in_port = g_omx_core_setup_port (core, param);
   gst_pad_set_element_private (self->sinkpad, self->in_port);
 
   /* Output port configuration. */
 
-  param->nPortIndex = 1;
-  OMX_GetParameter (core->omx_handle, OMX_IndexParamPortDefinition, param);
+  param = g_omx_port_get_definition (g_omx_core_port (core, 1));
   self->out_port = g_omx_core_setup_port (core, param);
   gst_pad_set_element_private (self->srcpad, self->out_port);
+}
+
+static void
+clear_fallback_buffers (GstOmxBaseFilter * self)
+{
+  g_slist_foreach (self->fallback_buffers, (GFunc) g_free, NULL);
+  g_slist_free (self->fallback_buffers);
+  self->fallback_buffers = NULL;
+}
+
+static void
+clear_reverse (GstOmxBaseFilter * self)
+{
+  GstBuffer *buf;
+
+  while ((buf = g_queue_pop_head (self->reverse_frames)))
+    gst_buffer_unref (buf);
+}
+
+/* Push the held GOP, latest first. */
+static GstFlowReturn
+flush_reverse (GstOmxBaseFilter * self)
+{
+  GstFlowReturn ret = GST_FLOW_OK;
+  GstBuffer *buf;
+
+  while ((buf = g_queue_pop_tail (self->reverse_frames))) {
+    if (ret == GST_FLOW_OK)
+      ret = gst_pad_push (self->srcpad, buf);
+    else
+      gst_buffer_unref (buf);
+  }
 
-  free (param);
+  return ret;
+}
+
+/*
+ * Demuxers play backwards a GOP at a time, each in forward order; a frame
+ * earlier than everything held starts the next one.
+ */
+static GstFlowReturn
+queue_reverse (GstOmxBaseFilter * self, GstBuffer * buf)
+{
+  GstFlowReturn ret = GST_FLOW_OK;
+  GstBuffer *first;
+
+  first = g_queue_peek_head (self->reverse_frames);
+  if (first && GST_BUFFER_TIMESTAMP (buf) < GST_BUFFER_TIMESTAMP (first))
+    ret = flush_reverse (self);
+
+  if (g_queue_get_length (self->reverse_frames) >= self->max_reverse_frames) {
+    GST_DEBUG_OBJECT (self, "GOP longer than %u frames, dropping",
+        self->max_reverse_frames);
+    gst_buffer_unref (buf);
+    return ret;
+  }
+
+  g_queue_push_tail (self->reverse_frames, buf);
+
+  return ret;
 }
 
 static GstStateChangeReturn
@@ -82,6 +138,10 @@ change_state (GstElement * element, GstStateChange transition)
 
   switch (transition) {
     case GST_STATE_CHANGE_NULL_TO_READY:
+      g_omx_core_set_fallback (self->gomx,
+          self->fallback_library ? self->fallback_library : self->omx_library,
+          self->fallback_component);
+      g_omx_core_set_candidates (self->gomx, self->candidates);
       g_omx_core_init (self->gomx, self->omx_library, self->omx_component);
       if (self->gomx->omx_error)
         return GST_STATE_CHANGE_FAILURE;
@@ -114,6 +174,16 @@ change_state (GstElement * element, GstStateChange transition)
         g_omx_core_finish (self->gomx);
         self->initialized = FALSE;
       }
+      /* the headers that held them are gone */
+      clear_fallback_buffers (self);
+      self->tunnel_checked = FALSE;
+      self->tunnel_resync = FALSE;
+      self->settings_generation = -1;
+      clear_reverse (self);
+      gst_buffer_replace (&self->output_rest, NULL);
+      self->frame_ended = TRUE;
+      /* the next component may flag differently */
+      self->sync_flags = -1;
       break;
 
     case GST_STATE_CHANGE_READY_TO_NULL:
@@ -143,10 +213,22 @@ dispose (GObject * obj)
     self->codec_data = NULL;
   }
 
+  gst_buffer_replace (&self->output_rest, NULL);
+
   g_omx_core_free (self->gomx);
+  clear_fallback_buffers (self);
 
   g_free (self->omx_component);
   g_free (self->omx_library);
+  g_free (self->fallback_component);
+  g_free (self->fallback_library);
+  g_free (self->candidates);
+
+  if (self->reverse_frames) {
+    clear_reverse (self);
+    g_queue_free (self->reverse_frames);
+    self->reverse_frames = NULL;
+  }
 
   G_OBJECT_CLASS (parent_class)->dispose (obj);
 }
@@ -171,6 +253,27 @@ set_property (GObject * obj,
     case ARG_USE_TIMESTAMPS:
       self->use_timestamps = g_value_get_boolean (value);
       break;
+    case ARG_USE_TUNNEL:
+      self->use_tunnel = g_value_get_boolean (value);
+      break;
+    case ARG_ASYNC_CALLBACKS:
+      self->gomx->use_dispatch = g_value_get_boolean (value);
+      break;
+    case ARG_PRIORITY:
+      self->gomx->priority = g_value_get_int (value);
+      break;
+    case ARG_FALLBACK_COMPONENT_NAME:
+      g_free (self->fallback_component);
+      self->fallback_component = g_value_dup_string (value);
+      break;
+    case ARG_FALLBACK_LIBRARY_NAME:
+      g_free (self->fallback_library);
+      self->fallback_library = g_value_dup_string (value);
+      break;
+    case ARG_CANDIDATES:
+      g_free (self->candidates);
+      self->candidates = g_value_dup_string (value);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (obj, prop_id, pspec);
       break;
@@ -194,6 +297,24 @@ get_property (GObject * obj, guint prop_id, GValue * value, GParamSpec * pspec)
     case ARG_USE_TIMESTAMPS:
       g_value_set_boolean (value, self->use_timestamps);
       break;
+    case ARG_USE_TUNNEL:
+      g_value_set_boolean (value, self->use_tunnel);
+      break;
+    case ARG_ASYNC_CALLBACKS:
+      g_value_set_boolean (value, self->gomx->use_dispatch);
+      break;
+    case ARG_PRIORITY:
+      g_value_set_int (value, self->gomx->priority);
+      break;
+    case ARG_FALLBACK_COMPONENT_NAME:
+      g_value_set_string (value, self->fallback_component);
+      break;
+    case ARG_FALLBACK_LIBRARY_NAME:
+      g_value_set_string (value, self->fallback_library);
+      break;
+    case ARG_CANDIDATES:
+      g_value_set_string (value, self->candidates);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (obj, prop_id, pspec);
       break;
@@ -232,6 +353,42 @@ type_class_init (gpointer g_class, gpointer class_data)
     g_object_class_install_property (gobject_class, ARG_USE_TIMESTAMPS,
         g_param_spec_boolean ("use-timestamps", "Use timestamps",
             "Whether or not to use timestamps", TRUE, G_PARAM_READWRITE));
+
+    g_object_class_install_property (gobject_class, ARG_USE_TUNNEL,
+        g_param_spec_boolean ("use-tunnel", "Use tunnel",
+            "Whether or not to tunnel to a downstream OpenMAX IL element",
+            TRUE, G_PARAM_READWRITE));
+
+    g_object_class_install_property (gobject_class, ARG_ASYNC_CALLBACKS,
+        g_param_spec_boolean ("async-callbacks", "Async callbacks",
+            "Handle OpenMAX IL callbacks in a separate thread "
+            "(takes effect on the next NULL to READY change)",
+            FALSE, G_PARAM_READWRITE));
+
+    g_object_class_install_property (gobject_class, ARG_PRIORITY,
+        g_param_spec_int ("priority", "Priority",
+            "Higher priority elements may preempt lower priority ones "
+            "when the component is busy",
+            G_MININT, G_MAXINT, 0, G_PARAM_READWRITE));
+
+    g_object_class_install_property (gobject_class,
+        ARG_FALLBACK_COMPONENT_NAME,
+        g_param_spec_string ("fallback-component-name",
+            "Fallback component name",
+            "Component to use when the main one has no free instances, "
+            "e.g. a software codec", NULL, G_PARAM_READWRITE));
+
+    g_object_class_install_property (gobject_class, ARG_FALLBACK_LIBRARY_NAME,
+        g_param_spec_string ("fallback-library-name", "Fallback library name",
+            "Implementation library of the fallback component",
+            NULL, G_PARAM_READWRITE));
+
+    g_object_class_install_property (gobject_class, ARG_CANDIDATES,
+        g_param_spec_string ("candidates", "Candidates",
+            "Equivalent components to balance streams over, as "
+            "\"library:component,...\" (the library defaults to "
+            "library-name); overrides component-name",
+            NULL, G_PARAM_READWRITE));
   }
 }
 
@@ -242,12 +399,341 @@ push_buffer (GstOmxBaseFilter * self, GstBuffer * buf)
 
     /** @todo check if tainted */
   GST_LOG_OBJECT (self, "begin");
+
+  if (G_UNLIKELY (self->max_reverse_frames)) {
+    gdouble rate;
+
+    GST_OBJECT_LOCK (self);
+    rate = self->segment.rate;
+    GST_OBJECT_UNLOCK (self);
+
+    if (rate < 0.0 && GST_BUFFER_TIMESTAMP_IS_VALID (buf))
+      return queue_reverse (self, buf);
+  }
+
   ret = gst_pad_push (self->srcpad, buf);
   GST_LOG_OBJECT (self, "end");
 
   return ret;
 }
 
+static void drain_output (GOmxPort * port, OMX_BUFFERHEADERTYPE * omx_buffer,
+    gpointer data);
+
+/* Connects our output port straight to the input port of the downstream
+ * element, if that is an OpenMAX IL element too. */
+static gboolean
+setup_tunnel (GstOmxBaseFilter * self)
+{
+  GstPad *peer;
+  GstElement *element;
+  GOmxPort *port = NULL;
+  gboolean ret = FALSE;
+
+  peer = gst_pad_get_peer (self->srcpad);
+  if (!peer)
+    return FALSE;
+
+  element = gst_pad_get_parent_element (peer);
+  if (element) {
+    /* the port is there once the peer has processed a buffer */
+    if (GST_IS_OMX (element))
+      port = gst_pad_get_element_private (peer);
+    gst_object_unref (element);
+  }
+
+  if (port) {
+    /* keep the peer out of its chain/render while its port changes */
+    GST_PAD_STREAM_LOCK (peer);
+    ret = g_omx_port_setup_tunnel (self->out_port, port, drain_output, self);
+    GST_PAD_STREAM_UNLOCK (peer);
+  }
+
+  gst_object_unref (peer);
+
+  return ret;
+}
+
+/* While tunneled nothing flows through the src pad, but downstream still
+ * needs a buffer to preroll after a flush. */
+static void
+push_tunnel_marker (GstOmxBaseFilter * self, GstBuffer * buf)
+{
+  GstBuffer *marker;
+
+  marker = gst_buffer_new ();
+  GST_BUFFER_TIMESTAMP (marker) = GST_BUFFER_TIMESTAMP (buf);
+  gst_buffer_set_caps (marker, GST_PAD_CAPS (self->srcpad));
+
+  GST_LOG_OBJECT (self, "push tunnel marker");
+  self->last_pad_push_return = push_buffer (self, marker);
+}
+
+/* A downstream buffer holding the output, repacked if need be. */
+static GstBuffer *
+copy_output_buffer (GstOmxBaseFilter * self, OMX_BUFFERHEADERTYPE * omx_buffer)
+{
+  GstBuffer *buf = NULL;
+  guint size;
+
+  size = self->copy_output ? self->copy_output_size : omx_buffer->nFilledLen;
+
+  gst_pad_alloc_buffer_and_set_caps (self->srcpad,
+      GST_BUFFER_OFFSET_NONE, size, GST_PAD_CAPS (self->srcpad), &buf);
+
+  if (G_UNLIKELY (!buf)) {
+    GST_WARNING_OBJECT (self, "couldn't allocate buffer of size %u", size);
+    return NULL;
+  }
+
+  if (self->copy_output) {
+    if (!self->copy_output (self, GST_BUFFER_DATA (buf), omx_buffer)) {
+      gst_buffer_unref (buf);
+      return NULL;
+    }
+  } else
+    memcpy (GST_BUFFER_DATA (buf),
+        omx_buffer->pBuffer + omx_buffer->nOffset, omx_buffer->nFilledLen);
+
+  if (self->use_timestamps) {
+    GST_BUFFER_TIMESTAMP (buf) =
+        gst_util_uint64_scale_int (omx_buffer->nTimeStamp, GST_SECOND,
+        OMX_TICKS_PER_SECOND);
+  }
+
+  return buf;
+}
+
+static void
+free_fallback_buffer (GstOmxBaseFilter * self, gpointer data)
+{
+  GSList *link;
+
+  link = g_slist_find (self->fallback_buffers, data);
+  if (link) {
+    self->fallback_buffers = g_slist_delete_link (self->fallback_buffers, link);
+    g_free (data);
+  }
+}
+
+/* Flags and rewrites a buffer on its way out. */
+static GstBuffer *
+finish_output (GstOmxBaseFilter * self, GstBuffer * buf, guint32 omx_flags)
+{
+  if (self->mark_delta_units) {
+    gboolean sync;
+
+    /* the first frame is always a sync frame, if the component says so */
+    if (G_UNLIKELY (self->sync_flags < 0)) {
+      self->sync_flags = (omx_flags & OMX_BUFFERFLAG_SYNCFRAME) != 0;
+      if (!self->sync_flags)
+        GST_WARNING_OBJECT (self, "component doesn't flag sync frames");
+    }
+
+    sync = (omx_flags & OMX_BUFFERFLAG_SYNCFRAME) != 0;
+
+    /* slices after the first may not carry the frame's flags */
+    if (self->partial_frames) {
+      if (self->frame_ended ||
+          GST_BUFFER_TIMESTAMP (buf) != self->frame_timestamp) {
+        self->frame_sync = sync;
+        self->frame_timestamp = GST_BUFFER_TIMESTAMP (buf);
+      } else {
+        sync = self->frame_sync = self->frame_sync || sync;
+      }
+      self->frame_ended = (omx_flags & OMX_BUFFERFLAG_ENDOFFRAME) != 0;
+    }
+
+    if (self->sync_flags && !sync)
+      GST_BUFFER_FLAG_SET (buf, GST_BUFFER_FLAG_DELTA_UNIT);
+    else
+      GST_BUFFER_FLAG_UNSET (buf, GST_BUFFER_FLAG_DELTA_UNIT);
+  }
+
+  if (self->process_output)
+    buf = self->process_output (self, buf, omx_flags);
+
+  return buf;
+}
+
+/* Pushes buffers in order; once one is refused the rest are dropped. */
+static GstFlowReturn
+push_units (GstOmxBaseFilter * self, GList * units)
+{
+  GstFlowReturn ret = GST_FLOW_OK;
+
+  while (units) {
+    GstBuffer *unit = units->data;
+
+    if (G_LIKELY (ret == GST_FLOW_OK))
+      ret = push_buffer (self, unit);
+    else
+      gst_buffer_unref (unit);
+
+    units = g_list_delete_link (units, units);
+  }
+
+  return ret;
+}
+
+/* Pushes what split_output held back, once nothing can complete it. */
+static GstFlowReturn
+flush_output_rest (GstOmxBaseFilter * self)
+{
+  GstBuffer *rest;
+
+  rest = self->output_rest;
+  if (!rest)
+    return GST_FLOW_OK;
+  self->output_rest = NULL;
+
+  return push_units (self, self->split_output (self, rest, NULL));
+}
+
+/* Pushes a finished buffer, in as many pieces as split_output cuts. */
+static GstFlowReturn
+push_output (GstOmxBaseFilter * self, GstBuffer * buf, guint32 omx_flags)
+{
+  GstFlowReturn ret = GST_FLOW_OK;
+  GstBuffer **rest = NULL;
+
+  if (!self->split_output)
+    return push_buffer (self, buf);
+
+  if (self->output_rest) {
+    if (GST_BUFFER_TIMESTAMP (self->output_rest) ==
+        GST_BUFFER_TIMESTAMP (buf)) {
+      GstBuffer *joined;
+
+      /* more of the same frame; its flags are the latest verdict */
+      joined = gst_buffer_merge (self->output_rest, buf);
+      gst_buffer_copy_metadata (joined, buf, GST_BUFFER_COPY_ALL);
+      gst_buffer_unref (self->output_rest);
+      gst_buffer_unref (buf);
+      self->output_rest = NULL;
+      buf = joined;
+    } else {
+      /* the frame ended without saying so */
+      ret = flush_output_rest (self);
+    }
+  }
+
+  /* otherwise every buffer is taken to end on a unit boundary */
+  if (self->partial_units &&
+      !(omx_flags & (OMX_BUFFERFLAG_ENDOFFRAME | OMX_BUFFERFLAG_EOS)))
+    rest = &self->output_rest;
+
+  if (G_UNLIKELY (ret != GST_FLOW_OK)) {
+    gst_buffer_unref (buf);
+    return ret;
+  }
+
+  return push_units (self, self->split_output (self, buf, rest));
+}
+
+/* Output left when the port goes into a tunnel still goes downstream. */
+static void
+drain_output (GOmxPort * port, OMX_BUFFERHEADERTYPE * omx_buffer,
+    gpointer data)
+{
+  GstOmxBaseFilter *self = data;
+  GstBuffer *buf;
+
+  buf = copy_output_buffer (self, omx_buffer);
+  if (G_LIKELY (buf))
+    buf = finish_output (self, buf, omx_buffer->nFlags);
+  if (G_LIKELY (buf))
+    self->last_pad_push_return = push_output (self, buf, omx_buffer->nFlags);
+}
+
+/* Codec config goes in the caps, once per change. */
+static void
+set_codec_data (GstOmxBaseFilter * self, GstBuffer * buf, guint32 omx_flags)
+{
+  GstCaps *caps;
+  GstStructure *structure;
+  const GValue *current;
+  GValue value = { 0, };
+
+  if (self->process_output)
+    buf = self->process_output (self, buf, omx_flags);
+  if (G_UNLIKELY (!buf))
+    return;
+
+  caps = gst_pad_get_negotiated_caps (self->srcpad);
+  if (G_UNLIKELY (!caps)) {
+    GST_WARNING_OBJECT (self, "codec config before caps, dropped");
+    gst_buffer_unref (buf);
+    return;
+  }
+
+  structure = gst_caps_get_structure (caps, 0);
+  current = gst_structure_get_value (structure, "codec_data");
+  if (current) {
+    GstBuffer *old;
+
+    old = gst_value_get_buffer (current);
+    if (GST_BUFFER_SIZE (old) == GST_BUFFER_SIZE (buf) &&
+        memcmp (GST_BUFFER_DATA (old), GST_BUFFER_DATA (buf),
+            GST_BUFFER_SIZE (buf)) == 0) {
+      GST_LOG_OBJECT (self, "codec data unchanged");
+      gst_buffer_unref (buf);
+      gst_caps_unref (caps);
+      return;
+    }
+  }
+
+  caps = gst_caps_make_writable (caps);
+  structure = gst_caps_get_structure (caps, 0);
+
+  g_value_init (&value, GST_TYPE_BUFFER);
+  gst_value_take_buffer (&value, buf);
+  gst_structure_set_value (structure, "codec_data", &value);
+  g_value_unset (&value);
+
+  gst_pad_set_caps (self->srcpad, caps);
+  gst_caps_unref (caps);
+}
+
+/* Output of input sent DECODEONLY, which nobody will show. */
+static inline gboolean
+output_decode_only (GstOmxBaseFilter * self, OMX_BUFFERHEADERTYPE * omx_buffer)
+{
+  gint64 until;
+
+  if (!self->use_decode_only ||
+      omx_buffer->nFlags & (OMX_BUFFERFLAG_EOS | OMX_BUFFERFLAG_CODECCONFIG))
+    return FALSE;
+
+  if (omx_buffer->nFlags & OMX_BUFFERFLAG_DECODEONLY)
+    return TRUE;
+
+  /* in case the component doesn't carry the flag over */
+  GST_OBJECT_LOCK (self);
+  until = self->decode_only_until;
+  GST_OBJECT_UNLOCK (self);
+
+  return until >= 0 && omx_buffer->nTimeStamp <= until;
+}
+
+/* Whether the input is only needed to decode what follows it. */
+static inline gboolean
+input_decode_only (GstOmxBaseFilter * self, GstBuffer * buf)
+{
+  GstClockTime end;
+
+  if (!self->use_decode_only || !self->use_timestamps ||
+      self->segment.format != GST_FORMAT_TIME ||
+      !GST_BUFFER_TIMESTAMP_IS_VALID (buf))
+    return FALSE;
+
+  end = GST_BUFFER_TIMESTAMP (buf);
+  if (GST_BUFFER_DURATION_IS_VALID (buf))
+    end += GST_BUFFER_DURATION (buf);
+
+  return (gint64) end < self->segment.start;
+}
+
 static void
 output_loop (gpointer data)
 {
@@ -288,54 +774,70 @@ output_loop (gpointer data)
         omx_buffer->nAllocLen, omx_buffer->nFilledLen, omx_buffer->nFlags,
         omx_buffer->nOffset, omx_buffer->nTimeStamp);
 
-    if (G_LIKELY (omx_buffer->nFilledLen > 0)) {
+    if (G_UNLIKELY (omx_buffer->nFilledLen > 0 &&
+            output_decode_only (self, omx_buffer))) {
+      GST_LOG_OBJECT (self, "decode only, not pushed");
+    } else if (G_LIKELY (omx_buffer->nFilledLen > 0)) {
       GstBuffer *buf;
 
-#if 1
-            /** @todo remove this check */
-      if (G_LIKELY (self->in_port->enabled)) {
-        GstCaps *caps = NULL;
+      {
+        gint generation;
 
-        caps = gst_pad_get_negotiated_caps (self->srcpad);
+        generation = g_atomic_int_get (&gomx->settings_generation);
 
-        if (!caps || gomx->settings_changed) {
-                    /** @todo We shouldn't be doing this. */
-          GST_WARNING_OBJECT (self, "faking settings changed notification");
-          if (gomx->settings_changed_cb)
-            gomx->settings_changed_cb (gomx);
-          gomx->settings_changed = FALSE;
-          GST_LOG_OBJECT (self, "Reset setting of source pad");
-        } else {
-          GST_LOG_OBJECT (self, "caps already fixed: %" GST_PTR_FORMAT, caps);
-          gst_caps_unref (caps);
+        if (G_UNLIKELY (generation != self->settings_generation)) {
+          /* before any settings change only missing caps matter */
+          if (generation > 0 || !GST_PAD_CAPS (self->srcpad)) {
+            GST_INFO_OBJECT (self, "settings changed, generation %d",
+                generation);
+            if (gomx->settings_changed_cb)
+              gomx->settings_changed_cb (gomx);
+          }
+          self->settings_generation = generation;
         }
       }
-#endif
 
       /* buf is always null when the output buffer pointer isn't shared. */
       buf = omx_buffer->pAppPrivate;
 
             /** @todo we need to move all the caps handling to one single
              * place, in the output loop probably. */
-      if (G_UNLIKELY (omx_buffer->nFlags & 0x80)) {
-        GstCaps *caps = NULL;
-        GstStructure *structure;
-        GValue value = { 0, };
-
-        caps = gst_pad_get_negotiated_caps (self->srcpad);
-        caps = gst_caps_make_writable (caps);
-        structure = gst_caps_get_structure (caps, 0);
-
-        g_value_init (&value, GST_TYPE_BUFFER);
-        buf = gst_buffer_new_and_alloc (omx_buffer->nFilledLen);
-        memcpy (GST_BUFFER_DATA (buf),
-            omx_buffer->pBuffer + omx_buffer->nOffset, omx_buffer->nFilledLen);
-        gst_value_set_buffer (&value, buf);
-        gst_buffer_unref (buf);
-        gst_structure_set_value (structure, "codec_data", &value);
-        g_value_unset (&value);
+      if (G_UNLIKELY (omx_buffer->nFlags & OMX_BUFFERFLAG_CODECCONFIG)) {
+        if (buf) {
+          /* shared; keep it instead of copying */
+          GST_BUFFER_SIZE (buf) = omx_buffer->nFilledLen;
+
+          omx_buffer->pAppPrivate = NULL;
+          omx_buffer->pBuffer = NULL;
+
+          /* the one kept for the header */
+          gst_buffer_unref (buf);
+        } else {
+          buf = gst_buffer_new_and_alloc (omx_buffer->nFilledLen);
+          memcpy (GST_BUFFER_DATA (buf),
+              omx_buffer->pBuffer + omx_buffer->nOffset,
+              omx_buffer->nFilledLen);
+        }
+
+        set_codec_data (self, buf, omx_buffer->nFlags);
+      } else if (buf && self->copy_output &&
+          !(omx_buffer->nFlags & OMX_BUFFERFLAG_EOS)) {
+        GstBuffer *shared = buf;
 
-        gst_pad_set_caps (self->srcpad, caps);
+        /* shared, but downstream can't take the padding */
+        buf = copy_output_buffer (self, omx_buffer);
+
+        omx_buffer->pAppPrivate = NULL;
+        omx_buffer->pBuffer = NULL;
+
+        /* ours and the one kept for the header */
+        gst_buffer_unref (shared);
+        gst_buffer_unref (shared);
+
+        if (G_LIKELY (buf))
+          buf = finish_output (self, buf, omx_buffer->nFlags);
+        if (G_LIKELY (buf))
+          ret = push_output (self, buf, omx_buffer->nFlags);
       } else if (buf && !(omx_buffer->nFlags & OMX_BUFFERFLAG_EOS)) {
         GST_BUFFER_SIZE (buf) = omx_buffer->nFilledLen;
         if (self->use_timestamps) {
@@ -347,41 +849,29 @@ output_loop (gpointer data)
         omx_buffer->pAppPrivate = NULL;
         omx_buffer->pBuffer = NULL;
 
-        ret = push_buffer (self, buf);
-
+        /* the one kept for the header; ours is writable now */
         gst_buffer_unref (buf);
+
+        buf = finish_output (self, buf, omx_buffer->nFlags);
+        if (G_LIKELY (buf))
+          ret = push_output (self, buf, omx_buffer->nFlags);
       } else {
         /* This is only meant for the first OpenMAX buffers,
          * which need to be pre-allocated. */
         /* Also for the very last one. */
-        gst_pad_alloc_buffer_and_set_caps (self->srcpad,
-            GST_BUFFER_OFFSET_NONE,
-            omx_buffer->nFilledLen, GST_PAD_CAPS (self->srcpad), &buf);
+        buf = copy_output_buffer (self, omx_buffer);
+        if (G_LIKELY (buf))
+          buf = finish_output (self, buf, omx_buffer->nFlags);
 
         if (G_LIKELY (buf)) {
-          memcpy (GST_BUFFER_DATA (buf),
-              omx_buffer->pBuffer + omx_buffer->nOffset,
-              omx_buffer->nFilledLen);
-          if (self->use_timestamps) {
-
-            GST_BUFFER_TIMESTAMP (buf) =
-                gst_util_uint64_scale_int (omx_buffer->nTimeStamp, GST_SECOND,
-                OMX_TICKS_PER_SECOND);
-          }
-
           if (self->share_output_buffer) {
             GST_WARNING_OBJECT (self, "couldn't zero-copy");
-                        /** @todo only the first buffer must be freed (the one
-                         * allocated by us), the rest are allocated by the next
-                         * element. */
-            /* g_free (omx_buffer->pBuffer); */
+            /* arena slots stay with the port; only malloc fallbacks are ours */
+            free_fallback_buffer (self, omx_buffer->pBuffer);
             omx_buffer->pBuffer = NULL;
           }
 
-          ret = push_buffer (self, buf);
-        } else {
-          GST_WARNING_OBJECT (self, "couldn't allocate buffer of size %lu",
-              omx_buffer->nFilledLen);
+          ret = push_output (self, buf, omx_buffer->nFlags);
         }
       }
     } else {
@@ -390,6 +880,8 @@ output_loop (gpointer data)
 
     if (G_UNLIKELY (omx_buffer->nFlags & OMX_BUFFERFLAG_EOS)) {
       GST_DEBUG_OBJECT (self, "got eos");
+      flush_output_rest (self);
+      flush_reverse (self);
       gst_pad_push_event (self->srcpad, gst_event_new_eos ());
       ret = GST_FLOW_UNEXPECTED;
       goto leave;
@@ -415,6 +907,8 @@ output_loop (gpointer data)
         GST_WARNING_OBJECT (self,
             "could not pad allocate buffer, using malloc");
         omx_buffer->pBuffer = g_malloc (omx_buffer->nAllocLen);
+        self->fallback_buffers =
+            g_slist_prepend (self->fallback_buffers, omx_buffer->pBuffer);
       }
     }
 
@@ -425,6 +919,16 @@ output_loop (gpointer data)
     omx_buffer->nFilledLen = 0;
     GST_LOG_OBJECT (self, "release_buffer");
     g_omx_port_release_buffer (out_port, omx_buffer);
+
+    /* downstream is configured now that it got a buffer */
+    if (G_UNLIKELY (self->use_tunnel && !self->tunnel_checked) &&
+        ret == GST_FLOW_OK) {
+      self->tunnel_checked = TRUE;
+      if (setup_tunnel (self)) {
+        GST_INFO_OBJECT (self, "tunneled, stopping output loop");
+        gst_pad_pause_task (self->srcpad);
+      }
+    }
   }
 
 leave:
@@ -456,6 +960,12 @@ pad_chain (GstPad * pad, GstBuffer * buf)
   GST_LOG_OBJECT (self, "begin");
   GST_LOG_OBJECT (self, "gst_buffer: size=%u", GST_BUFFER_SIZE (buf));
 
+  if (self->drop_input && self->drop_input (self, buf)) {
+    GST_LOG_OBJECT (self, "dropped");
+    gst_buffer_unref (buf);
+    return GST_FLOW_OK;
+  }
+
   GST_LOG_OBJECT (self, "state: %d", gomx->omx_state);
 
   if (G_UNLIKELY (gomx->omx_state == OMX_StateLoaded)) {
@@ -477,8 +987,20 @@ pad_chain (GstPad * pad, GstBuffer * buf)
 
   in_port = self->in_port;
 
+  if (G_UNLIKELY (self->tunnel_resync && self->out_port->tunneled)) {
+    self->tunnel_resync = FALSE;
+    push_tunnel_marker (self, buf);
+  }
+
+  if (G_UNLIKELY (in_port->tunneled)) {
+    /* the data comes through the tunnel, this is only a marker */
+    gst_buffer_unref (buf);
+    return self->last_pad_push_return;
+  }
+
   if (G_LIKELY (in_port->enabled)) {
     guint buffer_offset = 0;
+    gboolean decode_only;
 
     if (G_UNLIKELY (gomx->omx_state == OMX_StateIdle)) {
       GST_INFO_OBJECT (self, "omx: play");
@@ -494,7 +1016,7 @@ pad_chain (GstPad * pad, GstBuffer * buf)
         omx_buffer = g_omx_port_request_buffer (in_port);
 
         if (G_LIKELY (omx_buffer)) {
-          omx_buffer->nFlags |= 0x00000080;     /* codec data flag */
+          omx_buffer->nFlags |= OMX_BUFFERFLAG_CODECCONFIG;
 
           omx_buffer->nFilledLen = GST_BUFFER_SIZE (self->codec_data);
           memcpy (omx_buffer->pBuffer + omx_buffer->nOffset,
@@ -510,6 +1032,8 @@ pad_chain (GstPad * pad, GstBuffer * buf)
       GST_ERROR_OBJECT (self, "Whoa! very wrong");
     }
 
+    decode_only = input_decode_only (self, buf);
+
     while (G_LIKELY (buffer_offset < GST_BUFFER_SIZE (buf))) {
       OMX_BUFFERHEADERTYPE *omx_buffer;
 
@@ -529,17 +1053,7 @@ pad_chain (GstPad * pad, GstBuffer * buf)
             omx_buffer->nOffset, omx_buffer->nTimeStamp);
 
         if (omx_buffer->nOffset == 0 && self->share_input_buffer) {
-          {
-            GstBuffer *old_buf;
-            old_buf = omx_buffer->pAppPrivate;
-
-            if (old_buf) {
-              gst_buffer_unref (old_buf);
-            } else if (omx_buffer->pBuffer) {
-              g_free (omx_buffer->pBuffer);
-            }
-          }
-
+          /* the port drops this reference on EmptyBufferDone */
           omx_buffer->pBuffer = GST_BUFFER_DATA (buf);
           omx_buffer->nAllocLen = GST_BUFFER_SIZE (buf);
           omx_buffer->nFilledLen = GST_BUFFER_SIZE (buf);
@@ -565,6 +1079,15 @@ pad_chain (GstPad * pad, GstBuffer * buf)
         /* set end of frame to work with PV OpenMAX in Android */
         omx_buffer->nFlags |= OMX_BUFFERFLAG_ENDOFFRAME;
 
+        omx_buffer->nFlags &= ~OMX_BUFFERFLAG_DECODEONLY;
+        if (G_UNLIKELY (decode_only)) {
+          omx_buffer->nFlags |= OMX_BUFFERFLAG_DECODEONLY;
+          GST_OBJECT_LOCK (self);
+          self->decode_only_until =
+              MAX (self->decode_only_until, omx_buffer->nTimeStamp);
+          GST_OBJECT_UNLOCK (self);
+        }
+
         GST_LOG_OBJECT (self, "release_buffer");
                 /** @todo untaint buffer */
         g_omx_port_release_buffer (in_port, omx_buffer);
@@ -624,6 +1147,16 @@ pad_event (GstPad * pad, GstEvent * event)
 
   switch (GST_EVENT_TYPE (event)) {
     case GST_EVENT_EOS:
+      /* the EOS flag travels through the tunnel; forward the event
+       * ourselves only if there is no output loop to do it */
+      if (self->initialized && in_port->tunneled) {
+        if (out_port->tunneled)
+          ret = gst_pad_push_event (self->srcpad, event);
+        else
+          gst_event_unref (event);
+        break;
+      }
+
       /* if we are init'ed, and there is a running loop; then
        * if we get a buffer to inform it of EOS, let it handle the rest
        * in any other case, we send EOS */
@@ -643,7 +1176,10 @@ pad_event (GstPad * pad, GstEvent * event)
             /* foo_buffer_untaint (omx_buffer); */
             g_omx_port_release_buffer (in_port, omx_buffer);
             /* loop handles EOS, eat it here */
-            gst_event_unref (event);
+            if (out_port->tunneled)
+              ret = gst_pad_push_event (self->srcpad, event);
+            else
+              gst_event_unref (event);
             break;
           }
         }
@@ -668,17 +1204,51 @@ pad_event (GstPad * pad, GstEvent * event)
       gst_pad_push_event (self->srcpad, event);
       self->last_pad_push_return = GST_FLOW_OK;
 
+      GST_OBJECT_LOCK (self);
+      gst_segment_init (&self->segment, GST_FORMAT_UNDEFINED);
+      self->decode_only_until = -1;
+      GST_OBJECT_UNLOCK (self);
+
+      /* the output task is paused */
+      clear_reverse (self);
+      gst_buffer_replace (&self->output_rest, NULL);
+      self->frame_ended = TRUE;
+
       g_omx_core_flush_stop (gomx, TRUE);
 
-      if (self->initialized)
-        gst_pad_start_task (self->srcpad, output_loop, self->srcpad);
+      if (self->initialized) {
+        if (out_port->tunneled)
+          self->tunnel_resync = TRUE;
+        else
+          gst_pad_start_task (self->srcpad, output_loop, self->srcpad);
+      }
 
       ret = TRUE;
       break;
 
     case GST_EVENT_NEWSEGMENT:
+    {
+      gboolean update;
+      gdouble rate;
+      gdouble applied_rate;
+      GstFormat format;
+      gint64 start;
+      gint64 stop;
+      gint64 position;
+
+      gst_event_parse_new_segment_full (event, &update, &rate, &applied_rate,
+          &format, &start, &stop, &position);
+
+      GST_OBJECT_LOCK (self);
+      gst_segment_set_newsegment_full (&self->segment, update, rate,
+          applied_rate, format, start, stop, position);
+      if (!update)
+        self->decode_only_until = -1;
+      GST_OBJECT_UNLOCK (self);
+
       ret = gst_pad_push_event (self->srcpad, event);
       break;
+    }
 
     default:
       ret = gst_pad_push_event (self->srcpad, event);
@@ -708,7 +1278,8 @@ activate_push (GstPad * pad, gboolean active)
                 /** @todo link callback function also needed */
         g_omx_core_flush_stop (self->gomx, FALSE);
 
-        result = gst_pad_start_task (pad, output_loop, pad);
+        if (!self->out_port->tunneled)
+          result = gst_pad_start_task (pad, output_loop, pad);
       }
     }
   } else {
@@ -748,6 +1319,14 @@ type_instance_init (GTypeInstance * instance, gpointer g_class)
   GST_LOG_OBJECT (self, "begin");
 
   self->use_timestamps = TRUE;
+  self->use_tunnel = TRUE;
+  self->settings_generation = -1;
+
+  gst_segment_init (&self->segment, GST_FORMAT_UNDEFINED);
+  self->decode_only_until = -1;
+  self->reverse_frames = g_queue_new ();
+  self->sync_flags = -1;
+  self->frame_ended = TRUE;
 
   /* GOmx */
   {
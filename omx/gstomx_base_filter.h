@@ -37,6 +37,14 @@ typedef void (*GstOmxBaseFilterCb) (GstOmxBaseFilter *self);
 #include "gstomx_util.h"
 #include <async_queue.h>
 
+typedef gboolean (*GstOmxBaseFilterCopyCb) (GstOmxBaseFilter *self, guint8 *dest,
+                                            OMX_BUFFERHEADERTYPE *omx_buffer);
+typedef gboolean (*GstOmxBaseFilterBufferCb) (GstOmxBaseFilter *self, GstBuffer *buf);
+typedef GstBuffer *(*GstOmxBaseFilterOutputCb) (GstOmxBaseFilter *self, GstBuffer *buf,
+                                               guint32 omx_flags);
+typedef GList *(*GstOmxBaseFilterSplitCb) (GstOmxBaseFilter *self, GstBuffer *buf,
+                                          GstBuffer **rest);
+
 struct GstOmxBaseFilter
 {
     GstElement element;
@@ -50,15 +58,44 @@ struct GstOmxBaseFilter
 
     char *omx_component;
     char *omx_library;
+    char *fallback_component;
+    char *fallback_library;
+    char *candidates;
     gboolean use_timestamps; /** @todo remove; timestamps should always be used */
     gboolean initialized;
 
     GstOmxBaseFilterCb omx_setup;
+    GstOmxBaseFilterCopyCb copy_output; /**< Repacks output downstream can't take as is. */
+    guint copy_output_size; /**< Bytes copy_output writes. */
+    GstOmxBaseFilterBufferCb drop_input; /**< TRUE skips the buffer before the component sees it. */
+    GstOmxBaseFilterOutputCb process_output; /**< Rewrites output, codec config included, before it leaves. */
+    GstOmxBaseFilterSplitCb split_output; /**< Cuts output into buffers pushed one by one; an unfinished last one goes in rest, which is NULL once the frame ended. */
+    gboolean partial_units; /**< Output may end mid-unit, so split_output is given a rest. */
+    GstBuffer *output_rest; /**< Held by split_output until the rest of it comes. */
+    gboolean mark_delta_units; /**< Output is compressed video. */
+    gint sync_flags; /**< Whether the component flags sync frames, -1 until its first frame. */
+    gboolean partial_frames; /**< Output may be part of a frame, up to OMX_BUFFERFLAG_ENDOFFRAME. */
+    gboolean frame_ended; /**< The last output buffer finished its frame. */
+    gboolean frame_sync; /**< The frame being output is a sync frame. */
+    GstClockTime frame_timestamp; /**< Slices of one frame share it. */
     GstFlowReturn last_pad_push_return;
     GstBuffer *codec_data;
 
     gboolean share_input_buffer;
     gboolean share_output_buffer; /** @todo this is hack, OpenMAX IL spec should be revised. */
+    GSList *fallback_buffers; /**< Output memory malloc'ed when downstream couldn't allocate. */
+
+    gboolean use_tunnel;
+    gboolean tunnel_checked;
+    gboolean tunnel_resync;
+    gint settings_generation; /**< Of the src pad caps, -1 before the first buffer. */
+
+    GstSegment segment; /**< Of the input. */
+    gboolean use_decode_only; /**< Input before the segment is sent DECODEONLY; video decoders. */
+    gint64 decode_only_until; /**< Latest OMX timestamp sent DECODEONLY, -1 if none. */
+
+    guint max_reverse_frames; /**< Held to play a GOP backwards, 0 to push as decoded. */
+    GQueue *reverse_frames; /**< Of the current GOP, ascending. */
 };
 
 struct GstOmxBaseFilterClass
@@ -23,16 +23,17 @@
 #include "gstomx.h"
 #include "gstomx_interface.h"
 
-#include <stdlib.h>             /* For calloc, free */
 #include <string.h>             /* For memcpy */
 
-static gboolean share_input_buffer = FALSE;
+#define DEFAULT_MAX_PENDING 4
 
 enum
 {
   ARG_0,
   ARG_COMPONENT_NAME,
   ARG_LIBRARY_NAME,
+  ARG_ZERO_COPY,
+  ARG_MAX_PENDING,
 };
 
 static GstElementClass *parent_class = NULL;
@@ -45,19 +46,145 @@ setup_ports (GstOmxBaseSink * self)
 
   core = self->gomx;
 
-  param = calloc (1, sizeof (OMX_PARAM_PORTDEFINITIONTYPE));
-  param->nSize = sizeof (OMX_PARAM_PORTDEFINITIONTYPE);
-  param->nVersion.s.nVersionMajor = 1;
-  param->nVersion.s.nVersionMinor = 1;
-
   /* Input port configuration. */
 
-  param->nPortIndex = 0;
-  OMX_GetParameter (core->omx_handle, OMX_IndexParamPortDefinition, param);
+  param = g_omx_port_get_definition (g_omx_core_port (core, 0));
   self->in_port = g_omx_core_setup_port (core, param);
   gst_pad_set_element_private (self->sinkpad, self->in_port);
+}
+
+static void
+clear_pending (GstOmxBaseSink * self)
+{
+  GstBuffer *buf;
+
+  while ((buf = g_queue_pop_head (self->pending)))
+    gst_buffer_unref (buf);
+
+  self->pending_offset = 0;
+
+  if (self->prerolled) {
+    gst_buffer_unref (self->prerolled);
+    self->prerolled = NULL;
+  }
+}
+
+/* Buffers ahead of the newest one, waiting here or in the component.
+ * Called with pending_mutex held. */
+static guint
+in_flight (GstOmxBaseSink * self)
+{
+  guint free_headers;
+
+  free_headers = MIN (async_queue_length (self->in_port->queue),
+      self->in_port->num_buffers);
+
+  return g_queue_get_length (self->pending) - 1 +
+      self->in_port->num_buffers - free_headers;
+}
+
+/* Hands the pending data to the component as soon as a header is free,
+ * so render only waits when too much is queued. */
+static void
+feed_loop (gpointer data)
+{
+  GstOmxBaseSink *self;
+  GOmxPort *in_port;
+  OMX_BUFFERHEADERTYPE *omx_buffer;
+  GstBuffer *buf;
+
+  self = GST_OMX_BASE_SINK (data);
+  in_port = self->in_port;
+
+  g_mutex_lock (self->pending_mutex);
+  while (self->feeding && (self->flushing || g_queue_is_empty (self->pending)))
+    g_cond_wait (self->pending_cond, self->pending_mutex);
+  g_mutex_unlock (self->pending_mutex);
+
+  if (G_UNLIKELY (!self->feeding))
+    return;
+
+  GST_LOG_OBJECT (self, "request_buffer");
+  omx_buffer = g_omx_port_request_buffer (in_port);
+
+  /* the port was paused; flushing or shutting down */
+  if (G_UNLIKELY (!omx_buffer))
+    return;
+
+  GST_DEBUG_OBJECT (self,
+      "omx_buffer: size=%lu, len=%lu, flags=%lu, offset=%lu, timestamp=%lld",
+      omx_buffer->nAllocLen, omx_buffer->nFilledLen, omx_buffer->nFlags,
+      omx_buffer->nOffset, omx_buffer->nTimeStamp);
+
+  g_mutex_lock (self->pending_mutex);
+
+  buf = g_queue_peek_head (self->pending);
+  if (G_UNLIKELY (self->flushing || !buf)) {
+    /* flushed while we waited for the header */
+    g_mutex_unlock (self->pending_mutex);
+    g_omx_port_push_buffer (in_port, omx_buffer);
+    return;
+  }
+
+  if (self->pending_offset == 0 && self->share_input_buffer) {
+    /* the port drops this reference on EmptyBufferDone */
+    g_queue_pop_head (self->pending);
+
+    omx_buffer->pBuffer = GST_BUFFER_DATA (buf);
+    omx_buffer->nAllocLen = GST_BUFFER_SIZE (buf);
+    omx_buffer->nFilledLen = GST_BUFFER_SIZE (buf);
+    omx_buffer->nOffset = 0;
+    omx_buffer->pAppPrivate = buf;
+  } else {
+    omx_buffer->nFilledLen =
+        MIN (GST_BUFFER_SIZE (buf) - self->pending_offset,
+        omx_buffer->nAllocLen - omx_buffer->nOffset);
+    memcpy (omx_buffer->pBuffer + omx_buffer->nOffset,
+        GST_BUFFER_DATA (buf) + self->pending_offset, omx_buffer->nFilledLen);
+
+    self->pending_offset += omx_buffer->nFilledLen;
+    if (self->pending_offset >= GST_BUFFER_SIZE (buf)) {
+      g_queue_pop_head (self->pending);
+      gst_buffer_unref (buf);
+      self->pending_offset = 0;
+    }
+  }
+
+  /* still locked, so EOS can't overtake it */
+  GST_LOG_OBJECT (self, "release_buffer");
+  g_omx_port_release_buffer (in_port, omx_buffer);
+
+  g_cond_broadcast (self->pending_cond);
+  g_mutex_unlock (self->pending_mutex);
+}
+
+static void
+start_feeding (GstOmxBaseSink * self)
+{
+  self->feeding = TRUE;
+  self->feed_task = gst_task_create (feed_loop, self);
+  gst_task_set_lock (self->feed_task, &self->feed_lock);
+  gst_task_start (self->feed_task);
+}
+
+static void
+stop_feeding (GstOmxBaseSink * self)
+{
+  if (!self->feed_task)
+    return;
+
+  g_mutex_lock (self->pending_mutex);
+  self->feeding = FALSE;
+  g_cond_broadcast (self->pending_cond);
+  g_mutex_unlock (self->pending_mutex);
+
+  /* wake it up if it waits for a header */
+  g_omx_port_pause (self->in_port);
 
-  free (param);
+  gst_task_stop (self->feed_task);
+  gst_task_join (self->feed_task);
+  gst_object_unref (self->feed_task);
+  self->feed_task = NULL;
 }
 
 static gboolean
@@ -73,6 +200,9 @@ start (GstBaseSink * gst_base)
   if (self->gomx->omx_error)
     return GST_STATE_CHANGE_FAILURE;
 
+  g_omx_core_reset_done (self->gomx);
+  self->flushing = FALSE;
+
   GST_LOG_OBJECT (self, "end");
 
   return TRUE;
@@ -87,8 +217,13 @@ stop (GstBaseSink * gst_base)
 
   GST_LOG_OBJECT (self, "begin");
 
+  stop_feeding (self);
+
   g_omx_core_finish (self->gomx);
 
+  clear_pending (self);
+  self->reported_in_flight = 0;
+
   g_omx_core_deinit (self->gomx);
   if (self->gomx->omx_error)
     return GST_STATE_CHANGE_FAILURE;
@@ -110,22 +245,48 @@ dispose (GObject * obj)
   g_free (self->omx_component);
   g_free (self->omx_library);
 
+  g_queue_free (self->pending);
+  g_mutex_free (self->pending_mutex);
+  g_cond_free (self->pending_cond);
+  g_static_rec_mutex_free (&self->feed_lock);
+
   G_OBJECT_CLASS (parent_class)->dispose (obj);
 }
 
+/* A new buffer waits behind what is queued here and in the component,
+ * tell the base class so it renders early enough. Only grows, it is the
+ * worst case that matters. */
+static void
+report_latency (GstOmxBaseSink * self, GstBuffer * buf, guint ahead)
+{
+  GstClockTime delay;
+
+  if (!GST_BUFFER_DURATION_IS_VALID (buf) || ahead <= self->reported_in_flight)
+    return;
+
+  self->reported_in_flight = ahead;
+  delay = GST_BUFFER_DURATION (buf) * ahead;
+
+  GST_INFO_OBJECT (self, "render delay: %" GST_TIME_FORMAT " (%u buffers)",
+      GST_TIME_ARGS (delay), ahead);
+
+  gst_base_sink_set_render_delay (GST_BASE_SINK (self), delay);
+
+  gst_element_post_message (GST_ELEMENT (self),
+      gst_message_new_latency (GST_OBJECT (self)));
+}
+
+/* Queues a buffer for the feed task. */
 static GstFlowReturn
-render (GstBaseSink * gst_base, GstBuffer * buf)
+submit (GstOmxBaseSink * self, GstBuffer * buf)
 {
   GOmxCore *gomx;
   GOmxPort *in_port;
-  GstOmxBaseSink *self;
   GstFlowReturn ret = GST_FLOW_OK;
-
-  self = GST_OMX_BASE_SINK (gst_base);
+  guint ahead;
 
   gomx = self->gomx;
 
-  GST_LOG_OBJECT (self, "begin");
   GST_LOG_OBJECT (self, "gst_buffer: size=%lu", GST_BUFFER_SIZE (buf));
 
   GST_LOG_OBJECT (self, "state: %d", gomx->omx_state);
@@ -141,75 +302,149 @@ render (GstBaseSink * gst_base, GstBuffer * buf)
 
   in_port = self->in_port;
 
-  if (G_LIKELY (in_port->enabled)) {
-    guint buffer_offset = 0;
+  if (G_UNLIKELY (in_port->tunneled)) {
+    /* the data comes through the tunnel, this is only a marker */
+    GST_LOG_OBJECT (self, "tunneled");
+    return GST_FLOW_OK;
+  }
 
-    if (G_UNLIKELY (gomx->omx_state == OMX_StateIdle)) {
-      GST_INFO_OBJECT (self, "omx: play");
-      g_omx_core_start (gomx);
-    }
+  if (G_UNLIKELY (!in_port->enabled)) {
+    GST_WARNING_OBJECT (self, "done");
+    return GST_FLOW_UNEXPECTED;
+  }
 
-    if (G_UNLIKELY (gomx->omx_state != OMX_StateExecuting)) {
-      GST_ERROR_OBJECT (self, "Whoa! very wrong");
-    }
+  if (G_UNLIKELY (gomx->omx_state == OMX_StateIdle)) {
+    GST_INFO_OBJECT (self, "omx: play");
+    g_omx_core_start (gomx);
+  }
 
-    while (G_LIKELY (buffer_offset < GST_BUFFER_SIZE (buf))) {
-      OMX_BUFFERHEADERTYPE *omx_buffer;
-
-      GST_LOG_OBJECT (self, "request_buffer");
-      omx_buffer = g_omx_port_request_buffer (in_port);
-
-      if (G_LIKELY (omx_buffer)) {
-        GST_DEBUG_OBJECT (self,
-            "omx_buffer: size=%lu, len=%lu, flags=%lu, offset=%lu, timestamp=%lld",
-            omx_buffer->nAllocLen, omx_buffer->nFilledLen, omx_buffer->nFlags,
-            omx_buffer->nOffset, omx_buffer->nTimeStamp);
-
-        if (omx_buffer->nOffset == 0 && share_input_buffer) {
-          {
-            GstBuffer *old_buf;
-            old_buf = omx_buffer->pAppPrivate;
-
-            if (old_buf) {
-              gst_buffer_unref (old_buf);
-            } else if (omx_buffer->pBuffer) {
-              g_free (omx_buffer->pBuffer);
-            }
-          }
-
-          /* We are going to use this. */
-          gst_buffer_ref (buf);
-
-          omx_buffer->pBuffer = GST_BUFFER_DATA (buf);
-          omx_buffer->nAllocLen = GST_BUFFER_SIZE (buf);
-          omx_buffer->nFilledLen = GST_BUFFER_SIZE (buf);
-          omx_buffer->pAppPrivate = buf;
-        } else {
-          omx_buffer->nFilledLen = MIN (GST_BUFFER_SIZE (buf) - buffer_offset,
-              omx_buffer->nAllocLen - omx_buffer->nOffset);
-          memcpy (omx_buffer->pBuffer + omx_buffer->nOffset,
-              GST_BUFFER_DATA (buf) + buffer_offset, omx_buffer->nFilledLen);
-        }
-
-        GST_LOG_OBJECT (self, "release_buffer");
-        g_omx_port_release_buffer (in_port, omx_buffer);
-
-        buffer_offset += omx_buffer->nFilledLen;
-      } else {
-        GST_WARNING_OBJECT (self, "null buffer");
-        /* ret = GST_FLOW_ERROR; */
-      }
-    }
-  } else {
-    GST_WARNING_OBJECT (self, "done");
-    ret = GST_FLOW_UNEXPECTED;
+  if (G_UNLIKELY (gomx->omx_state != OMX_StateExecuting)) {
+    GST_ERROR_OBJECT (self, "Whoa! very wrong");
   }
 
+  if (G_UNLIKELY (!self->feed_task))
+    start_feeding (self);
+
+  g_mutex_lock (self->pending_mutex);
+
+  if (G_UNLIKELY (self->flushing)) {
+    g_mutex_unlock (self->pending_mutex);
+    return GST_FLOW_WRONG_STATE;
+  }
+
+  g_queue_push_tail (self->pending, gst_buffer_ref (buf));
+  ahead = in_flight (self);
+  g_cond_broadcast (self->pending_cond);
+
+  while (!self->flushing &&
+      g_queue_get_length (self->pending) > self->max_pending)
+    g_cond_wait (self->pending_cond, self->pending_mutex);
+
+  if (G_UNLIKELY (self->flushing))
+    ret = GST_FLOW_WRONG_STATE;
+
+  g_mutex_unlock (self->pending_mutex);
+
+  report_latency (self, buf, ahead);
+
+  return ret;
+}
+
+/* Shows the first frame while paused; render skips it later. */
+static GstFlowReturn
+preroll (GstBaseSink * gst_base, GstBuffer * buf)
+{
+  GstOmxBaseSink *self;
+  GstFlowReturn ret;
+
+  self = GST_OMX_BASE_SINK (gst_base);
+
+  GST_LOG_OBJECT (self, "begin");
+
+  ret = submit (self, buf);
+  if (ret == GST_FLOW_OK && !self->in_port->tunneled)
+    gst_buffer_replace (&self->prerolled, buf);
+
   GST_LOG_OBJECT (self, "end");
 
   return ret;
 }
 
+static GstFlowReturn
+render (GstBaseSink * gst_base, GstBuffer * buf)
+{
+  GstOmxBaseSink *self;
+  GstFlowReturn ret;
+
+  self = GST_OMX_BASE_SINK (gst_base);
+
+  GST_LOG_OBJECT (self, "begin");
+
+  if (buf == self->prerolled) {
+    GST_LOG_OBJECT (self, "submitted on preroll");
+    gst_buffer_unref (self->prerolled);
+    self->prerolled = NULL;
+    return GST_FLOW_OK;
+  }
+
+  ret = submit (self, buf);
+
+  GST_LOG_OBJECT (self, "end");
+
+  return ret;
+}
+
+/* Wakes render and the feed task; pending data is dropped. */
+static void
+set_flushing (GstOmxBaseSink * self)
+{
+  g_mutex_lock (self->pending_mutex);
+  self->flushing = TRUE;
+  clear_pending (self);
+  g_cond_broadcast (self->pending_cond);
+  g_mutex_unlock (self->pending_mutex);
+}
+
+static gboolean
+unlock (GstBaseSink * gst_base)
+{
+  GstOmxBaseSink *self;
+
+  self = GST_OMX_BASE_SINK (gst_base);
+
+  GST_LOG_OBJECT (self, "unlock");
+
+  set_flushing (self);
+
+  if (self->initialized)
+    g_omx_port_pause (self->in_port);
+
+  /* flushing or shutting down, the EOS won't come */
+  GST_OBJECT_LOCK (self);
+  if (self->waiting_eos) {
+    self->waiting_eos = FALSE;
+    g_omx_core_set_done (self->gomx);
+  }
+  GST_OBJECT_UNLOCK (self);
+
+  return TRUE;
+}
+
+static gboolean
+unlock_stop (GstBaseSink * gst_base)
+{
+  GstOmxBaseSink *self;
+
+  self = GST_OMX_BASE_SINK (gst_base);
+
+  GST_LOG_OBJECT (self, "unlock_stop");
+
+  if (self->initialized)
+    g_omx_port_resume (self->in_port);
+
+  return TRUE;
+}
+
 static gboolean
 handle_event (GstBaseSink * gst_base, GstEvent * event)
 {
@@ -227,11 +462,35 @@ handle_event (GstBaseSink * gst_base, GstEvent * event)
 
   switch (GST_EVENT_TYPE (event)) {
     case GST_EVENT_EOS:
+      if (self->initialized && in_port->tunneled) {
+        /* the data came through the tunnel and may still be queued in the
+         * component; the EOS is out once it flags the end */
+        GST_OBJECT_LOCK (self);
+        self->waiting_eos = TRUE;
+        GST_OBJECT_UNLOCK (self);
+
+        GST_DEBUG_OBJECT (self, "waiting for the component's EOS");
+        g_omx_core_wait_for_done (gomx);
+
+        GST_OBJECT_LOCK (self);
+        self->waiting_eos = FALSE;
+        GST_OBJECT_UNLOCK (self);
+        break;
+      }
+
+      /* everything must reach the component first */
+      g_mutex_lock (self->pending_mutex);
+      while (!self->flushing && !g_queue_is_empty (self->pending))
+        g_cond_wait (self->pending_cond, self->pending_mutex);
+      g_mutex_unlock (self->pending_mutex);
+
       /* Close the inpurt port. */
       g_omx_core_set_done (gomx);
       break;
 
     case GST_EVENT_FLUSH_START:
+      set_flushing (self);
+
       /* unlock loops */
       g_omx_port_pause (in_port);
 
@@ -242,7 +501,16 @@ handle_event (GstBaseSink * gst_base, GstEvent * event)
     case GST_EVENT_FLUSH_STOP:
       g_omx_sem_down (gomx->flush_sem);
 
+      /* an EOS from before the flush doesn't end the new data */
+      g_omx_core_reset_done (gomx);
+
       g_omx_port_resume (in_port);
+
+      g_mutex_lock (self->pending_mutex);
+      clear_pending (self);
+      self->flushing = FALSE;
+      g_cond_broadcast (self->pending_cond);
+      g_mutex_unlock (self->pending_mutex);
       break;
 
     default:
@@ -271,6 +539,12 @@ set_property (GObject * obj,
       g_free (self->omx_library);
       self->omx_library = g_value_dup_string (value);
       break;
+    case ARG_ZERO_COPY:
+      self->share_input_buffer = g_value_get_boolean (value);
+      break;
+    case ARG_MAX_PENDING:
+      self->max_pending = g_value_get_uint (value);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (obj, prop_id, pspec);
       break;
@@ -291,6 +565,12 @@ get_property (GObject * obj, guint prop_id, GValue * value, GParamSpec * pspec)
     case ARG_LIBRARY_NAME:
       g_value_set_string (value, self->omx_library);
       break;
+    case ARG_ZERO_COPY:
+      g_value_set_boolean (value, self->share_input_buffer);
+      break;
+    case ARG_MAX_PENDING:
+      g_value_set_uint (value, self->max_pending);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (obj, prop_id, pspec);
       break;
@@ -315,8 +595,10 @@ type_class_init (gpointer g_class, gpointer class_data)
   gst_base_sink_class->start = start;
   gst_base_sink_class->stop = stop;
   gst_base_sink_class->event = handle_event;
-  gst_base_sink_class->preroll = render;
+  gst_base_sink_class->preroll = preroll;
   gst_base_sink_class->render = render;
+  gst_base_sink_class->unlock = unlock;
+  gst_base_sink_class->unlock_stop = unlock_stop;
 
   /* Properties stuff */
   {
@@ -332,6 +614,16 @@ type_class_init (gpointer g_class, gpointer class_data)
         g_param_spec_string ("library-name", "Library name",
             "Name of the OpenMAX IL implementation library to use",
             NULL, G_PARAM_READWRITE));
+
+    g_object_class_install_property (gobject_class, ARG_ZERO_COPY,
+        g_param_spec_boolean ("zero-copy", "Zero copy",
+            "Hand the incoming buffers to the component without copying",
+            FALSE, G_PARAM_READWRITE));
+
+    g_object_class_install_property (gobject_class, ARG_MAX_PENDING,
+        g_param_spec_uint ("max-pending", "Maximum pending buffers",
+            "Buffers to hold while the component has no free input buffers",
+            0, G_MAXUINT, DEFAULT_MAX_PENDING, G_PARAM_READWRITE));
   }
 }
 
@@ -394,6 +686,12 @@ type_instance_init (GTypeInstance * instance, gpointer g_class)
 
   self->omx_library = g_strdup (DEFAULT_LIBRARY_NAME);
 
+  self->pending = g_queue_new ();
+  self->pending_mutex = g_mutex_new ();
+  self->pending_cond = g_cond_new ();
+  self->max_pending = DEFAULT_MAX_PENDING;
+  g_static_rec_mutex_init (&self->feed_lock);
+
   {
     GstPad *sinkpad;
     self->sinkpad = sinkpad = GST_BASE_SINK_PAD (self);
@@ -50,6 +50,21 @@ struct GstOmxBaseSink
     char *omx_library;
 
     gboolean initialized;
+    gboolean share_input_buffer;
+
+    GQueue *pending; /**< Buffers waiting for a free input header. */
+    guint pending_offset;
+    guint max_pending;
+    GMutex *pending_mutex;
+    GCond *pending_cond;
+    gboolean flushing;
+    GstBuffer *prerolled; /**< Submitted by preroll, not to be rendered again. */
+    guint reported_in_flight; /**< Buffers ahead behind the last render delay. */
+
+    GstTask *feed_task; /**< Hands pending buffers to the component. */
+    GStaticRecMutex feed_lock;
+    gboolean feeding;
+    gboolean waiting_eos; /**< Tunneled, waiting for the component to render the end. */
 };
 
 struct GstOmxBaseSinkClass
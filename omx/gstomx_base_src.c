@@ -22,18 +22,132 @@
 #include "gstomx_base_src.h"
 #include "gstomx.h"
 
-#include <stdlib.h>             /* For calloc, free */
-#include <string.h>             /* For memcpy */
 #include <stdbool.h>
 
 enum
 {
   ARG_0,
   ARG_COMPONENT_NAME,
-  ARG_LIBRARY_NAME
+  ARG_LIBRARY_NAME,
+  ARG_IS_LIVE
 };
 
 static GstElementClass *parent_class = NULL;
+static GstBaseSrcClass *base_src_parent_class = NULL;
+
+/*
+ * Output buffers are handed downstream without copying; the header goes
+ * back to the component when the last reference is dropped. Those still
+ * out when the element stops get a copy of their data instead.
+ */
+
+#define RECYCLE_TIMEOUT 100
+
+typedef struct
+{
+  GstBuffer buffer;
+
+  GstOmxBaseSrc *src;
+  OMX_BUFFERHEADERTYPE *omx_buffer; /**< NULL once detached. */
+} GstOmxSrcBuffer;
+
+static GstMiniObjectClass *src_buffer_parent_class = NULL;
+
+static void
+src_buffer_finalize (GstOmxSrcBuffer * buffer)
+{
+  GstOmxBaseSrc *self;
+
+  self = buffer->src;
+
+  g_mutex_lock (self->recycle_mutex);
+  if (G_LIKELY (buffer->omx_buffer)) {
+    if (G_LIKELY (self->running)) {
+      buffer->omx_buffer->nFilledLen = 0;
+      buffer->omx_buffer->nFlags = 0;
+      g_omx_port_release_buffer (self->out_port, buffer->omx_buffer);
+    }
+    self->outstanding = g_list_remove (self->outstanding, buffer);
+    if (!self->outstanding)
+      g_cond_broadcast (self->recycle_cond);
+  }
+  g_mutex_unlock (self->recycle_mutex);
+
+  gst_object_unref (self);
+
+  src_buffer_parent_class->finalize (GST_MINI_OBJECT_CAST (buffer));
+}
+
+static void
+src_buffer_class_init (gpointer g_class, gpointer class_data)
+{
+  GstMiniObjectClass *mini_object_class;
+
+  mini_object_class = GST_MINI_OBJECT_CLASS (g_class);
+
+  src_buffer_parent_class = g_type_class_peek_parent (g_class);
+
+  mini_object_class->finalize =
+      (GstMiniObjectFinalizeFunction) src_buffer_finalize;
+}
+
+static GType
+src_buffer_get_type (void)
+{
+  static GType type = 0;
+
+  if (G_UNLIKELY (type == 0)) {
+    GTypeInfo *type_info;
+
+    type_info = g_new0 (GTypeInfo, 1);
+    type_info->class_size = sizeof (GstBufferClass);
+    type_info->class_init = src_buffer_class_init;
+    type_info->instance_size = sizeof (GstOmxSrcBuffer);
+
+    type =
+        g_type_register_static (GST_TYPE_BUFFER, "GstOmxSrcBuffer", type_info,
+        0);
+
+    g_free (type_info);
+  }
+
+  return type;
+}
+
+static GstBuffer *
+src_buffer_new (GstOmxBaseSrc * self, OMX_BUFFERHEADERTYPE * omx_buffer)
+{
+  GstOmxSrcBuffer *buffer;
+  GstBuffer *buf;
+
+  buffer = (GstOmxSrcBuffer *) gst_mini_object_new (src_buffer_get_type ());
+  buffer->src = gst_object_ref (self);
+  buffer->omx_buffer = omx_buffer;
+
+  buf = GST_BUFFER_CAST (buffer);
+  GST_BUFFER_DATA (buf) = omx_buffer->pBuffer + omx_buffer->nOffset;
+  GST_BUFFER_SIZE (buf) = omx_buffer->nFilledLen;
+
+  g_mutex_lock (self->recycle_mutex);
+  self->outstanding = g_list_prepend (self->outstanding, buffer);
+  g_mutex_unlock (self->recycle_mutex);
+
+  return buf;
+}
+
+/* Gives a buffer downstream still holds memory of its own. Called with
+ * recycle_mutex. */
+static void
+src_buffer_detach (GstOmxSrcBuffer * buffer)
+{
+  GstBuffer *buf;
+
+  buf = GST_BUFFER_CAST (buffer);
+  GST_BUFFER_MALLOCDATA (buf) = g_memdup (GST_BUFFER_DATA (buf),
+      GST_BUFFER_SIZE (buf));
+  GST_BUFFER_DATA (buf) = GST_BUFFER_MALLOCDATA (buf);
+  buffer->omx_buffer = NULL;
+}
 
 static void
 setup_ports (GstOmxBaseSrc * self)
@@ -43,19 +157,11 @@ setup_ports (GstOmxBaseSrc * self)
 
   core = self->gomx;
 
-  param = calloc (1, sizeof (OMX_PARAM_PORTDEFINITIONTYPE));
-  param->nSize = sizeof (OMX_PARAM_PORTDEFINITIONTYPE);
-  param->nVersion.s.nVersionMajor = 1;
-  param->nVersion.s.nVersionMinor = 1;
-
   /* Input port configuration. */
 
-  param->nPortIndex = 0;
-  OMX_GetParameter (core->omx_handle, OMX_IndexParamPortDefinition, param);
+  param = g_omx_port_get_definition (g_omx_core_port (core, 0));
   self->out_port = g_omx_core_setup_port (core, param);
 
-  free (param);
-
   if (self->setup_ports) {
     self->setup_ports (self);
   }
@@ -74,6 +180,15 @@ start (GstBaseSrc * gst_base)
   if (self->gomx->omx_error)
     return GST_STATE_CHANGE_FAILURE;
 
+  self->eos = FALSE;
+  self->settings_generation = -1;
+  self->last_timestamp = 0;
+  self->buffer_duration = GST_CLOCK_TIME_NONE;
+
+  g_mutex_lock (self->recycle_mutex);
+  self->running = TRUE;
+  g_mutex_unlock (self->recycle_mutex);
+
   GST_LOG_OBJECT (self, "end");
 
   return true;
@@ -88,7 +203,34 @@ stop (GstBaseSrc * gst_base)
 
   GST_LOG_OBJECT (self, "begin");
 
+  g_mutex_lock (self->recycle_mutex);
+  self->running = FALSE;
+  /* the buffers point into port memory that finish() frees; a sink's last
+   * buffer or a queue may keep them for good, so only wait a little */
+  if (self->outstanding) {
+    GTimeVal deadline;
+
+    GST_INFO_OBJECT (self, "waiting for %u buffers",
+        g_list_length (self->outstanding));
+    g_get_current_time (&deadline);
+    g_time_val_add (&deadline, RECYCLE_TIMEOUT * 1000);
+    while (self->outstanding) {
+      if (!g_cond_timed_wait (self->recycle_cond, self->recycle_mutex,
+              &deadline))
+        break;
+    }
+  }
+  if (self->outstanding) {
+    GST_INFO_OBJECT (self, "copying %u buffers still out",
+        g_list_length (self->outstanding));
+    g_list_foreach (self->outstanding, (GFunc) src_buffer_detach, NULL);
+    g_list_free (self->outstanding);
+    self->outstanding = NULL;
+  }
+  g_mutex_unlock (self->recycle_mutex);
+
   g_omx_core_finish (self->gomx);
+  self->out_port = NULL;
 
   g_omx_core_deinit (self->gomx);
   if (self->gomx->omx_error)
@@ -111,9 +253,39 @@ dispose (GObject * obj)
   g_free (self->omx_component);
   g_free (self->omx_library);
 
+  g_mutex_free (self->recycle_mutex);
+  g_cond_free (self->recycle_cond);
+
   G_OBJECT_CLASS (parent_class)->dispose (obj);
 }
 
+/* Live sources are only as late as the component's buffering. */
+static void
+update_duration (GstOmxBaseSrc * self, OMX_BUFFERHEADERTYPE * omx_buffer)
+{
+  if (omx_buffer->nTimeStamp > self->last_timestamp &&
+      self->last_timestamp > 0) {
+    GstClockTime duration;
+
+    duration = gst_util_uint64_scale_int (omx_buffer->nTimeStamp -
+        self->last_timestamp, GST_SECOND, OMX_TICKS_PER_SECOND);
+
+    if (G_UNLIKELY (duration != self->buffer_duration)) {
+      gboolean first;
+
+      first = !GST_CLOCK_TIME_IS_VALID (self->buffer_duration);
+      self->buffer_duration = duration;
+
+      if (first && self->is_live) {
+        gst_element_post_message (GST_ELEMENT (self),
+            gst_message_new_latency (GST_OBJECT (self)));
+      }
+    }
+  }
+
+  self->last_timestamp = omx_buffer->nTimeStamp;
+}
+
 static GstFlowReturn
 create (GstBaseSrc * gst_base,
     guint64 offset, guint length, GstBuffer ** ret_buf)
@@ -121,7 +293,7 @@ create (GstBaseSrc * gst_base,
   GOmxCore *gomx;
   GOmxPort *out_port;
   GstOmxBaseSrc *self;
-  GstFlowReturn ret = GST_FLOW_OK;
+  OMX_BUFFERHEADERTYPE *omx_buffer;
 
   self = GST_OMX_BASE_SRC (gst_base);
 
@@ -129,168 +301,152 @@ create (GstBaseSrc * gst_base,
 
   GST_LOG_OBJECT (self, "begin");
 
-  GST_LOG_OBJECT (self, "state: %d", gomx->omx_state);
+  if (G_UNLIKELY (gomx->omx_state != OMX_StateExecuting)) {
+    GST_LOG_OBJECT (self, "state: %d", gomx->omx_state);
 
-  if (gomx->omx_state == OMX_StateLoaded) {
-    GST_INFO_OBJECT (self, "omx: prepare");
+    if (gomx->omx_state == OMX_StateLoaded) {
+      GST_INFO_OBJECT (self, "omx: prepare");
 
-    setup_ports (self);
-    g_omx_core_prepare (self->gomx);
+      setup_ports (self);
+      g_omx_core_prepare (self->gomx);
+    }
+
+    if (gomx->omx_state == OMX_StateIdle) {
+      GST_INFO_OBJECT (self, "omx: play");
+      g_omx_core_start (gomx);
+    }
+
+    if (gomx->omx_state != OMX_StateExecuting) {
+      GST_ERROR_OBJECT (self, "Whoa! very wrong");
+      return GST_FLOW_ERROR;
+    }
   }
 
   out_port = self->out_port;
 
-  while (out_port->enabled) {
-    switch (gomx->omx_state) {
-      case OMX_StateIdle:
-      {
-        GST_INFO_OBJECT (self, "omx: play");
-        g_omx_core_start (gomx);
-      }
-        break;
-      default:
-        break;
+  if (G_UNLIKELY (self->eos || !out_port->enabled)) {
+    GST_WARNING_OBJECT (self, "done");
+    return GST_FLOW_UNEXPECTED;
+  }
+
+  do {
+    GST_LOG_OBJECT (self, "request_buffer");
+    omx_buffer = g_omx_port_request_buffer (out_port);
+
+    if (G_UNLIKELY (!omx_buffer)) {
+      /* unlocked; flushing or shutting down */
+      GST_DEBUG_OBJECT (self, "null buffer");
+      return GST_FLOW_WRONG_STATE;
     }
 
-    switch (gomx->omx_state) {
-      case OMX_StateExecuting:
-        /* OK */
-        break;
-      default:
-        GST_ERROR_OBJECT (self, "Whoa! very wrong");
-        break;
+    GST_DEBUG_OBJECT (self, "omx_buffer: size=%lu, len=%lu, offset=%lu",
+        omx_buffer->nAllocLen, omx_buffer->nFilledLen, omx_buffer->nOffset);
+
+    if (G_UNLIKELY (omx_buffer->nFlags & OMX_BUFFERFLAG_EOS)) {
+      GST_INFO_OBJECT (self, "got eos");
+      g_omx_core_set_done (gomx);
+      self->eos = TRUE;
+
+      if (omx_buffer->nFilledLen == 0) {
+        g_omx_port_release_buffer (out_port, omx_buffer);
+        return GST_FLOW_UNEXPECTED;
+      }
+    } else if (G_UNLIKELY (omx_buffer->nFilledLen == 0)) {
+      GST_WARNING_OBJECT (self, "empty buffer");
+      g_omx_port_release_buffer (out_port, omx_buffer);
+      omx_buffer = NULL;
     }
+  } while (!omx_buffer);
 
-    {
-      OMX_BUFFERHEADERTYPE *omx_buffer;
-
-      GST_LOG_OBJECT (self, "request_buffer");
-      omx_buffer = g_omx_port_request_buffer (out_port);
-
-      if (omx_buffer) {
-        GST_DEBUG_OBJECT (self, "omx_buffer: size=%lu, len=%lu, offset=%lu",
-            omx_buffer->nAllocLen, omx_buffer->nFilledLen, omx_buffer->nOffset);
-
-        if (omx_buffer->nFlags & OMX_BUFFERFLAG_EOS) {
-          GST_INFO_OBJECT (self, "got eos");
-          g_omx_core_set_done (gomx);
-          break;
-        }
-
-        if (omx_buffer->nFilledLen > 0) {
-          GstBuffer *buf;
-
-          if (out_port->enabled) {
-            GstCaps *caps = NULL;
-
-            caps = gst_pad_get_negotiated_caps (gst_base->srcpad);
-
-            if (!caps) {
-                            /** @todo We shouldn't be doing this. */
-              GST_WARNING_OBJECT (self, "somebody didn't do his work");
-              gomx->settings_changed_cb (gomx);
-            } else {
-              GST_LOG_OBJECT (self, "caps already fixed");
-              gst_caps_unref (caps);
-            }
-          }
-
-          buf = omx_buffer->pAppPrivate;
-
-          if (buf && !(omx_buffer->nFlags & OMX_BUFFERFLAG_EOS)) {
-            GST_BUFFER_SIZE (buf) = omx_buffer->nFilledLen;
-#if 0
-            if (self->use_timestamps) {
-              GST_BUFFER_TIMESTAMP (buf) =
-                  omx_buffer->nTimeStamp * (GST_SECOND / OMX_TICKS_PER_SECOND);
-            }
-#endif
-
-            omx_buffer->pAppPrivate = NULL;
-            omx_buffer->pBuffer = NULL;
-            omx_buffer->nFilledLen = 0;
-
-            *ret_buf = buf;
-
-            gst_buffer_unref (buf);
-          } else {
-            /* This is only meant for the first OpenMAX buffers,
-             * which need to be pre-allocated. */
-            /* Also for the very last one. */
-            gst_pad_alloc_buffer_and_set_caps (gst_base->srcpad,
-                GST_BUFFER_OFFSET_NONE,
-                omx_buffer->nFilledLen, GST_PAD_CAPS (gst_base->srcpad), &buf);
-
-            if (buf) {
-              GST_WARNING_OBJECT (self, "couldn't zero-copy");
-              memcpy (GST_BUFFER_DATA (buf),
-                  omx_buffer->pBuffer + omx_buffer->nOffset,
-                  omx_buffer->nFilledLen);
-#if 0
-              if (self->use_timestamps) {
-                GST_BUFFER_TIMESTAMP (buf) =
-                    omx_buffer->nTimeStamp * (GST_SECOND /
-                    OMX_TICKS_PER_SECOND);
-              }
-#endif
-
-              omx_buffer->nFilledLen = 0;
-              g_free (omx_buffer->pBuffer);
-              omx_buffer->pBuffer = NULL;
-
-              *ret_buf = buf;
-            } else {
-              GST_ERROR_OBJECT (self, "whoa!");
-            }
-          }
-
-          if (!omx_buffer->pBuffer) {
-            GstBuffer *new_buf;
-            GstFlowReturn result;
-
-            GST_LOG_OBJECT (self, "allocate buffer");
-            result = gst_pad_alloc_buffer_and_set_caps (gst_base->srcpad,
-                GST_BUFFER_OFFSET_NONE,
-                omx_buffer->nAllocLen,
-                GST_PAD_CAPS (gst_base->srcpad), &new_buf);
-
-            if (result == GST_FLOW_OK) {
-              gst_buffer_ref (new_buf);
-              omx_buffer->pAppPrivate = new_buf;
-
-              omx_buffer->pBuffer = GST_BUFFER_DATA (new_buf);
-              omx_buffer->nAllocLen = GST_BUFFER_SIZE (new_buf);
-            } else {
-              GST_WARNING_OBJECT (self, "could not allocate buffer");
-              omx_buffer->pBuffer = g_malloc (omx_buffer->nAllocLen);
-            }
-          }
-
-          GST_LOG_OBJECT (self, "release_buffer");
-          g_omx_port_release_buffer (out_port, omx_buffer);
-          break;
-        } else {
-          GST_WARNING_OBJECT (self, "empty buffer");
-          GST_LOG_OBJECT (self, "release_buffer");
-          g_omx_port_release_buffer (out_port, omx_buffer);
-          continue;
-        }
-      } else {
-        GST_WARNING_OBJECT (self, "null buffer");
-        /* ret = GST_FLOW_ERROR; */
-        break;
+  {
+    gint generation;
+
+    generation = g_atomic_int_get (&gomx->settings_generation);
+
+    if (G_UNLIKELY (generation != self->settings_generation)) {
+      /* before any settings change only missing caps matter */
+      if (generation > 0 || !GST_PAD_CAPS (gst_base->srcpad)) {
+        GST_INFO_OBJECT (self, "settings changed, generation %d", generation);
+        if (gomx->settings_changed_cb)
+          gomx->settings_changed_cb (gomx);
       }
+      self->settings_generation = generation;
     }
   }
 
-  if (!out_port->enabled) {
-    GST_WARNING_OBJECT (self, "done");
-    ret = GST_FLOW_UNEXPECTED;
-  }
+  update_duration (self, omx_buffer);
+
+  *ret_buf = src_buffer_new (self, omx_buffer);
+  gst_buffer_set_caps (*ret_buf, GST_PAD_CAPS (gst_base->srcpad));
 
   GST_LOG_OBJECT (self, "end");
 
-  return ret;
+  return GST_FLOW_OK;
+}
+
+static gboolean
+unlock (GstBaseSrc * gst_base)
+{
+  GstOmxBaseSrc *self;
+
+  self = GST_OMX_BASE_SRC (gst_base);
+
+  if (self->out_port)
+    g_omx_port_pause (self->out_port);
+
+  return true;
+}
+
+static gboolean
+unlock_stop (GstBaseSrc * gst_base)
+{
+  GstOmxBaseSrc *self;
+
+  self = GST_OMX_BASE_SRC (gst_base);
+
+  if (self->out_port)
+    g_omx_port_resume (self->out_port);
+
+  return true;
+}
+
+static gboolean
+query (GstBaseSrc * gst_base, GstQuery * query)
+{
+  GstOmxBaseSrc *self;
+
+  self = GST_OMX_BASE_SRC (gst_base);
+
+  switch (GST_QUERY_TYPE (query)) {
+    case GST_QUERY_LATENCY:
+    {
+      GstClockTime min_latency, max_latency;
+
+      if (!self->is_live) {
+        gst_query_set_latency (query, FALSE, 0, GST_CLOCK_TIME_NONE);
+        return true;
+      }
+
+      if (!GST_CLOCK_TIME_IS_VALID (self->buffer_duration) || !self->out_port) {
+        GST_DEBUG_OBJECT (self, "latency not known yet");
+        return false;
+      }
+
+      /* a buffer is pushed once it is complete, and the component can
+       * hold all of its buffers before we get to them */
+      min_latency = self->buffer_duration;
+      max_latency = self->buffer_duration * self->out_port->num_buffers;
+
+      GST_DEBUG_OBJECT (self, "latency: min %" GST_TIME_FORMAT " max %"
+          GST_TIME_FORMAT, GST_TIME_ARGS (min_latency),
+          GST_TIME_ARGS (max_latency));
+
+      gst_query_set_latency (query, TRUE, min_latency, max_latency);
+      return true;
+    }
+    default:
+      return base_src_parent_class->query (gst_base, query);
+  }
 }
 
 static gboolean
@@ -343,6 +499,10 @@ set_property (GObject * obj,
       }
       self->omx_library = g_value_dup_string (value);
       break;
+    case ARG_IS_LIVE:
+      self->is_live = g_value_get_boolean (value);
+      gst_base_src_set_live (GST_BASE_SRC (self), self->is_live);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (obj, prop_id, pspec);
       break;
@@ -363,6 +523,9 @@ get_property (GObject * obj, guint prop_id, GValue * value, GParamSpec * pspec)
     case ARG_LIBRARY_NAME:
       g_value_set_string (value, self->omx_library);
       break;
+    case ARG_IS_LIVE:
+      g_value_set_boolean (value, self->is_live);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (obj, prop_id, pspec);
       break;
@@ -381,6 +544,7 @@ type_class_init (gpointer g_class, gpointer class_data)
   gst_base_src_class = GST_BASE_SRC_CLASS (g_class);
 
   parent_class = g_type_class_ref (GST_TYPE_ELEMENT);
+  base_src_parent_class = g_type_class_peek_parent (g_class);
 
   gobject_class->dispose = dispose;
 
@@ -388,6 +552,9 @@ type_class_init (gpointer g_class, gpointer class_data)
   gst_base_src_class->stop = stop;
   gst_base_src_class->event = handle_event;
   gst_base_src_class->create = create;
+  gst_base_src_class->unlock = unlock;
+  gst_base_src_class->unlock_stop = unlock_stop;
+  gst_base_src_class->query = query;
 
   /* Properties stuff */
   {
@@ -403,6 +570,11 @@ type_class_init (gpointer g_class, gpointer class_data)
         g_param_spec_string ("library-name", "Library name",
             "Name of the OpenMAX IL implementation library to use",
             NULL, G_PARAM_READWRITE));
+
+    g_object_class_install_property (gobject_class, ARG_IS_LIVE,
+        g_param_spec_boolean ("is-live", "Is live",
+            "Whether the component captures in real time",
+            FALSE, G_PARAM_READWRITE));
   }
 }
 
@@ -427,6 +599,10 @@ type_instance_init (GTypeInstance * instance, gpointer g_class)
 
   self->omx_library = g_strdup (DEFAULT_LIBRARY_NAME);
 
+  self->recycle_mutex = g_mutex_new ();
+  self->recycle_cond = g_cond_new ();
+  self->buffer_duration = GST_CLOCK_TIME_NONE;
+
   GST_LOG_OBJECT (self, "end");
 }
 
@@ -47,6 +47,18 @@ struct GstOmxBaseSrc
     char *omx_component;
     char *omx_library;
     GstOmxBaseSrcCb setup_ports;
+
+    gboolean is_live;
+    gboolean running; /**< Returned buffers may go back to the port. */
+    gboolean eos;
+    GMutex *recycle_mutex;
+    GCond *recycle_cond; /**< Signalled when the last output buffer comes back. */
+    GList *outstanding; /**< Output buffers still owned by downstream. */
+
+    gint settings_generation; /**< Of the src pad caps, -1 before the first buffer. */
+
+    OMX_TICKS last_timestamp;
+    GstClockTime buffer_duration;
 };
 
 struct GstOmxBaseSrcClass
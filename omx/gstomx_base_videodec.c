@@ -21,11 +21,46 @@
 
 #include "gstomx_base_videodec.h"
 #include "gstomx.h"
+#include "gstomx_convert.h"
+#include "gstomx_bitstream.h"
 
-#include <stdlib.h>             /* For calloc, free */
+#include <string.h>             /* For memset */
+
+enum
+{
+  ARG_0,
+  ARG_SKIP_FRAMES,
+  ARG_KEY_ONLY_RATE,
+  ARG_REVERSE_FRAMES
+};
+
+#define DEFAULT_KEY_ONLY_RATE 4.0
+#define DEFAULT_REVERSE_FRAMES 32
 
 static GstOmxBaseFilterClass *parent_class = NULL;
 
+#define GST_TYPE_OMX_SKIP_FRAMES (gst_omx_skip_frames_get_type ())
+static GType
+gst_omx_skip_frames_get_type (void)
+{
+  static GType gst_omx_skip_frames_type = 0;
+
+  if (!gst_omx_skip_frames_type) {
+    static GEnumValue gst_omx_skip_frames[] = {
+      {GST_OMX_SKIP_FRAMES_NONE, "Decode everything", "none"},
+      {GST_OMX_SKIP_FRAMES_NON_REFERENCE,
+          "Skip frames nothing depends on", "non-reference"},
+      {GST_OMX_SKIP_FRAMES_NON_KEY, "Decode only key frames", "non-key"},
+      {0, NULL, NULL},
+    };
+
+    gst_omx_skip_frames_type = g_enum_register_static ("GstOmxSkipFrames",
+        gst_omx_skip_frames);
+  }
+
+  return gst_omx_skip_frames_type;
+}
+
 static GstCaps *
 generate_src_template (void)
 {
@@ -57,6 +92,12 @@ generate_src_template (void)
     gst_value_set_fourcc (&val, GST_MAKE_FOURCC ('U', 'Y', 'V', 'Y'));
     gst_value_list_append_value (&list, &val);
 
+    gst_value_set_fourcc (&val, GST_MAKE_FOURCC ('N', 'V', '1', '2'));
+    gst_value_list_append_value (&list, &val);
+
+    gst_value_set_fourcc (&val, GST_MAKE_FOURCC ('N', 'V', '2', '1'));
+    gst_value_list_append_value (&list, &val);
+
     gst_structure_set_value (struc, "format", &list);
 
     g_value_unset (&val);
@@ -65,6 +106,16 @@ generate_src_template (void)
 
   gst_caps_append_structure (caps, struc);
 
+  /* padded hardware layout, for those who understand it */
+  struc = gst_structure_copy (struc);
+  gst_structure_set_name (struc, "video/x-raw-yuv-strided");
+  gst_structure_set (struc,
+      "rowstride", GST_TYPE_INT_RANGE, 16, G_MAXINT,
+      "slice-height", GST_TYPE_INT_RANGE, 16, G_MAXINT,
+      "crop-left", GST_TYPE_INT_RANGE, 0, G_MAXINT,
+      "crop-top", GST_TYPE_INT_RANGE, 0, G_MAXINT, NULL);
+  gst_caps_append_structure (caps, struc);
+
   return caps;
 }
 
@@ -85,20 +136,522 @@ type_base_init (gpointer g_class)
   }
 }
 
+static void
+dispose (GObject * obj)
+{
+  GstOmxBaseVideoDec *self;
+
+  self = GST_OMX_BASE_VIDEODEC (obj);
+
+  g_free (self->frame);
+  self->frame = NULL;
+  g_free (self->scratch);
+  self->scratch = NULL;
+
+  G_OBJECT_CLASS (parent_class)->dispose (obj);
+}
+
+static void
+set_property (GObject * obj,
+    guint prop_id, const GValue * value, GParamSpec * pspec)
+{
+  GstOmxBaseVideoDec *self;
+
+  self = GST_OMX_BASE_VIDEODEC (obj);
+
+  switch (prop_id) {
+    case ARG_SKIP_FRAMES:
+      self->skip_frames = g_value_get_enum (value);
+      break;
+    case ARG_KEY_ONLY_RATE:
+      self->key_only_rate = g_value_get_double (value);
+      break;
+    case ARG_REVERSE_FRAMES:
+      self->omx_base.max_reverse_frames = g_value_get_uint (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (obj, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+get_property (GObject * obj, guint prop_id, GValue * value, GParamSpec * pspec)
+{
+  GstOmxBaseVideoDec *self;
+
+  self = GST_OMX_BASE_VIDEODEC (obj);
+
+  switch (prop_id) {
+    case ARG_SKIP_FRAMES:
+      g_value_set_enum (value, self->skip_frames);
+      break;
+    case ARG_KEY_ONLY_RATE:
+      g_value_set_double (value, self->key_only_rate);
+      break;
+    case ARG_REVERSE_FRAMES:
+      g_value_set_uint (value, self->omx_base.max_reverse_frames);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (obj, prop_id, pspec);
+      break;
+  }
+}
+
 static void
 type_class_init (gpointer g_class, gpointer class_data)
 {
+  GObjectClass *gobject_class;
+
+  gobject_class = G_OBJECT_CLASS (g_class);
+
   parent_class = g_type_class_ref (GST_OMX_BASE_FILTER_TYPE);
+
+  gobject_class->dispose = dispose;
+
+  /* Properties stuff */
+  {
+    gobject_class->set_property = set_property;
+    gobject_class->get_property = get_property;
+
+    g_object_class_install_property (gobject_class, ARG_SKIP_FRAMES,
+        g_param_spec_enum ("skip-frames", "Skip frames",
+            "Which frames to drop before decoding",
+            GST_TYPE_OMX_SKIP_FRAMES, GST_OMX_SKIP_FRAMES_NONE,
+            G_PARAM_READWRITE));
+
+    g_object_class_install_property (gobject_class, ARG_KEY_ONLY_RATE,
+        g_param_spec_double ("key-only-rate", "Key only rate",
+            "Decode only key frames when playing faster than this, "
+            "either way", 1.0, G_MAXDOUBLE, DEFAULT_KEY_ONLY_RATE,
+            G_PARAM_READWRITE));
+
+    g_object_class_install_property (gobject_class, ARG_REVERSE_FRAMES,
+        g_param_spec_uint ("reverse-frames", "Reverse frames",
+            "Most decoded frames held to play a GOP backwards "
+            "(0 plays only key frames backwards)",
+            0, G_MAXUINT, DEFAULT_REVERSE_FRAMES, G_PARAM_READWRITE));
+  }
 }
 
-static void
-settings_changed_cb (GOmxCore * core)
+static GOmxFrameType
+frame_type (GstOmxBaseVideoDec * self, GstBuffer * buf)
 {
   GstOmxBaseFilter *omx_base;
+  const guint8 *data;
+  guint size;
+  const guint8 *codec_data = NULL;
+  guint codec_size = 0;
+
+  omx_base = GST_OMX_BASE_FILTER (self);
+  data = GST_BUFFER_DATA (buf);
+  size = GST_BUFFER_SIZE (buf);
+
+  if (omx_base->codec_data) {
+    codec_data = GST_BUFFER_DATA (omx_base->codec_data);
+    codec_size = GST_BUFFER_SIZE (omx_base->codec_data);
+  }
+
+  switch (self->compression_format) {
+    case OMX_VIDEO_CodingAVC:
+    {
+      guint nal_length_size = 4;
+
+      /* avcC says, otherwise start codes tell */
+      if (codec_data && codec_size > 4 && codec_data[0] == 1)
+        nal_length_size = (codec_data[4] & 0x3) + 1;
+      else if (size >= 3 && data[0] == 0 && data[1] == 0 &&
+          (data[2] == 1 || (size >= 4 && data[2] == 0 && data[3] == 1)))
+        nal_length_size = 0;
+
+      return g_omx_frame_type_h264 (data, size, nal_length_size);
+    }
+    case OMX_VIDEO_CodingMPEG4:
+      return g_omx_frame_type_mpeg4 (data, size);
+    case OMX_VIDEO_CodingH263:
+      return g_omx_frame_type_h263 (data, size);
+    case OMX_VIDEO_CodingWMV:
+      return g_omx_frame_type_wmv (data, size, codec_data, codec_size);
+    default:
+      return GOMX_FRAME_UNKNOWN;
+  }
+}
+
+static gboolean
+drop_input (GstOmxBaseFilter * omx_base, GstBuffer * buf)
+{
   GstOmxBaseVideoDec *self;
+  GstOmxSkipFrames skip_frames;
+  GOmxFrameType type;
+  gdouble rate;
+
+  self = GST_OMX_BASE_VIDEODEC (omx_base);
+  skip_frames = self->skip_frames;
+
+  /* trick modes; the segment only changes in this thread */
+  rate = omx_base->segment.rate;
+  if (ABS (rate) > self->key_only_rate ||
+      (rate < 0.0 && !omx_base->max_reverse_frames))
+    skip_frames = GST_OMX_SKIP_FRAMES_NON_KEY;
+
+  if (skip_frames == GST_OMX_SKIP_FRAMES_NONE)
+    return FALSE;
+
+  type = frame_type (self, buf);
+
+  /* the demuxer may still know */
+  if (type == GOMX_FRAME_UNKNOWN &&
+      GST_BUFFER_FLAG_IS_SET (buf, GST_BUFFER_FLAG_DELTA_UNIT))
+    type = GOMX_FRAME_REFERENCE;
+
+  switch (type) {
+    case GOMX_FRAME_NON_REFERENCE:
+      return TRUE;
+    case GOMX_FRAME_REFERENCE:
+      return skip_frames == GST_OMX_SKIP_FRAMES_NON_KEY;
+    default:
+      return FALSE;
+  }
+}
+
+static inline gboolean
+is_semi_planar (guint32 format)
+{
+  return format == GST_MAKE_FOURCC ('N', 'V', '1', '2') ||
+      format == GST_MAKE_FOURCC ('N', 'V', '2', '1');
+}
+
+/* Luma in a plane of its own. */
+static inline gboolean
+is_planar (guint32 format)
+{
+  return format == GST_MAKE_FOURCC ('I', '4', '2', '0') ||
+      is_semi_planar (format);
+}
+
+/* Bytes per row of a tightly packed frame. */
+static inline guint
+packed_stride (guint32 format, guint width)
+{
+  return is_planar (format) ? width : width * 2;
+}
+
+/* Chroma of an odd size still covers the last luma column or row. */
+static inline guint
+chroma_size (guint n)
+{
+  return (n + 1) / 2;
+}
+
+static inline guint
+packed_size (guint32 format, guint width, guint height)
+{
+  if (is_planar (format))
+    return width * height + 2 * chroma_size (width) * chroma_size (height);
+
+  return width * 2 * height;
+}
+
+static void
+convert_semi_planar (GstOmxBaseVideoDec * self, guint8 * dest,
+    const guint8 * src)
+{
+  GOmxConvertSource source;
+  guint width;
+  guint height;
+  guint stride;
+
+  width = self->width;
+  height = self->height;
+  stride = self->stride;
+
+  g_omx_convert_source_init (&source, src, stride, self->slice_height,
+      self->crop_left, self->crop_top,
+      self->format == GST_MAKE_FOURCC ('N', 'V', '2', '1'));
+
+  switch (self->out_format) {
+    case GST_MAKE_FOURCC ('I', '4', '2', '0'):
+      g_omx_convert_to_i420 (&source, dest, dest + width * height,
+          dest + width * height + chroma_size (width) * chroma_size (height),
+          width, width, height);
+      break;
+    case GST_MAKE_FOURCC ('Y', 'U', 'Y', '2'):
+    case GST_MAKE_FOURCC ('U', 'Y', 'V', 'Y'):
+      g_omx_convert_to_packed (&source, dest, width * 2,
+          self->out_format == GST_MAKE_FOURCC ('U', 'Y', 'V', 'Y'),
+          width, height);
+      break;
+    default:
+      /* as is, minus padding */
+      g_omx_copy_plane (dest, width, source.y, stride, width, height);
+      g_omx_copy_plane (dest + width * height, 2 * chroma_size (width),
+          source.uv, stride, 2 * chroma_size (width), chroma_size (height));
+      break;
+  }
+}
+
+static inline guint8 *
+ensure_buffer (guint8 ** buffer, gsize * size, gsize needed)
+{
+  if (*size < needed) {
+    *buffer = g_realloc (*buffer, needed);
+    *size = needed;
+  }
+
+  return *buffer;
+}
+
+/* Shrink to I420 at the downstream size. */
+static void
+scale_output (GstOmxBaseVideoDec * self, guint8 * dest, const guint8 * src)
+{
+  const guint8 *y;
+  const guint8 *u;
+  const guint8 *v;
+  guint y_stride;
+  guint c_stride;
   guint width;
   guint height;
+  guint out_width;
+  guint out_height;
+  guint8 *scratch;
+
+  width = self->width;
+  height = self->height;
+  out_width = self->out_width;
+  out_height = self->out_height;
+
+  if (is_semi_planar (self->format)) {
+    guint8 *frame;
+
+    frame = ensure_buffer (&self->frame, &self->frame_size,
+        packed_size (GST_MAKE_FOURCC ('I', '4', '2', '0'), width, height));
+    convert_semi_planar (self, frame, src);
+
+    y = frame;
+    u = y + width * height;
+    v = u + chroma_size (width) * chroma_size (height);
+    y_stride = width;
+    c_stride = chroma_size (width);
+  } else {
+    const guint8 *chroma;
+    guint stride = self->stride;
+
+    chroma = src + stride * self->slice_height +
+        (self->crop_top / 2) * (stride / 2) + self->crop_left / 2;
+
+    y = src + self->crop_top * stride + self->crop_left;
+    u = chroma;
+    v = chroma + (stride / 2) * (self->slice_height / 2);
+    y_stride = stride;
+    c_stride = stride / 2;
+  }
+
+  scratch = ensure_buffer (&self->scratch, &self->scratch_size,
+      chroma_size (width) * chroma_size (height));
+
+  g_omx_scale_plane (y, y_stride, width, height,
+      dest, out_width, out_width, out_height, scratch);
+  dest += out_width * out_height;
+  g_omx_scale_plane (u, c_stride, chroma_size (width), chroma_size (height),
+      dest, chroma_size (out_width), chroma_size (out_width),
+      chroma_size (out_height), scratch);
+  dest += chroma_size (out_width) * chroma_size (out_height);
+  g_omx_scale_plane (v, c_stride, chroma_size (width), chroma_size (height),
+      dest, chroma_size (out_width), chroma_size (out_width),
+      chroma_size (out_height), scratch);
+}
+
+/* Drop the padding and crop, convert or scale, for downstream. */
+static gboolean
+copy_output (GstOmxBaseFilter * omx_base, guint8 * dest,
+    OMX_BUFFERHEADERTYPE * omx_buffer)
+{
+  GstOmxBaseVideoDec *self;
+  const guint8 *src;
+  guint width;
+  guint height;
+  guint stride;
+  gsize needed;
+
+  self = GST_OMX_BASE_VIDEODEC (omx_base);
+  src = omx_buffer->pBuffer + omx_buffer->nOffset;
+  width = self->width;
+  height = self->height;
+  stride = self->stride;
+
+  /* the planes are read at the configured layout, whatever was filled */
+  needed = g_omx_frame_size (stride, self->slice_height,
+      is_planar (self->format));
+
+  if (G_UNLIKELY (omx_buffer->nFilledLen < needed)) {
+    GST_WARNING_OBJECT (self, "short frame: %lu < %" G_GSIZE_FORMAT,
+        (gulong) omx_buffer->nFilledLen, needed);
+    return FALSE;
+  }
+
+  if (self->out_width != width || self->out_height != height) {
+    scale_output (self, dest, src);
+  } else if (is_semi_planar (self->format)) {
+    convert_semi_planar (self, dest, src);
+  } else if (is_planar (self->format)) {
+    guint plane;
+
+    g_omx_copy_plane (dest, width,
+        src + self->crop_top * stride + self->crop_left,
+        stride, width, height);
+    dest += width * height;
+    src += stride * self->slice_height;
+
+    for (plane = 0; plane < 2; plane++) {
+      g_omx_copy_plane (dest, chroma_size (width),
+          src + (self->crop_top / 2) * (stride / 2) + self->crop_left / 2,
+          stride / 2, chroma_size (width), chroma_size (height));
+      dest += chroma_size (width) * chroma_size (height);
+      src += (stride / 2) * (self->slice_height / 2);
+    }
+  } else {
+    g_omx_copy_plane (dest, width * 2,
+        src + self->crop_top * stride + self->crop_left * 2,
+        stride, width * 2, height);
+  }
+
+  return TRUE;
+}
+
+static GstCaps *
+make_caps (GstOmxBaseVideoDec * self, guint32 format, gboolean strided)
+{
+  GstCaps *caps;
+
+  caps = gst_caps_new_simple (strided ?
+      "video/x-raw-yuv-strided" : "video/x-raw-yuv",
+      "width", G_TYPE_INT, self->out_width,
+      "height", G_TYPE_INT, self->out_height,
+      "framerate", GST_TYPE_FRACTION,
+      self->framerate_num, self->framerate_denom,
+      "format", GST_TYPE_FOURCC, format, NULL);
+
+  if (strided)
+    gst_caps_set_simple (caps,
+        "rowstride", G_TYPE_INT, self->stride,
+        "slice-height", G_TYPE_INT, self->slice_height,
+        "crop-left", G_TYPE_INT, self->crop_left,
+        "crop-top", G_TYPE_INT, self->crop_top, NULL);
+
+  return caps;
+}
+
+static gboolean
+try_caps (GstOmxBaseFilter * omx_base, GstCaps * caps)
+{
+  gboolean ret;
+
+  ret = gst_pad_peer_accept_caps (omx_base->srcpad, caps);
+  if (ret) {
+    GST_INFO_OBJECT (omx_base, "caps are: %" GST_PTR_FORMAT, caps);
+    gst_pad_set_caps (omx_base->srcpad, caps);
+  }
+  gst_caps_unref (caps);
+
+  return ret;
+}
+
+static void
+limit_size (GstStructure * structure, const gchar * field, guint * size)
+{
+  const GValue *value;
+
+  value = gst_structure_get_value (structure, field);
+  if (!value)
+    return;
+
+  if (G_VALUE_HOLDS_INT (value))
+    *size = MIN (*size, (guint) g_value_get_int (value));
+  else if (GST_VALUE_HOLDS_INT_RANGE (value))
+    *size = MIN (*size, (guint) gst_value_get_int_range_max (value));
+}
+
+/* Whether downstream wants the frames smaller than they are. */
+static gboolean
+downstream_size (GstOmxBaseVideoDec * self, guint * width, guint * height)
+{
+  GstOmxBaseFilter *omx_base;
+  GstCaps *caps;
+
+  omx_base = GST_OMX_BASE_FILTER (self);
+
+  caps = gst_pad_peer_get_caps (omx_base->srcpad);
+  if (!caps)
+    return FALSE;
+
+  *width = self->width;
+  *height = self->height;
+
+  if (!gst_caps_is_empty (caps) && !gst_caps_is_any (caps)) {
+    GstStructure *structure;
+
+    structure = gst_caps_get_structure (caps, 0);
+    limit_size (structure, "width", width);
+    limit_size (structure, "height", height);
+  }
+
+  gst_caps_unref (caps);
+
+  *width &= ~1;
+  *height &= ~1;
+
+  return *width > 0 && *height > 0 &&
+      (*width < self->width || *height < self->height);
+}
+
+/* Ask the component to scale; we do it ourselves until it does. */
+static void
+request_scale (GstOmxBaseVideoDec * self, guint width, guint height)
+{
+  GstOmxBaseFilter *omx_base;
+  OMX_CONFIG_SCALEFACTORTYPE config;
+  OMX_ERRORTYPE error;
+
+  if (width == self->scale_width && height == self->scale_height)
+    return;
+
+  omx_base = GST_OMX_BASE_FILTER (self);
+  self->scale_width = width;
+  self->scale_height = height;
+
+  memset (&config, 0, sizeof (config));
+  config.nSize = sizeof (config);
+  config.nVersion.s.nVersionMajor = 1;
+  config.nVersion.s.nVersionMinor = 1;
+  config.nPortIndex = omx_base->out_port->port_index;
+  /* Q16 */
+  config.xWidth = ((OMX_S64) width << 16) / self->width;
+  config.xHeight = ((OMX_S64) height << 16) / self->height;
+
+  error = OMX_SetConfig (omx_base->gomx->omx_handle,
+      OMX_IndexConfigCommonScale, &config);
+
+  if (error == OMX_ErrorNone)
+    GST_INFO_OBJECT (self, "component scales to %ux%u", width, height);
+  else
+    GST_INFO_OBJECT (self, "component can't scale (%s), scaling here",
+        g_omx_error_name (error));
+}
+
+static void
+settings_changed_cb (GOmxCore * core)
+{
+  GstOmxBaseFilter *omx_base;
+  GstOmxBaseVideoDec *self;
+  guint frame_width;
+  guint frame_height;
   guint32 format = 0;
+  guint32 out_formats[4];
+  guint n_out_formats = 0;
+  gboolean padded;
+  gboolean strided = FALSE;
+  guint i;
 
   omx_base = core->client_data;
   self = GST_OMX_BASE_VIDEODEC (omx_base);
@@ -108,19 +661,11 @@ settings_changed_cb (GOmxCore * core)
   {
     OMX_PARAM_PORTDEFINITIONTYPE *param;
 
-    param = calloc (1, sizeof (OMX_PARAM_PORTDEFINITIONTYPE));
-
-    param->nSize = sizeof (OMX_PARAM_PORTDEFINITIONTYPE);
-    param->nVersion.s.nVersionMajor = 1;
-    param->nVersion.s.nVersionMinor = 1;
+    param = g_omx_port_get_definition (omx_base->out_port);
 
-    param->nPortIndex = 1;
-    OMX_GetParameter (omx_base->gomx->omx_handle, OMX_IndexParamPortDefinition,
-        param);
-
-    width = param->format.video.nFrameWidth;
-    height = param->format.video.nFrameHeight;
-    switch (param->format.video.eColorFormat) {
+    frame_width = param->format.video.nFrameWidth;
+    frame_height = param->format.video.nFrameHeight;
+    switch ((guint) param->format.video.eColorFormat) {
       case OMX_COLOR_FormatYUV420Planar:
         format = GST_MAKE_FOURCC ('I', '4', '2', '0');
         break;
@@ -130,25 +675,123 @@ settings_changed_cb (GOmxCore * core)
       case OMX_COLOR_FormatCbYCrY:
         format = GST_MAKE_FOURCC ('U', 'Y', 'V', 'Y');
         break;
+      case OMX_COLOR_FormatYUV420SemiPlanar:
+      case OMX_COLOR_FormatYUV420PackedSemiPlanar:
+        format = GST_MAKE_FOURCC ('N', 'V', '1', '2');
+        break;
+      case OMX_QCOM_COLOR_FormatYVU420SemiPlanar:
+        format = GST_MAKE_FOURCC ('N', 'V', '2', '1');
+        break;
       default:
+        GST_WARNING_OBJECT (omx_base, "unsupported color format 0x%x",
+            param->format.video.eColorFormat);
         break;
     }
 
-    free (param);
+    self->format = format;
+    self->stride = packed_stride (format, frame_width);
+    if (param->format.video.nStride > 0 &&
+        (guint) param->format.video.nStride > self->stride)
+      self->stride = param->format.video.nStride;
+    self->slice_height = MAX (param->format.video.nSliceHeight, frame_height);
   }
 
+  self->crop_left = 0;
+  self->crop_top = 0;
+  self->width = frame_width;
+  self->height = frame_height;
+
   {
-    GstCaps *new_caps;
+    OMX_CONFIG_RECTTYPE config;
+
+    memset (&config, 0, sizeof (config));
+    config.nSize = sizeof (config);
+    config.nVersion.s.nVersionMajor = 1;
+    config.nVersion.s.nVersionMinor = 1;
+    config.nPortIndex = omx_base->out_port->port_index;
+
+    if (OMX_GetConfig (core->omx_handle, OMX_IndexConfigCommonOutputCrop,
+            &config) == OMX_ErrorNone && config.nWidth > 0 &&
+        config.nHeight > 0 &&
+        config.nLeft + config.nWidth <= frame_width &&
+        config.nTop + config.nHeight <= frame_height) {
+      self->crop_left = config.nLeft;
+      self->crop_top = config.nTop;
+      self->width = config.nWidth;
+      self->height = config.nHeight;
+    }
+  }
+
+  self->out_width = self->width;
+  self->out_height = self->height;
+
+  {
+    guint width;
+    guint height;
+
+    if (is_planar (format) && downstream_size (self, &width, &height)) {
+      request_scale (self, width, height);
+
+      self->out_width = width;
+      self->out_height = height;
+
+      if (try_caps (omx_base, make_caps (self, GST_MAKE_FOURCC ('I', '4', '2',
+                      '0'), FALSE))) {
+        GST_INFO_OBJECT (omx_base, "scaling %ux%u to %ux%u", self->width,
+            self->height, width, height);
+        self->out_format = GST_MAKE_FOURCC ('I', '4', '2', '0');
+        omx_base->copy_output = copy_output;
+        omx_base->copy_output_size = packed_size (self->out_format, width,
+            height);
+        return;
+      }
+
+      self->out_width = self->width;
+      self->out_height = self->height;
+    }
+  }
 
-    new_caps = gst_caps_new_simple ("video/x-raw-yuv",
-        "width", G_TYPE_INT, width,
-        "height", G_TYPE_INT, height,
-        "framerate", GST_TYPE_FRACTION,
-        self->framerate_num, self->framerate_denom,
-        "format", GST_TYPE_FOURCC, format, NULL);
+  padded = self->stride != packed_stride (format, self->width) ||
+      self->slice_height != self->height ||
+      self->crop_left || self->crop_top;
 
+  /* native first, then what we can convert it to */
+  out_formats[n_out_formats++] = format;
+  if (is_semi_planar (format)) {
+    out_formats[n_out_formats++] = GST_MAKE_FOURCC ('I', '4', '2', '0');
+    out_formats[n_out_formats++] = GST_MAKE_FOURCC ('Y', 'U', 'Y', '2');
+    out_formats[n_out_formats++] = GST_MAKE_FOURCC ('U', 'Y', 'V', 'Y');
+  }
+
+  for (i = 0; i < n_out_formats; i++) {
+    if (i == 0 && padded && try_caps (omx_base, make_caps (self, format, TRUE))) {
+      strided = TRUE;
+      break;
+    }
+    if (try_caps (omx_base, make_caps (self, out_formats[i], FALSE)))
+      break;
+  }
+
+  if (i == n_out_formats) {
+    GstCaps *new_caps;
+
+    /* nobody to ask yet; go with the most common */
+    i = n_out_formats > 1 ? 1 : 0;
+    new_caps = make_caps (self, out_formats[i], FALSE);
     GST_INFO_OBJECT (omx_base, "caps are: %" GST_PTR_FORMAT, new_caps);
     gst_pad_set_caps (omx_base->srcpad, new_caps);
+    gst_caps_unref (new_caps);
+  }
+
+  self->out_format = out_formats[i];
+
+  if (!strided && (padded || self->out_format != format)) {
+    GST_INFO_OBJECT (omx_base, "repacking output for downstream");
+    omx_base->copy_output = copy_output;
+    omx_base->copy_output_size = packed_size (self->out_format, self->width,
+        self->height);
+  } else {
+    omx_base->copy_output = NULL;
   }
 }
 
@@ -182,11 +825,6 @@ sink_setcaps (GstPad * pad, GstCaps * caps)
     self->framerate_denom = 1;
   }
 
-  param = calloc (1, sizeof (OMX_PARAM_PORTDEFINITIONTYPE));
-  param->nSize = sizeof (OMX_PARAM_PORTDEFINITIONTYPE);
-  param->nVersion.s.nVersionMajor = 1;
-  param->nVersion.s.nVersionMinor = 1;
-
   {
     const GValue *codec_data;
     GstBuffer *buffer;
@@ -201,17 +839,17 @@ sink_setcaps (GstPad * pad, GstCaps * caps)
 
   /* Input port configuration. */
   {
-    param->nPortIndex = 0;
-    OMX_GetParameter (gomx->omx_handle, OMX_IndexParamPortDefinition, param);
+    GOmxPort *port;
+
+    port = g_omx_core_port (gomx, 0);
+    param = g_omx_port_get_definition (port);
 
     param->format.video.nFrameWidth = width;
     param->format.video.nFrameHeight = height;
 
-    OMX_SetParameter (gomx->omx_handle, OMX_IndexParamPortDefinition, param);
+    g_omx_port_definition_changed (port);
   }
 
-  free (param);
-
   return gst_pad_set_caps (pad, caps);
 }
 
@@ -227,24 +865,18 @@ omx_setup (GstOmxBaseFilter * omx_base)
   GST_INFO_OBJECT (omx_base, "begin");
 
   {
+    GOmxPort *port;
     OMX_PARAM_PORTDEFINITIONTYPE *param;
 
-    param = calloc (1, sizeof (OMX_PARAM_PORTDEFINITIONTYPE));
-    param->nSize = sizeof (OMX_PARAM_PORTDEFINITIONTYPE);
-    param->nVersion.s.nVersionMajor = 1;
-    param->nVersion.s.nVersionMinor = 1;
-
     /* Input port configuration. */
     {
-      param->nPortIndex = 0;
-      OMX_GetParameter (gomx->omx_handle, OMX_IndexParamPortDefinition, param);
+      port = g_omx_core_port (gomx, 0);
+      param = g_omx_port_get_definition (port);
 
       param->format.video.eCompressionFormat = self->compression_format;
 
-      OMX_SetParameter (gomx->omx_handle, OMX_IndexParamPortDefinition, param);
+      g_omx_port_definition_changed (port);
     }
-
-    free (param);
   }
 
   GST_INFO_OBJECT (omx_base, "end");
@@ -254,10 +886,17 @@ static void
 type_instance_init (GTypeInstance * instance, gpointer g_class)
 {
   GstOmxBaseFilter *omx_base;
+  GstOmxBaseVideoDec *self;
 
   omx_base = GST_OMX_BASE_FILTER (instance);
+  self = GST_OMX_BASE_VIDEODEC (instance);
 
   omx_base->omx_setup = omx_setup;
+  omx_base->drop_input = drop_input;
+  omx_base->max_reverse_frames = DEFAULT_REVERSE_FRAMES;
+  omx_base->use_decode_only = TRUE;
+
+  self->key_only_rate = DEFAULT_KEY_ONLY_RATE;
 
   omx_base->gomx->settings_changed_cb = settings_changed_cb;
 
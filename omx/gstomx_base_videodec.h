@@ -32,6 +32,14 @@ G_BEGIN_DECLS
 
 typedef struct GstOmxBaseVideoDec GstOmxBaseVideoDec;
 typedef struct GstOmxBaseVideoDecClass GstOmxBaseVideoDecClass;
+typedef enum GstOmxSkipFrames GstOmxSkipFrames;
+
+enum GstOmxSkipFrames
+{
+    GST_OMX_SKIP_FRAMES_NONE,
+    GST_OMX_SKIP_FRAMES_NON_REFERENCE,
+    GST_OMX_SKIP_FRAMES_NON_KEY
+};
 
 #include "gstomx_base_filter.h"
 
@@ -42,6 +50,26 @@ struct GstOmxBaseVideoDec
     OMX_VIDEO_CODINGTYPE compression_format;
     gint framerate_num;
     gint framerate_denom;
+    GstOmxSkipFrames skip_frames;
+    gdouble key_only_rate; /**< Beyond this absolute rate only key frames are decoded. */
+
+    /* output layout, from the port definition and output crop */
+    guint32 format; /**< What the component produces. */
+    guint32 out_format; /**< What goes downstream. */
+    guint stride; /**< Bytes per luma or packed row. */
+    guint slice_height; /**< Rows per plane. */
+    guint crop_left;
+    guint crop_top;
+    guint width; /**< Visible, after cropping. */
+    guint height;
+    guint out_width; /**< Downstream's, when we scale. */
+    guint out_height;
+    guint scale_width; /**< Last size asked of the component. */
+    guint scale_height;
+    guint8 *frame; /**< Converted frame before scaling. */
+    gsize frame_size;
+    guint8 *scratch;
+    gsize scratch_size;
 };
 
 struct GstOmxBaseVideoDecClass
@@ -22,16 +22,17 @@
 #include "gstomx_base_videoenc.h"
 #include "gstomx.h"
 
-#include <stdlib.h>             /* For calloc, free */
 #include <string.h>             /* For strcmp */
 
 enum
 {
   ARG_0,
-  ARG_BITRATE
+  ARG_BITRATE,
+  ARG_SLICE_SPACING
 };
 
 #define DEFAULT_BITRATE 500000
+#define DEFAULT_SLICE_SPACING 0
 
 static GstOmxBaseFilterClass *parent_class = NULL;
 
@@ -106,6 +107,9 @@ set_property (GObject * obj,
     case ARG_BITRATE:
       self->bitrate = g_value_get_uint (value);
       break;
+    case ARG_SLICE_SPACING:
+      self->slice_spacing = g_value_get_uint (value);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (obj, prop_id, pspec);
       break;
@@ -124,6 +128,9 @@ get_property (GObject * obj, guint prop_id, GValue * value, GParamSpec * pspec)
             /** @todo propagate this to OpenMAX when processing. */
       g_value_set_uint (value, self->bitrate);
       break;
+    case ARG_SLICE_SPACING:
+      g_value_set_uint (value, self->slice_spacing);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (obj, prop_id, pspec);
       break;
@@ -148,6 +155,12 @@ type_class_init (gpointer g_class, gpointer class_data)
         g_param_spec_uint ("bitrate", "Bit-rate",
             "Encoding bit-rate",
             0, G_MAXUINT, DEFAULT_BITRATE, G_PARAM_READWRITE));
+
+    g_object_class_install_property (gobject_class, ARG_SLICE_SPACING,
+        g_param_spec_uint ("slice-spacing", "Slice spacing",
+            "Macroblocks per slice, each pushed as soon as it is encoded "
+            "(0 = one slice per frame)",
+            0, G_MAXUINT, DEFAULT_SLICE_SPACING, G_PARAM_READWRITE));
   }
 }
 
@@ -205,31 +218,69 @@ sink_setcaps (GstPad * pad, GstCaps * caps)
   }
 
   {
+    GOmxPort *port;
     OMX_PARAM_PORTDEFINITIONTYPE *param;
-    param = calloc (1, sizeof (OMX_PARAM_PORTDEFINITIONTYPE));
-    param->nSize = sizeof (OMX_PARAM_PORTDEFINITIONTYPE);
-    param->nVersion.s.nVersionMajor = 1;
-    param->nVersion.s.nVersionMinor = 1;
 
     /* Input port configuration. */
     {
-      param->nPortIndex = 0;
-      OMX_GetParameter (gomx->omx_handle, OMX_IndexParamPortDefinition, param);
+      port = g_omx_core_port (gomx, 0);
+      param = g_omx_port_get_definition (port);
 
       param->format.video.nFrameWidth = width;
       param->format.video.nFrameHeight = height;
       param->format.video.xFramerate = framerate;
       param->format.video.eColorFormat = color_format;
 
-      OMX_SetParameter (gomx->omx_handle, OMX_IndexParamPortDefinition, param);
+      g_omx_port_definition_changed (port);
     }
-
-    free (param);
   }
 
   return gst_pad_set_caps (pad, caps);
 }
 
+static void
+setup_slices (GstOmxBaseVideoEnc * self)
+{
+  GOmxPort *port;
+
+  port = g_omx_core_port (self->omx_base.gomx, 1);
+
+  GST_DEBUG_OBJECT (self, "setting slice spacing: %u", self->slice_spacing);
+
+  switch (self->compression_format) {
+    case OMX_VIDEO_CodingAVC:
+    {
+      OMX_VIDEO_PARAM_AVCTYPE *param;
+      OMX_VIDEO_PARAM_AVCSLICEFMO *fmo;
+
+      param = g_omx_port_get_param (port, OMX_IndexParamVideoAvc,
+          sizeof (OMX_VIDEO_PARAM_AVCTYPE));
+      param->nSliceHeaderSpacing = self->slice_spacing;
+      g_omx_port_param_changed (port, OMX_IndexParamVideoAvc);
+
+      /* some components only go by the slice mode */
+      fmo = g_omx_port_get_param (port, OMX_IndexParamVideoSliceFMO,
+          sizeof (OMX_VIDEO_PARAM_AVCSLICEFMO));
+      fmo->eSliceMode = OMX_VIDEO_SLICEMODE_AVCMBSlice;
+      g_omx_port_param_changed (port, OMX_IndexParamVideoSliceFMO);
+      break;
+    }
+    case OMX_VIDEO_CodingMPEG4:
+    {
+      OMX_VIDEO_PARAM_MPEG4TYPE *param;
+
+      param = g_omx_port_get_param (port, OMX_IndexParamVideoMpeg4,
+          sizeof (OMX_VIDEO_PARAM_MPEG4TYPE));
+      param->nSliceHeaderSpacing = self->slice_spacing;
+      g_omx_port_param_changed (port, OMX_IndexParamVideoMpeg4);
+      break;
+    }
+    default:
+      GST_WARNING_OBJECT (self, "no slices for this format");
+      break;
+  }
+}
+
 static void
 omx_setup (GstOmxBaseFilter * omx_base)
 {
@@ -242,29 +293,28 @@ omx_setup (GstOmxBaseFilter * omx_base)
   GST_INFO_OBJECT (omx_base, "begin");
 
   {
+    GOmxPort *port;
     OMX_PARAM_PORTDEFINITIONTYPE *param;
 
-    param = calloc (1, sizeof (OMX_PARAM_PORTDEFINITIONTYPE));
-    param->nSize = sizeof (OMX_PARAM_PORTDEFINITIONTYPE);
-    param->nVersion.s.nVersionMajor = 1;
-    param->nVersion.s.nVersionMinor = 1;
-
     /* Output port configuration. */
     {
-      param->nPortIndex = 1;
-      OMX_GetParameter (gomx->omx_handle, OMX_IndexParamPortDefinition, param);
+      port = g_omx_core_port (gomx, 1);
+      param = g_omx_port_get_definition (port);
 
       param->format.video.eCompressionFormat = self->compression_format;
 
             /** @todo this should be set with a property */
       param->format.video.nBitrate = self->bitrate;
 
-      OMX_SetParameter (gomx->omx_handle, OMX_IndexParamPortDefinition, param);
+      g_omx_port_definition_changed (port);
     }
-
-    free (param);
   }
 
+  if (self->slice_spacing > 0)
+    setup_slices (self);
+
+  omx_base->partial_frames = self->slice_spacing > 0;
+
   GST_INFO_OBJECT (omx_base, "end");
 }
 
@@ -278,10 +328,12 @@ type_instance_init (GTypeInstance * instance, gpointer g_class)
   self = GST_OMX_BASE_VIDEOENC (instance);
 
   omx_base->omx_setup = omx_setup;
+  omx_base->mark_delta_units = TRUE;
 
   gst_pad_set_setcaps_function (omx_base->sinkpad, sink_setcaps);
 
   self->bitrate = DEFAULT_BITRATE;
+  self->slice_spacing = DEFAULT_SLICE_SPACING;
 }
 
 GType
@@ -40,6 +40,7 @@ struct GstOmxBaseVideoEnc
 
     OMX_VIDEO_CODINGTYPE compression_format;
     guint bitrate;
+    guint slice_spacing; /**< Macroblocks per slice, 0 for whole frames. */
 };
 
 struct GstOmxBaseVideoEncClass
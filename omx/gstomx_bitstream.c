@@ -0,0 +1,483 @@
+/*
+ * Copyright (C) 2007-2009 Nokia Corporation.
+ *
+ * Author: Felipe Contreras <felipe.contreras@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "gstomx_bitstream.h"
+
+#include <string.h>
+
+typedef struct
+{
+  const guint8 *data;
+  guint size;
+  guint pos; /**< In bits. */
+} BitReader;
+
+static inline void
+bit_reader_init (BitReader * br, const guint8 * data, guint size)
+{
+  br->data = data;
+  br->size = size;
+  br->pos = 0;
+}
+
+/* Zeroes past the end; callers only look a few bits in. */
+static guint
+read_bits (BitReader * br, guint n)
+{
+  guint value = 0;
+
+  while (n--) {
+    guint byte = br->pos / 8;
+
+    value <<= 1;
+    if (byte < br->size)
+      value |= (br->data[byte] >> (7 - br->pos % 8)) & 1;
+    br->pos++;
+  }
+
+  return value;
+}
+
+/* Exp-Golomb */
+static guint
+read_ue (BitReader * br)
+{
+  guint zeros = 0;
+
+  while (read_bits (br, 1) == 0 && zeros < 32)
+    zeros++;
+
+  return ((1 << zeros) - 1) + read_bits (br, zeros);
+}
+
+/* Offset of the byte after the next 00 00 01, or size. */
+static guint
+next_start_code (const guint8 * data, guint size, guint offset)
+{
+  guint i;
+
+  for (i = offset; i + 3 <= size; i++) {
+    if (data[i] == 0 && data[i + 1] == 0 && data[i + 2] == 1)
+      return i + 3;
+  }
+
+  return size;
+}
+
+/*
+ * H.264
+ */
+
+typedef struct
+{
+  gboolean key;
+  gboolean reference;
+  gboolean non_reference;
+  gboolean config;
+} NalSummary;
+
+static void
+h264_nal (NalSummary * summary, const guint8 * nal, guint size)
+{
+  guint type;
+  guint ref_idc;
+
+  if (size < 1)
+    return;
+
+  type = nal[0] & 0x1f;
+  ref_idc = (nal[0] >> 5) & 0x3;
+
+  switch (type) {
+    case 5:                    /* IDR */
+      summary->key = TRUE;
+      break;
+    case 1:                    /* non-IDR slice */
+    case 2:                    /* partition A */
+    {
+      BitReader br;
+      guint slice_type;
+
+      bit_reader_init (&br, nal + 1, size - 1);
+      read_ue (&br);            /* first_mb_in_slice */
+      slice_type = read_ue (&br) % 5;
+
+      /* I or SI; decodes alone even if it isn't IDR */
+      if (slice_type == 2 || slice_type == 4)
+        summary->key = TRUE;
+      else if (ref_idc == 0)
+        summary->non_reference = TRUE;
+      else
+        summary->reference = TRUE;
+      break;
+    }
+    case 7:                    /* SPS */
+    case 8:                    /* PPS */
+      summary->config = TRUE;
+      break;
+    default:
+      break;
+  }
+}
+
+GOmxFrameType
+g_omx_frame_type_h264 (const guint8 * data, guint size,
+    guint nal_length_size)
+{
+  NalSummary summary = { FALSE, FALSE, FALSE, FALSE };
+
+  if (nal_length_size == 0) {
+    guint offset;
+
+    offset = next_start_code (data, size, 0);
+    while (offset < size) {
+      guint next;
+      guint end;
+
+      next = next_start_code (data, size, offset);
+      end = next < size ? next - 3 : size;
+      h264_nal (&summary, data + offset, end - offset);
+      offset = next;
+    }
+  } else {
+    guint offset = 0;
+
+    while (offset + nal_length_size <= size) {
+      guint length = 0;
+      guint i;
+
+      for (i = 0; i < nal_length_size; i++)
+        length = (length << 8) | data[offset + i];
+      offset += nal_length_size;
+
+      if (length > size - offset)
+        break;
+
+      h264_nal (&summary, data + offset, length);
+      offset += length;
+    }
+  }
+
+  if (summary.key)
+    return GOMX_FRAME_KEY;
+  if (summary.reference)
+    return GOMX_FRAME_REFERENCE;
+  if (summary.non_reference)
+    return GOMX_FRAME_NON_REFERENCE;
+  if (summary.config)
+    return GOMX_FRAME_CONFIG;
+
+  return GOMX_FRAME_UNKNOWN;
+}
+
+guint
+g_omx_h264_split (const guint8 * data, guint size,
+    GOmxNal * nals, guint max_nals)
+{
+  guint count = 0;
+  guint offset;
+
+  offset = next_start_code (data, size, 0);
+  while (offset < size) {
+    guint next;
+    guint end;
+
+    next = next_start_code (data, size, offset);
+    end = next < size ? next - 3 : size;
+
+    /* a NAL unit never ends in zero; those belong to the next start code */
+    while (end > offset && data[end - 1] == 0)
+      end--;
+
+    if (end > offset) {
+      if (count < max_nals) {
+        nals[count].offset = offset;
+        nals[count].size = end - offset;
+      }
+      count++;
+    }
+
+    offset = next;
+  }
+
+  return count;
+}
+
+#define MAX_PARAMETER_SETS 32
+
+guint
+g_omx_h264_avcc (const guint8 * data, guint size, guint8 * dest,
+    guint dest_size)
+{
+  GOmxNal nals[MAX_PARAMETER_SETS];
+  guint n_nals;
+  guint n_sps = 0;
+  guint n_pps = 0;
+  guint length;
+  guint pass;
+  guint i;
+  const guint8 *sps = NULL;
+
+  n_nals = MIN (g_omx_h264_split (data, size, nals, MAX_PARAMETER_SETS),
+      MAX_PARAMETER_SETS);
+
+  length = 7;
+  for (i = 0; i < n_nals; i++) {
+    switch (data[nals[i].offset] & 0x1f) {
+      case 7:
+        if (!sps && nals[i].size >= 4)
+          sps = data + nals[i].offset;
+        n_sps++;
+        length += 2 + nals[i].size;
+        break;
+      case 8:
+        n_pps++;
+        length += 2 + nals[i].size;
+        break;
+      default:
+        break;
+    }
+  }
+
+  if (!sps || n_sps > 31 || n_pps > 255 || length > dest_size)
+    return 0;
+
+  dest[0] = 1;                  /* configurationVersion */
+  dest[1] = sps[1];             /* profile_idc */
+  dest[2] = sps[2];             /* constraint flags */
+  dest[3] = sps[3];             /* level_idc */
+  dest[4] = 0xfc | 3;           /* 4-byte lengths */
+  dest[5] = 0xe0 | n_sps;
+  length = 6;
+
+  /* SPS, then PPS */
+  for (pass = 7; pass <= 8; pass++) {
+    if (pass == 8)
+      dest[length++] = n_pps;
+
+    for (i = 0; i < n_nals; i++) {
+      if ((data[nals[i].offset] & 0x1f) != pass)
+        continue;
+
+      dest[length++] = nals[i].size >> 8;
+      dest[length++] = nals[i].size & 0xff;
+      memcpy (dest + length, data + nals[i].offset, nals[i].size);
+      length += nals[i].size;
+    }
+  }
+
+  return length;
+}
+
+/*
+ * MPEG-4 part 2
+ */
+
+GOmxFrameType
+g_omx_frame_type_mpeg4 (const guint8 * data, guint size)
+{
+  gboolean config = FALSE;
+  guint offset;
+
+  for (offset = next_start_code (data, size, 0); offset < size;
+      offset = next_start_code (data, size, offset)) {
+    guint code = data[offset];
+
+    if (code == 0xb6 && offset + 1 < size) {
+      switch (data[offset + 1] >> 6) {
+        case 0:
+          return GOMX_FRAME_KEY;
+        case 2:
+          return GOMX_FRAME_NON_REFERENCE;
+        default:               /* P and S(GMC) */
+          return GOMX_FRAME_REFERENCE;
+      }
+    }
+
+    /* VOS, VO, VOL */
+    if (code == 0xb0 || code == 0xb5 || code <= 0x2f)
+      config = TRUE;
+  }
+
+  return config ? GOMX_FRAME_CONFIG : GOMX_FRAME_UNKNOWN;
+}
+
+/*
+ * H.263
+ */
+
+GOmxFrameType
+g_omx_frame_type_h263 (const guint8 * data, guint size)
+{
+  BitReader br;
+  guint source_format;
+
+  /* picture start code, 0000 0000 0000 0000 1000 00 */
+  if (size < 5 || data[0] != 0 || data[1] != 0 || (data[2] & 0xfc) != 0x80)
+    return GOMX_FRAME_UNKNOWN;
+
+  bit_reader_init (&br, data, size);
+  br.pos = 22 + 8;              /* PSC, TR */
+
+  read_bits (&br, 5);           /* marker, zero, split, document, freeze */
+  source_format = read_bits (&br, 3);
+
+  if (source_format != 7)
+    return read_bits (&br, 1) ? GOMX_FRAME_REFERENCE : GOMX_FRAME_KEY;
+
+  /* PLUSPTYPE */
+  if (read_bits (&br, 3) == 1)
+    read_bits (&br, 18);        /* OPPTYPE */
+
+  switch (read_bits (&br, 3)) {
+    case 0:
+      return GOMX_FRAME_KEY;
+    case 3:                    /* B */
+      return GOMX_FRAME_NON_REFERENCE;
+    default:
+      return GOMX_FRAME_REFERENCE;
+  }
+}
+
+/*
+ * WMV 9 / VC-1
+ */
+
+static GOmxFrameType
+wmv_simple_main (const guint8 * data, guint size, const guint8 * struct_c)
+{
+  BitReader br;
+  guint rangered;
+  guint max_b_frames;
+  guint finterpflag;
+
+  bit_reader_init (&br, struct_c, 4);
+  /* profile to overlap */
+  read_bits (&br, 4 + 3 + 5 + 1 + 1 + 1 + 1 + 1 + 1 + 2 + 1 + 1 + 1);
+  read_bits (&br, 1);           /* syncmarker */
+  rangered = read_bits (&br, 1);
+  max_b_frames = read_bits (&br, 3);
+  read_bits (&br, 2);           /* quantizer */
+  finterpflag = read_bits (&br, 1);
+
+  if (size < 1)
+    return GOMX_FRAME_UNKNOWN;
+
+  bit_reader_init (&br, data, size);
+  if (finterpflag)
+    read_bits (&br, 1);
+  read_bits (&br, 2);           /* frame count */
+  if (rangered)
+    read_bits (&br, 1);
+
+  if (read_bits (&br, 1))
+    return GOMX_FRAME_REFERENCE;
+  if (max_b_frames == 0)
+    return GOMX_FRAME_KEY;
+
+  return read_bits (&br, 1) ? GOMX_FRAME_KEY : GOMX_FRAME_NON_REFERENCE;
+}
+
+/* INTERLACE from an advanced profile sequence header, if there is one. */
+static gboolean
+wmv_advanced_interlace (const guint8 * data, guint size, gboolean * interlace)
+{
+  guint offset;
+
+  for (offset = next_start_code (data, size, 0); offset < size;
+      offset = next_start_code (data, size, offset)) {
+    if (data[offset] == 0x0f) {
+      BitReader br;
+
+      bit_reader_init (&br, data + offset + 1, size - offset - 1);
+      /* profile to pulldown */
+      br.pos = 2 + 3 + 2 + 3 + 5 + 1 + 12 + 12 + 1;
+      *interlace = read_bits (&br, 1);
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+static GOmxFrameType
+wmv_advanced (const guint8 * data, guint size, gboolean interlace)
+{
+  gboolean config = FALSE;
+  guint offset;
+
+  for (offset = next_start_code (data, size, 0); offset < size;
+      offset = next_start_code (data, size, offset)) {
+    BitReader br;
+    guint bits;
+
+    if (data[offset] == 0x0f || data[offset] == 0x0e)
+      config = TRUE;
+
+    if (data[offset] != 0x0d)
+      continue;
+
+    bit_reader_init (&br, data + offset + 1, size - offset - 1);
+
+    if (interlace && read_bits (&br, 1) && read_bits (&br, 1)) {
+      /* field pairs, FPTYPE */
+      bits = read_bits (&br, 3);
+      if (bits == 0)
+        return GOMX_FRAME_KEY;
+      return bits < 4 ? GOMX_FRAME_REFERENCE : GOMX_FRAME_NON_REFERENCE;
+    }
+
+    /* PTYPE: P 0, B 10, I 110, BI 1110, skipped 1111 */
+    for (bits = 0; bits < 4 && read_bits (&br, 1); bits++);
+    switch (bits) {
+      case 0:
+        return GOMX_FRAME_REFERENCE;
+      case 2:
+        return GOMX_FRAME_KEY;
+      default:
+        return GOMX_FRAME_NON_REFERENCE;
+    }
+  }
+
+  return config ? GOMX_FRAME_CONFIG : GOMX_FRAME_UNKNOWN;
+}
+
+GOmxFrameType
+g_omx_frame_type_wmv (const guint8 * data, guint size,
+    const guint8 * codec_data, guint codec_size)
+{
+  gboolean interlace = FALSE;
+
+  if (codec_data && wmv_advanced_interlace (codec_data, codec_size,
+          &interlace))
+    return wmv_advanced (data, size, interlace);
+
+  /* advanced profile is 3 in the top two bits */
+  if (codec_data && codec_size >= 4 && (codec_data[0] >> 6) != 3)
+    return wmv_simple_main (data, size, codec_data);
+
+  if (next_start_code (data, size, 0) < size) {
+    wmv_advanced_interlace (data, size, &interlace);
+    return wmv_advanced (data, size, interlace);
+  }
+
+  return GOMX_FRAME_UNKNOWN;
+}
@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2007-2009 Nokia Corporation.
+ *
+ * Author: Felipe Contreras <felipe.contreras@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef GSTOMX_BITSTREAM_H
+#define GSTOMX_BITSTREAM_H
+
+#include <glib.h>
+
+/*
+ * Frame type inspection
+ *
+ * Just enough parsing of compressed video to tell whether a buffer can be
+ * dropped before it reaches the component. Anything these can't make
+ * sense of is GOMX_FRAME_UNKNOWN, which callers must keep.
+ */
+
+typedef enum GOmxFrameType GOmxFrameType;
+
+enum GOmxFrameType
+{
+    GOMX_FRAME_UNKNOWN,
+    GOMX_FRAME_CONFIG, /**< Only headers, like SPS/PPS or VOL. */
+    GOMX_FRAME_KEY, /**< Decodes on its own. */
+    GOMX_FRAME_REFERENCE, /**< Others may depend on it. */
+    GOMX_FRAME_NON_REFERENCE /**< Nothing depends on it. */
+};
+
+/** nal_length_size is 0 for start codes (byte-stream). */
+GOmxFrameType g_omx_frame_type_h264 (const guint8 *data, guint size,
+                                     guint nal_length_size);
+GOmxFrameType g_omx_frame_type_mpeg4 (const guint8 *data, guint size);
+GOmxFrameType g_omx_frame_type_h263 (const guint8 *data, guint size);
+/** codec_data is the WMV3 sequence header (STRUCT_C), NULL for VC-1 advanced. */
+GOmxFrameType g_omx_frame_type_wmv (const guint8 *data, guint size,
+                                    const guint8 *codec_data, guint codec_size);
+
+/*
+ * H.264 byte-stream to AVC (length-prefixed NAL units)
+ */
+
+typedef struct GOmxNal GOmxNal;
+
+struct GOmxNal
+{
+    guint offset; /**< Past the start code. */
+    guint size;
+};
+
+/** Returns how many NAL units there are; only the first max_nals are stored. */
+guint g_omx_h264_split (const guint8 *data, guint size,
+                        GOmxNal *nals, guint max_nals);
+/**
+ * Builds an AVCDecoderConfigurationRecord, with 4-byte lengths, from the
+ * SPS and PPS in data. Returns its size, 0 without an SPS or if it
+ * doesn't fit; size + 8 bytes always do.
+ */
+guint g_omx_h264_avcc (const guint8 *data, guint size,
+                       guint8 *dest, guint dest_size);
+
+#endif /* GSTOMX_BITSTREAM_H */
@@ -0,0 +1,162 @@
+/*
+ * Copyright (C) 2007-2009 Nokia Corporation.
+ *
+ * Author: Felipe Contreras <felipe.contreras@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "gstomx_capture.h"
+
+#include <stdio.h>
+#include <stdlib.h>             /* For getenv */
+#include <string.h>             /* For strncpy */
+#include <time.h>
+#include <unistd.h>             /* For getpid */
+
+struct GOmxCapture
+{
+  FILE *file;
+  GMutex *mutex;
+  gboolean payload;
+  gint64 start;
+};
+
+static gint capture_count;
+
+static gint64
+now (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+
+  return (gint64) ts.tv_sec * G_USEC_PER_SEC + ts.tv_nsec / 1000;
+}
+
+GOmxCapture *
+g_omx_capture_open (const gchar * component)
+{
+  GOmxCapture *capture;
+  GOmxCaptureHeader header;
+  const gchar *prefix;
+  const gchar *payload;
+  gchar *filename;
+  FILE *file;
+
+  prefix = getenv ("GST_OMX_CAPTURE");
+  if (!prefix || !*prefix)
+    return NULL;
+
+  filename = g_strdup_printf ("%s.%d.%d.omxcap", prefix, (gint) getpid (),
+      g_atomic_int_exchange_and_add (&capture_count, 1));
+  file = fopen (filename, "wb");
+  if (!file) {
+    g_warning ("could not open capture file %s", filename);
+    g_free (filename);
+    return NULL;
+  }
+  g_free (filename);
+
+  payload = getenv ("GST_OMX_CAPTURE_PAYLOAD");
+
+  capture = g_new0 (GOmxCapture, 1);
+  capture->file = file;
+  capture->mutex = g_mutex_new ();
+  capture->payload = payload && strcmp (payload, "0") != 0;
+  capture->start = now ();
+
+  memset (&header, 0, sizeof (header));
+  memcpy (header.magic, GOMX_CAPTURE_MAGIC, sizeof (GOMX_CAPTURE_MAGIC));
+  header.version = GOMX_CAPTURE_VERSION;
+  header.payload = capture->payload;
+  if (component)
+    strncpy (header.component, component, sizeof (header.component) - 1);
+  fwrite (&header, sizeof (header), 1, file);
+
+  return capture;
+}
+
+void
+g_omx_capture_close (GOmxCapture * capture)
+{
+  if (!capture)
+    return;
+
+  fclose (capture->file);
+  g_mutex_free (capture->mutex);
+  g_free (capture);
+}
+
+static void
+capture_write (GOmxCapture * capture, GOmxCaptureRecord * record,
+    gconstpointer payload)
+{
+  g_mutex_lock (capture->mutex);
+  record->time = now () - capture->start;
+  fwrite (record, sizeof (*record), 1, capture->file);
+  if (record->payload_len)
+    fwrite (payload, record->payload_len, 1, capture->file);
+  g_mutex_unlock (capture->mutex);
+}
+
+void
+g_omx_capture_port (GOmxCapture * capture, guint port_index,
+    guint num_buffers, gulong buffer_size)
+{
+  GOmxCaptureRecord record;
+
+  memset (&record, 0, sizeof (record));
+  record.type = GOMX_CAPTURE_PORT;
+  record.port_index = port_index;
+  record.filled_len = num_buffers;
+  record.flags = buffer_size;
+
+  capture_write (capture, &record, NULL);
+}
+
+void
+g_omx_capture_buffer (GOmxCapture * capture, GOmxCaptureType type,
+    guint port_index, guint buffer_index, OMX_BUFFERHEADERTYPE * omx_buffer)
+{
+  GOmxCaptureRecord record;
+
+  memset (&record, 0, sizeof (record));
+  record.type = type;
+  record.port_index = port_index;
+  record.buffer_index = buffer_index;
+  record.flags = omx_buffer->nFlags;
+  record.filled_len = omx_buffer->nFilledLen;
+  record.timestamp = omx_buffer->nTimeStamp;
+
+  if (capture->payload && type == GOMX_CAPTURE_EMPTY_THIS_BUFFER)
+    record.payload_len = omx_buffer->nFilledLen;
+
+  capture_write (capture, &record,
+      omx_buffer->pBuffer + omx_buffer->nOffset);
+}
+
+void
+g_omx_capture_state (GOmxCapture * capture, OMX_STATETYPE state)
+{
+  GOmxCaptureRecord record;
+
+  memset (&record, 0, sizeof (record));
+  record.type = GOMX_CAPTURE_STATE;
+  record.flags = state;
+
+  capture_write (capture, &record, NULL);
+}
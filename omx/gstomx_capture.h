@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2007-2009 Nokia Corporation.
+ *
+ * Author: Felipe Contreras <felipe.contreras@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef GSTOMX_CAPTURE_H
+#define GSTOMX_CAPTURE_H
+
+#include <glib.h>
+#include <OMX_Core.h>
+
+/*
+ * Buffer traffic capture
+ *
+ * With GST_OMX_CAPTURE=<prefix> every core writes <prefix>.<pid>.<n>.omxcap:
+ * a file header, one PORT record per allocated port, then a record for
+ * every header given to or returned by the component. Set
+ * GST_OMX_CAPTURE_PAYLOAD=1 to also store the input data.
+ *
+ * tools/gst-omx-replay plays a capture back against any component
+ * library. All fields are in host byte order; bump the version on any
+ * change.
+ */
+
+#define GOMX_CAPTURE_MAGIC "GOMXCAP"
+#define GOMX_CAPTURE_VERSION 1
+
+typedef struct GOmxCapture GOmxCapture;
+typedef struct GOmxCaptureHeader GOmxCaptureHeader;
+typedef struct GOmxCaptureRecord GOmxCaptureRecord;
+typedef enum GOmxCaptureType GOmxCaptureType;
+
+enum GOmxCaptureType
+{
+    GOMX_CAPTURE_PORT, /**< num_buffers in filled_len, size in flags. */
+    GOMX_CAPTURE_EMPTY_THIS_BUFFER,
+    GOMX_CAPTURE_FILL_THIS_BUFFER,
+    GOMX_CAPTURE_EMPTY_BUFFER_DONE,
+    GOMX_CAPTURE_FILL_BUFFER_DONE,
+    GOMX_CAPTURE_STATE /**< New state in flags. */
+};
+
+struct GOmxCaptureHeader
+{
+    gchar magic[8];
+    guint32 version;
+    guint32 payload; /**< Records carry input data. */
+    gchar component[64];
+};
+
+struct GOmxCaptureRecord
+{
+    guint8 type;
+    guint8 port_index;
+    guint16 buffer_index; /**< Which of the port's headers. */
+    guint32 flags;
+    guint32 filled_len;
+    guint32 payload_len; /**< Bytes following the record. */
+    gint64 time; /**< Since the capture started, in us. */
+    gint64 timestamp; /**< nTimeStamp */
+};
+
+GOmxCapture *g_omx_capture_open (const gchar *component);
+void g_omx_capture_close (GOmxCapture *capture);
+void g_omx_capture_port (GOmxCapture *capture, guint port_index,
+                         guint num_buffers, gulong buffer_size);
+void g_omx_capture_buffer (GOmxCapture *capture, GOmxCaptureType type,
+                           guint port_index, guint buffer_index,
+                           OMX_BUFFERHEADERTYPE *omx_buffer);
+void g_omx_capture_state (GOmxCapture *capture, OMX_STATETYPE state);
+
+#endif /* GSTOMX_CAPTURE_H */
@@ -0,0 +1,431 @@
+/*
+ * Copyright (C) 2007-2009 Nokia Corporation.
+ *
+ * Author: Felipe Contreras <felipe.contreras@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "gstomx_convert.h"
+
+#include <string.h>             /* For memcpy */
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+#define HAVE_NEON
+#include <arm_neon.h>
+#endif
+
+typedef void (*SplitRowFunc) (guint8 * u, guint8 * v, const guint8 * uv,
+    guint n, gboolean swap_uv);
+typedef void (*PackRowFunc) (guint8 * dest, const guint8 * y,
+    const guint8 * uv, guint width, gboolean uyvy, gboolean swap_uv);
+typedef void (*HalveRowFunc) (guint8 * dest, const guint8 * row0,
+    const guint8 * row1, guint width);
+
+/*
+ * Reference versions.
+ */
+
+/* n chroma pairs into two planes */
+static void
+split_row_c (guint8 * u, guint8 * v, const guint8 * uv, guint n,
+    gboolean swap_uv)
+{
+  guint i;
+
+  if (swap_uv) {
+    guint8 *tmp = u;
+    u = v;
+    v = tmp;
+  }
+
+  for (i = 0; i < n; i++) {
+    u[i] = uv[2 * i];
+    v[i] = uv[2 * i + 1];
+  }
+}
+
+/*
+ * width pixels of luma and their chroma pairs into YUY2 or UYVY; an odd
+ * last pixel gets only its luma and U, in the two bytes it has.
+ */
+static void
+pack_row_c (guint8 * dest, const guint8 * y, const guint8 * uv,
+    guint width, gboolean uyvy, gboolean swap_uv)
+{
+  guint u_index = swap_uv ? 1 : 0;
+  guint v_index = swap_uv ? 0 : 1;
+  guint i;
+
+  for (i = 0; i + 2 <= width; i += 2) {
+    if (uyvy) {
+      dest[0] = uv[u_index];
+      dest[1] = y[0];
+      dest[2] = uv[v_index];
+      dest[3] = y[1];
+    } else {
+      dest[0] = y[0];
+      dest[1] = uv[u_index];
+      dest[2] = y[1];
+      dest[3] = uv[v_index];
+    }
+    dest += 4;
+    y += 2;
+    uv += 2;
+  }
+
+  if (i < width) {
+    dest[uyvy ? 0 : 1] = uv[u_index];
+    dest[uyvy ? 1 : 0] = y[0];
+  }
+}
+
+/* width output pixels, each the rounded mean of a 2x2 block */
+static void
+halve_row_c (guint8 * dest, const guint8 * row0, const guint8 * row1,
+    guint width)
+{
+  guint i;
+
+  for (i = 0; i < width; i++)
+    dest[i] = (row0[2 * i] + row0[2 * i + 1] +
+        row1[2 * i] + row1[2 * i + 1] + 2) >> 2;
+}
+
+/*
+ * SIMD versions; each does whole blocks and leaves the rest to C.
+ */
+
+#if defined(__SSE2__)
+
+static void
+split_row_simd (guint8 * u, guint8 * v, const guint8 * uv, guint n,
+    gboolean swap_uv)
+{
+  const __m128i mask = _mm_set1_epi16 (0x00ff);
+  guint i;
+
+  if (swap_uv) {
+    guint8 *tmp = u;
+    u = v;
+    v = tmp;
+  }
+
+  for (i = 0; i + 16 <= n; i += 16) {
+    __m128i a, b;
+
+    a = _mm_loadu_si128 ((const __m128i *) (uv + 2 * i));
+    b = _mm_loadu_si128 ((const __m128i *) (uv + 2 * i + 16));
+
+    _mm_storeu_si128 ((__m128i *) (u + i),
+        _mm_packus_epi16 (_mm_and_si128 (a, mask), _mm_and_si128 (b, mask)));
+    _mm_storeu_si128 ((__m128i *) (v + i),
+        _mm_packus_epi16 (_mm_srli_epi16 (a, 8), _mm_srli_epi16 (b, 8)));
+  }
+
+  split_row_c (u + i, v + i, uv + 2 * i, n - i, FALSE);
+}
+
+static void
+pack_row_simd (guint8 * dest, const guint8 * y, const guint8 * uv,
+    guint width, gboolean uyvy, gboolean swap_uv)
+{
+  guint i;
+
+  for (i = 0; i + 16 <= width; i += 16) {
+    __m128i luma, chroma, lo, hi;
+
+    luma = _mm_loadu_si128 ((const __m128i *) (y + i));
+    chroma = _mm_loadu_si128 ((const __m128i *) (uv + i));
+    if (swap_uv)
+      chroma = _mm_or_si128 (_mm_slli_epi16 (chroma, 8),
+          _mm_srli_epi16 (chroma, 8));
+
+    /* Y U Y V is just luma and chroma bytes taking turns */
+    if (uyvy) {
+      lo = _mm_unpacklo_epi8 (chroma, luma);
+      hi = _mm_unpackhi_epi8 (chroma, luma);
+    } else {
+      lo = _mm_unpacklo_epi8 (luma, chroma);
+      hi = _mm_unpackhi_epi8 (luma, chroma);
+    }
+
+    _mm_storeu_si128 ((__m128i *) (dest + 2 * i), lo);
+    _mm_storeu_si128 ((__m128i *) (dest + 2 * i + 16), hi);
+  }
+
+  pack_row_c (dest + 2 * i, y + i, uv + i, width - i, uyvy, swap_uv);
+}
+
+static inline __m128i
+pair_sums (const guint8 * row0, const guint8 * row1)
+{
+  const __m128i mask = _mm_set1_epi16 (0x00ff);
+  __m128i a, b;
+
+  a = _mm_loadu_si128 ((const __m128i *) row0);
+  b = _mm_loadu_si128 ((const __m128i *) row1);
+
+  return _mm_add_epi16 (
+      _mm_add_epi16 (_mm_and_si128 (a, mask), _mm_srli_epi16 (a, 8)),
+      _mm_add_epi16 (_mm_and_si128 (b, mask), _mm_srli_epi16 (b, 8)));
+}
+
+static void
+halve_row_simd (guint8 * dest, const guint8 * row0, const guint8 * row1,
+    guint width)
+{
+  const __m128i two = _mm_set1_epi16 (2);
+  guint i;
+
+  for (i = 0; i + 16 <= width; i += 16) {
+    __m128i lo, hi;
+
+    lo = pair_sums (row0 + 2 * i, row1 + 2 * i);
+    hi = pair_sums (row0 + 2 * i + 16, row1 + 2 * i + 16);
+    lo = _mm_srli_epi16 (_mm_add_epi16 (lo, two), 2);
+    hi = _mm_srli_epi16 (_mm_add_epi16 (hi, two), 2);
+
+    _mm_storeu_si128 ((__m128i *) (dest + i), _mm_packus_epi16 (lo, hi));
+  }
+
+  halve_row_c (dest + i, row0 + 2 * i, row1 + 2 * i, width - i);
+}
+
+#elif defined(HAVE_NEON)
+
+static void
+split_row_simd (guint8 * u, guint8 * v, const guint8 * uv, guint n,
+    gboolean swap_uv)
+{
+  guint i;
+
+  if (swap_uv) {
+    guint8 *tmp = u;
+    u = v;
+    v = tmp;
+  }
+
+  for (i = 0; i + 16 <= n; i += 16) {
+    uint8x16x2_t pairs;
+
+    pairs = vld2q_u8 (uv + 2 * i);
+    vst1q_u8 (u + i, pairs.val[0]);
+    vst1q_u8 (v + i, pairs.val[1]);
+  }
+
+  split_row_c (u + i, v + i, uv + 2 * i, n - i, FALSE);
+}
+
+static void
+pack_row_simd (guint8 * dest, const guint8 * y, const guint8 * uv,
+    guint width, gboolean uyvy, gboolean swap_uv)
+{
+  guint i;
+
+  for (i = 0; i + 16 <= width; i += 16) {
+    uint8x16_t luma, chroma;
+    uint8x16x2_t out;
+
+    luma = vld1q_u8 (y + i);
+    chroma = vld1q_u8 (uv + i);
+    if (swap_uv)
+      chroma = vrev16q_u8 (chroma);
+
+    out = uyvy ? vzipq_u8 (chroma, luma) : vzipq_u8 (luma, chroma);
+    vst1q_u8 (dest + 2 * i, out.val[0]);
+    vst1q_u8 (dest + 2 * i + 16, out.val[1]);
+  }
+
+  pack_row_c (dest + 2 * i, y + i, uv + i, width - i, uyvy, swap_uv);
+}
+
+static void
+halve_row_simd (guint8 * dest, const guint8 * row0, const guint8 * row1,
+    guint width)
+{
+  guint i;
+
+  for (i = 0; i + 16 <= width; i += 16) {
+    uint16x8_t lo, hi;
+
+    lo = vaddq_u16 (vpaddlq_u8 (vld1q_u8 (row0 + 2 * i)),
+        vpaddlq_u8 (vld1q_u8 (row1 + 2 * i)));
+    hi = vaddq_u16 (vpaddlq_u8 (vld1q_u8 (row0 + 2 * i + 16)),
+        vpaddlq_u8 (vld1q_u8 (row1 + 2 * i + 16)));
+
+    vst1q_u8 (dest + i, vcombine_u8 (vrshrn_n_u16 (lo, 2),
+            vrshrn_n_u16 (hi, 2)));
+  }
+
+  halve_row_c (dest + i, row0 + 2 * i, row1 + 2 * i, width - i);
+}
+
+#else
+
+#define split_row_simd split_row_c
+#define pack_row_simd pack_row_c
+#define halve_row_simd halve_row_c
+
+#endif
+
+static SplitRowFunc split_row = split_row_simd;
+static PackRowFunc pack_row = pack_row_simd;
+static HalveRowFunc halve_row = halve_row_simd;
+
+void
+g_omx_convert_use_simd (gboolean enable)
+{
+  split_row = enable ? split_row_simd : split_row_c;
+  pack_row = enable ? pack_row_simd : pack_row_c;
+  halve_row = enable ? halve_row_simd : halve_row_c;
+}
+
+void
+g_omx_convert_source_init (GOmxConvertSource * src, const guint8 * frame,
+    guint stride, guint slice_height, guint crop_left, guint crop_top,
+    gboolean swap_uv)
+{
+  src->y = frame + crop_top * stride + crop_left;
+  src->uv = frame + stride * slice_height + (crop_top / 2) * stride +
+      (crop_left & ~1);
+  src->y_stride = stride;
+  src->uv_stride = stride;
+  src->swap_uv = swap_uv;
+}
+
+gsize
+g_omx_frame_size (guint stride, guint slice_height, gboolean planar)
+{
+  gsize size = (gsize) stride * slice_height;
+
+  return planar ? size * 3 / 2 : size;
+}
+
+void
+g_omx_copy_plane (guint8 * dest, guint dest_stride,
+    const guint8 * src, guint src_stride, guint row_bytes, guint rows)
+{
+  guint i;
+
+  /* only bottom padding or crop; one go */
+  if (dest_stride == src_stride && rows) {
+    memcpy (dest, src, dest_stride * (rows - 1) + row_bytes);
+    return;
+  }
+
+  for (i = 0; i < rows; i++) {
+    memcpy (dest, src, row_bytes);
+    dest += dest_stride;
+    src += src_stride;
+  }
+}
+
+void
+g_omx_convert_to_i420 (const GOmxConvertSource * src,
+    guint8 * dest_y, guint8 * dest_u, guint8 * dest_v,
+    guint dest_stride, guint width, guint height)
+{
+  guint i;
+
+  for (i = 0; i < height; i++)
+    memcpy (dest_y + i * dest_stride, src->y + i * src->y_stride, width);
+
+  for (i = 0; i < (height + 1) / 2; i++)
+    split_row (dest_u + i * ((dest_stride + 1) / 2),
+        dest_v + i * ((dest_stride + 1) / 2),
+        src->uv + i * src->uv_stride, (width + 1) / 2, src->swap_uv);
+}
+
+void
+g_omx_convert_to_packed (const GOmxConvertSource * src,
+    guint8 * dest, guint dest_stride, gboolean uyvy,
+    guint width, guint height)
+{
+  guint i;
+
+  /* both luma rows of a pair share the chroma row */
+  for (i = 0; i < height; i++)
+    pack_row (dest + i * dest_stride, src->y + i * src->y_stride,
+        src->uv + (i / 2) * src->uv_stride, width, uyvy, src->swap_uv);
+}
+
+/* Area average for shrinking by less than two in each direction. */
+static void
+box_scale (const guint8 * src, guint src_stride,
+    guint src_width, guint src_height,
+    guint8 * dest, guint dest_stride, guint dest_width, guint dest_height)
+{
+  guint x;
+  guint y;
+
+  for (y = 0; y < dest_height; y++) {
+    guint y0 = y * src_height / dest_height;
+    guint y1 = MAX ((y + 1) * src_height / dest_height, y0 + 1);
+
+    for (x = 0; x < dest_width; x++) {
+      guint x0 = x * src_width / dest_width;
+      guint x1 = MAX ((x + 1) * src_width / dest_width, x0 + 1);
+      guint count = (x1 - x0) * (y1 - y0);
+      guint sum = 0;
+      guint i;
+      guint j;
+
+      for (j = y0; j < y1; j++)
+        for (i = x0; i < x1; i++)
+          sum += src[j * src_stride + i];
+
+      dest[y * dest_stride + x] = (sum + count / 2) / count;
+    }
+  }
+}
+
+void
+g_omx_scale_plane (const guint8 * src, guint src_stride,
+    guint src_width, guint src_height,
+    guint8 * dest, guint dest_stride, guint dest_width, guint dest_height,
+    guint8 * scratch)
+{
+  guint width = src_width;
+  guint height = src_height;
+
+  /* halve into scratch, then in place; row i only overwrites rows before 2i */
+  while (width >= 2 * dest_width && height >= 2 * dest_height) {
+    guint i;
+
+    for (i = 0; i < height / 2; i++)
+      halve_row (scratch + i * (width / 2), src + 2 * i * src_stride,
+          src + (2 * i + 1) * src_stride, width / 2);
+
+    width /= 2;
+    height /= 2;
+    src = scratch;
+    src_stride = width;
+  }
+
+  if (width == dest_width && height == dest_height) {
+    guint i;
+
+    for (i = 0; i < height; i++)
+      memcpy (dest + i * dest_stride, src + i * src_stride, width);
+    return;
+  }
+
+  box_scale (src, src_stride, width, height,
+      dest, dest_stride, dest_width, dest_height);
+}
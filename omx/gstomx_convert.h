@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2007-2009 Nokia Corporation.
+ *
+ * Author: Felipe Contreras <felipe.contreras@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef GSTOMX_CONVERT_H
+#define GSTOMX_CONVERT_H
+
+#include <glib.h>
+
+/*
+ * Color format conversion
+ *
+ * Turns the semi-planar 4:2:0 output of many hardware decoders (one luma
+ * plane, one plane of interleaved chroma pairs) into formats downstream
+ * understands. Rows are converted with SSE2 or NEON when the compiler
+ * targets them, and with plain C otherwise; g_omx_convert_use_simd() lets
+ * the tests compare the two.
+ *
+ * Odd widths and heights are fine: the last chroma pair or row covers a
+ * single pixel, and packed rows end in half a pair. Strides are in bytes.
+ *
+ * g_omx_scale_plane() shrinks one 8-bit plane by area averaging: exact
+ * halvings first, which vectorize, then a box filter for what is left.
+ *
+ * The decoders share the layout helpers: a 4:2:0 frame is the luma plane,
+ * stride by slice height, followed by the chroma at the same stride.
+ */
+
+/* Qualcomm's NV21 */
+#define OMX_QCOM_COLOR_FormatYVU420SemiPlanar 0x7FA30C00
+
+typedef struct GOmxConvertSource GOmxConvertSource;
+
+struct GOmxConvertSource
+{
+    const guint8 *y;
+    const guint8 *uv;
+    guint y_stride;
+    guint uv_stride;
+    gboolean swap_uv; /**< Pairs are V U, as in NV21. */
+};
+
+void g_omx_convert_use_simd (gboolean enable);
+
+/** Where the visible part of a semi-planar frame starts; crops are even. */
+void g_omx_convert_source_init (GOmxConvertSource *src, const guint8 *frame,
+                                guint stride, guint slice_height,
+                                guint crop_left, guint crop_top,
+                                gboolean swap_uv);
+/** Bytes a component fills for one frame; planar means 4:2:0. */
+gsize g_omx_frame_size (guint stride, guint slice_height, gboolean planar);
+void g_omx_copy_plane (guint8 *dest, guint dest_stride,
+                       const guint8 *src, guint src_stride,
+                       guint row_bytes, guint rows);
+
+void g_omx_convert_to_i420 (const GOmxConvertSource *src,
+                            guint8 *dest_y, guint8 *dest_u, guint8 *dest_v,
+                            guint dest_stride, guint width, guint height);
+void g_omx_convert_to_packed (const GOmxConvertSource *src,
+                              guint8 *dest, guint dest_stride, gboolean uyvy,
+                              guint width, guint height);
+
+/** scratch must hold (src_width / 2) * (src_height / 2) bytes. */
+void g_omx_scale_plane (const guint8 *src, guint src_stride,
+                        guint src_width, guint src_height,
+                        guint8 *dest, guint dest_stride,
+                        guint dest_width, guint dest_height,
+                        guint8 *scratch);
+
+#endif /* GSTOMX_CONVERT_H */
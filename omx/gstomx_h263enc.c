@@ -22,7 +22,6 @@
 #include "gstomx_h263enc.h"
 #include "gstomx.h"
 
-#include <stdlib.h>             /* For calloc, free */
 
 #define OMX_COMPONENT_NAME "OMX.st.video_encoder.h263"
 
@@ -93,21 +92,11 @@ settings_changed_cb (GOmxCore * core)
   {
     OMX_PARAM_PORTDEFINITIONTYPE *param;
 
-    param = calloc (1, sizeof (OMX_PARAM_PORTDEFINITIONTYPE));
-
-    param->nSize = sizeof (OMX_PARAM_PORTDEFINITIONTYPE);
-    param->nVersion.s.nVersionMajor = 1;
-    param->nVersion.s.nVersionMinor = 1;
-
-    param->nPortIndex = 1;
-    OMX_GetParameter (omx_base->gomx->omx_handle, OMX_IndexParamPortDefinition,
-        param);
+    param = g_omx_port_get_definition (omx_base->out_port);
 
     width = param->format.video.nFrameWidth;
     height = param->format.video.nFrameHeight;
     framerate = param->format.video.xFramerate;
-
-    free (param);
   }
 
   {
@@ -20,14 +20,53 @@
  */
 
 #include "gstomx_h264enc.h"
+#include "gstomx_bitstream.h"
 #include "gstomx.h"
 
-#include <stdlib.h>             /* For calloc, free */
+#include <string.h>
+
+enum
+{
+  ARG_0,
+  ARG_STREAM_FORMAT,
+  ARG_PARTIAL_NALS
+};
+
+#define DEFAULT_STREAM_FORMAT GST_OMX_H264ENC_STREAM_FORMAT_BYTE_STREAM
+#define DEFAULT_PARTIAL_NALS FALSE
 
 #define OMX_COMPONENT_NAME "OMX.st.video_encoder.avc"
 
 static GstOmxBaseFilterClass *parent_class = NULL;
 
+#define GST_TYPE_OMX_H264ENC_STREAM_FORMAT (gst_omx_h264enc_stream_format_get_type ())
+static GType
+gst_omx_h264enc_stream_format_get_type (void)
+{
+  static GType gst_omx_h264enc_stream_format_type = 0;
+
+  if (!gst_omx_h264enc_stream_format_type) {
+    static GEnumValue gst_omx_h264enc_stream_format[] = {
+      {GST_OMX_H264ENC_STREAM_FORMAT_BYTE_STREAM, "Start codes", "byte-stream"},
+      {GST_OMX_H264ENC_STREAM_FORMAT_AVC,
+          "Length-prefixed NAL units, avcC codec data", "avc"},
+      {0, NULL, NULL},
+    };
+
+    gst_omx_h264enc_stream_format_type =
+        g_enum_register_static ("GstOmxH264EncStreamFormat",
+        gst_omx_h264enc_stream_format);
+  }
+
+  return gst_omx_h264enc_stream_format_type;
+}
+
+static const gchar *
+stream_format_name (GstOmxH264EncStreamFormat format)
+{
+  return format == GST_OMX_H264ENC_STREAM_FORMAT_AVC ? "avc" : "byte-stream";
+}
+
 static GstCaps *
 generate_src_template (void)
 {
@@ -38,6 +77,46 @@ generate_src_template (void)
       "height", GST_TYPE_INT_RANGE, 16, 4096,
       "framerate", GST_TYPE_FRACTION_RANGE, 0, 1, 30, 1, NULL);
 
+  {
+    GValue list = { 0 };
+    GValue val = { 0 };
+
+    g_value_init (&list, GST_TYPE_LIST);
+    g_value_init (&val, G_TYPE_STRING);
+
+    g_value_set_static_string (&val, "byte-stream");
+    gst_value_list_append_value (&list, &val);
+
+    g_value_set_static_string (&val, "avc");
+    gst_value_list_append_value (&list, &val);
+
+    gst_structure_set_value (gst_caps_get_structure (caps, 0),
+        "stream-format", &list);
+
+    g_value_unset (&val);
+    g_value_unset (&list);
+  }
+
+  {
+    GValue list = { 0 };
+    GValue val = { 0 };
+
+    g_value_init (&list, GST_TYPE_LIST);
+    g_value_init (&val, G_TYPE_STRING);
+
+    g_value_set_static_string (&val, "au");
+    gst_value_list_append_value (&list, &val);
+
+    g_value_set_static_string (&val, "nal");
+    gst_value_list_append_value (&list, &val);
+
+    gst_structure_set_value (gst_caps_get_structure (caps, 0),
+        "alignment", &list);
+
+    g_value_unset (&val);
+    g_value_unset (&list);
+  }
+
   return caps;
 }
 
@@ -71,42 +150,101 @@ type_base_init (gpointer g_class)
   }
 }
 
+static void
+set_property (GObject * obj,
+    guint prop_id, const GValue * value, GParamSpec * pspec)
+{
+  GstOmxH264Enc *self;
+
+  self = GST_OMX_H264ENC (obj);
+
+  switch (prop_id) {
+    case ARG_STREAM_FORMAT:
+      self->stream_format = g_value_get_enum (value);
+      break;
+    case ARG_PARTIAL_NALS:
+      self->partial_nals = g_value_get_boolean (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (obj, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+get_property (GObject * obj, guint prop_id, GValue * value, GParamSpec * pspec)
+{
+  GstOmxH264Enc *self;
+
+  self = GST_OMX_H264ENC (obj);
+
+  switch (prop_id) {
+    case ARG_STREAM_FORMAT:
+      g_value_set_enum (value, self->stream_format);
+      break;
+    case ARG_PARTIAL_NALS:
+      g_value_set_boolean (value, self->partial_nals);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (obj, prop_id, pspec);
+      break;
+  }
+}
+
 static void
 type_class_init (gpointer g_class, gpointer class_data)
 {
+  GObjectClass *gobject_class;
+
+  gobject_class = G_OBJECT_CLASS (g_class);
+
   parent_class = g_type_class_ref (GST_OMX_BASE_FILTER_TYPE);
+
+  /* Properties stuff */
+  {
+    gobject_class->set_property = set_property;
+    gobject_class->get_property = get_property;
+
+    g_object_class_install_property (gobject_class, ARG_STREAM_FORMAT,
+        g_param_spec_enum ("stream-format", "Stream format",
+            "How NAL units are delimited; avc spares downstream "
+            "from scanning for them",
+            GST_TYPE_OMX_H264ENC_STREAM_FORMAT, DEFAULT_STREAM_FORMAT,
+            G_PARAM_READWRITE));
+
+    g_object_class_install_property (gobject_class, ARG_PARTIAL_NALS,
+        g_param_spec_boolean ("partial-nals", "Partial NAL units",
+            "The component may end a slice buffer in the middle of a NAL "
+            "unit; hold the last one back until its frame ends",
+            DEFAULT_PARTIAL_NALS, G_PARAM_READWRITE));
+  }
 }
 
+static GList *split_output (GstOmxBaseFilter * omx_base, GstBuffer * buf,
+    GstBuffer ** rest);
+
 static void
 settings_changed_cb (GOmxCore * core)
 {
   GstOmxBaseFilter *omx_base;
+  GstOmxH264Enc *self;
   guint width;
   guint height;
   guint framerate;
 
   omx_base = core->client_data;
+  self = GST_OMX_H264ENC (omx_base);
 
   GST_DEBUG_OBJECT (omx_base, "settings changed");
 
   {
     OMX_PARAM_PORTDEFINITIONTYPE *param;
 
-    param = calloc (1, sizeof (OMX_PARAM_PORTDEFINITIONTYPE));
-
-    param->nSize = sizeof (OMX_PARAM_PORTDEFINITIONTYPE);
-    param->nVersion.s.nVersionMajor = 1;
-    param->nVersion.s.nVersionMinor = 1;
-
-    param->nPortIndex = 1;
-    OMX_GetParameter (omx_base->gomx->omx_handle, OMX_IndexParamPortDefinition,
-        param);
+    param = g_omx_port_get_definition (omx_base->out_port);
 
     width = param->format.video.nFrameWidth;
     height = param->format.video.nFrameHeight;
     framerate = param->format.video.xFramerate;
-
-    free (param);
   }
 
   {
@@ -115,11 +253,188 @@ settings_changed_cb (GOmxCore * core)
     new_caps = gst_caps_new_simple ("video/x-h264",
         "width", G_TYPE_INT, width,
         "height", G_TYPE_INT, height,
-        "framerate", GST_TYPE_FRACTION, framerate, 1, NULL);
+        "framerate", GST_TYPE_FRACTION, framerate, 1,
+        "stream-format", G_TYPE_STRING,
+        stream_format_name (self->stream_format),
+        "alignment", G_TYPE_STRING,
+        self->omx_base.slice_spacing > 0 ? "nal" : "au", NULL);
 
     GST_INFO_OBJECT (omx_base, "caps are: %" GST_PTR_FORMAT, new_caps);
     gst_pad_set_caps (omx_base->srcpad, new_caps);
   }
+
+  /* slices may share output buffers, or straddle them if so configured */
+  if (self->omx_base.slice_spacing > 0)
+    omx_base->split_output = split_output;
+  else
+    omx_base->split_output = NULL;
+  omx_base->partial_units = self->partial_nals;
+}
+
+#define MAX_NALS 64
+
+/* Start codes to 4-byte lengths; in place when they all are 4 bytes. */
+static GstBuffer *
+to_avc (GstOmxH264Enc * self, GstBuffer * buf)
+{
+  GOmxNal stack_nals[MAX_NALS];
+  GOmxNal *nals = stack_nals;
+  const guint8 *data;
+  guint8 *dest;
+  guint n_nals;
+  guint size = 0;
+  guint i;
+  gboolean in_place;
+
+  data = GST_BUFFER_DATA (buf);
+  n_nals = g_omx_h264_split (data, GST_BUFFER_SIZE (buf), nals, MAX_NALS);
+  if (G_UNLIKELY (!n_nals)) {
+    GST_WARNING_OBJECT (self, "no start codes, passing as is");
+    return buf;
+  }
+  if (G_UNLIKELY (n_nals > MAX_NALS)) {
+    nals = g_new (GOmxNal, n_nals);
+    g_omx_h264_split (data, GST_BUFFER_SIZE (buf), nals, n_nals);
+  }
+
+  for (i = 0; i < n_nals; i++)
+    size += 4 + nals[i].size;
+
+  /* every start code must be 4 bytes for the lengths to fit in place */
+  in_place = size == GST_BUFFER_SIZE (buf) && nals[0].offset == 4;
+  for (i = 1; in_place && i < n_nals; i++)
+    in_place = nals[i].offset == nals[i - 1].offset + nals[i - 1].size + 4;
+
+  if (in_place) {
+    dest = GST_BUFFER_DATA (buf);
+  } else {
+    GstBuffer *out;
+
+    GST_LOG_OBJECT (self, "short start codes, copying");
+    out = gst_buffer_new_and_alloc (size);
+    gst_buffer_copy_metadata (out, buf, GST_BUFFER_COPY_ALL);
+    dest = GST_BUFFER_DATA (out);
+
+    for (i = 0; i < n_nals; i++) {
+      memcpy (dest + 4, data + nals[i].offset, nals[i].size);
+      dest += 4 + nals[i].size;
+    }
+
+    gst_buffer_unref (buf);
+    buf = out;
+    dest = GST_BUFFER_DATA (out);
+  }
+
+  for (i = 0; i < n_nals; i++) {
+    GST_WRITE_UINT32_BE (dest, nals[i].size);
+    dest += 4 + nals[i].size;
+  }
+
+  if (nals != stack_nals)
+    g_free (nals);
+
+  return buf;
+}
+
+/* One NAL unit per buffer, for alignment=nal. */
+static GList *
+split_output (GstOmxBaseFilter * omx_base, GstBuffer * buf, GstBuffer ** rest)
+{
+  GstOmxH264Enc *self;
+  GOmxNal stack_nals[MAX_NALS];
+  GOmxNal *nals = stack_nals;
+  GList *units = NULL;
+  const guint8 *data;
+  guint n_nals;
+  guint n_whole;
+  guint start = 0;
+  guint i;
+
+  self = GST_OMX_H264ENC (omx_base);
+
+  data = GST_BUFFER_DATA (buf);
+  n_nals = g_omx_h264_split (data, GST_BUFFER_SIZE (buf), nals, MAX_NALS);
+  if (G_UNLIKELY (!n_nals)) {
+    if (rest) {
+      /* a start code may be cut in two */
+      *rest = buf;
+      return NULL;
+    }
+    GST_WARNING_OBJECT (self, "no start codes, passing as is");
+    return g_list_append (NULL, buf);
+  }
+  if (G_UNLIKELY (n_nals > MAX_NALS)) {
+    nals = g_new (GOmxNal, n_nals);
+    g_omx_h264_split (data, GST_BUFFER_SIZE (buf), nals, n_nals);
+  }
+
+  /* the last one may go on in the next buffer */
+  n_whole = rest ? n_nals - 1 : n_nals;
+
+  for (i = 0; i < n_whole; i++) {
+    GstBuffer *unit;
+    guint end;
+
+    /* zeros before a start code go with it */
+    end = nals[i].offset + nals[i].size;
+    unit = gst_buffer_create_sub (buf, start, end - start);
+    gst_buffer_copy_metadata (unit, buf, GST_BUFFER_COPY_ALL);
+    start = end;
+
+    if (self->stream_format == GST_OMX_H264ENC_STREAM_FORMAT_AVC)
+      unit = to_avc (self, unit);
+
+    units = g_list_append (units, unit);
+  }
+
+  if (rest) {
+    *rest = gst_buffer_create_sub (buf, start, GST_BUFFER_SIZE (buf) - start);
+    gst_buffer_copy_metadata (*rest, buf, GST_BUFFER_COPY_ALL);
+  }
+
+  if (nals != stack_nals)
+    g_free (nals);
+  gst_buffer_unref (buf);
+
+  return units;
+}
+
+static GstBuffer *
+process_output (GstOmxBaseFilter * omx_base, GstBuffer * buf,
+    guint32 omx_flags)
+{
+  GstOmxH264Enc *self;
+
+  self = GST_OMX_H264ENC (omx_base);
+
+  if (self->stream_format != GST_OMX_H264ENC_STREAM_FORMAT_AVC)
+    return buf;
+
+  if (omx_flags & OMX_BUFFERFLAG_CODECCONFIG) {
+    GstBuffer *avcc;
+    guint size;
+
+    avcc = gst_buffer_new_and_alloc (GST_BUFFER_SIZE (buf) + 8);
+    size = g_omx_h264_avcc (GST_BUFFER_DATA (buf), GST_BUFFER_SIZE (buf),
+        GST_BUFFER_DATA (avcc), GST_BUFFER_SIZE (avcc));
+
+    if (!size) {
+      GST_WARNING_OBJECT (self, "no SPS in codec config");
+      gst_buffer_unref (avcc);
+      return buf;
+    }
+
+    GST_BUFFER_SIZE (avcc) = size;
+    gst_buffer_unref (buf);
+
+    return avcc;
+  }
+
+  /* split_output converts each NAL unit on its own */
+  if (omx_base->split_output)
+    return buf;
+
+  return to_avc (self, buf);
 }
 
 static void
@@ -127,14 +442,20 @@ type_instance_init (GTypeInstance * instance, gpointer g_class)
 {
   GstOmxBaseFilter *omx_base_filter;
   GstOmxBaseVideoEnc *omx_base;
+  GstOmxH264Enc *self;
 
   omx_base_filter = GST_OMX_BASE_FILTER (instance);
   omx_base = GST_OMX_BASE_VIDEOENC (instance);
+  self = GST_OMX_H264ENC (instance);
 
   omx_base_filter->omx_component = g_strdup (OMX_COMPONENT_NAME);
   omx_base->compression_format = OMX_VIDEO_CodingAVC;
 
   omx_base_filter->gomx->settings_changed_cb = settings_changed_cb;
+  omx_base_filter->process_output = process_output;
+
+  self->stream_format = DEFAULT_STREAM_FORMAT;
+  self->partial_nals = DEFAULT_PARTIAL_NALS;
 }
 
 GType
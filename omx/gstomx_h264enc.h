@@ -32,11 +32,20 @@ G_BEGIN_DECLS
 typedef struct GstOmxH264Enc GstOmxH264Enc;
 typedef struct GstOmxH264EncClass GstOmxH264EncClass;
 
+typedef enum
+{
+    GST_OMX_H264ENC_STREAM_FORMAT_BYTE_STREAM,
+    GST_OMX_H264ENC_STREAM_FORMAT_AVC
+} GstOmxH264EncStreamFormat;
+
 #include "gstomx_base_videoenc.h"
 
 struct GstOmxH264Enc
 {
     GstOmxBaseVideoEnc omx_base;
+
+    GstOmxH264EncStreamFormat stream_format;
+    gboolean partial_nals; /**< Slice buffers may end mid-unit. */
 };
 
 struct GstOmxH264EncClass
@@ -0,0 +1,728 @@
+/*
+ * Copyright (C) 2008-2009 Nokia Corporation.
+ *
+ * Author: Felipe Contreras <felipe.contreras@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+
+#include "gstomx_jpegdec.h"
+#include "gstomx_base_filter.h"
+#include "gstomx_convert.h"
+#include "gstomx.h"
+
+#include <string.h>
+
+enum
+{
+  ARG_0,
+  ARG_SCALE,
+  ARG_ROI_LEFT,
+  ARG_ROI_TOP,
+  ARG_ROI_WIDTH,
+  ARG_ROI_HEIGHT
+};
+
+#define DEFAULT_SCALE GST_OMX_JPEGDEC_SCALE_1
+
+#define OMX_COMPONENT_NAME "OMX.st.image_decoder.jpeg"
+
+static GstOmxBaseFilterClass *parent_class = NULL;
+
+#define GST_TYPE_OMX_JPEGDEC_SCALE (gst_omx_jpegdec_scale_get_type ())
+static GType
+gst_omx_jpegdec_scale_get_type (void)
+{
+  static GType gst_omx_jpegdec_scale_type = 0;
+
+  if (!gst_omx_jpegdec_scale_type) {
+    static GEnumValue gst_omx_jpegdec_scale[] = {
+      {GST_OMX_JPEGDEC_SCALE_1, "Full size", "1/1"},
+      {GST_OMX_JPEGDEC_SCALE_2, "Half size", "1/2"},
+      {GST_OMX_JPEGDEC_SCALE_4, "Quarter size", "1/4"},
+      {GST_OMX_JPEGDEC_SCALE_8, "Eighth size", "1/8"},
+      {0, NULL, NULL},
+    };
+
+    gst_omx_jpegdec_scale_type = g_enum_register_static ("GstOmxJpegDecScale",
+        gst_omx_jpegdec_scale);
+  }
+
+  return gst_omx_jpegdec_scale_type;
+}
+
+static GstCaps *
+generate_src_template (void)
+{
+  GstCaps *caps;
+  GstStructure *struc;
+
+  caps = gst_caps_new_empty ();
+
+  struc = gst_structure_new ("video/x-raw-yuv",
+      "width", GST_TYPE_INT_RANGE, 2, 4096,
+      "height", GST_TYPE_INT_RANGE, 2, 4096,
+      "framerate", GST_TYPE_FRACTION_RANGE, 0, 1, G_MAXINT, 1, NULL);
+
+  {
+    GValue list = { 0 };
+    GValue val = { 0 };
+
+    g_value_init (&list, GST_TYPE_LIST);
+    g_value_init (&val, GST_TYPE_FOURCC);
+
+    gst_value_set_fourcc (&val, GST_MAKE_FOURCC ('I', '4', '2', '0'));
+    gst_value_list_append_value (&list, &val);
+
+    gst_value_set_fourcc (&val, GST_MAKE_FOURCC ('Y', 'U', 'Y', '2'));
+    gst_value_list_append_value (&list, &val);
+
+    gst_value_set_fourcc (&val, GST_MAKE_FOURCC ('U', 'Y', 'V', 'Y'));
+    gst_value_list_append_value (&list, &val);
+
+    gst_structure_set_value (struc, "format", &list);
+
+    g_value_unset (&val);
+    g_value_unset (&list);
+  }
+
+  gst_caps_append_structure (caps, struc);
+
+  return caps;
+}
+
+static GstCaps *
+generate_sink_template (void)
+{
+  GstCaps *caps;
+
+  caps = gst_caps_new_simple ("image/jpeg",
+      "width", GST_TYPE_INT_RANGE, 16, 4096,
+      "height", GST_TYPE_INT_RANGE, 16, 4096,
+      "framerate", GST_TYPE_FRACTION_RANGE, 0, 1, G_MAXINT, 1, NULL);
+
+  return caps;
+}
+
+static void
+type_base_init (gpointer g_class)
+{
+  GstElementClass *element_class;
+
+  element_class = GST_ELEMENT_CLASS (g_class);
+
+  {
+    GstElementDetails details;
+
+    details.longname = "OpenMAX IL JPEG image decoder";
+    details.klass = "Codec/Decoder/Image";
+    details.description = "Decodes JPEG images and MJPEG with OpenMAX IL";
+    details.author = "Felipe Contreras";
+
+    gst_element_class_set_details (element_class, &details);
+  }
+
+  {
+    GstPadTemplate *template;
+
+    template = gst_pad_template_new ("src", GST_PAD_SRC,
+        GST_PAD_ALWAYS, generate_src_template ());
+
+    gst_element_class_add_pad_template (element_class, template);
+  }
+
+  {
+    GstPadTemplate *template;
+
+    template = gst_pad_template_new ("sink", GST_PAD_SINK,
+        GST_PAD_ALWAYS, generate_sink_template ());
+
+    gst_element_class_add_pad_template (element_class, template);
+  }
+}
+
+static void
+dispose (GObject * obj)
+{
+  GstOmxJpegDec *self;
+
+  self = GST_OMX_JPEGDEC (obj);
+
+  g_free (self->scratch);
+  self->scratch = NULL;
+  g_free (self->frame);
+  self->frame = NULL;
+
+  G_OBJECT_CLASS (parent_class)->dispose (obj);
+}
+
+static void
+set_property (GObject * obj,
+    guint prop_id, const GValue * value, GParamSpec * pspec)
+{
+  GstOmxJpegDec *self;
+
+  self = GST_OMX_JPEGDEC (obj);
+
+  switch (prop_id) {
+    case ARG_SCALE:
+      self->scale = g_value_get_enum (value);
+      break;
+    case ARG_ROI_LEFT:
+      self->roi_left = g_value_get_uint (value);
+      break;
+    case ARG_ROI_TOP:
+      self->roi_top = g_value_get_uint (value);
+      break;
+    case ARG_ROI_WIDTH:
+      self->roi_width = g_value_get_uint (value);
+      break;
+    case ARG_ROI_HEIGHT:
+      self->roi_height = g_value_get_uint (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (obj, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+get_property (GObject * obj, guint prop_id, GValue * value, GParamSpec * pspec)
+{
+  GstOmxJpegDec *self;
+
+  self = GST_OMX_JPEGDEC (obj);
+
+  switch (prop_id) {
+    case ARG_SCALE:
+      g_value_set_enum (value, self->scale);
+      break;
+    case ARG_ROI_LEFT:
+      g_value_set_uint (value, self->roi_left);
+      break;
+    case ARG_ROI_TOP:
+      g_value_set_uint (value, self->roi_top);
+      break;
+    case ARG_ROI_WIDTH:
+      g_value_set_uint (value, self->roi_width);
+      break;
+    case ARG_ROI_HEIGHT:
+      g_value_set_uint (value, self->roi_height);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (obj, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+type_class_init (gpointer g_class, gpointer class_data)
+{
+  GObjectClass *gobject_class;
+
+  gobject_class = G_OBJECT_CLASS (g_class);
+
+  parent_class = g_type_class_ref (GST_OMX_BASE_FILTER_TYPE);
+
+  gobject_class->dispose = dispose;
+
+  /* Properties stuff */
+  {
+    gobject_class->set_property = set_property;
+    gobject_class->get_property = get_property;
+
+    g_object_class_install_property (gobject_class, ARG_SCALE,
+        g_param_spec_enum ("scale", "Scale",
+            "Decode at a fraction of the size",
+            GST_TYPE_OMX_JPEGDEC_SCALE, DEFAULT_SCALE, G_PARAM_READWRITE));
+
+    g_object_class_install_property (gobject_class, ARG_ROI_LEFT,
+        g_param_spec_uint ("roi-left", "ROI left",
+            "Left edge of the region to decode, in image pixels",
+            0, G_MAXUINT, 0, G_PARAM_READWRITE));
+
+    g_object_class_install_property (gobject_class, ARG_ROI_TOP,
+        g_param_spec_uint ("roi-top", "ROI top",
+            "Top edge of the region to decode, in image pixels",
+            0, G_MAXUINT, 0, G_PARAM_READWRITE));
+
+    g_object_class_install_property (gobject_class, ARG_ROI_WIDTH,
+        g_param_spec_uint ("roi-width", "ROI width",
+            "Width of the region to decode (0 reaches the right edge)",
+            0, G_MAXUINT, 0, G_PARAM_READWRITE));
+
+    g_object_class_install_property (gobject_class, ARG_ROI_HEIGHT,
+        g_param_spec_uint ("roi-height", "ROI height",
+            "Height of the region to decode (0 reaches the bottom edge)",
+            0, G_MAXUINT, 0, G_PARAM_READWRITE));
+  }
+}
+
+static inline gboolean
+has_roi (GstOmxJpegDec * self)
+{
+  return self->roi_left || self->roi_top || self->roi_width || self->roi_height;
+}
+
+static inline gboolean
+is_planar (guint32 format)
+{
+  return format == GST_MAKE_FOURCC ('I', '4', '2', '0');
+}
+
+/* Cut what the component didn't, shrink what it didn't. */
+static gboolean
+copy_output (GstOmxBaseFilter * omx_base, guint8 * dest,
+    OMX_BUFFERHEADERTYPE * omx_buffer)
+{
+  GstOmxJpegDec *self;
+  const guint8 *src;
+  guint stride;
+  guint slice_height;
+  guint crop_left;
+  guint crop_top;
+  guint width;
+  guint height;
+  guint out_width;
+  guint out_height;
+  guint plane;
+  gsize needed;
+
+  self = GST_OMX_JPEGDEC (omx_base);
+  src = omx_buffer->pBuffer + omx_buffer->nOffset;
+  stride = self->stride;
+  slice_height = self->slice_height;
+  crop_left = self->crop_left;
+  crop_top = self->crop_top;
+  width = self->width;
+  height = self->height;
+  out_width = self->out_width;
+  out_height = self->out_height;
+
+  if (G_UNLIKELY (!self->format))
+    return FALSE;
+
+  /* the planes are read at the configured layout, whatever was filled */
+  needed = g_omx_frame_size (stride, slice_height, is_planar (self->format));
+  if (G_UNLIKELY (omx_buffer->nFilledLen < needed)) {
+    GST_WARNING_OBJECT (self, "short frame: %lu < %" G_GSIZE_FORMAT,
+        (gulong) omx_buffer->nFilledLen, needed);
+    return FALSE;
+  }
+
+  if (self->semi_planar) {
+    GOmxConvertSource source;
+    guint8 *frame = dest;
+
+    g_omx_convert_source_init (&source, src, stride, slice_height,
+        crop_left, crop_top, self->swap_uv);
+
+    /* straight to the output, or to a frame to scale from */
+    if (out_width != width || out_height != height) {
+      needed = width * height + 2 * ((width / 2) * (height / 2));
+      if (self->frame_size < needed) {
+        self->frame = g_realloc (self->frame, needed);
+        self->frame_size = needed;
+      }
+      frame = self->frame;
+    }
+
+    g_omx_convert_to_i420 (&source, frame, frame + width * height,
+        frame + width * height + (width / 2) * (height / 2),
+        width, width, height);
+
+    if (frame == dest)
+      return TRUE;
+
+    src = frame;
+    stride = width;
+    slice_height = height;
+    crop_left = 0;
+    crop_top = 0;
+  }
+
+  if (!is_planar (self->format)) {
+    g_omx_copy_plane (dest, width * 2,
+        src + self->crop_top * stride + self->crop_left * 2,
+        stride, width * 2, height);
+    return TRUE;
+  }
+
+  if (out_width != width || out_height != height) {
+    needed = (width / 2) * (height / 2);
+    if (self->scratch_size < needed) {
+      self->scratch = g_realloc (self->scratch, needed);
+      self->scratch_size = needed;
+    }
+  }
+
+  for (plane = 0; plane < 3; plane++) {
+    const guint8 *origin;
+    guint shift = plane ? 1 : 0;
+
+    origin = src + (crop_top >> shift) * stride + (crop_left >> shift);
+
+    if (out_width != width || out_height != height)
+      g_omx_scale_plane (origin, stride, width >> shift, height >> shift,
+          dest, out_width >> shift, out_width >> shift, out_height >> shift,
+          self->scratch);
+    else
+      g_omx_copy_plane (dest, width >> shift, origin, stride, width >> shift,
+          height >> shift);
+
+    dest += (out_width >> shift) * (out_height >> shift);
+    src += stride * (slice_height >> shift);
+    if (plane == 0)
+      stride /= 2;
+  }
+
+  return TRUE;
+}
+
+static void
+settings_changed_cb (GOmxCore * core)
+{
+  GstOmxBaseFilter *omx_base;
+  GstOmxJpegDec *self;
+  guint frame_width;
+  guint frame_height;
+  guint min_stride;
+  guint factor;
+
+  omx_base = core->client_data;
+  self = GST_OMX_JPEGDEC (omx_base);
+
+  GST_DEBUG_OBJECT (omx_base, "settings changed");
+
+  {
+    OMX_PARAM_PORTDEFINITIONTYPE *param;
+
+    param = g_omx_port_get_definition (omx_base->out_port);
+
+    frame_width = param->format.image.nFrameWidth;
+    frame_height = param->format.image.nFrameHeight;
+    self->semi_planar = FALSE;
+    self->swap_uv = FALSE;
+    switch ((guint) param->format.image.eColorFormat) {
+      case OMX_COLOR_FormatYCbYCr:
+        self->format = GST_MAKE_FOURCC ('Y', 'U', 'Y', '2');
+        break;
+      case OMX_COLOR_FormatCbYCrY:
+        self->format = GST_MAKE_FOURCC ('U', 'Y', 'V', 'Y');
+        break;
+      case OMX_QCOM_COLOR_FormatYVU420SemiPlanar:
+        self->swap_uv = TRUE;
+        /* fall through */
+      case OMX_COLOR_FormatYUV420SemiPlanar:
+      case OMX_COLOR_FormatYUV420PackedSemiPlanar:
+        self->semi_planar = TRUE;
+        /* fall through */
+      case OMX_COLOR_FormatYUV420Planar:
+      case OMX_COLOR_FormatYUV420PackedPlanar:
+        self->format = GST_MAKE_FOURCC ('I', '4', '2', '0');
+        break;
+      default:
+        /* guessing would only show garbage */
+        GST_ELEMENT_ERROR (omx_base, STREAM, FORMAT, (NULL),
+            ("Unsupported color format 0x%x",
+                param->format.image.eColorFormat));
+        self->format = 0;
+        omx_base->copy_output = copy_output;
+        omx_base->copy_output_size = 0;
+        return;
+    }
+
+    min_stride = is_planar (self->format) ? frame_width : frame_width * 2;
+    self->stride = MAX ((guint) MAX (param->format.image.nStride, 0),
+        min_stride);
+    self->slice_height = MAX (param->format.image.nSliceHeight, frame_height);
+  }
+
+  /* the region, in output pixels */
+  self->crop_left = 0;
+  self->crop_top = 0;
+  self->width = frame_width;
+  self->height = frame_height;
+
+  factor = self->component_scales ? self->scale : 1;
+
+  if (has_roi (self) && !self->component_crops) {
+    guint right = frame_width;
+    guint bottom = frame_height;
+
+    self->crop_left = MIN (self->roi_left / factor, frame_width - 2) & ~1;
+    self->crop_top = MIN (self->roi_top / factor, frame_height - 2) & ~1;
+    if (self->roi_width)
+      right = MIN (right, (self->roi_left + self->roi_width) / factor);
+    if (self->roi_height)
+      bottom = MIN (bottom, (self->roi_top + self->roi_height) / factor);
+
+    self->width = MAX (right, self->crop_left + 2) - self->crop_left;
+    self->height = MAX (bottom, self->crop_top + 2) - self->crop_top;
+  }
+
+  self->width &= ~1;
+  self->height &= ~1;
+
+  factor = self->component_scales ? 1 : self->scale;
+
+  if (factor > 1 && !is_planar (self->format)) {
+    GST_WARNING_OBJECT (omx_base, "can't scale packed output, full size");
+    factor = 1;
+  }
+
+  self->out_width = MAX (self->width / factor, 2) & ~1;
+  self->out_height = MAX (self->height / factor, 2) & ~1;
+
+  {
+    GstCaps *new_caps;
+
+    new_caps = gst_caps_new_simple ("video/x-raw-yuv",
+        "width", G_TYPE_INT, self->out_width,
+        "height", G_TYPE_INT, self->out_height,
+        "framerate", GST_TYPE_FRACTION,
+        self->framerate_num, self->framerate_denom,
+        "format", GST_TYPE_FOURCC, self->format, NULL);
+
+    GST_INFO_OBJECT (omx_base, "caps are: %" GST_PTR_FORMAT, new_caps);
+    gst_pad_set_caps (omx_base->srcpad, new_caps);
+    gst_caps_unref (new_caps);
+  }
+
+  if (self->out_width != frame_width || self->out_height != frame_height ||
+      self->stride != min_stride || self->slice_height != frame_height ||
+      self->semi_planar) {
+    GST_INFO_OBJECT (omx_base, "%ux%u at %u,%u of %ux%u to %ux%u",
+        self->width, self->height, self->crop_left, self->crop_top,
+        frame_width, frame_height, self->out_width, self->out_height);
+    omx_base->copy_output = copy_output;
+    if (is_planar (self->format))
+      omx_base->copy_output_size = self->out_width * self->out_height +
+          2 * ((self->out_width / 2) * (self->out_height / 2));
+    else
+      omx_base->copy_output_size = self->out_width * 2 * self->out_height;
+  } else {
+    omx_base->copy_output = NULL;
+  }
+}
+
+static gboolean
+sink_setcaps (GstPad * pad, GstCaps * caps)
+{
+  GstStructure *structure;
+  GstOmxJpegDec *self;
+  GstOmxBaseFilter *omx_base;
+  GOmxCore *gomx;
+  gint width = 0;
+  gint height = 0;
+
+  self = GST_OMX_JPEGDEC (GST_PAD_PARENT (pad));
+  omx_base = GST_OMX_BASE_FILTER (self);
+  gomx = (GOmxCore *) omx_base->gomx;
+
+  GST_INFO_OBJECT (self, "setcaps (sink): %" GST_PTR_FORMAT, caps);
+
+  g_return_val_if_fail (gst_caps_get_size (caps) == 1, FALSE);
+
+  structure = gst_caps_get_structure (caps, 0);
+
+  gst_structure_get_int (structure, "width", &width);
+  gst_structure_get_int (structure, "height", &height);
+  /* a still image unless it's MJPEG */
+  if (!gst_structure_get_fraction (structure, "framerate", &self->framerate_num,
+          &self->framerate_denom)) {
+    self->framerate_num = 0;
+    self->framerate_denom = 1;
+  }
+
+  /* Input port configuration. */
+  {
+    GOmxPort *port;
+    OMX_PARAM_PORTDEFINITIONTYPE *param;
+
+    port = g_omx_core_port (gomx, 0);
+    param = g_omx_port_get_definition (port);
+
+    param->format.image.nFrameWidth = width;
+    param->format.image.nFrameHeight = height;
+
+    g_omx_port_definition_changed (port);
+  }
+
+  return gst_pad_set_caps (pad, caps);
+}
+
+static gboolean
+request_scale (GstOmxJpegDec * self, guint port_index)
+{
+  OMX_CONFIG_SCALEFACTORTYPE config;
+  OMX_ERRORTYPE error;
+
+  memset (&config, 0, sizeof (config));
+  config.nSize = sizeof (config);
+  config.nVersion.s.nVersionMajor = 1;
+  config.nVersion.s.nVersionMinor = 1;
+  config.nPortIndex = port_index;
+  /* Q16 */
+  config.xWidth = (1 << 16) / self->scale;
+  config.xHeight = (1 << 16) / self->scale;
+
+  error = OMX_SetConfig (self->omx_base.gomx->omx_handle,
+      OMX_IndexConfigCommonScale, &config);
+
+  if (error != OMX_ErrorNone) {
+    GST_INFO_OBJECT (self, "component can't scale (%s), scaling here",
+        g_omx_error_name (error));
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static gboolean
+request_roi (GstOmxJpegDec * self, guint port_index)
+{
+  OMX_PARAM_PORTDEFINITIONTYPE *param;
+  OMX_CONFIG_RECTTYPE config;
+  OMX_ERRORTYPE error;
+  guint width;
+  guint height;
+
+  param = g_omx_port_get_definition (g_omx_core_port (self->omx_base.gomx, 0));
+  width = self->roi_width;
+  height = self->roi_height;
+
+  /* open edges need the image size */
+  if (!width)
+    width = param->format.image.nFrameWidth > self->roi_left ?
+        param->format.image.nFrameWidth - self->roi_left : 0;
+  if (!height)
+    height = param->format.image.nFrameHeight > self->roi_top ?
+        param->format.image.nFrameHeight - self->roi_top : 0;
+  if (!width || !height)
+    return FALSE;
+
+  memset (&config, 0, sizeof (config));
+  config.nSize = sizeof (config);
+  config.nVersion.s.nVersionMajor = 1;
+  config.nVersion.s.nVersionMinor = 1;
+  config.nPortIndex = port_index;
+  config.nLeft = self->roi_left;
+  config.nTop = self->roi_top;
+  config.nWidth = width;
+  config.nHeight = height;
+
+  error = OMX_SetConfig (self->omx_base.gomx->omx_handle,
+      OMX_IndexConfigCommonInputCrop, &config);
+
+  if (error != OMX_ErrorNone) {
+    GST_INFO_OBJECT (self, "component can't crop (%s), cropping here",
+        g_omx_error_name (error));
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+static void
+omx_setup (GstOmxBaseFilter * omx_base)
+{
+  GstOmxJpegDec *self;
+  GOmxCore *gomx;
+  GOmxPort *port;
+  OMX_PARAM_PORTDEFINITIONTYPE *param;
+
+  self = GST_OMX_JPEGDEC (omx_base);
+  gomx = (GOmxCore *) omx_base->gomx;
+
+  GST_INFO_OBJECT (omx_base, "begin");
+
+  /* Input port configuration. */
+  {
+    port = g_omx_core_port (gomx, 0);
+    param = g_omx_port_get_definition (port);
+
+    param->format.image.eCompressionFormat = OMX_IMAGE_CodingJPEG;
+
+    g_omx_port_definition_changed (port);
+  }
+
+  /* Output port configuration. */
+  {
+    port = g_omx_core_port (gomx, 1);
+    param = g_omx_port_get_definition (port);
+
+    param->format.image.eCompressionFormat = OMX_IMAGE_CodingUnused;
+    param->format.image.eColorFormat = OMX_COLOR_FormatYUV420Planar;
+
+    g_omx_port_definition_changed (port);
+  }
+
+  self->component_scales = self->scale == GST_OMX_JPEGDEC_SCALE_1 ||
+      request_scale (self, port->port_index);
+  self->component_crops = !has_roi (self) ||
+      request_roi (self, port->port_index);
+
+  GST_INFO_OBJECT (omx_base, "end");
+}
+
+static void
+type_instance_init (GTypeInstance * instance, gpointer g_class)
+{
+  GstOmxBaseFilter *omx_base;
+  GstOmxJpegDec *self;
+
+  omx_base = GST_OMX_BASE_FILTER (instance);
+  self = GST_OMX_JPEGDEC (instance);
+
+  omx_base->omx_component = g_strdup (OMX_COMPONENT_NAME);
+  omx_base->omx_setup = omx_setup;
+  /* a buffer is a whole image, or a whole MJPEG frame; hand it over as is */
+  omx_base->share_input_buffer = TRUE;
+
+  omx_base->gomx->settings_changed_cb = settings_changed_cb;
+
+  gst_pad_set_setcaps_function (omx_base->sinkpad, sink_setcaps);
+
+  self->scale = DEFAULT_SCALE;
+  self->framerate_num = 0;
+  self->framerate_denom = 1;
+}
+
+GType
+gst_omx_jpegdec_get_type (void)
+{
+  static GType type = 0;
+
+  if (G_UNLIKELY (type == 0)) {
+    GTypeInfo *type_info;
+
+    type_info = g_new0 (GTypeInfo, 1);
+    type_info->class_size = sizeof (GstOmxJpegDecClass);
+    type_info->base_init = type_base_init;
+    type_info->class_init = type_class_init;
+    type_info->instance_size = sizeof (GstOmxJpegDec);
+    type_info->instance_init = type_instance_init;
+
+    type =
+        g_type_register_static (GST_OMX_BASE_FILTER_TYPE, "GstOmxJpegDec",
+        type_info, 0);
+
+    g_free (type_info);
+  }
+
+  return type;
+}
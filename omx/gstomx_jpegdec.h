@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2007-2009 Nokia Corporation.
+ *
+ * Author: Felipe Contreras <felipe.contreras@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ *
+ */
+
+#ifndef GSTOMX_JPEGDEC_H
+#define GSTOMX_JPEGDEC_H
+
+#include <gst/gst.h>
+
+#include <config.h>
+
+G_BEGIN_DECLS
+
+#define GST_OMX_JPEGDEC(obj) (GstOmxJpegDec *) (obj)
+#define GST_OMX_JPEGDEC_TYPE (gst_omx_jpegdec_get_type ())
+
+typedef struct GstOmxJpegDec GstOmxJpegDec;
+typedef struct GstOmxJpegDecClass GstOmxJpegDecClass;
+
+#include "gstomx_base_filter.h"
+
+typedef enum
+{
+    GST_OMX_JPEGDEC_SCALE_1 = 1,
+    GST_OMX_JPEGDEC_SCALE_2 = 2,
+    GST_OMX_JPEGDEC_SCALE_4 = 4,
+    GST_OMX_JPEGDEC_SCALE_8 = 8
+} GstOmxJpegDecScale;
+
+struct GstOmxJpegDec
+{
+    GstOmxBaseFilter omx_base;
+
+    GstOmxJpegDecScale scale;
+    guint roi_left; /**< The region of interest, in source pixels. */
+    guint roi_top;
+    guint roi_width; /**< 0 reaches the right edge. */
+    guint roi_height; /**< 0 reaches the bottom edge. */
+
+    gboolean component_scales;
+    gboolean component_crops;
+
+    gint framerate_num;
+    gint framerate_denom;
+
+    guint32 format; /**< Of the output, 0 if the component's can't be handled. */
+    gboolean semi_planar; /**< The component gives NV12, or NV21 with swap_uv, for I420. */
+    gboolean swap_uv;
+    guint stride;
+    guint slice_height;
+    guint crop_left; /**< What is left to cut here, in output pixels. */
+    guint crop_top;
+    guint width;
+    guint height;
+    guint out_width;
+    guint out_height;
+
+    guint8 *scratch;
+    gsize scratch_size;
+    guint8 *frame; /**< Semi-planar output made planar, before scaling. */
+    gsize frame_size;
+};
+
+struct GstOmxJpegDecClass
+{
+    GstOmxBaseFilterClass parent_class;
+};
+
+GType gst_omx_jpegdec_get_type (void);
+
+G_END_DECLS
+
+#endif /* GSTOMX_JPEGDEC_H */
@@ -30,15 +30,40 @@
 enum
 {
   ARG_0,
-  ARG_QUALITY
+  ARG_QUALITY,
+  ARG_INSTANCES,
+  ARG_UTILIZATION
 };
 
 #define DEFAULT_QUALITY 90
+#define DEFAULT_INSTANCES 1
+#define MAX_INSTANCES 16
 
 #define OMX_COMPONENT_NAME "OMX.st.image_encoder.jpeg"
 
 static GstOmxBaseFilterClass *parent_class = NULL;
 
+static GstStateChangeReturn change_state (GstElement * element,
+    GstStateChange transition);
+static void parallel_stop (GstOmxJpegEnc * self);
+
+struct GstOmxJpegEncWorker
+{
+  GstOmxJpegEnc *self;
+  GOmxCore *core;
+  GOmxPort *in_port;
+  GOmxPort *out_port;
+  gboolean prepared;
+  GThread *thread;
+  gboolean running;
+  GQueue *done;                 /* encoded, waiting for their turn */
+  GstBuffer *partial;           /* output of the frame being encoded */
+  guint in_flight;
+  GstClockTime busy_since;
+  GstClockTime busy;
+  guint64 frames;
+};
+
 static GstCaps *
 generate_src_template (void)
 {
@@ -126,6 +151,58 @@ type_base_init (gpointer g_class)
   }
 }
 
+/* dispose may run more than once; the locks must outlive it */
+static void
+finalize (GObject * obj)
+{
+  GstOmxJpegEnc *self;
+
+  self = GST_OMX_JPEGENC (obj);
+
+  g_mutex_free (self->parallel_mutex);
+  g_cond_free (self->parallel_cond);
+  g_mutex_free (self->push_mutex);
+
+  G_OBJECT_CLASS (parent_class)->finalize (obj);
+}
+
+/* Fraction of the time each instance had a frame, since it started. */
+static gchar *
+utilization (GstOmxJpegEnc * self)
+{
+  GString *str;
+  GstClockTime now;
+  GstClockTime elapsed;
+  guint i;
+
+  g_mutex_lock (self->parallel_mutex);
+
+  if (!self->workers) {
+    g_mutex_unlock (self->parallel_mutex);
+    return NULL;
+  }
+
+  now = gst_util_get_timestamp ();
+  elapsed = MAX (now - self->parallel_start, 1);
+  str = g_string_new (NULL);
+
+  for (i = 0; i < self->n_workers; i++) {
+    GstOmxJpegEncWorker *worker = &self->workers[i];
+    GstClockTime busy;
+
+    busy = worker->busy;
+    if (worker->in_flight)
+      busy += now - worker->busy_since;
+
+    g_string_append_printf (str, "%s%.2f", i ? "," : "",
+        (gdouble) busy / elapsed);
+  }
+
+  g_mutex_unlock (self->parallel_mutex);
+
+  return g_string_free (str, FALSE);
+}
+
 static void
 set_property (GObject * obj,
     guint prop_id, const GValue * value, GParamSpec * pspec)
@@ -138,6 +215,9 @@ set_property (GObject * obj,
     case ARG_QUALITY:
       self->quality = g_value_get_uint (value);
       break;
+    case ARG_INSTANCES:
+      self->instances = g_value_get_uint (value);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (obj, prop_id, pspec);
       break;
@@ -155,6 +235,12 @@ get_property (GObject * obj, guint prop_id, GValue * value, GParamSpec * pspec)
     case ARG_QUALITY:
       g_value_set_uint (value, self->quality);
       break;
+    case ARG_INSTANCES:
+      g_value_set_uint (value, self->instances);
+      break;
+    case ARG_UTILIZATION:
+      g_value_take_string (value, utilization (self));
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (obj, prop_id, pspec);
       break;
@@ -170,6 +256,9 @@ type_class_init (gpointer g_class, gpointer class_data)
 
   parent_class = g_type_class_ref (GST_OMX_BASE_FILTER_TYPE);
 
+  gobject_class->finalize = finalize;
+  GST_ELEMENT_CLASS (g_class)->change_state = change_state;
+
   /* Properties stuff */
   {
     gobject_class->set_property = set_property;
@@ -179,6 +268,16 @@ type_class_init (gpointer g_class, gpointer class_data)
         g_param_spec_uint ("quality", "Quality of image",
             "Set the quality from 0 to 100",
             0, 100, DEFAULT_QUALITY, G_PARAM_READWRITE));
+
+    g_object_class_install_property (gobject_class, ARG_INSTANCES,
+        g_param_spec_uint ("instances", "Instances",
+            "Encode consecutive frames on this many components at once",
+            1, MAX_INSTANCES, DEFAULT_INSTANCES, G_PARAM_READWRITE));
+
+    g_object_class_install_property (gobject_class, ARG_UTILIZATION,
+        g_param_spec_string ("utilization", "Utilization",
+            "Busy fraction of each instance while encoding in parallel",
+            NULL, G_PARAM_READABLE));
   }
 }
 
@@ -196,20 +295,11 @@ settings_changed_cb (GOmxCore * core)
   {
     OMX_PARAM_PORTDEFINITIONTYPE *param;
 
-    param = calloc (1, sizeof (OMX_PARAM_PORTDEFINITIONTYPE));
-
-    param->nSize = sizeof (OMX_PARAM_PORTDEFINITIONTYPE);
-    param->nVersion.s.nVersionMajor = 1;
-    param->nVersion.s.nVersionMinor = 1;
-
-    param->nPortIndex = 1;
-    OMX_GetParameter (omx_base->gomx->omx_handle, OMX_IndexParamPortDefinition,
-        param);
+    /* there's no out_port when encoding in parallel */
+    param = g_omx_port_get_definition (g_omx_core_port (core, 1));
 
     width = param->format.image.nFrameWidth;
     height = param->format.image.nFrameHeight;
-
-    free (param);
   }
 
   {
@@ -263,60 +353,42 @@ sink_setcaps (GstPad * pad, GstCaps * caps)
   }
 
   {
+    GOmxPort *port;
     OMX_PARAM_PORTDEFINITIONTYPE *param;
-    param = calloc (1, sizeof (OMX_PARAM_PORTDEFINITIONTYPE));
-    param->nSize = sizeof (OMX_PARAM_PORTDEFINITIONTYPE);
-    param->nVersion.s.nVersionMajor = 1;
-    param->nVersion.s.nVersionMinor = 1;
 
     /* Input port configuration. */
     {
-      param->nPortIndex = 0;
-      OMX_GetParameter (gomx->omx_handle, OMX_IndexParamPortDefinition, param);
+      port = g_omx_core_port (gomx, 0);
+      param = g_omx_port_get_definition (port);
 
       param->format.image.nFrameWidth = width;
       param->format.image.nFrameHeight = height;
       param->format.image.eColorFormat = color_format;
 
-      OMX_SetParameter (gomx->omx_handle, OMX_IndexParamPortDefinition, param);
+      g_omx_port_definition_changed (port);
     }
-
-    free (param);
   }
 
   return gst_pad_set_caps (pad, caps);
 }
 
 static void
-omx_setup (GstOmxBaseFilter * omx_base)
+setup_core (GstOmxJpegEnc * self, GOmxCore * gomx)
 {
-  GstOmxJpegEnc *self;
-  GOmxCore *gomx;
-
-  self = GST_OMX_JPEGENC (omx_base);
-  gomx = (GOmxCore *) omx_base->gomx;
-
-  GST_INFO_OBJECT (omx_base, "begin");
 
   {
+    GOmxPort *port;
     OMX_PARAM_PORTDEFINITIONTYPE *param;
 
-    param = calloc (1, sizeof (OMX_PARAM_PORTDEFINITIONTYPE));
-    param->nSize = sizeof (OMX_PARAM_PORTDEFINITIONTYPE);
-    param->nVersion.s.nVersionMajor = 1;
-    param->nVersion.s.nVersionMinor = 1;
-
     /* Output port configuration. */
     {
-      param->nPortIndex = 1;
-      OMX_GetParameter (gomx->omx_handle, OMX_IndexParamPortDefinition, param);
+      port = g_omx_core_port (gomx, 1);
+      param = g_omx_port_get_definition (port);
 
       param->format.image.eCompressionFormat = OMX_IMAGE_CodingJPEG;
 
-      OMX_SetParameter (gomx->omx_handle, OMX_IndexParamPortDefinition, param);
+      g_omx_port_definition_changed (port);
     }
-
-    free (param);
   }
 
   {
@@ -334,10 +406,543 @@ omx_setup (GstOmxBaseFilter * omx_base)
 
     free (param);
   }
+}
+
+static void
+omx_setup (GstOmxBaseFilter * omx_base)
+{
+  GST_INFO_OBJECT (omx_base, "begin");
+
+  setup_core (GST_OMX_JPEGENC (omx_base), omx_base->gomx);
 
   GST_INFO_OBJECT (omx_base, "end");
 }
 
+/*
+ * Parallel encoding: frame n goes to instance n % instances, each with a
+ * thread taking its output. A frame is pushed once all before it have
+ * been, so the stream keeps its order.
+ */
+
+/*
+ * Called without parallel_mutex, which is only held to take the buffers;
+ * push_mutex keeps two workers from overtaking each other downstream.
+ */
+static void
+push_in_order (GstOmxJpegEnc * self)
+{
+  GstOmxBaseFilter *omx_base;
+
+  omx_base = GST_OMX_BASE_FILTER (self);
+
+  g_mutex_lock (self->push_mutex);
+
+  while (TRUE) {
+    GstOmxJpegEncWorker *next;
+    GOmxCore *core;
+    GstBuffer *buf;
+    GstFlowReturn ret;
+
+    g_mutex_lock (self->parallel_mutex);
+    next = &self->workers[self->next_out % self->n_workers];
+    core = next->core;
+    buf = g_queue_pop_head (next->done);
+    if (buf) {
+      self->next_out++;
+      g_cond_broadcast (self->parallel_cond);
+    }
+    ret = omx_base->last_pad_push_return;
+    g_mutex_unlock (self->parallel_mutex);
+
+    if (!buf)
+      break;
+
+    /* empty: nothing came out of that frame */
+    if (GST_BUFFER_SIZE (buf) == 0 || ret != GST_FLOW_OK) {
+      gst_buffer_unref (buf);
+      continue;
+    }
+
+    if (G_UNLIKELY (!GST_PAD_CAPS (omx_base->srcpad)))
+      settings_changed_cb (core);
+    gst_buffer_set_caps (buf, GST_PAD_CAPS (omx_base->srcpad));
+
+    ret = gst_pad_push (omx_base->srcpad, buf);
+
+    g_mutex_lock (self->parallel_mutex);
+    omx_base->last_pad_push_return = ret;
+    g_mutex_unlock (self->parallel_mutex);
+  }
+
+  g_mutex_unlock (self->push_mutex);
+}
+
+/* Called with parallel_mutex; frame is NULL when nothing came out. */
+static void
+finish_frame (GstOmxJpegEncWorker * worker, GstBuffer * frame)
+{
+  if (worker->in_flight && --worker->in_flight == 0)
+    worker->busy += gst_util_get_timestamp () - worker->busy_since;
+
+  if (frame)
+    worker->frames++;
+  else
+    frame = gst_buffer_new ();
+
+  g_queue_push_tail (worker->done, frame);
+}
+
+static gpointer
+worker_loop (gpointer data)
+{
+  GstOmxJpegEncWorker *worker = data;
+  GstOmxJpegEnc *self = worker->self;
+  GstOmxBaseFilter *omx_base;
+
+  omx_base = GST_OMX_BASE_FILTER (self);
+
+  while (TRUE) {
+    OMX_BUFFERHEADERTYPE *omx_buffer;
+    gboolean eos;
+    gboolean frame_end;
+
+    omx_buffer = g_omx_port_request_buffer (worker->out_port);
+    if (!omx_buffer)
+      break;
+
+    if (G_LIKELY (omx_buffer->nFilledLen > 0)) {
+      GstBuffer *buf;
+
+      buf = gst_buffer_new_and_alloc (omx_buffer->nFilledLen);
+      memcpy (GST_BUFFER_DATA (buf),
+          omx_buffer->pBuffer + omx_buffer->nOffset, omx_buffer->nFilledLen);
+
+      if (worker->partial) {
+        GstBuffer *joined;
+
+        /* a frame larger than the output buffers */
+        joined = gst_buffer_merge (worker->partial, buf);
+        GST_BUFFER_TIMESTAMP (joined) = GST_BUFFER_TIMESTAMP (worker->partial);
+        gst_buffer_unref (worker->partial);
+        gst_buffer_unref (buf);
+        worker->partial = joined;
+      } else {
+        if (omx_base->use_timestamps)
+          GST_BUFFER_TIMESTAMP (buf) =
+              gst_util_uint64_scale_int (omx_buffer->nTimeStamp, GST_SECOND,
+              OMX_TICKS_PER_SECOND);
+        worker->partial = buf;
+      }
+    }
+
+    eos = omx_buffer->nFlags & OMX_BUFFERFLAG_EOS;
+    /* an empty EOS buffer ends the stream, not a frame */
+    frame_end = (omx_buffer->nFlags & OMX_BUFFERFLAG_ENDOFFRAME && !eos) ||
+        (eos && worker->partial);
+
+    omx_buffer->nFilledLen = 0;
+    g_omx_port_release_buffer (worker->out_port, omx_buffer);
+
+    if (frame_end || eos) {
+      g_mutex_lock (self->parallel_mutex);
+      if (frame_end) {
+        finish_frame (worker, worker->partial);
+        worker->partial = NULL;
+      }
+      /* whatever is still in flight won't come out */
+      while (eos && worker->in_flight)
+        finish_frame (worker, NULL);
+      g_mutex_unlock (self->parallel_mutex);
+
+      push_in_order (self);
+    }
+
+    if (eos)
+      break;
+  }
+
+  g_mutex_lock (self->parallel_mutex);
+  worker->running = FALSE;
+  g_cond_broadcast (self->parallel_cond);
+  g_mutex_unlock (self->parallel_mutex);
+
+  return NULL;
+}
+
+static void
+start_worker (GstOmxJpegEncWorker * worker)
+{
+  worker->running = TRUE;
+  worker->thread = g_thread_create (worker_loop, worker, TRUE, NULL);
+}
+
+static void
+join_worker (GstOmxJpegEncWorker * worker)
+{
+  if (worker->thread) {
+    g_thread_join (worker->thread);
+    worker->thread = NULL;
+  }
+}
+
+/* Forget what was in flight, after the threads are gone. */
+static void
+reset_workers (GstOmxJpegEnc * self)
+{
+  GstClockTime now;
+  guint i;
+
+  now = gst_util_get_timestamp ();
+
+  g_mutex_lock (self->parallel_mutex);
+  for (i = 0; i < self->n_workers; i++) {
+    GstOmxJpegEncWorker *worker = &self->workers[i];
+    GstBuffer *buf;
+
+    while ((buf = g_queue_pop_head (worker->done)))
+      gst_buffer_unref (buf);
+    gst_buffer_replace (&worker->partial, NULL);
+
+    if (worker->in_flight)
+      worker->busy += now - worker->busy_since;
+    worker->in_flight = 0;
+  }
+  self->next_in = 0;
+  self->next_out = 0;
+  g_mutex_unlock (self->parallel_mutex);
+}
+
+static gboolean
+parallel_start (GstOmxJpegEnc * self)
+{
+  GstOmxBaseFilter *omx_base;
+  OMX_PARAM_PORTDEFINITIONTYPE *input;
+  guint i;
+
+  omx_base = GST_OMX_BASE_FILTER (self);
+  input = g_omx_port_get_definition (g_omx_core_port (omx_base->gomx, 0));
+
+  g_mutex_lock (self->parallel_mutex);
+  self->n_workers = self->instances;
+  self->workers = g_new0 (GstOmxJpegEncWorker, self->n_workers);
+  self->next_in = 0;
+  self->next_out = 0;
+  self->parallel_start = gst_util_get_timestamp ();
+  g_mutex_unlock (self->parallel_mutex);
+
+  GST_INFO_OBJECT (self, "encoding on %u instances", self->n_workers);
+
+  for (i = 0; i < self->n_workers; i++) {
+    self->workers[i].self = self;
+    self->workers[i].done = g_queue_new ();
+  }
+
+  for (i = 0; i < self->n_workers; i++) {
+    GstOmxJpegEncWorker *worker = &self->workers[i];
+    GOmxCore *core;
+
+    /* the first is the one the base filter already loaded */
+    if (i == 0) {
+      core = omx_base->gomx;
+    } else {
+      OMX_PARAM_PORTDEFINITIONTYPE *param;
+
+      core = g_omx_core_new ();
+      core->client_data = self;
+      core->settings_changed_cb = settings_changed_cb;
+      core->use_dispatch = omx_base->gomx->use_dispatch;
+      core->priority = omx_base->gomx->priority;
+      g_omx_core_set_fallback (core,
+          omx_base->fallback_library ? omx_base->fallback_library :
+          omx_base->omx_library, omx_base->fallback_component);
+      g_omx_core_set_candidates (core, omx_base->candidates);
+      worker->core = core;
+
+      g_omx_core_init (core, omx_base->omx_library, omx_base->omx_component);
+      if (core->omx_error)
+        goto fail;
+
+      param = g_omx_port_get_definition (g_omx_core_port (core, 0));
+      param->format.image.nFrameWidth = input->format.image.nFrameWidth;
+      param->format.image.nFrameHeight = input->format.image.nFrameHeight;
+      param->format.image.eColorFormat = input->format.image.eColorFormat;
+      g_omx_port_definition_changed (g_omx_core_port (core, 0));
+    }
+    worker->core = core;
+
+    setup_core (self, core);
+
+    worker->in_port = g_omx_core_setup_port (core,
+        g_omx_port_get_definition (g_omx_core_port (core, 0)));
+    worker->out_port = g_omx_core_setup_port (core,
+        g_omx_port_get_definition (g_omx_core_port (core, 1)));
+
+    if (!g_omx_core_prepare (core))
+      goto fail;
+    worker->prepared = TRUE;
+
+    if (!g_omx_core_start (core))
+      goto fail;
+
+    start_worker (worker);
+  }
+
+  return TRUE;
+
+fail:
+  /* nothing half built may stay around for pad_chain to use */
+  parallel_stop (self);
+  return FALSE;
+}
+
+static void
+parallel_stop (GstOmxJpegEnc * self)
+{
+  GstOmxJpegEncWorker *workers;
+  gchar *busy;
+  guint i;
+
+  if (!self->workers)
+    return;
+
+  busy = utilization (self);
+  GST_INFO_OBJECT (self, "utilization: %s", busy);
+  g_free (busy);
+
+  /* unblock the threads */
+  for (i = 0; i < self->n_workers; i++) {
+    if (self->workers[i].core)
+      g_omx_core_flush_start (self->workers[i].core);
+  }
+
+  for (i = 0; i < self->n_workers; i++)
+    join_worker (&self->workers[i]);
+
+  reset_workers (self);
+
+  for (i = 0; i < self->n_workers; i++) {
+    GstOmxJpegEncWorker *worker = &self->workers[i];
+
+    if (worker->prepared) {
+      g_omx_core_flush_stop (worker->core, FALSE);
+      g_omx_core_finish (worker->core);
+    }
+
+    if (i > 0 && worker->core) {
+      g_omx_core_deinit (worker->core);
+      g_omx_core_free (worker->core);
+    }
+
+    g_queue_free (worker->done);
+  }
+
+  g_mutex_lock (self->parallel_mutex);
+  workers = self->workers;
+  self->workers = NULL;
+  self->n_workers = 0;
+  g_mutex_unlock (self->parallel_mutex);
+
+  g_free (workers);
+}
+
+static GstFlowReturn
+pad_chain (GstPad * pad, GstBuffer * buf)
+{
+  GstOmxJpegEnc *self;
+  GstOmxBaseFilter *omx_base;
+  GstOmxJpegEncWorker *worker;
+  GstFlowReturn ret;
+  guint offset = 0;
+
+  self = GST_OMX_JPEGENC (GST_OBJECT_PARENT (pad));
+  omx_base = GST_OMX_BASE_FILTER (self);
+
+  /* the count only matters when starting */
+  if (!self->workers && (self->instances <= 1 || omx_base->initialized))
+    return self->base_chain_func (pad, buf);
+
+  if (G_UNLIKELY (!self->workers) && !parallel_start (self)) {
+    GST_ELEMENT_ERROR (self, LIBRARY, INIT, (NULL),
+        ("Could not start %u instances of %s", self->instances,
+            omx_base->omx_component));
+    gst_buffer_unref (buf);
+    return GST_FLOW_ERROR;
+  }
+
+  g_mutex_lock (self->parallel_mutex);
+  ret = omx_base->last_pad_push_return;
+  worker = &self->workers[self->next_in++ % self->n_workers];
+  g_mutex_unlock (self->parallel_mutex);
+
+  if (ret != GST_FLOW_OK) {
+    gst_buffer_unref (buf);
+    return ret;
+  }
+
+  /* stopped at EOS */
+  if (G_UNLIKELY (!worker->thread))
+    start_worker (worker);
+
+  while (offset < GST_BUFFER_SIZE (buf)) {
+    OMX_BUFFERHEADERTYPE *omx_buffer;
+
+    omx_buffer = g_omx_port_request_buffer (worker->in_port);
+    if (!omx_buffer) {
+      gst_buffer_unref (buf);
+      return GST_FLOW_WRONG_STATE;
+    }
+
+    omx_buffer->nFilledLen = MIN (GST_BUFFER_SIZE (buf) - offset,
+        omx_buffer->nAllocLen - omx_buffer->nOffset);
+    memcpy (omx_buffer->pBuffer + omx_buffer->nOffset,
+        GST_BUFFER_DATA (buf) + offset, omx_buffer->nFilledLen);
+    offset += omx_buffer->nFilledLen;
+
+    if (omx_base->use_timestamps)
+      omx_buffer->nTimeStamp =
+          gst_util_uint64_scale_int (GST_BUFFER_TIMESTAMP (buf),
+          OMX_TICKS_PER_SECOND, GST_SECOND);
+
+    if (offset == GST_BUFFER_SIZE (buf)) {
+      omx_buffer->nFlags |= OMX_BUFFERFLAG_ENDOFFRAME;
+
+      g_mutex_lock (self->parallel_mutex);
+      if (worker->in_flight++ == 0)
+        worker->busy_since = gst_util_get_timestamp ();
+      g_mutex_unlock (self->parallel_mutex);
+    } else {
+      omx_buffer->nFlags &= ~OMX_BUFFERFLAG_ENDOFFRAME;
+    }
+
+    g_omx_port_release_buffer (worker->in_port, omx_buffer);
+  }
+
+  gst_buffer_unref (buf);
+
+  return GST_FLOW_OK;
+}
+
+/*
+ * Wait until every frame taken so far has been handed downstream, or
+ * pushing stopped. Frames are pushed by the workers, so a serialized
+ * event forwarded right away would overtake them.
+ */
+static void
+wait_pushed (GstOmxJpegEnc * self)
+{
+  GstOmxBaseFilter *omx_base;
+
+  omx_base = GST_OMX_BASE_FILTER (self);
+
+  g_mutex_lock (self->parallel_mutex);
+  while (self->next_out < self->next_in &&
+      omx_base->last_pad_push_return == GST_FLOW_OK)
+    g_cond_wait (self->parallel_cond, self->parallel_mutex);
+  g_mutex_unlock (self->parallel_mutex);
+}
+
+static gboolean
+pad_event (GstPad * pad, GstEvent * event)
+{
+  GstOmxJpegEnc *self;
+  gboolean ret;
+  guint i;
+
+  self = GST_OMX_JPEGENC (GST_OBJECT_PARENT (pad));
+
+  if (!self->workers)
+    return self->base_event_func (pad, event);
+
+  switch (GST_EVENT_TYPE (event)) {
+    case GST_EVENT_EOS:
+      /* drain every instance, then let the base send EOS */
+      for (i = 0; i < self->n_workers; i++) {
+        GstOmxJpegEncWorker *worker = &self->workers[i];
+        OMX_BUFFERHEADERTYPE *omx_buffer;
+
+        if (!worker->thread)
+          continue;
+
+        omx_buffer = g_omx_port_request_buffer (worker->in_port);
+        if (omx_buffer) {
+          omx_buffer->nFilledLen = 0;
+          omx_buffer->nFlags |= OMX_BUFFERFLAG_EOS;
+          g_omx_port_release_buffer (worker->in_port, omx_buffer);
+        }
+      }
+
+      g_mutex_lock (self->parallel_mutex);
+      for (i = 0; i < self->n_workers; i++) {
+        while (self->workers[i].running)
+          g_cond_wait (self->parallel_cond, self->parallel_mutex);
+      }
+      g_mutex_unlock (self->parallel_mutex);
+
+      for (i = 0; i < self->n_workers; i++)
+        join_worker (&self->workers[i]);
+
+      ret = self->base_event_func (pad, event);
+      break;
+
+    case GST_EVENT_FLUSH_START:
+      /* the base flushes its own core */
+      ret = self->base_event_func (pad, event);
+
+      /* frames in flight won't be pushed now */
+      g_mutex_lock (self->parallel_mutex);
+      g_cond_broadcast (self->parallel_cond);
+      g_mutex_unlock (self->parallel_mutex);
+
+      for (i = 1; i < self->n_workers; i++)
+        g_omx_core_flush_start (self->workers[i].core);
+
+      for (i = 0; i < self->n_workers; i++)
+        join_worker (&self->workers[i]);
+      break;
+
+    case GST_EVENT_FLUSH_STOP:
+      ret = self->base_event_func (pad, event);
+
+      for (i = 1; i < self->n_workers; i++)
+        g_omx_core_flush_stop (self->workers[i].core, TRUE);
+
+      reset_workers (self);
+
+      for (i = 0; i < self->n_workers; i++)
+        start_worker (&self->workers[i]);
+      break;
+
+    default:
+      if (!GST_EVENT_IS_SERIALIZED (event)) {
+        ret = self->base_event_func (pad, event);
+        break;
+      }
+
+      /* the last frame may still be on its way out; push_mutex waits */
+      wait_pushed (self);
+      g_mutex_lock (self->push_mutex);
+      ret = self->base_event_func (pad, event);
+      g_mutex_unlock (self->push_mutex);
+      break;
+  }
+
+  return ret;
+}
+
+static GstStateChangeReturn
+change_state (GstElement * element, GstStateChange transition)
+{
+  GstOmxJpegEnc *self;
+
+  self = GST_OMX_JPEGENC (element);
+
+  /* before the base filter; it doesn't know about the other instances */
+  if (transition == GST_STATE_CHANGE_PAUSED_TO_READY)
+    parallel_stop (self);
+
+  return GST_ELEMENT_CLASS (parent_class)->change_state (element, transition);
+}
+
 static void
 type_instance_init (GTypeInstance * instance, gpointer g_class)
 {
@@ -355,6 +960,16 @@ type_instance_init (GTypeInstance * instance, gpointer g_class)
   gst_pad_set_setcaps_function (omx_base->sinkpad, sink_setcaps);
 
   self->quality = DEFAULT_QUALITY;
+  self->instances = DEFAULT_INSTANCES;
+
+  self->parallel_mutex = g_mutex_new ();
+  self->parallel_cond = g_cond_new ();
+  self->push_mutex = g_mutex_new ();
+
+  self->base_chain_func = GST_PAD_CHAINFUNC (omx_base->sinkpad);
+  self->base_event_func = GST_PAD_EVENTFUNC (omx_base->sinkpad);
+  gst_pad_set_chain_function (omx_base->sinkpad, pad_chain);
+  gst_pad_set_event_function (omx_base->sinkpad, pad_event);
 }
 
 GType
@@ -33,6 +33,7 @@ G_BEGIN_DECLS
 
 typedef struct GstOmxJpegEnc GstOmxJpegEnc;
 typedef struct GstOmxJpegEncClass GstOmxJpegEncClass;
+typedef struct GstOmxJpegEncWorker GstOmxJpegEncWorker;
 
 #include "gstomx_base_filter.h"
 
@@ -41,6 +42,18 @@ struct GstOmxJpegEnc
     GstOmxBaseFilter omx_base;
 
     guint quality;
+
+    guint instances; /**< Components frames are spread over. */
+    GstOmxJpegEncWorker *workers; /**< While encoding in parallel, else NULL. */
+    guint n_workers;
+    guint64 next_in; /**< Frame numbers, for round robin and reordering. */
+    guint64 next_out;
+    GMutex *parallel_mutex;
+    GCond *parallel_cond;
+    GMutex *push_mutex; /**< One pusher at a time, so frames and events leave in order. */
+    GstClockTime parallel_start;
+    GstPadChainFunction base_chain_func;
+    GstPadEventFunction base_event_func;
 };
 
 struct GstOmxJpegEncClass
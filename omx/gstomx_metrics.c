@@ -0,0 +1,162 @@
+/*
+ * Copyright (C) 2007-2009 Nokia Corporation.
+ *
+ * Author: Felipe Contreras <felipe.contreras@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "gstomx_metrics.h"
+#include "gstomx.h"
+
+#include "config.h"
+
+#ifdef HAVE_SHM_OPEN
+
+#include <stdlib.h>             /* For getenv, atexit */
+#include <string.h>             /* For strcmp, memset */
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+static GStaticMutex segment_mutex = G_STATIC_MUTEX_INIT;
+static GOmxMetricsSegment *segment;
+static gboolean disabled;
+static gboolean full_warned;
+static gchar segment_name[64];
+
+static void
+segment_unlink (void)
+{
+  shm_unlink (segment_name);
+}
+
+static GOmxMetricsSegment *
+segment_open (void)
+{
+  GOmxMetricsSegment *seg;
+  const gchar *env;
+  guint n_slots = GOMX_METRICS_DEFAULT_SLOTS;
+  gsize size;
+  int fd;
+
+  env = getenv ("GST_OMX_METRICS");
+  if (env && strcmp (env, "0") == 0)
+    return NULL;
+
+  env = getenv ("GST_OMX_METRICS_SLOTS");
+  if (env && atoi (env) > 0)
+    n_slots = MIN (atoi (env), GOMX_METRICS_MAX_SLOTS);
+  size = GOMX_METRICS_SEGMENT_SIZE (n_slots);
+
+  g_snprintf (segment_name, sizeof (segment_name), "/" GOMX_METRICS_PREFIX "%d",
+      (gint) getpid ());
+
+  /* a leftover from a dead process with our pid */
+  shm_unlink (segment_name);
+
+  fd = shm_open (segment_name, O_CREAT | O_EXCL | O_RDWR, 0644);
+  if (fd < 0)
+    return NULL;
+
+  if (ftruncate (fd, size) < 0) {
+    close (fd);
+    shm_unlink (segment_name);
+    return NULL;
+  }
+
+  seg = mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close (fd);
+
+  if (seg == MAP_FAILED) {
+    shm_unlink (segment_name);
+    return NULL;
+  }
+
+  seg->version = GOMX_METRICS_VERSION;
+  seg->n_slots = n_slots;
+  seg->pid = getpid ();
+  /* last, readers check it */
+  __atomic_store_n (&seg->magic, GOMX_METRICS_MAGIC, __ATOMIC_RELEASE);
+
+  atexit (segment_unlink);
+
+  return seg;
+}
+
+GOmxMetricsSlot *
+g_omx_metrics_register (const gchar * element, const gchar * component)
+{
+  guint i;
+
+  g_static_mutex_lock (&segment_mutex);
+  if (!segment && !disabled) {
+    segment = segment_open ();
+    disabled = !segment;
+  }
+  g_static_mutex_unlock (&segment_mutex);
+
+  if (!segment)
+    return NULL;
+
+  for (i = 0; i < segment->n_slots; i++) {
+    GOmxMetricsSlot *slot = &segment->slots[i];
+    gint free_slot = 0;
+
+    if (__atomic_compare_exchange_n (&slot->in_use, &free_slot, 1, FALSE,
+            __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+      memset ((gchar *) slot + sizeof (slot->in_use), 0,
+          sizeof (GOmxMetricsSlot) - sizeof (slot->in_use));
+      g_strlcpy (slot->element, element ? element : "", sizeof (slot->element));
+      g_strlcpy (slot->component, component ? component : "",
+          sizeof (slot->component));
+      return slot;
+    }
+  }
+
+  /* more cores than slots; these go unseen */
+  if (!g_atomic_int_get (&full_warned)) {
+    g_atomic_int_set (&full_warned, TRUE);
+    GST_WARNING ("all %u metrics slots in use, %s goes unseen; "
+        "raise GST_OMX_METRICS_SLOTS", segment->n_slots,
+        element ? element : "a core");
+  }
+  return NULL;
+}
+
+void
+g_omx_metrics_unregister (GOmxMetricsSlot * slot)
+{
+  if (slot)
+    __atomic_store_n (&slot->in_use, 0, __ATOMIC_RELEASE);
+}
+
+#else /* HAVE_SHM_OPEN */
+
+/* no POSIX shared memory (e.g. bionic); cores simply go unseen */
+
+GOmxMetricsSlot *
+g_omx_metrics_register (const gchar * element, const gchar * component)
+{
+  return NULL;
+}
+
+void
+g_omx_metrics_unregister (GOmxMetricsSlot * slot)
+{
+}
+
+#endif /* HAVE_SHM_OPEN */
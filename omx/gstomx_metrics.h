@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2007-2009 Nokia Corporation.
+ *
+ * Author: Felipe Contreras <felipe.contreras@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef GSTOMX_METRICS_H
+#define GSTOMX_METRICS_H
+
+#include <glib.h>
+
+/*
+ * Every process using the plugin exposes one shared-memory segment,
+ * /dev/shm/gst-omx.<pid>, with a slot per GOmxCore. Counters are updated
+ * with relaxed atomics; readers (gst-omx-top) only ever map it read-only.
+ * Set GST_OMX_METRICS=0 to disable, GST_OMX_METRICS_SLOTS=n for room for
+ * more than GOMX_METRICS_DEFAULT_SLOTS cores.
+ *
+ * This layout is shared with tools/gst-omx-top.c; bump the version on
+ * any change.
+ */
+
+#define GOMX_METRICS_MAGIC 0x474f4d58 /* "GOMX" */
+#define GOMX_METRICS_VERSION 2
+#define GOMX_METRICS_DEFAULT_SLOTS 64
+#define GOMX_METRICS_MAX_SLOTS 4096
+#define GOMX_METRICS_PREFIX "gst-omx."
+
+typedef struct GOmxMetricsSlot GOmxMetricsSlot;
+typedef struct GOmxMetricsSegment GOmxMetricsSegment;
+
+struct GOmxMetricsSlot
+{
+    gint in_use;
+    gint state; /**< OMX_STATETYPE */
+    gchar element[32];
+    gchar component[64];
+    guint in_queue; /**< Free input headers on our side. */
+    guint out_queue; /**< Filled output headers not yet taken. */
+    guint64 buffers_in;
+    guint64 buffers_out;
+    guint64 bytes_in;
+    guint64 bytes_out;
+    guint64 errors;
+    guint64 latency_sum; /**< Input hold time in the component, in us. */
+    guint64 latency_count;
+};
+
+struct GOmxMetricsSegment
+{
+    guint32 magic;
+    guint32 version;
+    guint32 n_slots;
+    gint32 pid;
+    GOmxMetricsSlot slots[]; /**< n_slots of them. */
+};
+
+#define GOMX_METRICS_SEGMENT_SIZE(n_slots) \
+    (sizeof (GOmxMetricsSegment) + (n_slots) * sizeof (GOmxMetricsSlot))
+
+#define GOMX_METRICS_ADD(slot, field, n) \
+G_STMT_START { \
+    if (G_UNLIKELY (slot)) \
+        __atomic_fetch_add (&(slot)->field, (n), __ATOMIC_RELAXED); \
+} G_STMT_END
+
+#define GOMX_METRICS_SET(slot, field, v) \
+G_STMT_START { \
+    if (G_UNLIKELY (slot)) \
+        __atomic_store_n (&(slot)->field, (v), __ATOMIC_RELAXED); \
+} G_STMT_END
+
+GOmxMetricsSlot *g_omx_metrics_register (const gchar *element, const gchar *component);
+void g_omx_metrics_unregister (GOmxMetricsSlot *slot);
+
+#endif /* GSTOMX_METRICS_H */
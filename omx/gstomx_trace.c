@@ -0,0 +1,211 @@
+/*
+ * Copyright (C) 2007-2009 Nokia Corporation.
+ *
+ * Author: Felipe Contreras <felipe.contreras@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include "gstomx_trace.h"
+#include "gstomx_util.h"
+
+#include <stdio.h>
+#include <stdlib.h>             /* For getenv, atexit */
+#include <time.h>
+#include <unistd.h>             /* For getpid */
+
+/* 32MB at most; pages are only touched as records come in */
+#define MAX_RECORDS (512 * 1024)
+
+typedef struct
+{
+  gint64 ts;                    /* microseconds */
+  gpointer thread;
+  gpointer core;
+  gpointer header;
+  guint type;
+  guint port_index;
+  guint value;
+  guint filled_len;
+  gint64 omx_timestamp;
+} GOmxTraceRecord;
+
+gboolean g_omx_trace_enabled;
+
+static gchar *trace_file;
+static GMutex *trace_mutex;
+static GOmxTraceRecord *records;
+static guint n_records;
+
+static gint64
+now (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+
+  return (gint64) ts.tv_sec * G_USEC_PER_SEC + ts.tv_nsec / 1000;
+}
+
+void
+g_omx_trace_record (GOmxTraceType type, gpointer core, guint port_index,
+    OMX_BUFFERHEADERTYPE * omx_buffer, guint value)
+{
+  GOmxTraceRecord *record;
+
+  g_mutex_lock (trace_mutex);
+
+  if (G_UNLIKELY (!records || n_records == MAX_RECORDS)) {
+    g_mutex_unlock (trace_mutex);
+    return;
+  }
+
+  record = &records[n_records++];
+  record->ts = now ();
+  record->thread = g_thread_self ();
+  record->core = core;
+  record->type = type;
+  record->port_index = port_index;
+  record->value = value;
+
+  if (omx_buffer) {
+    record->header = omx_buffer;
+    record->filled_len = omx_buffer->nFilledLen;
+    record->omx_timestamp = omx_buffer->nTimeStamp;
+  }
+
+  g_mutex_unlock (trace_mutex);
+}
+
+static void
+write_async (FILE * file, GOmxTraceRecord * record, const gchar * phase,
+    const gchar * name, gboolean * first)
+{
+  fprintf (file, "%s\n{\"name\":\"%s\",\"cat\":\"port%u\",\"ph\":\"%s\","
+      "\"id\":\"%p\",\"pid\":%d,\"tid\":%lu,\"ts\":%" G_GINT64_FORMAT ","
+      "\"args\":{\"core\":\"%p\",\"len\":%u,\"timestamp\":%" G_GINT64_FORMAT
+      "}}", *first ? "" : ",", name, record->port_index, phase,
+      record->header, (gint) getpid (), (gulong) record->thread, record->ts,
+      record->core, record->filled_len, record->omx_timestamp);
+  *first = FALSE;
+}
+
+static void
+write_instant (FILE * file, GOmxTraceRecord * record, const gchar * name,
+    gboolean * first)
+{
+  fprintf (file, "%s\n{\"name\":\"%s\",\"cat\":\"core\",\"ph\":\"i\","
+      "\"s\":\"p\",\"pid\":%d,\"tid\":%lu,\"ts\":%" G_GINT64_FORMAT ","
+      "\"args\":{\"core\":\"%p\"}}", *first ? "" : ",", name,
+      (gint) getpid (), (gulong) record->thread, record->ts, record->core);
+  *first = FALSE;
+}
+
+/*
+ * Each header is shown as a chain of async slices sharing its address as
+ * id: "client" from request to release, "component" from release to the
+ * done callback, and "queued" from there to the next request.
+ */
+static void
+trace_dump (void)
+{
+  FILE *file;
+  GHashTable *queued;
+  guint i;
+  gboolean first = TRUE;
+
+  if (!g_omx_trace_enabled)
+    return;
+
+  g_mutex_lock (trace_mutex);
+  g_omx_trace_enabled = FALSE;
+
+  file = fopen (trace_file, "w");
+  if (!file) {
+    g_warning ("could not write trace to %s", trace_file);
+    g_mutex_unlock (trace_mutex);
+    return;
+  }
+
+  fprintf (file, "{\"traceEvents\":[");
+
+  /* headers whose "queued" slice was begun; the first request has none */
+  queued = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+  for (i = 0; i < n_records; i++) {
+    GOmxTraceRecord *record = &records[i];
+
+    switch (record->type) {
+      case GOMX_TRACE_REQUEST:
+        if (g_hash_table_remove (queued, record->header))
+          write_async (file, record, "e", "queued", &first);
+        write_async (file, record, "b", "client", &first);
+        break;
+      case GOMX_TRACE_RELEASE:
+        write_async (file, record, "e", "client", &first);
+        write_async (file, record, "b", "component", &first);
+        break;
+      case GOMX_TRACE_DONE:
+        write_async (file, record, "e", "component", &first);
+        write_async (file, record, "b", "queued", &first);
+        g_hash_table_insert (queued, record->header, record->header);
+        break;
+      case GOMX_TRACE_GOT:
+        write_async (file, record, "n", "got_buffer", &first);
+        break;
+      case GOMX_TRACE_STATE:
+        write_instant (file, record, g_omx_state_name (record->value), &first);
+        break;
+      case GOMX_TRACE_FLUSH:
+        write_instant (file, record, "flush", &first);
+        break;
+      default:
+        break;
+    }
+  }
+
+  fprintf (file, "\n]}\n");
+  fclose (file);
+
+  g_hash_table_destroy (queued);
+
+  g_free (records);
+  records = NULL;
+
+  g_mutex_unlock (trace_mutex);
+}
+
+void
+g_omx_trace_init (void)
+{
+  const gchar *file;
+
+  if (trace_mutex)
+    return;
+
+  file = getenv ("GST_OMX_TRACE");
+  if (!file || !*file)
+    return;
+
+  trace_file = g_strdup (file);
+  trace_mutex = g_mutex_new ();
+  records = g_new0 (GOmxTraceRecord, MAX_RECORDS);
+
+  /* plugins are never unloaded, so this is the only reliable end */
+  atexit (trace_dump);
+
+  g_omx_trace_enabled = TRUE;
+}
@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2007-2009 Nokia Corporation.
+ *
+ * Author: Felipe Contreras <felipe.contreras@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef GSTOMX_TRACE_H
+#define GSTOMX_TRACE_H
+
+#include <glib.h>
+#include <OMX_Core.h>
+
+#include "config.h"
+
+#ifdef HAVE_SYS_SDT_H
+#include <sys/sdt.h>
+#endif
+
+/*
+ * Tracepoints
+ *
+ * With <sys/sdt.h> every trace point is also a USDT probe in the
+ * "gstomx" provider, usable from SystemTap, bpftrace, perf or LTTng.
+ * They are a nop unless attached.
+ *
+ * Setting GST_OMX_TRACE=<file> records the same points in memory and
+ * writes them as Chrome trace events (chrome://tracing, Perfetto) on
+ * exit.
+ */
+
+typedef enum GOmxTraceType GOmxTraceType;
+
+enum GOmxTraceType
+{
+    GOMX_TRACE_REQUEST,  /**< The client took a header from the port. */
+    GOMX_TRACE_RELEASE,  /**< The client gave a header to the component. */
+    GOMX_TRACE_DONE,     /**< The component gave a header back. */
+    GOMX_TRACE_GOT,      /**< The header was queued on the port. */
+    GOMX_TRACE_STATE,
+    GOMX_TRACE_FLUSH
+};
+
+extern gboolean g_omx_trace_enabled;
+
+void g_omx_trace_init (void);
+void g_omx_trace_record (GOmxTraceType type, gpointer core, guint port_index,
+                         OMX_BUFFERHEADERTYPE *omx_buffer, guint value);
+
+#ifdef HAVE_SYS_SDT_H
+#define GOMX_PROBE_BUFFER(probe, port_index, omx_buffer) \
+    DTRACE_PROBE4 (gstomx, probe, omx_buffer, port_index, \
+                   (omx_buffer)->nFilledLen, (omx_buffer)->nTimeStamp)
+#define GOMX_PROBE_CORE(probe, core, value) \
+    DTRACE_PROBE2 (gstomx, probe, core, value)
+#else
+#define GOMX_PROBE_BUFFER(probe, port_index, omx_buffer)
+#define GOMX_PROBE_CORE(probe, core, value)
+#endif /* HAVE_SYS_SDT_H */
+
+#define GOMX_TRACE_BUFFER(probe, type, core, port_index, omx_buffer) \
+G_STMT_START { \
+    GOMX_PROBE_BUFFER (probe, port_index, omx_buffer); \
+    if (G_UNLIKELY (g_omx_trace_enabled)) \
+        g_omx_trace_record (type, core, port_index, omx_buffer, 0); \
+} G_STMT_END
+
+#define GOMX_TRACE_CORE(probe, type, core, value) \
+G_STMT_START { \
+    GOMX_PROBE_CORE (probe, core, value); \
+    if (G_UNLIKELY (g_omx_trace_enabled)) \
+        g_omx_trace_record (type, core, 0, NULL, value); \
+} G_STMT_END
+
+#endif /* GSTOMX_TRACE_H */
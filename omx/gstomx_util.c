@@ -23,8 +23,13 @@
 #include "gstomx_util.h"
 #include <gst/gst.h>
 #include <dlfcn.h>
+#include <stdlib.h>             /* For posix_memalign, free */
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
 
 #include "gstomx.h"
+#include "gstomx_trace.h"
 
 GST_DEBUG_CATEGORY (gstomx_util_debug);
 
@@ -32,6 +37,10 @@ GST_DEBUG_CATEGORY (gstomx_util_debug);
 #define GST_CAT_DEFAULT gstomx_util_debug
 
 /* #define USE_ALLOCATE_BUFFER */
+/* #define USE_HUGETLB */
+
+#define CACHE_LINE_SIZE 64
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
 
 /*
  * Forward declarations
@@ -51,6 +60,16 @@ static inline void
 got_buffer (GOmxCore * core,
     GOmxPort * port, OMX_BUFFERHEADERTYPE * omx_buffer);
 
+static inline gint64 monotonic_time (void);
+
+static void port_commit_params (GOmxPort * port);
+static void param_free (gpointer data);
+
+static void dispatch_start (GOmxCore * core);
+static void dispatch_stop (GOmxCore * core);
+
+static guint core_count_ports (GOmxCore * core);
+
 static OMX_ERRORTYPE
 EventHandler (OMX_HANDLETYPE omx_handle,
     OMX_PTR app_data,
@@ -72,6 +91,8 @@ static inline void port_allocate_buffers (GOmxPort * port);
 
 static inline void port_start_buffers (GOmxPort * port);
 
+static void port_teardown_tunnel (GOmxPort * port);
+
 static OMX_CALLBACKTYPE callbacks =
     { EventHandler, EmptyBufferDone, FillBufferDone };
 
@@ -134,6 +155,8 @@ imp_new (const gchar * name)
     imp->sym_table.deinit = dlsym (handle, "OMX_Deinit");
     imp->sym_table.get_handle = dlsym (handle, "OMX_GetHandle");
     imp->sym_table.free_handle = dlsym (handle, "OMX_FreeHandle");
+    /* optional, only needed for tunneling */
+    imp->sym_table.setup_tunnel = dlsym (handle, "OMX_SetupTunnel");
 #endif
     GST_LOG ("init=%p, deinit=%p, get_handle=%p, free_handle=%p",
         imp->sym_table.init,
@@ -208,6 +231,433 @@ release_imp (GOmxImp * imp)
   g_mutex_unlock (imp->mutex);
 }
 
+/*
+ * Resource manager
+ *
+ * Hardware components can only run so many instances at once. Each
+ * library:component pair is a resource of its own, since two libraries
+ * may well use the same component names for different hardware. Limits
+ * come from GST_OMX_RESOURCES ("library:component=count,...", where a
+ * bare component name sets the limit for every library) or are learned
+ * when a component runs out. A core that finds its component full switches to its
+ * fallback if it has one, otherwise preempts a lower priority user, and
+ * waits GST_OMX_RESOURCE_TIMEOUT milliseconds for a free slot. A preempted
+ * core keeps its slot until its application shuts it down; only then does
+ * core_release() hand it on.
+ */
+
+#define DEFAULT_RESOURCE_TIMEOUT 5000
+
+struct GOmxResource
+{
+  gint limit; /**< -1 when unknown. */
+  gdouble capacity; /**< Output buffers/s with all holders busy, 0 if unknown. */
+  GList *holders; /**< Cores using the component, lowest priority first. */
+  GList *waiters; /**< Cores waiting for it, highest priority first. */
+};
+
+static GMutex *resource_mutex;
+static GCond *resource_cond;
+static GHashTable *resources;
+static glong resource_timeout = DEFAULT_RESOURCE_TIMEOUT;
+static gboolean resources_loaded;
+
+static void resources_load (void);
+
+/* Called with resource_mutex. */
+static GOmxResource *
+resource_get (const gchar * library_name, const gchar * component_name)
+{
+  GOmxResource *resource;
+  gchar *key;
+
+  if (G_UNLIKELY (!resources_loaded))
+    resources_load ();
+
+  key = g_strconcat (library_name ? library_name : "", ":", component_name,
+      NULL);
+  resource = g_hash_table_lookup (resources, key);
+  if (!resource) {
+    GOmxResource *any;
+
+    resource = g_new0 (GOmxResource, 1);
+    resource->limit = -1;
+    /* set up by a bare component name, for any library */
+    any = g_hash_table_lookup (resources, component_name);
+    if (any)
+      resource->limit = any->limit;
+    g_hash_table_insert (resources, key, resource);
+  } else {
+    g_free (key);
+  }
+
+  return resource;
+}
+
+/*
+ * Limits are read on first use rather than when the plugin loads, so they
+ * are whatever the process set up before its first component.
+ * Called with resource_mutex.
+ */
+static void
+resources_load (void)
+{
+  const gchar *env;
+
+  resources_loaded = TRUE;
+
+  env = g_getenv ("GST_OMX_RESOURCES");
+  if (env) {
+    gchar **pairs;
+    gchar **pair;
+
+    pairs = g_strsplit (env, ",", 0);
+    for (pair = pairs; *pair; pair++) {
+      GOmxResource *resource;
+      gchar *component;
+      gchar *count;
+
+      count = strrchr (*pair, '=');
+      if (!count)
+        continue;
+      *count++ = '\0';
+
+      component = strchr (*pair, ':');
+      if (component) {
+        *component++ = '\0';
+        resource = resource_get (g_strstrip (*pair), g_strstrip (component));
+      } else {
+        /* never held; only copied into each library's */
+        resource = g_new0 (GOmxResource, 1);
+        g_hash_table_replace (resources, g_strdup (g_strstrip (*pair)),
+            resource);
+      }
+      resource->limit = atoi (count);
+    }
+    g_strfreev (pairs);
+  }
+}
+
+static void
+resources_init (void)
+{
+  const gchar *env;
+
+  resource_mutex = g_mutex_new ();
+  resource_cond = g_cond_new ();
+  resources = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+
+  env = g_getenv ("GST_OMX_RESOURCE_TIMEOUT");
+  if (env)
+    resource_timeout = atol (env);
+}
+
+static gint
+compare_priority (gconstpointer a, gconstpointer b)
+{
+  const GOmxCore *core_a = a;
+  const GOmxCore *core_b = b;
+
+  if (core_a->priority < core_b->priority)
+    return -1;
+  if (core_a->priority > core_b->priority)
+    return 1;
+  return 0;
+}
+
+static gint
+compare_priority_reverse (gconstpointer a, gconstpointer b)
+{
+  return compare_priority (b, a);
+}
+
+static inline gboolean
+resource_has_room (GOmxResource * resource)
+{
+  return resource->limit < 0 ||
+      g_list_length (resource->holders) < (guint) resource->limit;
+}
+
+/* Called with resource_mutex. */
+static void
+resource_take (GOmxCore * core, GOmxResource * resource)
+{
+  resource->holders =
+      g_list_insert_sorted (resource->holders, core, compare_priority);
+  core->resource = resource;
+}
+
+/* Called with resource_mutex. */
+static gboolean
+resource_releasing (GOmxResource * resource)
+{
+  GList *l;
+
+  for (l = resource->holders; l; l = l->next) {
+    if (((GOmxCore *) l->data)->preempted)
+      return TRUE;
+  }
+
+  return FALSE;
+}
+
+/*
+ * Makes the core fail, so its element errors out and its application shuts
+ * it down; the slot is free once that reaches core_release(). Called with
+ * resource_mutex, which is dropped while the victim is flushed;
+ * core_release() waits for that to finish.
+ */
+static void
+core_preempt (GOmxCore * core)
+{
+  GST_WARNING ("preempting core %p, priority %d", core, core->priority);
+  core->preempted = TRUE;
+  core->preempting = TRUE;
+  g_mutex_unlock (resource_mutex);
+
+  g_mutex_lock (core->omx_state_mutex);
+  core->omx_error = OMX_ErrorResourcesPreempted;
+  g_mutex_unlock (core->omx_state_mutex);
+
+  g_omx_core_flush_start (core);
+
+  g_mutex_lock (resource_mutex);
+  core->preempting = FALSE;
+  g_cond_broadcast (resource_cond);
+}
+
+/*
+ * Reserve a slot for the component, or for the fallback, which then
+ * replaces library_name and component_name.
+ */
+static gboolean
+core_acquire (GOmxCore * core,
+    const gchar ** library_name, const gchar ** component_name)
+{
+  GOmxResource *resource;
+  GTimeVal deadline;
+  gboolean ret = FALSE;
+  gboolean waiting = FALSE;
+
+  g_get_current_time (&deadline);
+  g_time_val_add (&deadline, resource_timeout * 1000);
+
+  g_mutex_lock (resource_mutex);
+
+  resource = resource_get (*library_name, *component_name);
+
+  while (TRUE) {
+    GOmxCore *victim;
+
+    if (resource_has_room (resource) &&
+        (!resource->waiters || resource->waiters->data == core)) {
+      resource_take (core, resource);
+      ret = TRUE;
+      break;
+    }
+
+    if (core->fallback_component) {
+      GOmxResource *fallback;
+
+      fallback = resource_get (core->fallback_library,
+          core->fallback_component);
+      if (resource_has_room (fallback)) {
+        GST_INFO ("%s is busy, using %s", *component_name,
+            core->fallback_component);
+        resource_take (core, fallback);
+        *library_name = core->fallback_library;
+        *component_name = core->fallback_component;
+        ret = TRUE;
+        break;
+      }
+    }
+
+    if (!waiting) {
+      resource->waiters =
+          g_list_insert_sorted (resource->waiters, core,
+          compare_priority_reverse);
+      waiting = TRUE;
+    }
+
+    /* one at a time; the last one may not have let go yet */
+    victim = NULL;
+    if (resource->holders && !resource_releasing (resource)) {
+      GOmxCore *lowest = resource->holders->data;
+
+      if (lowest->priority < core->priority)
+        victim = lowest;
+    }
+
+    /* the lock was dropped; it may even be back already. If not, the
+     * wait below lasts until its core_release() */
+    if (victim) {
+      core_preempt (victim);
+      continue;
+    }
+
+    if (!g_cond_timed_wait (resource_cond, resource_mutex, &deadline)) {
+      GST_ERROR ("timed out waiting for %s", *component_name);
+      break;
+    }
+  }
+
+  if (waiting)
+    resource->waiters = g_list_remove (resource->waiters, core);
+
+  /* the next waiter might fit now */
+  g_cond_broadcast (resource_cond);
+
+  g_mutex_unlock (resource_mutex);
+
+  return ret;
+}
+
+/* Called with resource_mutex. */
+static void
+resource_account (GOmxCore * core, GOmxResource * resource)
+{
+  gint64 elapsed;
+  gdouble sample;
+
+  if (!core->run_start || core->processed <= 0)
+    return;
+
+  elapsed = monotonic_time () - core->run_start;
+  if (elapsed <= 0)
+    return;
+
+  /* what this component managed while shared this way */
+  sample = (gdouble) core->processed * G_USEC_PER_SEC / elapsed *
+      g_list_length (resource->holders);
+
+  if (resource->capacity > 0)
+    resource->capacity = 0.75 * resource->capacity + 0.25 * sample;
+  else
+    resource->capacity = sample;
+
+  core->run_start = 0;
+}
+
+static void
+core_release (GOmxCore * core)
+{
+  if (!core->resource)
+    return;
+
+  g_mutex_lock (resource_mutex);
+  while (core->preempting)
+    g_cond_wait (resource_cond, resource_mutex);
+  resource_account (core, core->resource);
+  core->resource->holders = g_list_remove (core->resource->holders, core);
+  core->resource = NULL;
+  core->preempted = FALSE;
+  g_cond_broadcast (resource_cond);
+  g_mutex_unlock (resource_mutex);
+}
+
+/* The component said no; it can't take more than the others using it. */
+static void
+core_exhausted (GOmxCore * core)
+{
+  GOmxResource *resource;
+  guint others;
+
+  resource = core->resource;
+  if (!resource)
+    return;
+
+  g_mutex_lock (resource_mutex);
+  others = g_list_length (resource->holders) - 1;
+  /* with no one else here, another process has it; don't learn that */
+  if (others > 0 && (resource->limit < 0 || (guint) resource->limit > others)) {
+    GST_INFO ("limiting to %u instances", others);
+    resource->limit = others;
+  }
+  g_mutex_unlock (resource_mutex);
+}
+
+/*
+ * Pick the candidate that should give a new stream the most throughput:
+ * known capacity, or the average of the known ones, shared among the
+ * current holders plus us. Full components only win if all are.
+ */
+static void
+core_pick_candidate (gchar ** candidates,
+    const gchar ** library_name, const gchar ** component_name)
+{
+  gdouble known = 0.0;
+  gdouble best_score = -1.0;
+  gboolean best_full = TRUE;
+  guint known_count = 0;
+  gchar **components;
+  guint i;
+
+  components = g_new0 (gchar *, g_strv_length (candidates));
+
+  /* "lib : comp, comp" is fine too; each becomes "lib\0comp" */
+  for (i = 0; candidates[i]; i++) {
+    gchar **parts;
+
+    parts = g_strsplit (candidates[i], ":", 2);
+    g_free (candidates[i]);
+    if (parts[1] && *g_strstrip (parts[0]))
+      candidates[i] = g_strconcat (parts[0], ":", g_strstrip (parts[1]),
+          NULL);
+    else
+      candidates[i] = g_strconcat (*library_name ? *library_name : "", ":",
+          g_strstrip (parts[1] ? parts[1] : parts[0]), NULL);
+    g_strfreev (parts);
+
+    components[i] = strchr (candidates[i], ':');
+    *components[i]++ = '\0';
+  }
+
+  g_mutex_lock (resource_mutex);
+
+  for (i = 0; candidates[i]; i++) {
+    GOmxResource *resource;
+
+    if (!*components[i])
+      continue;
+
+    resource = resource_get (candidates[i], components[i]);
+    if (resource->capacity > 0) {
+      known += resource->capacity;
+      known_count++;
+    }
+  }
+  known = known_count ? known / known_count : 1.0;
+
+  for (i = 0; candidates[i]; i++) {
+    GOmxResource *resource;
+    gboolean full;
+    gdouble score;
+
+    if (!*components[i])
+      continue;
+
+    resource = resource_get (candidates[i], components[i]);
+    full = !resource_has_room (resource);
+    score = (resource->capacity > 0 ? resource->capacity : known) /
+        (g_list_length (resource->holders) + 1);
+
+    GST_DEBUG ("%s:%s holders=%u capacity=%.1f score=%.1f%s", candidates[i],
+        components[i], g_list_length (resource->holders), resource->capacity,
+        score, full ? " (full)" : "");
+
+    if ((best_full && !full) || (full == best_full && score > best_score)) {
+      best_score = score;
+      best_full = full;
+      *library_name = candidates[i];
+      *component_name = components[i];
+    }
+  }
+
+  g_mutex_unlock (resource_mutex);
+
+  g_free (components);
+}
+
 void
 g_omx_init (void)
 {
@@ -217,6 +667,8 @@ g_omx_init (void)
     implementations =
         g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
         (GDestroyNotify) imp_free);
+    resources_init ();
+    g_omx_trace_init ();
     initialized = true;
   }
 }
@@ -225,6 +677,10 @@ void
 g_omx_deinit (void)
 {
   if (initialized) {
+    g_hash_table_destroy (resources);
+    resources_loaded = FALSE;
+    g_cond_free (resource_cond);
+    g_mutex_free (resource_mutex);
     g_hash_table_destroy (implementations);
     g_mutex_free (imp_mutex);
     initialized = false;
@@ -253,7 +709,7 @@ g_omx_core_new (void)
 
   core->omx_state = OMX_StateInvalid;
 
-  core->settings_changed = FALSE;
+  core->settings_generation = 0;
 
   return core;
 }
@@ -270,29 +726,129 @@ g_omx_core_free (GOmxCore * core)
 
   g_ptr_array_free (core->ports, TRUE);
 
+  g_free (core->fallback_library);
+  g_free (core->fallback_component);
+  g_free (core->candidates);
+
   g_free (core);
 }
 
 void
-g_omx_core_init (GOmxCore * core,
+g_omx_core_set_fallback (GOmxCore * core,
+    const gchar * library_name, const gchar * component_name)
+{
+  g_free (core->fallback_library);
+  g_free (core->fallback_component);
+  core->fallback_library = component_name ? g_strdup (library_name) : NULL;
+  core->fallback_component = g_strdup (component_name);
+}
+
+void
+g_omx_core_set_candidates (GOmxCore * core, const gchar * candidates)
+{
+  g_free (core->candidates);
+  core->candidates = g_strdup (candidates);
+}
+
+static void
+core_get_handle (GOmxCore * core,
     const gchar * library_name, const gchar * component_name)
 {
-  GST_LOG ("Enter, library_name=%s, component_name=%s", library_name,
-      component_name);
   core->imp = request_imp (library_name);
 
   if (!core->imp) {
     core->omx_error = OMX_ErrorUndefined;
-    GST_ERROR ("Leave, OMX_ErrorUndefined");
     return;
   }
 
+  /* callbacks may come as soon as there's a handle */
+  if (core->use_dispatch)
+    dispatch_start (core);
+
   core->omx_error =
       core->imp->sym_table.get_handle (&core->omx_handle,
       (gchar *) component_name, core, &callbacks);
+}
+
+void
+g_omx_core_init (GOmxCore * core,
+    const gchar * library_name, const gchar * component_name)
+{
+  gchar **candidates = NULL;
+
+  GST_LOG ("Enter, library_name=%s, component_name=%s", library_name,
+      component_name);
+
+  core->omx_error = OMX_ErrorNone;
+
+  if (core->candidates && *core->candidates) {
+    candidates = g_strsplit (core->candidates, ",", 0);
+    core_pick_candidate (candidates, &library_name, &component_name);
+    GST_INFO ("using %s:%s", library_name, component_name);
+  }
+
+  if (!core_acquire (core, &library_name, &component_name)) {
+    core->omx_error = OMX_ErrorInsufficientResources;
+    GST_ERROR ("Leave, OMX_ErrorInsufficientResources");
+    goto leave;
+  }
+
+  core_get_handle (core, library_name, component_name);
+
+  /* out of hardware; degrade rather than fail */
+  if (core->omx_error == OMX_ErrorInsufficientResources &&
+      core->fallback_component &&
+      strcmp (component_name, core->fallback_component) != 0) {
+    GST_WARNING ("%s is exhausted, falling back to %s", component_name,
+        core->fallback_component);
+
+    dispatch_stop (core);
+    release_imp (core->imp);
+    core->imp = NULL;
+
+    core_exhausted (core);
+    core_release (core);
+
+    library_name = core->fallback_library;
+    component_name = core->fallback_component;
+
+    g_mutex_lock (resource_mutex);
+    resource_take (core, resource_get (library_name, component_name));
+    g_mutex_unlock (resource_mutex);
+
+    core_get_handle (core, library_name, component_name);
+  }
+
+  if (core->omx_error) {
+    /* the element fails to start, so g_omx_core_deinit() won't come */
+    if (core->imp) {
+      dispatch_stop (core);
+      release_imp (core->imp);
+      core->imp = NULL;
+    }
+    core_release (core);
+    GST_ERROR ("Leave, %s", g_omx_error_name (core->omx_error));
+    goto leave;
+  }
+
   core->omx_state = OMX_StateLoaded;
+
+  {
+    const gchar *element = NULL;
+
+    if (GST_IS_OBJECT (core->client_data))
+      element = GST_OBJECT_NAME (core->client_data);
+    core->metrics = g_omx_metrics_register (element, component_name);
+    GOMX_METRICS_SET (core->metrics, state, OMX_StateLoaded);
+
+    core->capture = g_omx_capture_open (component_name);
+  }
+
   GST_LOG ("Leave, omx_error=%s, omx_handle=%p", g_omx_error_name(core->omx_error),
       core->omx_handle);
+
+leave:
+  g_strfreev (candidates);
 }
 
 void
@@ -303,6 +859,17 @@ g_omx_core_deinit (GOmxCore * core)
 
   core->omx_error = core->imp->sym_table.free_handle (core->omx_handle);
 
+  /* no more callbacks; handle what's left */
+  dispatch_stop (core);
+
+  core_release (core);
+
+  g_omx_metrics_unregister (core->metrics);
+  core->metrics = NULL;
+
+  g_omx_capture_close (core->capture);
+  core->capture = NULL;
+
   if (core->omx_error) {
     GST_ERROR ("%s", g_omx_error_name(core->omx_error));
     return;
@@ -333,15 +900,75 @@ core_for_each_port (GOmxCore * core, GOmxPortFunc func)
   GST_LOG ("Leave");
 }
 
+static gboolean
+core_wait_for_resources (GOmxCore * core)
+{
+  GTimeVal deadline;
+  gboolean acquired;
+
+  core_exhausted (core);
+
+  core_for_each_port (core, port_free_buffers);
+  core->omx_error = OMX_ErrorNone;
+  core->resources_acquired = FALSE;
+  g_omx_core_flush_stop (core, FALSE);
+
+  GST_INFO ("waiting for resources");
+
+  if (OMX_SendCommand (core->omx_handle, OMX_CommandStateSet,
+          OMX_StateWaitForResources, NULL) != OMX_ErrorNone)
+    goto fail;
+  if (!wait_for_state (core, OMX_StateWaitForResources))
+    goto fail;
+
+  g_get_current_time (&deadline);
+  g_time_val_add (&deadline, resource_timeout * 1000);
+
+  g_mutex_lock (core->omx_state_mutex);
+  while (!core->flushing && !core->resources_acquired) {
+    if (!g_cond_timed_wait (core->omx_state_condition, core->omx_state_mutex,
+            &deadline))
+      break;
+  }
+  acquired = core->resources_acquired;
+  g_mutex_unlock (core->omx_state_mutex);
+
+  if (!acquired)
+    goto fail;
+
+  change_state (core, OMX_StateIdle);
+  core_for_each_port (core, port_allocate_buffers);
+
+  return wait_for_state (core, OMX_StateIdle);
+
+fail:
+  if (!core->omx_error)
+    core->omx_error = OMX_ErrorInsufficientResources;
+  return FALSE;
+}
+
 gboolean
 g_omx_core_prepare (GOmxCore * core)
 {
+  /* everything configured while Loaded goes in one batch */
+  core_for_each_port (core, port_commit_params);
+
+  /* once; the component's ports don't change */
+  core->n_ports = core_count_ports (core);
+
   change_state (core, OMX_StateIdle);
 
   /* Allocate buffers. */
   core_for_each_port (core, port_allocate_buffers);
 
-  return wait_for_state (core, OMX_StateIdle);
+  if (wait_for_state (core, OMX_StateIdle))
+    return TRUE;
+
+  if (core->omx_error != OMX_ErrorInsufficientResources)
+    return FALSE;
+
+  /* busy hardware; queue for it instead of failing */
+  return core_wait_for_resources (core);
 }
 
 gboolean
@@ -353,6 +980,9 @@ g_omx_core_start (GOmxCore * core)
 
   core_for_each_port (core, port_start_buffers);
 
+  core->processed = 0;
+  core->run_start = monotonic_time ();
+
   return TRUE;
 
 fail:
@@ -371,6 +1001,9 @@ g_omx_core_pause (GOmxCore * core)
 gboolean
 g_omx_core_finish (GOmxCore * core)
 {
+  /* the peer component might not be going down with us */
+  core_for_each_port (core, port_teardown_tunnel);
+
   /* if component in error, do not expect it to handle state change */
   if (!core->omx_error) {
     change_state (core, OMX_StateIdle);
@@ -422,6 +1055,23 @@ g_omx_core_setup_port (GOmxCore * core, OMX_PARAM_PORTDEFINITIONTYPE * omx_port)
   return port;
 }
 
+GOmxPort *
+g_omx_core_port (GOmxCore * core, guint index)
+{
+  GOmxPort *port;
+
+  port = g_omx_core_get_port (core, index);
+
+  if (!port) {
+    port = g_omx_port_new (core);
+    port->port_index = index;
+    port->definition.nPortIndex = index;
+    g_ptr_array_insert (core->ports, index, port);
+  }
+
+  return port;
+}
+
 static inline GOmxPort *
 g_omx_core_get_port (GOmxCore * core, guint index)
 {
@@ -444,6 +1094,15 @@ g_omx_core_wait_for_done (GOmxCore * core)
   g_omx_sem_down (core->done_sem);
 }
 
+/* Forget a done left over from before a flush. */
+void
+g_omx_core_reset_done (GOmxCore * core)
+{
+  g_mutex_lock (core->done_sem->mutex);
+  core->done_sem->counter = 0;
+  g_mutex_unlock (core->done_sem->mutex);
+}
+
 void
 g_omx_core_flush_start (GOmxCore * core)
 {
@@ -454,11 +1113,100 @@ g_omx_core_flush_start (GOmxCore * core)
   g_mutex_unlock (core->omx_state_mutex);
 }
 
-void
-g_omx_core_flush_stop (GOmxCore * core, gboolean flush_port)
+/* Give the output headers the component returned back to it. */
+static void
+port_reclaim_output (GOmxPort * port)
 {
-  if (flush_port)
+  OMX_BUFFERHEADERTYPE *omx_buffer;
+
+  if (port->type != GOMX_PORT_OUTPUT || port->tunneled)
+    return;
+
+  while ((omx_buffer = async_queue_pop_forced (port->queue))) {
+    omx_buffer->nFilledLen = 0;
+    omx_buffer->nFlags = 0;
+    g_omx_port_release_buffer (port, omx_buffer);
+  }
+}
+
+/*
+ * OMX_ALL is acked once per port of the component, which may have more
+ * ports than the element set up.
+ */
+static guint
+core_count_ports (GOmxCore * core)
+{
+  static const OMX_INDEXTYPE domains[] = {
+    OMX_IndexParamAudioInit,
+    OMX_IndexParamImageInit,
+    OMX_IndexParamVideoInit,
+    OMX_IndexParamOtherInit
+  };
+  guint i;
+  guint count = 0;
+
+  for (i = 0; i < G_N_ELEMENTS (domains); i++) {
+    OMX_PORT_PARAM_TYPE param;
+
+    memset (&param, 0, sizeof (param));
+    param.nSize = sizeof (OMX_PORT_PARAM_TYPE);
+    param.nVersion.s.nVersionMajor = 1;
+    param.nVersion.s.nVersionMinor = 1;
+
+    if (OMX_GetParameter (core->omx_handle, domains[i], &param) ==
+        OMX_ErrorNone)
+      count += param.nPorts;
+  }
+
+  if (count == 0) {
+    guint index;
+
+    for (index = 0; index < core->ports->len; index++) {
+      if (g_omx_core_get_port (core, index))
+        count++;
+    }
+  }
+
+  return count;
+}
+
+/*
+ * Flush every port with a single command. The component flushes them in
+ * parallel and acks each one; buffers stay allocated and the state stays
+ * the same.
+ */
+static void
+core_flush_ports (GOmxCore * core)
+{
+  guint count;
+  OMX_ERRORTYPE error;
+
+  if (core->omx_state == OMX_StateLoaded || core->omx_state == OMX_StateInvalid)
+    return;
+
+  count = core->n_ports;
+
+  GOMX_TRACE_CORE (flush, GOMX_TRACE_FLUSH, core, OMX_ALL);
+
+  error = OMX_SendCommand (core->omx_handle, OMX_CommandFlush, OMX_ALL, NULL);
+  if (G_UNLIKELY (error != OMX_ErrorNone)) {
+    GST_WARNING ("flush all failed: %s, flushing one by one",
+        g_omx_error_name (error));
     core_for_each_port (core, g_omx_port_flush);
+    return;
+  }
+
+  while (count--)
+    g_omx_sem_down (core->flush_sem);
+
+  core_for_each_port (core, port_reclaim_output);
+}
+
+void
+g_omx_core_flush_stop (GOmxCore * core, gboolean flush_port)
+{
+  if (flush_port)
+    core_flush_ports (core);
   core_for_each_port (core, g_omx_port_resume);
   g_mutex_lock (core->omx_state_mutex);
   core->flushing = FALSE;
@@ -478,22 +1226,33 @@ g_omx_port_new (GOmxCore * core)
   port->core = core;
   port->num_buffers = 0;
   port->buffer_size = 0;
+  port->buffer_alignment = 0;
   port->buffers = NULL;
+  port->buffer_data = NULL;
+  port->arena = NULL;
 
   port->enabled = TRUE;
   port->queue = async_queue_new ();
   port->mutex = g_mutex_new ();
 
+  port->definition.nSize = sizeof (OMX_PARAM_PORTDEFINITIONTYPE);
+  port->definition.nVersion.s.nVersionMajor = 1;
+  port->definition.nVersion.s.nVersionMinor = 1;
+  port->params = g_hash_table_new_full (NULL, NULL, NULL, param_free);
+
   return port;
 }
 
 void
 g_omx_port_free (GOmxPort * port)
 {
+  g_hash_table_destroy (port->params);
   g_mutex_free (port->mutex);
   async_queue_free (port->queue);
 
   g_free (port->buffers);
+  g_free (port->buffer_data);
+  g_free (port->release_time);
   g_free (port);
 }
 
@@ -517,31 +1276,343 @@ g_omx_port_setup (GOmxPort * port, OMX_PARAM_PORTDEFINITIONTYPE * omx_port)
     /** @todo should it be nBufferCountMin? */
   port->num_buffers = omx_port->nBufferCountActual;
   port->buffer_size = omx_port->nBufferSize;
+  port->buffer_alignment = omx_port->nBufferAlignment;
   port->port_index = omx_port->nPortIndex;
 
   g_free (port->buffers);
   port->buffers = g_new0 (OMX_BUFFERHEADERTYPE *, port->num_buffers);
+  g_free (port->buffer_data);
+  port->buffer_data = g_new0 (OMX_U8 *, port->num_buffers);
+  g_free (port->release_time);
+  port->release_time = g_new0 (gint64, port->num_buffers);
+}
+
+/*
+ * Parameter cache
+ *
+ * Each Get/SetParameter can be a round trip to a DSP, so ports keep their
+ * parameters. Changes made while Loaded are sent in g_omx_core_prepare,
+ * later ones right away. A port settings change drops the cached values.
+ */
+
+typedef struct
+{
+  OMX_U32 nSize;
+  OMX_VERSIONTYPE nVersion;
+  OMX_U32 nPortIndex;
+} GOmxParamHeader;
+
+typedef struct
+{
+  gpointer data;
+  gint generation; /**< -1 until fetched. */
+  gboolean dirty;
+} GOmxParam;
+
+static void
+param_free (gpointer data)
+{
+  GOmxParam *param = data;
+
+  g_free (param->data);
+  g_free (param);
+}
+
+/* Called from the component's thread, possibly inside a SetParameter
+ * we issued; must not take the port lock. */
+static void
+port_invalidate_params (GOmxPort * port)
+{
+  g_atomic_int_set (&port->definition_valid, FALSE);
+  g_atomic_int_inc (&port->params_generation);
+}
+
+OMX_PARAM_PORTDEFINITIONTYPE *
+g_omx_port_get_definition (GOmxPort * port)
+{
+  if (G_UNLIKELY (!g_atomic_int_get (&port->definition_valid))) {
+    g_mutex_lock (port->mutex);
+    if (!port->definition_dirty) {
+      OMX_GetParameter (port->core->omx_handle, OMX_IndexParamPortDefinition,
+          &port->definition);
+    }
+    g_atomic_int_set (&port->definition_valid, TRUE);
+    g_mutex_unlock (port->mutex);
+  }
+
+  return &port->definition;
+}
+
+gpointer
+g_omx_port_get_param (GOmxPort * port, OMX_INDEXTYPE index, gsize size)
+{
+  GOmxParam *param;
+
+  g_mutex_lock (port->mutex);
+
+  param = g_hash_table_lookup (port->params, GINT_TO_POINTER (index));
+  if (!param) {
+    GOmxParamHeader *header;
+
+    param = g_new0 (GOmxParam, 1);
+    param->data = g_malloc0 (size);
+    param->generation = -1;
+
+    header = param->data;
+    header->nSize = size;
+    header->nVersion.s.nVersionMajor = 1;
+    header->nVersion.s.nVersionMinor = 1;
+    header->nPortIndex = port->port_index;
+
+    g_hash_table_insert (port->params, GINT_TO_POINTER (index), param);
+  }
+
+  /* ours is newer than the component's if it is still dirty */
+  if (!param->dirty &&
+      param->generation != g_atomic_int_get (&port->params_generation)) {
+    param->generation = g_atomic_int_get (&port->params_generation);
+    OMX_GetParameter (port->core->omx_handle, index, param->data);
+  }
+
+  g_mutex_unlock (port->mutex);
+
+  return param->data;
+}
+
+void
+g_omx_port_definition_changed (GOmxPort * port)
+{
+  g_mutex_lock (port->mutex);
+  port->definition_dirty = TRUE;
+  g_mutex_unlock (port->mutex);
+
+  if (port->core->omx_state != OMX_StateLoaded)
+    port_commit_params (port);
+}
+
+void
+g_omx_port_param_changed (GOmxPort * port, OMX_INDEXTYPE index)
+{
+  GOmxParam *param;
+
+  g_mutex_lock (port->mutex);
+  param = g_hash_table_lookup (port->params, GINT_TO_POINTER (index));
+  if (param)
+    param->dirty = TRUE;
+  g_mutex_unlock (port->mutex);
+
+  if (port->core->omx_state != OMX_StateLoaded)
+    port_commit_params (port);
+}
+
+static void
+param_commit (gpointer key, gpointer value, gpointer user_data)
+{
+  GOmxPort *port = user_data;
+  GOmxParam *param = value;
+
+  if (!param->dirty)
+    return;
+
+  OMX_SetParameter (port->core->omx_handle, GPOINTER_TO_INT (key),
+      param->data);
+  param->dirty = FALSE;
+  /* the component may have adjusted it */
+  param->generation = -1;
+}
+
+static void
+port_commit_params (GOmxPort * port)
+{
+  g_mutex_lock (port->mutex);
+
+  g_hash_table_foreach (port->params, param_commit, port);
+
+  if (port->definition_dirty) {
+    OMX_SetParameter (port->core->omx_handle, OMX_IndexParamPortDefinition,
+        &port->definition);
+    port->definition_dirty = FALSE;
+
+    /* buffer requirements follow the format */
+    OMX_GetParameter (port->core->omx_handle, OMX_IndexParamPortDefinition,
+        &port->definition);
+    g_atomic_int_set (&port->definition_valid, TRUE);
+
+    if (port->core->omx_state == OMX_StateLoaded && port->buffers)
+      g_omx_port_setup (port, &port->definition);
+  }
+
+  g_mutex_unlock (port->mutex);
+}
+
+static gsize
+port_slot_alignment (GOmxPort * port)
+{
+  gsize align;
+
+  align = MAX (port->buffer_alignment, CACHE_LINE_SIZE);
+
+  /* nBufferAlignment is not required to be a power of two. */
+  while (align & (align - 1))
+    align += align & -align;
+
+  return align;
+}
+
+static gpointer
+arena_alloc (gsize size, gsize align, gboolean * mapped)
+{
+  gpointer data = NULL;
+
+  *mapped = FALSE;
+
+  if (size >= HUGE_PAGE_SIZE) {
+    size = (size + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+
+#if defined(USE_HUGETLB) && defined(MAP_HUGETLB)
+    data = mmap (NULL, size, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (data == MAP_FAILED) {
+      GST_DEBUG ("no explicit huge pages available, size=%" G_GSIZE_FORMAT,
+          size);
+      data = NULL;
+    }
+#endif /* USE_HUGETLB */
+
+    if (!data) {
+      data = mmap (NULL, size, PROT_READ | PROT_WRITE,
+          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (data == MAP_FAILED)
+        data = NULL;
+#ifdef MADV_HUGEPAGE
+      else
+        madvise (data, size, MADV_HUGEPAGE);
+#endif
+    }
+
+    if (data) {
+      *mapped = TRUE;
+      return data;
+    }
+  }
+
+  if (posix_memalign (&data, align, size) != 0)
+    return NULL;
+
+  return data;
+}
+
+static void
+arena_free (gpointer data, gsize size, gboolean mapped)
+{
+  if (mapped) {
+    size = (size + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+    munmap (data, size);
+  } else {
+    free (data);
+  }
 }
 
 static void
 port_allocate_buffers (GOmxPort * port)
 {
   guint i;
+  gsize slot_size;
+
+  /* the supplier component allocates tunneled buffers */
+  if (port->tunneled)
+    return;
+
+  if (port->num_buffers == 0)
+    return;
+
+  if (port->core->capture)
+    g_omx_capture_port (port->core->capture, port->port_index,
+        port->num_buffers, port->buffer_size);
+
+  slot_size = port->buffer_size;
+
+#ifndef USE_ALLOCATE_BUFFER
+  {
+    gsize align;
+
+    align = port_slot_alignment (port);
+    slot_size = (slot_size + align - 1) & ~(align - 1);
+
+    port->arena_size = slot_size * port->num_buffers;
+    port->arena = arena_alloc (port->arena_size, align, &port->arena_mapped);
+
+    if (G_UNLIKELY (!port->arena)) {
+      GST_ERROR ("failed to allocate %" G_GSIZE_FORMAT " bytes for port %u",
+          port->arena_size, port->port_index);
+      return;
+    }
+
+    GST_DEBUG ("port %u: %u slots of %" G_GSIZE_FORMAT " bytes, align=%"
+        G_GSIZE_FORMAT ", mapped=%d", port->port_index, port->num_buffers,
+        slot_size, align, port->arena_mapped);
+  }
+#endif /* USE_ALLOCATE_BUFFER */
 
   for (i = 0; i < port->num_buffers; i++) {
-    gpointer buffer_data;
     guint size;
 
     size = port->buffer_size;
-    buffer_data = g_malloc (size);
 
 #ifdef USE_ALLOCATE_BUFFER
     OMX_AllocateBuffer (port->core->omx_handle,
         &port->buffers[i], port->port_index, NULL, size);
 #else
     OMX_UseBuffer (port->core->omx_handle,
-        &port->buffers[i], port->port_index, NULL, size, buffer_data);
+        &port->buffers[i], port->port_index, NULL, size,
+        (OMX_U8 *) port->arena + i * slot_size);
 #endif /* USE_ALLOCATE_BUFFER */
+
+    if (port->buffers[i])
+      port->buffer_data[i] = port->buffers[i]->pBuffer;
+  }
+}
+
+static gint
+port_buffer_index (GOmxPort * port, OMX_BUFFERHEADERTYPE * omx_buffer)
+{
+  guint i;
+
+  for (i = 0; i < port->num_buffers; i++) {
+    if (port->buffers[i] == omx_buffer)
+      return i;
+  }
+
+  return -1;
+}
+
+static inline void
+capture_buffer (GOmxCore * core, GOmxPort * port, GOmxCaptureType type,
+    OMX_BUFFERHEADERTYPE * omx_buffer)
+{
+  if (G_LIKELY (!core->capture || !port))
+    return;
+
+  g_omx_capture_buffer (core->capture, type, port->port_index,
+      port_buffer_index (port, omx_buffer), omx_buffer);
+}
+
+/* Give a header its own memory back after a GstBuffer was lent to it. */
+static void
+port_reclaim_buffer (GOmxPort * port, OMX_BUFFERHEADERTYPE * omx_buffer)
+{
+  gint i;
+
+  if (!omx_buffer->pAppPrivate)
+    return;
+
+  gst_buffer_unref (omx_buffer->pAppPrivate);
+  omx_buffer->pAppPrivate = NULL;
+
+  i = port_buffer_index (port, omx_buffer);
+  if (i >= 0) {
+    omx_buffer->pBuffer = port->buffer_data[i];
+    omx_buffer->nAllocLen = port->buffer_size;
   }
 }
 
@@ -556,16 +1627,19 @@ port_free_buffers (GOmxPort * port)
     omx_buffer = port->buffers[i];
 
     if (omx_buffer) {
-#if 0
-            /** @todo how shall we free that buffer? */
-      g_free (omx_buffer->pBuffer);
-      omx_buffer->pBuffer = NULL;
-#endif
-
+      if (port->type == GOMX_PORT_INPUT)
+        port_reclaim_buffer (port, omx_buffer);
       OMX_FreeBuffer (port->core->omx_handle, port->port_index, omx_buffer);
       port->buffers[i] = NULL;
     }
   }
+
+  /* The component is done with the slots, release them in one go. */
+  if (port->arena) {
+    arena_free (port->arena, port->arena_size, port->arena_mapped);
+    port->arena = NULL;
+    port->arena_size = 0;
+  }
 }
 
 static void
@@ -573,6 +1647,9 @@ port_start_buffers (GOmxPort * port)
 {
   guint i;
 
+  if (port->tunneled)
+    return;
+
   for (i = 0; i < port->num_buffers; i++) {
     OMX_BUFFERHEADERTYPE *omx_buffer;
 
@@ -596,17 +1673,57 @@ g_omx_port_push_buffer (GOmxPort * port, OMX_BUFFERHEADERTYPE * omx_buffer)
 OMX_BUFFERHEADERTYPE *
 g_omx_port_request_buffer (GOmxPort * port)
 {
-  return async_queue_pop (port->queue);
+  OMX_BUFFERHEADERTYPE *omx_buffer;
+
+  omx_buffer = async_queue_pop (port->queue);
+  if (omx_buffer)
+    GOMX_TRACE_BUFFER (request_buffer, GOMX_TRACE_REQUEST, port->core,
+        port->port_index, omx_buffer);
+
+  return omx_buffer;
+}
+
+OMX_BUFFERHEADERTYPE *
+g_omx_port_try_request_buffer (GOmxPort * port)
+{
+  OMX_BUFFERHEADERTYPE *omx_buffer;
+
+  omx_buffer = async_queue_try_pop (port->queue);
+  if (omx_buffer)
+    GOMX_TRACE_BUFFER (request_buffer, GOMX_TRACE_REQUEST, port->core,
+        port->port_index, omx_buffer);
+
+  return omx_buffer;
 }
 
 void
 g_omx_port_release_buffer (GOmxPort * port, OMX_BUFFERHEADERTYPE * omx_buffer)
 {
+  GOmxMetricsSlot *metrics = port->core->metrics;
+
+  GOMX_TRACE_BUFFER (release_buffer, GOMX_TRACE_RELEASE, port->core,
+      port->port_index, omx_buffer);
+
   switch (port->type) {
     case GOMX_PORT_INPUT:
+      capture_buffer (port->core, port, GOMX_CAPTURE_EMPTY_THIS_BUFFER,
+          omx_buffer);
+      if (metrics) {
+        gint i;
+
+        GOMX_METRICS_ADD (metrics, buffers_in, 1);
+        GOMX_METRICS_ADD (metrics, bytes_in, omx_buffer->nFilledLen);
+        GOMX_METRICS_SET (metrics, in_queue, async_queue_length (port->queue));
+
+        i = port_buffer_index (port, omx_buffer);
+        if (i >= 0)
+          port->release_time[i] = monotonic_time ();
+      }
       OMX_EmptyThisBuffer (port->core->omx_handle, omx_buffer);
       break;
     case GOMX_PORT_OUTPUT:
+      capture_buffer (port->core, port, GOMX_CAPTURE_FILL_THIS_BUFFER,
+          omx_buffer);
       OMX_FillThisBuffer (port->core->omx_handle, omx_buffer);
       break;
     default:
@@ -629,13 +1746,14 @@ g_omx_port_pause (GOmxPort * port)
 void
 g_omx_port_flush (GOmxPort * port)
 {
-  if (port->type == GOMX_PORT_OUTPUT) {
+  if (port->type == GOMX_PORT_OUTPUT && !port->tunneled) {
     OMX_BUFFERHEADERTYPE *omx_buffer;
     while ((omx_buffer = async_queue_pop_forced (port->queue))) {
       omx_buffer->nFilledLen = 0;
       g_omx_port_release_buffer (port, omx_buffer);
     }
   } else {
+    GOMX_TRACE_CORE (flush, GOMX_TRACE_FLUSH, port->core, port->port_index);
     OMX_SendCommand (port->core->omx_handle, OMX_CommandFlush, port->port_index,
         NULL);
     g_omx_sem_down (port->core->flush_sem);
@@ -682,6 +1800,178 @@ g_omx_port_finish (GOmxPort * port)
   async_queue_disable (port->queue);
 }
 
+/* Both ports of a tunnel have to change together, otherwise the
+ * supplier and non-supplier wait for each other. */
+static void
+tunnel_send_command (GOmxPort * port, GOmxPort * peer, OMX_COMMANDTYPE cmd)
+{
+  OMX_SendCommand (port->core->omx_handle, cmd, port->port_index, NULL);
+  OMX_SendCommand (peer->core->omx_handle, cmd, peer->port_index, NULL);
+
+  g_omx_sem_down (port->core->port_sem);
+  g_omx_sem_down (peer->core->port_sem);
+}
+
+#define TUNNEL_DRAIN_TIMEOUT 1000
+
+/*
+ * Disables an output port, handing what the component already produced to
+ * drain instead of dropping it.
+ */
+static void
+port_disable_drained (GOmxPort * port, GOmxPortDrainCb drain, gpointer data)
+{
+  GOmxCore *core;
+  OMX_BUFFERHEADERTYPE *omx_buffer;
+  GTimeVal deadline;
+
+  core = port->core;
+
+  OMX_SendCommand (core->omx_handle, OMX_CommandPortDisable, port->port_index,
+      NULL);
+
+  /* every header comes back, after the ones it filled */
+  g_get_current_time (&deadline);
+  g_time_val_add (&deadline, TUNNEL_DRAIN_TIMEOUT * 1000);
+  if (!async_queue_wait_length (port->queue, port->num_buffers, &deadline))
+    GST_WARNING ("component kept some output headers");
+
+  g_omx_port_pause (port);
+  while ((omx_buffer = async_queue_pop_forced (port->queue))) {
+    if (omx_buffer->nFilledLen > 0)
+      drain (port, omx_buffer, data);
+  }
+  port_free_buffers (port);
+
+  g_omx_sem_down (core->port_sem);
+}
+
+/*
+ * Disables an input port once the component took in everything queued on
+ * it, so none of it is flushed.
+ */
+static void
+port_disable_consumed (GOmxPort * port)
+{
+  GTimeVal deadline;
+
+  g_get_current_time (&deadline);
+  g_time_val_add (&deadline, TUNNEL_DRAIN_TIMEOUT * 1000);
+  if (!async_queue_wait_length (port->queue, port->num_buffers, &deadline))
+    GST_WARNING ("component didn't take all its input");
+
+  g_omx_port_disable (port);
+  async_queue_flush (port->queue);
+}
+
+/**
+ * Connects an output port directly to the input port of another component,
+ * so buffers no longer travel through GStreamer. Both components must come
+ * from the same implementation. Output the component already produced goes
+ * to drain, and through GStreamer to the peer, which takes it in before its
+ * port is disabled. On failure both ports are left working as before.
+ */
+gboolean
+g_omx_port_setup_tunnel (GOmxPort * port, GOmxPort * peer,
+    GOmxPortDrainCb drain, gpointer data)
+{
+  GOmxImp *imp;
+  OMX_ERRORTYPE omx_error;
+
+  imp = port->core->imp;
+
+  if (port->type != GOMX_PORT_OUTPUT || peer->type != GOMX_PORT_INPUT)
+    return FALSE;
+
+  if (!imp || imp != peer->core->imp || !imp->sym_table.setup_tunnel)
+    return FALSE;
+
+  if (port->tunneled || peer->tunneled)
+    return FALSE;
+
+  GST_LOG ("Enter, port=%u, peer=%u", port->port_index, peer->port_index);
+
+  /* the ports must be disabled unless the components are loaded; upstream
+   * first, so what it had ready still reaches the peer */
+  if (port->core->omx_state != OMX_StateLoaded)
+    port_disable_drained (port, drain, data);
+  if (peer->core->omx_state != OMX_StateLoaded)
+    port_disable_consumed (peer);
+
+  g_mutex_lock (imp->mutex);
+
+  omx_error = imp->sym_table.setup_tunnel (port->core->omx_handle,
+      port->port_index, peer->core->omx_handle, peer->port_index);
+
+  if (omx_error == OMX_ErrorNone) {
+    port->tunneled = peer->tunneled = TRUE;
+    port->peer = peer;
+    peer->peer = port;
+
+    if (port->core->omx_state != OMX_StateLoaded)
+      tunnel_send_command (port, peer, OMX_CommandPortEnable);
+  } else {
+    GST_INFO ("tunnel failed: %s", g_omx_error_name (omx_error));
+
+    if (port->core->omx_state != OMX_StateLoaded)
+      g_omx_port_enable (port);
+    if (peer->core->omx_state != OMX_StateLoaded)
+      g_omx_port_enable (peer);
+  }
+
+  g_mutex_unlock (imp->mutex);
+
+  GST_LOG ("Leave, omx_error=%s", g_omx_error_name (omx_error));
+
+  return omx_error == OMX_ErrorNone;
+}
+
+static void
+port_teardown_tunnel (GOmxPort * port)
+{
+  GOmxPort *out_port;
+  GOmxPort *in_port;
+  GOmxImp *imp;
+
+  if (!port->tunneled)
+    return;
+
+  if (port->type == GOMX_PORT_OUTPUT) {
+    out_port = port;
+    in_port = port->peer;
+  } else {
+    out_port = port->peer;
+    in_port = port;
+  }
+
+  imp = port->core->imp;
+
+  /* a component in error won't complete the commands */
+  if (out_port->core->omx_error || in_port->core->omx_error) {
+    out_port->tunneled = in_port->tunneled = FALSE;
+    out_port->peer = in_port->peer = NULL;
+    return;
+  }
+
+  g_mutex_lock (imp->mutex);
+
+  tunnel_send_command (out_port, in_port, OMX_CommandPortDisable);
+
+  imp->sym_table.setup_tunnel (out_port->core->omx_handle,
+      out_port->port_index, NULL, 0);
+  imp->sym_table.setup_tunnel (NULL, 0,
+      in_port->core->omx_handle, in_port->port_index);
+
+  out_port->tunneled = in_port->tunneled = FALSE;
+  out_port->peer = in_port->peer = NULL;
+
+  /* hand the ports back to their clients */
+  g_omx_port_enable (out_port);
+  g_omx_port_enable (in_port);
+
+  g_mutex_unlock (imp->mutex);
+}
+
 /*
  * Semaphore
  */
@@ -736,10 +2026,21 @@ g_omx_sem_up (GOmxSem * sem)
  * Helper functions.
  */
 
+static inline gint64
+monotonic_time (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+
+  return (gint64) ts.tv_sec * G_USEC_PER_SEC + ts.tv_nsec / 1000;
+}
+
 static inline void
 change_state (GOmxCore * core, OMX_STATETYPE state)
 {
   GST_LOG ("state=%s", g_omx_state_name(state));
+  GOMX_TRACE_CORE (change_state, GOMX_TRACE_STATE, core, state);
   OMX_SendCommand (core->omx_handle, OMX_CommandStateSet, state, NULL);
 }
 
@@ -749,7 +2050,11 @@ complete_change_state (GOmxCore * core, OMX_STATETYPE state)
   g_mutex_lock (core->omx_state_mutex);
 
   GST_LOG ("state=%s", g_omx_state_name(state));
+  GOMX_TRACE_CORE (state_changed, GOMX_TRACE_STATE, core, state);
   core->omx_state = state;
+  GOMX_METRICS_SET (core->metrics, state, state);
+  if (core->capture)
+    g_omx_capture_state (core->capture, state);
   g_cond_signal (core->omx_state_condition);
   GST_LOG ("done");
 
@@ -779,6 +2084,9 @@ wait_for_state (GOmxCore * core, OMX_STATETYPE state)
 static inline void
 in_port_cb (GOmxPort * port, OMX_BUFFERHEADERTYPE * omx_buffer)
 {
+  /* the component is done with any GstBuffer lent to this header */
+  port_reclaim_buffer (port, omx_buffer);
+
     /** @todo remove this */
 
   if (!port->enabled)
@@ -801,6 +2109,35 @@ out_port_cb (GOmxPort * port, OMX_BUFFERHEADERTYPE * omx_buffer)
 #endif
 }
 
+static void
+port_update_metrics (GOmxPort * port, OMX_BUFFERHEADERTYPE * omx_buffer)
+{
+  GOmxMetricsSlot *metrics = port->core->metrics;
+  gint i;
+
+  switch (port->type) {
+    case GOMX_PORT_INPUT:
+      GOMX_METRICS_SET (metrics, in_queue, async_queue_length (port->queue));
+
+      /* the initial headers were never released */
+      i = port_buffer_index (port, omx_buffer);
+      if (i >= 0 && port->release_time[i]) {
+        GOMX_METRICS_ADD (metrics, latency_sum,
+            monotonic_time () - port->release_time[i]);
+        GOMX_METRICS_ADD (metrics, latency_count, 1);
+        port->release_time[i] = 0;
+      }
+      break;
+    case GOMX_PORT_OUTPUT:
+      GOMX_METRICS_ADD (metrics, buffers_out, 1);
+      GOMX_METRICS_ADD (metrics, bytes_out, omx_buffer->nFilledLen);
+      GOMX_METRICS_SET (metrics, out_queue, async_queue_length (port->queue));
+      break;
+    default:
+      break;
+  }
+}
+
 static inline void
 got_buffer (GOmxCore * core, GOmxPort * port, OMX_BUFFERHEADERTYPE * omx_buffer)
 {
@@ -809,18 +2146,27 @@ got_buffer (GOmxCore * core, GOmxPort * port, OMX_BUFFERHEADERTYPE * omx_buffer)
   }
 
   if (G_LIKELY (port)) {
-    g_omx_port_push_buffer (port, omx_buffer);
+    GOMX_TRACE_BUFFER (got_buffer, GOMX_TRACE_GOT, core, port->port_index,
+        omx_buffer);
 
+    /* the header must be ready for reuse before anyone can pop it */
     switch (port->type) {
       case GOMX_PORT_INPUT:
         in_port_cb (port, omx_buffer);
         break;
       case GOMX_PORT_OUTPUT:
         out_port_cb (port, omx_buffer);
+        if (omx_buffer->nFilledLen)
+          g_atomic_int_inc (&core->processed);
         break;
       default:
         break;
     }
+
+    g_omx_port_push_buffer (port, omx_buffer);
+
+    if (core->metrics)
+      port_update_metrics (port, omx_buffer);
   }
 }
 
@@ -828,15 +2174,10 @@ got_buffer (GOmxCore * core, GOmxPort * port, OMX_BUFFERHEADERTYPE * omx_buffer)
  * OpenMAX IL callbacks.
  */
 
-static OMX_ERRORTYPE
-EventHandler (OMX_HANDLETYPE omx_handle,
-    OMX_PTR app_data,
-    OMX_EVENTTYPE event, OMX_U32 data_1, OMX_U32 data_2, OMX_PTR event_data)
+static void
+handle_event (GOmxCore * core,
+    OMX_EVENTTYPE event, OMX_U32 data_1, OMX_U32 data_2)
 {
-  GOmxCore *core;
-
-  core = (GOmxCore *) app_data;
-
   GST_LOG ("Enter, eEvent=%d", event);
   switch (event) {
     case OMX_EventCmdComplete:
@@ -862,6 +2203,14 @@ EventHandler (OMX_HANDLETYPE omx_handle,
       }
       break;
     }
+    case OMX_EventResourcesAcquired:
+    {
+      g_mutex_lock (core->omx_state_mutex);
+      core->resources_acquired = TRUE;
+      g_cond_signal (core->omx_state_condition);
+      g_mutex_unlock (core->omx_state_mutex);
+      break;
+    }
     case OMX_EventBufferFlag:
     {
       if (data_2 & OMX_BUFFERFLAG_EOS) {
@@ -871,27 +2220,29 @@ EventHandler (OMX_HANDLETYPE omx_handle,
     }
     case OMX_EventPortSettingsChanged:
     {
-                /** @todo only on the relevant port. */
-#ifdef BUILD_WITH_ANDROID
+      GOmxPort *port;
+
+      port = g_omx_core_get_port (core, data_1);
+      if (port)
+        port_invalidate_params (port);
+
       /*
-       *  In Android PV OpenMAX, we cannot call GetParameter() in call back function.
-       *  Set a flag to call it in stream thread
+       * Some components (Android PV OpenMAX) can't take GetParameter() from
+       * a callback; the streaming thread renegotiates when it sees the new
+       * generation.
        */
-      core->settings_changed = TRUE;
-#else
-      if (core->settings_changed_cb) {
-        core->settings_changed_cb (core);
-      }
-#endif /* BUILD_WITH_ANDROID */
+      g_atomic_int_inc (&core->settings_generation);
     }
     break;
     case OMX_EventError:
     {
       GST_WARNING ("OMX_EventError %s", g_omx_error_name(data_1));
+      GOMX_METRICS_ADD (core->metrics, errors, 1);
       switch (data_1) {
         case OMX_ErrorInvalidState:
         case OMX_ErrorInsufficientResources:
         case OMX_ErrorFormatNotDetected:
+        case OMX_ErrorIncorrectStateTransition:
           /* component might leave us waiting for buffers, unblock */
           g_omx_core_flush_start (core);
           core->omx_error = data_1;
@@ -911,6 +2262,125 @@ EventHandler (OMX_HANDLETYPE omx_handle,
   }
 
   GST_LOG ("Leave");
+}
+
+/*
+ * Dispatch
+ *
+ * Some vendor components do all their work on the thread that runs our
+ * callbacks. With use_dispatch the callbacks only queue what happened and
+ * return; a thread per core handles it, in the same order.
+ */
+
+typedef struct
+{
+  gboolean is_buffer;
+  OMX_EVENTTYPE event;
+  OMX_U32 data_1;
+  OMX_U32 data_2;
+  GOmxPort *port;
+  OMX_BUFFERHEADERTYPE *omx_buffer;
+} GOmxDispatchItem;
+
+static void
+dispatch_item (GOmxCore * core, GOmxDispatchItem * item)
+{
+  if (item->is_buffer)
+    got_buffer (core, item->port, item->omx_buffer);
+  else
+    handle_event (core, item->event, item->data_1, item->data_2);
+
+  g_slice_free (GOmxDispatchItem, item);
+}
+
+static gpointer
+dispatch_thread (gpointer data)
+{
+  GOmxCore *core = data;
+  GOmxDispatchItem *item;
+
+  while ((item = async_queue_pop (core->dispatch_queue)))
+    dispatch_item (core, item);
+
+  return NULL;
+}
+
+static void
+dispatch_start (GOmxCore * core)
+{
+  if (core->dispatch_thread)
+    return;
+
+  core->dispatch_queue = async_queue_new ();
+  core->dispatch_thread = g_thread_create (dispatch_thread, core, TRUE, NULL);
+
+  if (!core->dispatch_thread) {
+    GST_WARNING ("no dispatch thread, handling callbacks in place");
+    async_queue_free (core->dispatch_queue);
+    core->dispatch_queue = NULL;
+  }
+}
+
+static void
+dispatch_stop (GOmxCore * core)
+{
+  GOmxDispatchItem *item;
+
+  if (!core->dispatch_thread)
+    return;
+
+  async_queue_disable (core->dispatch_queue);
+  g_thread_join (core->dispatch_thread);
+  core->dispatch_thread = NULL;
+
+  while ((item = async_queue_pop_forced (core->dispatch_queue)))
+    dispatch_item (core, item);
+
+  async_queue_free (core->dispatch_queue);
+  core->dispatch_queue = NULL;
+}
+
+static inline void
+dispatch_buffer (GOmxCore * core,
+    GOmxPort * port, OMX_BUFFERHEADERTYPE * omx_buffer)
+{
+  if (core->dispatch_queue) {
+    GOmxDispatchItem *item;
+
+    item = g_slice_new0 (GOmxDispatchItem);
+    item->is_buffer = TRUE;
+    item->port = port;
+    item->omx_buffer = omx_buffer;
+    async_queue_push (core->dispatch_queue, item);
+  } else {
+    got_buffer (core, port, omx_buffer);
+  }
+}
+
+/*
+ * OpenMAX IL callbacks.
+ */
+
+static OMX_ERRORTYPE
+EventHandler (OMX_HANDLETYPE omx_handle,
+    OMX_PTR app_data,
+    OMX_EVENTTYPE event, OMX_U32 data_1, OMX_U32 data_2, OMX_PTR event_data)
+{
+  GOmxCore *core;
+
+  core = (GOmxCore *) app_data;
+
+  if (core->dispatch_queue) {
+    GOmxDispatchItem *item;
+
+    item = g_slice_new0 (GOmxDispatchItem);
+    item->event = event;
+    item->data_1 = data_1;
+    item->data_2 = data_2;
+    async_queue_push (core->dispatch_queue, item);
+  } else {
+    handle_event (core, event, data_1, data_2);
+  }
 
   return OMX_ErrorNone;
 }
@@ -926,7 +2396,10 @@ EmptyBufferDone (OMX_HANDLETYPE omx_handle,
   port = g_omx_core_get_port (core, omx_buffer->nInputPortIndex);
 
   GST_LOG ("omx_buffer=%p", omx_buffer);
-  got_buffer (core, port, omx_buffer);
+  GOMX_TRACE_BUFFER (empty_buffer_done, GOMX_TRACE_DONE, core,
+      omx_buffer->nInputPortIndex, omx_buffer);
+  capture_buffer (core, port, GOMX_CAPTURE_EMPTY_BUFFER_DONE, omx_buffer);
+  dispatch_buffer (core, port, omx_buffer);
 
   return OMX_ErrorNone;
 }
@@ -942,7 +2415,10 @@ FillBufferDone (OMX_HANDLETYPE omx_handle,
   port = g_omx_core_get_port (core, omx_buffer->nOutputPortIndex);
 
   GST_LOG ("omx_buffer=%p", omx_buffer);
-  got_buffer (core, port, omx_buffer);
+  GOMX_TRACE_BUFFER (fill_buffer_done, GOMX_TRACE_DONE, core,
+      omx_buffer->nOutputPortIndex, omx_buffer);
+  capture_buffer (core, port, GOMX_CAPTURE_FILL_BUFFER_DONE, omx_buffer);
+  dispatch_buffer (core, port, omx_buffer);
 
   return OMX_ErrorNone;
 }
@@ -30,6 +30,13 @@
 
 #include <async_queue.h>
 #include "config.h"
+#include "gstomx_metrics.h"
+#include "gstomx_capture.h"
+
+/* From OpenMAX IL 1.1.2; these headers predate it. */
+#ifndef OMX_BUFFERFLAG_CODECCONFIG
+#define OMX_BUFFERFLAG_CODECCONFIG 0x00000080
+#endif
 
 /* Typedefs. */
 
@@ -38,10 +45,13 @@ typedef struct GOmxPort GOmxPort;
 typedef struct GOmxSem GOmxSem;
 typedef struct GOmxImp GOmxImp;
 typedef struct GOmxSymbolTable GOmxSymbolTable;
+typedef struct GOmxResource GOmxResource;
 typedef enum GOmxPortType GOmxPortType;
 
 typedef void (*GOmxCb) (GOmxCore *core);
 typedef void (*GOmxPortCb) (GOmxPort *port);
+typedef void (*GOmxPortDrainCb) (GOmxPort *port, OMX_BUFFERHEADERTYPE *omx_buffer,
+                                 gpointer data);
 
 /* Enums. */
 
@@ -62,6 +72,10 @@ struct GOmxSymbolTable
                                  OMX_PTR data,
                                  OMX_CALLBACKTYPE *callbacks);
     OMX_ERRORTYPE (*free_handle) (OMX_HANDLETYPE handle);
+    OMX_ERRORTYPE (*setup_tunnel) (OMX_HANDLETYPE output,
+                                   OMX_U32 output_index,
+                                   OMX_HANDLETYPE input,
+                                   OMX_U32 input_index);
 };
 
 struct GOmxImp
@@ -82,6 +96,7 @@ struct GOmxCore
     GMutex *omx_state_mutex;
 
     GPtrArray *ports;
+    guint n_ports; /**< All the component has, set up or not; OMX_ALL acks each. */
 
     gpointer client_data; /**< Placeholder for the client data. */
 
@@ -90,11 +105,29 @@ struct GOmxCore
     GOmxSem *port_sem;
 
     GOmxCb settings_changed_cb;
-    gboolean settings_changed;
+    gint settings_generation; /**< Bumped on OMX_EventPortSettingsChanged. */
     GOmxImp *imp;
 
     gboolean done;
     gboolean flushing;
+
+    gboolean use_dispatch; /**< Handle callbacks in our own thread. */
+    AsyncQueue *dispatch_queue;
+    GThread *dispatch_thread;
+
+    gint priority; /**< Higher ones preempt lower ones for scarce components. */
+    gchar *fallback_library; /**< Used when the component is exhausted. */
+    gchar *fallback_component;
+    GOmxResource *resource; /**< Slot held in the resource manager. */
+    gboolean preempted;
+    gboolean preempting; /**< Another core is flushing this one; keeps it from going away. */
+    gboolean resources_acquired; /**< OMX_EventResourcesAcquired arrived. */
+    gchar *candidates; /**< "library:component,..." to balance over. */
+    gint processed; /**< Output buffers since Executing. */
+    gint64 run_start;
+
+    GOmxMetricsSlot *metrics; /**< NULL unless exported, see gstomx_metrics.h. */
+    GOmxCapture *capture; /**< NULL unless GST_OMX_CAPTURE is set. */
 };
 
 struct GOmxPort
@@ -104,12 +137,28 @@ struct GOmxPort
 
     guint num_buffers;
     gulong buffer_size;
+    gulong buffer_alignment;
     guint port_index;
     OMX_BUFFERHEADERTYPE **buffers;
+    OMX_U8 **buffer_data; /**< Original pBuffer of each header. */
+    gint64 *release_time; /**< When each input header went to the component. */
+
+    gpointer arena; /**< One block carved into num_buffers slots. */
+    gsize arena_size;
+    gboolean arena_mapped;
 
     GMutex *mutex;
     gboolean enabled;
     AsyncQueue *queue;
+
+    gboolean tunneled; /**< Buffers go straight to the peer component. */
+    GOmxPort *peer;
+
+    OMX_PARAM_PORTDEFINITIONTYPE definition; /**< Cached, see g_omx_port_get_definition. */
+    gint definition_valid;
+    gboolean definition_dirty;
+    GHashTable *params; /**< Other cached parameters, by OMX_INDEXTYPE. */
+    gint params_generation; /**< Bumped when the component changes them. */
 };
 
 struct GOmxSem
@@ -127,6 +176,8 @@ void g_omx_deinit (void);
 GOmxCore *g_omx_core_new (void);
 void g_omx_core_free (GOmxCore *core);
 void g_omx_core_init (GOmxCore *core, const gchar *library_name, const gchar *component_name);
+void g_omx_core_set_fallback (GOmxCore *core, const gchar *library_name, const gchar *component_name);
+void g_omx_core_set_candidates (GOmxCore *core, const gchar *candidates);
 void g_omx_core_deinit (GOmxCore *core);
 gboolean g_omx_core_prepare (GOmxCore *core);
 gboolean g_omx_core_start (GOmxCore *core);
@@ -134,15 +185,18 @@ gboolean g_omx_core_pause (GOmxCore *core);
 gboolean g_omx_core_finish (GOmxCore *core);
 void g_omx_core_set_done (GOmxCore *core);
 void g_omx_core_wait_for_done (GOmxCore *core);
+void g_omx_core_reset_done (GOmxCore *core);
 void g_omx_core_flush_start (GOmxCore *core);
 void g_omx_core_flush_stop (GOmxCore *core, gboolean flush_port);
 GOmxPort *g_omx_core_setup_port (GOmxCore *core, OMX_PARAM_PORTDEFINITIONTYPE *omx_port);
+GOmxPort *g_omx_core_port (GOmxCore *core, guint index);
 
 GOmxPort *g_omx_port_new (GOmxCore *core);
 void g_omx_port_free (GOmxPort *port);
 void g_omx_port_setup (GOmxPort *port, OMX_PARAM_PORTDEFINITIONTYPE *omx_port);
 void g_omx_port_push_buffer (GOmxPort *port, OMX_BUFFERHEADERTYPE *omx_buffer);
 OMX_BUFFERHEADERTYPE *g_omx_port_request_buffer (GOmxPort *port);
+OMX_BUFFERHEADERTYPE *g_omx_port_try_request_buffer (GOmxPort *port);
 void g_omx_port_release_buffer (GOmxPort *port, OMX_BUFFERHEADERTYPE *omx_buffer);
 void g_omx_port_resume (GOmxPort *port);
 void g_omx_port_pause (GOmxPort *port);
@@ -150,6 +204,12 @@ void g_omx_port_flush (GOmxPort *port);
 void g_omx_port_enable (GOmxPort *port);
 void g_omx_port_disable (GOmxPort *port);
 void g_omx_port_finish (GOmxPort *port);
+gboolean g_omx_port_setup_tunnel (GOmxPort *port, GOmxPort *peer,
+                                  GOmxPortDrainCb drain, gpointer data);
+OMX_PARAM_PORTDEFINITIONTYPE *g_omx_port_get_definition (GOmxPort *port);
+void g_omx_port_definition_changed (GOmxPort *port);
+gpointer g_omx_port_get_param (GOmxPort *port, OMX_INDEXTYPE index, gsize size);
+void g_omx_port_param_changed (GOmxPort *port, OMX_INDEXTYPE index);
 
 GOmxSem *g_omx_sem_new (void);
 void g_omx_sem_free (GOmxSem *sem);
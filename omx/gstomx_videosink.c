@@ -169,15 +169,11 @@ setcaps (GstBaseSink * gst_sink, GstCaps * caps)
     }
 
     {
+      GOmxPort *port;
       OMX_PARAM_PORTDEFINITIONTYPE *param;
 
-      param = calloc (1, sizeof (OMX_PARAM_PORTDEFINITIONTYPE));
-      param->nSize = sizeof (OMX_PARAM_PORTDEFINITIONTYPE);
-      param->nVersion.s.nVersionMajor = 1;
-      param->nVersion.s.nVersionMinor = 1;
-
-      param->nPortIndex = 0;
-      OMX_GetParameter (gomx->omx_handle, OMX_IndexParamPortDefinition, param);
+      port = g_omx_core_port (gomx, 0);
+      param = g_omx_port_get_definition (port);
 
       switch (color_format) {
         case OMX_COLOR_FormatYUV420Planar:
@@ -197,9 +193,7 @@ setcaps (GstBaseSink * gst_sink, GstCaps * caps)
       param->format.video.eCompressionFormat = OMX_VIDEO_CodingUnused;
       param->format.video.eColorFormat = color_format;
 
-      OMX_SetParameter (gomx->omx_handle, OMX_IndexParamPortDefinition, param);
-
-      free (param);
+      g_omx_port_definition_changed (port);
     }
 
     {
@@ -332,6 +326,10 @@ type_instance_init (GTypeInstance * instance, gpointer g_class)
   GST_DEBUG_OBJECT (omx_base, "start");
 
   omx_base->omx_component = g_strdup (OMX_COMPONENT_NAME);
+
+  /* drop frames the component can't show in time */
+  gst_base_sink_set_max_lateness (GST_BASE_SINK (omx_base), 20 * GST_MSECOND);
+  gst_base_sink_set_qos_enabled (GST_BASE_SINK (omx_base), TRUE);
 }
 
 GType
@@ -83,6 +83,27 @@ START_TEST (test_async_queue_pop)
 }
 END_TEST
 
+START_TEST (test_async_queue_try_pop)
+{
+    AsyncQueue *queue;
+    gpointer foo;
+    queue = async_queue_new ();
+    fail_if (!queue,
+             "Construction failed");
+    fail_if (async_queue_try_pop (queue) != NULL,
+             "Pop on empty queue didn't fail");
+    foo = GINT_TO_POINTER (1);
+    async_queue_push (queue, foo);
+    async_queue_disable (queue);
+    fail_if (async_queue_try_pop (queue) != NULL,
+             "Pop on disabled queue didn't fail");
+    async_queue_enable (queue);
+    fail_if (async_queue_try_pop (queue) != foo,
+             "Pop failed");
+    async_queue_free (queue);
+}
+END_TEST
+
 START_TEST (test_async_queue_process)
 {
     AsyncQueue *queue;
@@ -379,6 +400,85 @@ START_TEST (test_async_queue_stress)
 }
 END_TEST
 
+static gpointer
+pop_func_once (gpointer data)
+{
+    return async_queue_pop (data);
+}
+
+START_TEST (test_async_queue_wakeup)
+{
+    AsyncQueue *queue;
+    GThread *pop_thread;
+    gpointer foo;
+
+    queue = async_queue_new ();
+    fail_if (!queue,
+             "Construction failed");
+
+    pop_thread = g_thread_create (pop_func_once, queue, TRUE, NULL);
+
+    /* a wakeup without data must not end the wait */
+    g_usleep (10000);
+    g_mutex_lock (queue->mutex);
+    g_cond_broadcast (queue->condition);
+    g_mutex_unlock (queue->mutex);
+    g_usleep (10000);
+
+    foo = GINT_TO_POINTER (1);
+    async_queue_push (queue, foo);
+
+    fail_if (g_thread_join (pop_thread) != foo,
+             "Pop returned early");
+
+    async_queue_free (queue);
+}
+END_TEST
+
+static gpointer
+push_two_func (gpointer data)
+{
+    g_usleep (10000);
+    async_queue_push (data, GINT_TO_POINTER (1));
+    async_queue_push (data, GINT_TO_POINTER (2));
+
+    return NULL;
+}
+
+START_TEST (test_async_queue_wait_length)
+{
+    AsyncQueue *queue;
+    GThread *push_thread;
+    GTimeVal deadline;
+
+    queue = async_queue_new ();
+    fail_if (!queue,
+             "Construction failed");
+
+    g_get_current_time (&deadline);
+    g_time_val_add (&deadline, 10000);
+    fail_if (async_queue_wait_length (queue, 1, &deadline),
+             "Wait on empty queue didn't time out");
+
+    push_thread = g_thread_create (push_two_func, queue, TRUE, NULL);
+
+    g_get_current_time (&deadline);
+    g_time_val_add (&deadline, G_USEC_PER_SEC);
+    fail_if (!async_queue_wait_length (queue, 2, &deadline),
+             "Wait failed");
+    fail_if (async_queue_length (queue) != 2,
+             "Wait returned early");
+
+    g_thread_join (push_thread);
+
+    async_queue_disable (queue);
+    fail_if (async_queue_wait_length (queue, 3, &deadline),
+             "Wait on disabled queue didn't fail");
+
+    async_queue_free (queue);
+}
+END_TEST
+
 Suite *
 util_suite (void)
 {
@@ -391,12 +491,15 @@ util_suite (void)
     TCase *tc_core = tcase_create ("Core");
     tcase_add_test (tc_core, test_async_queue_create);
     tcase_add_test (tc_core, test_async_queue_pop);
+    tcase_add_test (tc_core, test_async_queue_try_pop);
     tcase_add_test (tc_core, test_async_queue_process);
     tcase_add_test (tc_core, test_async_queue_threads);
     tcase_add_test (tc_core, test_async_queue_disable_simple);
     tcase_add_test (tc_core, test_async_queue_disable);
     tcase_add_test (tc_core, test_async_queue_enable);
     tcase_add_test (tc_core, test_async_queue_stress);
+    tcase_add_test (tc_core, test_async_queue_wakeup);
+    tcase_add_test (tc_core, test_async_queue_wait_length);
     suite_add_tcase (s, tc_core);
 
     return s;
@@ -0,0 +1,190 @@
+/*
+ * Copyright (C) 2008-2009 Nokia Corporation.
+ *
+ * Author: Felipe Contreras <felipe.contreras@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <check.h>
+#include <string.h>
+#include "gstomx_bitstream.h"
+
+#define TYPE(func, ...) \
+    func ((const guint8[]) { __VA_ARGS__ }, sizeof ((const guint8[]) { __VA_ARGS__ }))
+
+static GOmxFrameType
+h264 (const guint8 *data,
+      guint size)
+{
+    return g_omx_frame_type_h264 (data, size, 0);
+}
+
+static GOmxFrameType
+avc (const guint8 *data,
+     guint size)
+{
+    return g_omx_frame_type_h264 (data, size, 4);
+}
+
+static const guint8 struct_c[] = { 0x00, 0x00, 0x00, 0x00 };
+static const guint8 struct_c_b_frames[] = { 0x00, 0x00, 0x00, 0x10 };
+
+static GOmxFrameType
+wmv (const guint8 *data,
+     guint size)
+{
+    return g_omx_frame_type_wmv (data, size, struct_c, sizeof (struct_c));
+}
+
+static GOmxFrameType
+wmv_b_frames (const guint8 *data,
+              guint size)
+{
+    return g_omx_frame_type_wmv (data, size, struct_c_b_frames, sizeof (struct_c_b_frames));
+}
+
+static GOmxFrameType
+advanced (const guint8 *data,
+          guint size)
+{
+    return g_omx_frame_type_wmv (data, size, NULL, 0);
+}
+
+START_TEST (test_bitstream_h264)
+{
+    /* SPS, PPS, IDR */
+    fail_if (TYPE (h264, 0, 0, 0, 1, 0x67, 0x42, 0, 0, 1, 0x68, 0xce, 0, 0, 1, 0x65, 0x88) != GOMX_FRAME_KEY,
+             "IDR not detected");
+    fail_if (TYPE (h264, 0, 0, 0, 1, 0x67, 0x42, 0, 0, 1, 0x68, 0xce) != GOMX_FRAME_CONFIG,
+             "Headers not detected");
+    /* P slice, nal_ref_idc 2 and 0 */
+    fail_if (TYPE (h264, 0, 0, 1, 0x41, 0x9a) != GOMX_FRAME_REFERENCE,
+             "Reference P not detected");
+    fail_if (TYPE (h264, 0, 0, 1, 0x01, 0x9a) != GOMX_FRAME_NON_REFERENCE,
+             "Non-reference P not detected");
+    /* I slice outside IDR */
+    fail_if (TYPE (h264, 0, 0, 1, 0x41, 0x88) != GOMX_FRAME_KEY,
+             "I slice not detected");
+    fail_if (TYPE (avc, 0, 0, 0, 2, 0x65, 0x88) != GOMX_FRAME_KEY,
+             "Length prefixed IDR not detected");
+    fail_if (TYPE (avc, 0, 0, 0, 2, 0x01, 0x9a) != GOMX_FRAME_NON_REFERENCE,
+             "Length prefixed P not detected");
+}
+END_TEST
+
+START_TEST (test_bitstream_mpeg4)
+{
+    fail_if (TYPE (g_omx_frame_type_mpeg4, 0, 0, 1, 0xb0, 0x01, 0, 0, 1, 0xb6, 0x00) != GOMX_FRAME_KEY,
+             "I-VOP not detected");
+    fail_if (TYPE (g_omx_frame_type_mpeg4, 0, 0, 1, 0xb6, 0x40) != GOMX_FRAME_REFERENCE,
+             "P-VOP not detected");
+    fail_if (TYPE (g_omx_frame_type_mpeg4, 0, 0, 1, 0xb6, 0x80) != GOMX_FRAME_NON_REFERENCE,
+             "B-VOP not detected");
+    fail_if (TYPE (g_omx_frame_type_mpeg4, 0, 0, 1, 0x20, 0x08) != GOMX_FRAME_CONFIG,
+             "VOL not detected");
+    fail_if (TYPE (g_omx_frame_type_mpeg4, 0x12, 0x34) != GOMX_FRAME_UNKNOWN,
+             "Garbage classified");
+}
+END_TEST
+
+START_TEST (test_bitstream_h263)
+{
+    /* QCIF, INTRA and INTER */
+    fail_if (TYPE (g_omx_frame_type_h263, 0, 0, 0x80, 0x02, 0x08) != GOMX_FRAME_KEY,
+             "I picture not detected");
+    fail_if (TYPE (g_omx_frame_type_h263, 0, 0, 0x80, 0x02, 0x0a) != GOMX_FRAME_REFERENCE,
+             "P picture not detected");
+}
+END_TEST
+
+START_TEST (test_bitstream_wmv)
+{
+    fail_if (TYPE (wmv, 0x00) != GOMX_FRAME_KEY,
+             "I frame not detected");
+    fail_if (TYPE (wmv, 0x20) != GOMX_FRAME_REFERENCE,
+             "P frame not detected");
+    fail_if (TYPE (wmv_b_frames, 0x10) != GOMX_FRAME_KEY,
+             "I frame not detected with B frames");
+    fail_if (TYPE (wmv_b_frames, 0x00) != GOMX_FRAME_NON_REFERENCE,
+             "B frame not detected");
+    /* advanced profile, progressive: I is 110, B is 10 */
+    fail_if (TYPE (advanced, 0, 0, 1, 0x0d, 0xc0) != GOMX_FRAME_KEY,
+             "Advanced I frame not detected");
+    fail_if (TYPE (advanced, 0, 0, 1, 0x0d, 0x80) != GOMX_FRAME_NON_REFERENCE,
+             "Advanced B frame not detected");
+}
+END_TEST
+
+START_TEST (test_bitstream_avc)
+{
+    /* 4-byte start code, 3-byte one after a trailing zero */
+    static const guint8 config[] = { 0, 0, 0, 1, 0x67, 0x42, 0xc0, 0x1e, 0x8d,
+                                     0x00, 0, 0, 1, 0x68, 0xce, 0x3c, 0x80 };
+    static const guint8 avcc[] = { 1, 0x42, 0xc0, 0x1e, 0xff, 0xe1,
+                                   0, 5, 0x67, 0x42, 0xc0, 0x1e, 0x8d,
+                                   1, 0, 4, 0x68, 0xce, 0x3c, 0x80 };
+    GOmxNal nals[2];
+    guint8 dest[sizeof (config) + 8];
+    guint size;
+
+    fail_if (g_omx_h264_split (config, sizeof (config), nals, 1) != 2,
+             "Wrong NAL count");
+    fail_if (nals[0].offset != 4 || nals[0].size != 5,
+             "Wrong first NAL");
+    g_omx_h264_split (config, sizeof (config), nals, 2);
+    fail_if (nals[1].offset != 13 || nals[1].size != 4,
+             "Wrong second NAL");
+
+    size = g_omx_h264_avcc (config, sizeof (config), dest, sizeof (dest));
+    fail_if (size != sizeof (avcc) || memcmp (dest, avcc, size) != 0,
+             "Wrong avcC");
+    fail_if (g_omx_h264_avcc (config + 9, sizeof (config) - 9, dest, sizeof (dest)) != 0,
+             "avcC without SPS");
+}
+END_TEST
+
+static Suite *
+bitstream_suite (void)
+{
+    Suite *s = suite_create ("bitstream");
+
+    TCase *tc_core = tcase_create ("Core");
+    tcase_add_test (tc_core, test_bitstream_h264);
+    tcase_add_test (tc_core, test_bitstream_mpeg4);
+    tcase_add_test (tc_core, test_bitstream_h263);
+    tcase_add_test (tc_core, test_bitstream_wmv);
+    tcase_add_test (tc_core, test_bitstream_avc);
+    suite_add_tcase (s, tc_core);
+
+    return s;
+}
+
+int
+main (void)
+{
+    int number_failed;
+    Suite *s;
+    SRunner *sr;
+
+    s = bitstream_suite ();
+    sr = srunner_create (s);
+    srunner_run_all (sr, CK_NORMAL);
+    number_failed = srunner_ntests_failed (sr);
+    srunner_free (sr);
+
+    return (number_failed == 0) ? 0 : 1;
+}
@@ -0,0 +1,208 @@
+/*
+ * Copyright (C) 2008-2009 Nokia Corporation.
+ *
+ * Author: Felipe Contreras <felipe.contreras@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <check.h>
+#include <string.h>
+#include "gstomx_convert.h"
+
+/* odd multiples of the SIMD block, so the C tails run too */
+#define WIDTH 70
+#define HEIGHT 6
+#define STRIDE 96
+#define U_OFFSET (WIDTH * HEIGHT)
+#define V_OFFSET (U_OFFSET + (WIDTH / 2) * (HEIGHT / 2))
+
+static guint8 y_plane[STRIDE * HEIGHT];
+static guint8 uv_plane[STRIDE * HEIGHT / 2];
+
+static void
+fill_source (GOmxConvertSource *src,
+             gboolean swap_uv)
+{
+    guint i;
+
+    for (i = 0; i < sizeof (y_plane); i++)
+        y_plane[i] = i * 7;
+    for (i = 0; i < sizeof (uv_plane); i++)
+        uv_plane[i] = 0x80 + i * 13;
+
+    src->y = y_plane;
+    src->uv = uv_plane;
+    src->y_stride = STRIDE;
+    src->uv_stride = STRIDE;
+    src->swap_uv = swap_uv;
+}
+
+START_TEST (test_convert_reference)
+{
+    GOmxConvertSource src;
+    guint8 out[WIDTH * HEIGHT * 2];
+    guint8 *pair;
+
+    fill_source (&src, FALSE);
+    g_omx_convert_use_simd (FALSE);
+
+    g_omx_convert_to_i420 (&src, out, out + U_OFFSET, out + V_OFFSET,
+                           WIDTH, WIDTH, HEIGHT);
+
+    fail_if (out[WIDTH + 1] != y_plane[STRIDE + 1],
+             "Luma moved");
+    fail_if (out[U_OFFSET + WIDTH / 2 + 3] != uv_plane[STRIDE + 6],
+             "Wrong U");
+    fail_if (out[V_OFFSET + WIDTH / 2 + 3] != uv_plane[STRIDE + 7],
+             "Wrong V");
+
+    g_omx_convert_to_packed (&src, out, WIDTH * 2, FALSE, WIDTH, HEIGHT);
+
+    /* third row, second pair, with chroma from the second chroma row */
+    pair = out + 2 * WIDTH * 2 + 4;
+    fail_if (pair[0] != y_plane[2 * STRIDE + 2] ||
+             pair[1] != uv_plane[STRIDE + 2] ||
+             pair[2] != y_plane[2 * STRIDE + 3] ||
+             pair[3] != uv_plane[STRIDE + 3],
+             "Wrong YUY2");
+}
+END_TEST
+
+START_TEST (test_convert_simd)
+{
+    GOmxConvertSource src;
+    guint8 expected[WIDTH * HEIGHT * 2];
+    guint8 out[WIDTH * HEIGHT * 2];
+    gboolean swap_uv;
+
+    for (swap_uv = FALSE; swap_uv <= TRUE; swap_uv++)
+    {
+        gboolean uyvy;
+
+        fill_source (&src, swap_uv);
+
+        memset (expected, 0, sizeof (expected));
+        memset (out, 0, sizeof (out));
+
+        g_omx_convert_use_simd (FALSE);
+        g_omx_convert_to_i420 (&src, expected, expected + U_OFFSET,
+                               expected + V_OFFSET, WIDTH, WIDTH, HEIGHT);
+        g_omx_convert_use_simd (TRUE);
+        g_omx_convert_to_i420 (&src, out, out + U_OFFSET, out + V_OFFSET,
+                               WIDTH, WIDTH, HEIGHT);
+
+        fail_if (memcmp (expected, out, sizeof (out)) != 0,
+                 "I420 differs from the reference");
+
+        for (uyvy = FALSE; uyvy <= TRUE; uyvy++)
+        {
+            g_omx_convert_use_simd (FALSE);
+            g_omx_convert_to_packed (&src, expected, WIDTH * 2, uyvy, WIDTH, HEIGHT);
+            g_omx_convert_use_simd (TRUE);
+            g_omx_convert_to_packed (&src, out, WIDTH * 2, uyvy, WIDTH, HEIGHT);
+
+            fail_if (memcmp (expected, out, sizeof (out)) != 0,
+                     "Packed differs from the reference");
+        }
+    }
+}
+END_TEST
+
+/* The half pair ending an odd packed row stays inside it. */
+START_TEST (test_convert_odd_width)
+{
+    GOmxConvertSource src;
+    guint8 out[(WIDTH - 1) * HEIGHT * 2 + 1];
+    guint8 *last;
+    gboolean simd;
+
+    fill_source (&src, FALSE);
+
+    for (simd = FALSE; simd <= TRUE; simd++)
+    {
+        g_omx_convert_use_simd (simd);
+
+        memset (out, 0xee, sizeof (out));
+        g_omx_convert_to_packed (&src, out, (WIDTH - 1) * 2, FALSE,
+                                 WIDTH - 1, HEIGHT);
+
+        last = out + (WIDTH - 1) * 2 - 2;
+        fail_if (last[0] != y_plane[WIDTH - 2] ||
+                 last[1] != uv_plane[WIDTH - 2],
+                 "Wrong last pixel");
+        fail_if (out[sizeof (out) - 1] != 0xee,
+                 "Wrote past the frame");
+    }
+}
+END_TEST
+
+START_TEST (test_convert_scale)
+{
+    GOmxConvertSource src;
+    guint8 expected[16 * 3];
+    guint8 out[16 * 3];
+    guint8 scratch[(WIDTH / 2) * (HEIGHT / 2)];
+
+    fill_source (&src, FALSE);
+
+    /* 70x6 to 16x3: one halving, then the box filter */
+    g_omx_convert_use_simd (FALSE);
+    g_omx_scale_plane (y_plane, STRIDE, WIDTH, HEIGHT, expected, 16, 16, 3, scratch);
+    g_omx_convert_use_simd (TRUE);
+    g_omx_scale_plane (y_plane, STRIDE, WIDTH, HEIGHT, out, 16, 16, 3, scratch);
+
+    fail_if (memcmp (expected, out, sizeof (out)) != 0,
+             "Scaling differs from the reference");
+
+    /* a flat plane stays flat */
+    memset (y_plane, 0x40, sizeof (y_plane));
+    g_omx_scale_plane (y_plane, STRIDE, WIDTH, HEIGHT, out, 16, 16, 3, scratch);
+    fail_if (out[0] != 0x40 || out[sizeof (out) - 1] != 0x40,
+             "Scaling changed a flat plane");
+}
+END_TEST
+
+static Suite *
+convert_suite (void)
+{
+    Suite *s = suite_create ("convert");
+
+    TCase *tc_core = tcase_create ("Core");
+    tcase_add_test (tc_core, test_convert_reference);
+    tcase_add_test (tc_core, test_convert_simd);
+    tcase_add_test (tc_core, test_convert_odd_width);
+    tcase_add_test (tc_core, test_convert_scale);
+    suite_add_tcase (s, tc_core);
+
+    return s;
+}
+
+int
+main (void)
+{
+    int number_failed;
+    Suite *s;
+    SRunner *sr;
+
+    s = convert_suite ();
+    sr = srunner_create (s);
+    srunner_run_all (sr, CK_NORMAL);
+    number_failed = srunner_ntests_failed (sr);
+    srunner_free (sr);
+
+    return (number_failed == 0) ? 0 : 1;
+}
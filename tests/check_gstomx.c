@@ -21,6 +21,8 @@
 
 #include <gst/check/gstcheck.h>
 
+#include <string.h> /* For memset */
+
 #define BUFFER_SIZE 0x1000
 #define BUFFER_COUNT 0x100
 #define FLUSH_AT 0x10
@@ -90,18 +92,53 @@ test_sink_event (GstPad * pad, GstEvent * event)
     return gst_pad_event_default (pad, event);
 }
 
+/*
+ * Index of the input expected at output position i, when the component
+ * reverses groups of reorder frames. A short group at the end comes out
+ * as it went in.
+ */
+static guint
+reordered (guint i,
+           guint reorder)
+{
+    guint first;
+
+    if (reorder < 2)
+        return i;
+
+    first = i - i % reorder;
+    if (first + reorder > BUFFER_COUNT)
+        return i;
+
+    return first + reorder - 1 - i % reorder;
+}
+
+/*
+ * Push numbered buffers through omx_dummy, or through two of them, which
+ * tunnel their components once the first buffer went through.
+ */
 static void
-helper (gboolean flush)
+helper (const gchar *library_name,
+        gboolean flush,
+        gboolean tunnel,
+        guint reorder)
 {
     GstElement *filter;
+    GstElement *last;
     GstBus *bus;
     GstPad *mysrcpad;
     GstPad *mysinkpad;
 
     /* init */
     filter = gst_check_setup_element ("omx_dummy");
+    last = filter;
+    if (tunnel)
+    {
+        last = gst_check_setup_element ("omx_dummy");
+        fail_unless (gst_element_link (filter, last));
+    }
     mysrcpad = gst_check_setup_src_pad (filter, &srctemplate, NULL);
-    mysinkpad = gst_check_setup_sink_pad (filter, &sinktemplate, NULL);
+    mysinkpad = gst_check_setup_sink_pad (last, &sinktemplate, NULL);
 
     gst_pad_set_active (mysrcpad, TRUE);
     gst_pad_set_active (mysinkpad, TRUE);
@@ -114,16 +151,20 @@ helper (gboolean flush)
     eos_cond = g_cond_new ();
     eos_arrived = FALSE;
 
-    g_object_set (G_OBJECT (filter), "library-name", "libomxil-foo.so", NULL);
+    g_object_set (G_OBJECT (filter), "library-name", library_name, NULL);
+    g_object_set (G_OBJECT (last), "library-name", library_name, NULL);
 
     /* start */
 
+    fail_unless_equals_int (gst_element_set_state (last, GST_STATE_PLAYING),
+                            GST_STATE_CHANGE_SUCCESS);
     fail_unless_equals_int (gst_element_set_state (filter, GST_STATE_PLAYING),
                             GST_STATE_CHANGE_SUCCESS);
 
     bus = gst_bus_new ();
 
     gst_element_set_bus (filter, bus);
+    gst_element_set_bus (last, bus);
 
     /* send buffers in order*/
     {
@@ -162,7 +203,7 @@ helper (gboolean flush)
         g_cond_wait (eos_cond, eos_mutex);
     g_mutex_unlock (eos_mutex);
 
-    /* check the order of the buffers*/
+    /* check the order of the buffers, through the tunnel too */
     if (!flush)
     {
         GList *cur;
@@ -171,7 +212,7 @@ helper (gboolean flush)
         {
             GstBuffer *buffer;
             buffer = cur->data;
-            fail_unless (GST_BUFFER_DATA(buffer)[0] == i);
+            fail_unless (GST_BUFFER_DATA(buffer)[0] == reordered (i, reorder));
         }
         fail_unless (i == BUFFER_COUNT);
     }
@@ -179,16 +220,23 @@ helper (gboolean flush)
     /* cleanup */
     gst_bus_set_flushing (bus, TRUE);
     gst_element_set_bus (filter, NULL);
+    gst_element_set_bus (last, NULL);
     gst_object_unref (GST_OBJECT (bus));
     gst_check_drop_buffers ();
 
     /* deinit */
     gst_element_set_state (filter, GST_STATE_NULL);
+    gst_element_set_state (last, GST_STATE_NULL);
 
     gst_pad_set_active (mysrcpad, FALSE);
     gst_pad_set_active (mysinkpad, FALSE);
     gst_check_teardown_src_pad (filter);
-    gst_check_teardown_sink_pad (filter);
+    gst_check_teardown_sink_pad (last);
+    if (tunnel)
+    {
+        gst_element_unlink (filter, last);
+        gst_check_teardown_element (last);
+    }
     gst_check_teardown_element (filter);
 
     g_mutex_free (eos_mutex);
@@ -197,13 +245,529 @@ helper (gboolean flush)
 
 GST_START_TEST (test_flush)
 {
-    helper (TRUE);
+    helper ("libomxil-foo.so", TRUE, FALSE, 0);
 }
 GST_END_TEST
 
 GST_START_TEST (test_basic)
 {
-    helper (FALSE);
+    helper ("libomxil-foo.so", FALSE, FALSE, 0);
+}
+GST_END_TEST
+
+/*
+ * Pipelined, with jitter and mid-stream settings changes; those only
+ * touch video ports, hence the frame size.
+ */
+GST_START_TEST (test_sim)
+{
+    g_setenv ("GST_OMX_SIM",
+              "process_time=200,jitter=100,depth=3,settings_change=32,alignment=128,"
+              "width=64,height=48",
+              TRUE);
+    helper ("libomxil-sim.so", FALSE, FALSE, 0);
+    g_unsetenv ("GST_OMX_SIM");
+}
+GST_END_TEST
+
+GST_START_TEST (test_sim_flush)
+{
+    g_setenv ("GST_OMX_SIM",
+              "process_time=200,jitter=100,depth=3,reorder=3,corrupt=0.05,seed=1",
+              TRUE);
+    helper ("libomxil-sim.so", TRUE, FALSE, 0);
+    g_unsetenv ("GST_OMX_SIM");
+}
+GST_END_TEST
+
+/* outputs come back in the component's order, not the input's */
+GST_START_TEST (test_sim_reorder)
+{
+    g_setenv ("GST_OMX_SIM", "process_time=200,jitter=100,depth=3,reorder=3", TRUE);
+    helper ("libomxil-sim.so", FALSE, FALSE, 3);
+    g_unsetenv ("GST_OMX_SIM");
+}
+GST_END_TEST
+
+GST_START_TEST (test_sim_tunnel)
+{
+    g_setenv ("GST_OMX_SIM", "process_time=200,jitter=100", TRUE);
+    helper ("libomxil-sim.so", FALSE, TRUE, 0);
+    g_unsetenv ("GST_OMX_SIM");
+}
+GST_END_TEST
+
+GST_START_TEST (test_sim_tunnel_flush)
+{
+    g_setenv ("GST_OMX_SIM", "process_time=200,jitter=100,depth=3,seed=1", TRUE);
+    helper ("libomxil-sim.so", TRUE, TRUE, 0);
+    g_unsetenv ("GST_OMX_SIM");
+}
+GST_END_TEST
+
+/*
+ * A component that fails to come up must give its slot back, or the next
+ * instance waits for one that never frees.
+ */
+GST_START_TEST (test_sim_handle_error)
+{
+    GstElement *filter;
+
+    g_setenv ("GST_OMX_RESOURCES", "OMX.sim.limited=1", TRUE);
+    g_setenv ("GST_OMX_SIM", "handle_errors=1", TRUE);
+
+    filter = gst_check_setup_element ("omx_dummy");
+    g_object_set (G_OBJECT (filter),
+                  "library-name", "libomxil-sim.so",
+                  "component-name", "OMX.sim.limited",
+                  NULL);
+    fail_unless_equals_int (gst_element_set_state (filter, GST_STATE_READY),
+                            GST_STATE_CHANGE_FAILURE);
+    gst_element_set_state (filter, GST_STATE_NULL);
+    gst_check_teardown_element (filter);
+
+    filter = gst_check_setup_element ("omx_dummy");
+    g_object_set (G_OBJECT (filter),
+                  "library-name", "libomxil-sim.so",
+                  "component-name", "OMX.sim.limited",
+                  NULL);
+    fail_unless_equals_int (gst_element_set_state (filter, GST_STATE_READY),
+                            GST_STATE_CHANGE_SUCCESS);
+    gst_element_set_state (filter, GST_STATE_NULL);
+    gst_check_teardown_element (filter);
+
+    g_unsetenv ("GST_OMX_SIM");
+    g_unsetenv ("GST_OMX_RESOURCES");
+}
+GST_END_TEST
+
+#define SLICE_FRAMES 0x20
+#define NAL_SIZE 0x40
+#define SYNC_EVERY 4
+
+/* A frame of two NAL units, each marked with the frame number. */
+static GstBuffer *
+slice_frame_new (guint i)
+{
+    GstBuffer *buffer;
+    guint8 *data;
+    guint nal;
+
+    buffer = gst_buffer_new_and_alloc (2 * NAL_SIZE);
+    data = GST_BUFFER_DATA (buffer);
+    memset (data, 0xaa, 2 * NAL_SIZE);
+
+    for (nal = 0; nal < 2; nal++, data += NAL_SIZE)
+    {
+        data[0] = data[1] = data[2] = 0;
+        data[3] = 1;
+        data[4] = 0x21 + nal;
+        data[5] = i;
+    }
+
+    GST_BUFFER_TIMESTAMP (buffer) = i * GST_SECOND / 30;
+
+    return buffer;
+}
+
+/* When each NAL unit reached the sink. */
+static GstClockTime arrivals[2 * SLICE_FRAMES];
+
+static gboolean
+arrival_probe (GstPad * pad, GstBuffer * buffer, gpointer data)
+{
+    guint *count = data;
+
+    if (*count < G_N_ELEMENTS (arrivals))
+        arrivals[*count] = gst_util_get_timestamp ();
+    (*count)++;
+
+    return TRUE;
+}
+
+/*
+ * Encode frames of two NAL units in slice mode, with the simulator set
+ * up by options. Every NAL unit must come out whole, on its own, flagged
+ * like its frame.
+ */
+static void
+slices_helper (const gchar *options,
+               gboolean partial_nals)
+{
+    GstElement *filter;
+    GstPad *mysrcpad;
+    GstPad *mysinkpad;
+    GstCaps *caps;
+    GList *cur;
+    guint count = 0;
+    guint i;
+
+    g_setenv ("GST_OMX_SIM", options, TRUE);
+
+    filter = gst_check_setup_element ("omx_h264enc");
+    mysrcpad = gst_check_setup_src_pad (filter, &srctemplate, NULL);
+    mysinkpad = gst_check_setup_sink_pad (filter, &sinktemplate, NULL);
+
+    gst_pad_set_active (mysrcpad, TRUE);
+    gst_pad_set_active (mysinkpad, TRUE);
+    gst_pad_set_event_function (mysinkpad, test_sink_event);
+    gst_pad_add_buffer_probe (mysinkpad, G_CALLBACK (arrival_probe), &count);
+
+    eos_mutex = g_mutex_new ();
+    eos_cond = g_cond_new ();
+    eos_arrived = FALSE;
+
+    g_object_set (G_OBJECT (filter),
+                  "library-name", "libomxil-sim.so",
+                  "slice-spacing", 1,
+                  "partial-nals", partial_nals,
+                  NULL);
+
+    fail_unless_equals_int (gst_element_set_state (filter, GST_STATE_PLAYING),
+                            GST_STATE_CHANGE_SUCCESS);
+
+    caps = gst_caps_from_string ("video/x-raw-yuv,format=(fourcc)I420,"
+                                 "width=64,height=48,framerate=30/1");
+
+    for (i = 0; i < SLICE_FRAMES; i++)
+    {
+        GstBuffer *inbuffer;
+
+        inbuffer = slice_frame_new (i);
+        gst_buffer_set_caps (inbuffer, caps);
+        fail_unless (gst_pad_push (mysrcpad, inbuffer) == GST_FLOW_OK);
+    }
+
+    gst_caps_unref (caps);
+
+    gst_pad_push_event (mysrcpad, gst_event_new_eos ());
+    g_mutex_lock (eos_mutex);
+    while (!eos_arrived)
+        g_cond_wait (eos_cond, eos_mutex);
+    g_mutex_unlock (eos_mutex);
+
+    for (cur = buffers, i = 0; cur; cur = g_list_next (cur), i++)
+    {
+        GstBuffer *buffer;
+        guint8 *data;
+        guint frame;
+        gboolean delta;
+
+        buffer = cur->data;
+        data = GST_BUFFER_DATA (buffer);
+        frame = i / 2;
+
+        fail_unless_equals_int (GST_BUFFER_SIZE (buffer), NAL_SIZE);
+        fail_unless (data[3] == 1 && data[4] == 0x21 + i % 2);
+        fail_unless_equals_int (data[5], frame);
+        delta = GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+        fail_unless (!delta == (frame % SYNC_EVERY == 0));
+    }
+    fail_unless_equals_int (i, 2 * SLICE_FRAMES);
+
+    gst_check_drop_buffers ();
+
+    gst_element_set_state (filter, GST_STATE_NULL);
+
+    gst_pad_set_active (mysrcpad, FALSE);
+    gst_pad_set_active (mysinkpad, FALSE);
+    gst_check_teardown_src_pad (filter);
+    gst_check_teardown_sink_pad (filter);
+    gst_check_teardown_element (filter);
+
+    g_mutex_free (eos_mutex);
+    g_cond_free (eos_cond);
+
+    g_unsetenv ("GST_OMX_SIM");
+}
+
+/*
+ * Each frame comes out of the component in three slices that cut NAL
+ * units in two, and only the first slice says whether it is a sync
+ * frame.
+ */
+GST_START_TEST (test_sim_slices)
+{
+    slices_helper ("width=64,height=48,slices=3,sync_every=" G_STRINGIFY (SYNC_EVERY),
+                   TRUE);
+}
+GST_END_TEST
+
+#define SLICE_TIME 20000
+
+/*
+ * Slices that end on NAL boundaries go downstream as they come: the first
+ * NAL unit of a frame must arrive well before the component produces the
+ * second, SLICE_TIME later.
+ */
+GST_START_TEST (test_sim_slices_whole)
+{
+    guint i;
+
+    slices_helper ("width=64,height=48,slices=2,slice_time=" G_STRINGIFY (SLICE_TIME)
+                   ",sync_every=" G_STRINGIFY (SYNC_EVERY),
+                   FALSE);
+
+    for (i = 0; i < SLICE_FRAMES; i++)
+        fail_unless (arrivals[2 * i + 1] - arrivals[2 * i] >=
+                     SLICE_TIME / 2 * GST_USECOND);
+}
+GST_END_TEST
+
+#define PARALLEL_FRAMES 0x40
+#define MARK_EVERY 8
+
+/* Output count when each mark event came out, by mark. */
+static guint marks_seen[PARALLEL_FRAMES / MARK_EVERY];
+
+static gboolean
+mark_sink_event (GstPad * pad, GstEvent * event)
+{
+    const GstStructure *structure;
+    guint mark;
+
+    structure = gst_event_get_structure (event);
+    if (GST_EVENT_TYPE (event) == GST_EVENT_CUSTOM_DOWNSTREAM &&
+        gst_structure_get_uint (structure, "mark", &mark))
+    {
+        g_mutex_lock (check_mutex);
+        marks_seen[mark] = g_list_length (buffers);
+        g_mutex_unlock (check_mutex);
+    }
+
+    return test_sink_event (pad, event);
+}
+
+/*
+ * Frames spread over several encoders finish in any order, with jitter;
+ * they must still come out in the order they went in, and the serialized
+ * events between them must stay where they were.
+ */
+GST_START_TEST (test_sim_parallel)
+{
+    GstElement *filter;
+    GstPad *mysrcpad;
+    GstPad *mysinkpad;
+    GstCaps *caps;
+    GList *cur;
+    guint i;
+
+    g_setenv ("GST_OMX_SIM", "width=16,height=16,process_time=1000,jitter=900", TRUE);
+
+    filter = gst_check_setup_element ("omx_jpegenc");
+    mysrcpad = gst_check_setup_src_pad (filter, &srctemplate, NULL);
+    mysinkpad = gst_check_setup_sink_pad (filter, &sinktemplate, NULL);
+
+    gst_pad_set_active (mysrcpad, TRUE);
+    gst_pad_set_active (mysinkpad, TRUE);
+    gst_pad_set_event_function (mysinkpad, mark_sink_event);
+
+    eos_mutex = g_mutex_new ();
+    eos_cond = g_cond_new ();
+    eos_arrived = FALSE;
+    memset (marks_seen, 0, sizeof (marks_seen));
+
+    g_object_set (G_OBJECT (filter),
+                  "library-name", "libomxil-sim.so",
+                  "instances", 4,
+                  NULL);
+
+    fail_unless_equals_int (gst_element_set_state (filter, GST_STATE_PLAYING),
+                            GST_STATE_CHANGE_SUCCESS);
+
+    caps = gst_caps_from_string ("video/x-raw-yuv,format=(fourcc)I420,"
+                                 "width=16,height=16,framerate=30/1");
+
+    for (i = 0; i < PARALLEL_FRAMES; i++)
+    {
+        GstBuffer *inbuffer;
+
+        if (i % MARK_EVERY == 0)
+        {
+            GstStructure *structure;
+
+            structure = gst_structure_new ("test-mark",
+                                           "mark", G_TYPE_UINT, i / MARK_EVERY,
+                                           NULL);
+            gst_pad_push_event (mysrcpad,
+                                gst_event_new_custom (GST_EVENT_CUSTOM_DOWNSTREAM,
+                                                      structure));
+        }
+
+        inbuffer = gst_buffer_new_and_alloc (16 * 16 * 3 / 2);
+        memset (GST_BUFFER_DATA (inbuffer), 0, GST_BUFFER_SIZE (inbuffer));
+        GST_BUFFER_DATA (inbuffer)[0] = i;
+        gst_buffer_set_caps (inbuffer, caps);
+        fail_unless (gst_pad_push (mysrcpad, inbuffer) == GST_FLOW_OK);
+    }
+
+    gst_caps_unref (caps);
+
+    gst_pad_push_event (mysrcpad, gst_event_new_eos ());
+    g_mutex_lock (eos_mutex);
+    while (!eos_arrived)
+        g_cond_wait (eos_cond, eos_mutex);
+    g_mutex_unlock (eos_mutex);
+
+    for (cur = buffers, i = 0; cur; cur = g_list_next (cur), i++)
+        fail_unless_equals_int (GST_BUFFER_DATA (cur->data)[0], i);
+    fail_unless_equals_int (i, PARALLEL_FRAMES);
+
+    for (i = 0; i < G_N_ELEMENTS (marks_seen); i++)
+        fail_unless_equals_int (marks_seen[i], i * MARK_EVERY);
+
+    gst_check_drop_buffers ();
+
+    gst_element_set_state (filter, GST_STATE_NULL);
+
+    gst_pad_set_active (mysrcpad, FALSE);
+    gst_pad_set_active (mysinkpad, FALSE);
+    gst_check_teardown_src_pad (filter);
+    gst_check_teardown_sink_pad (filter);
+    gst_check_teardown_element (filter);
+
+    g_mutex_free (eos_mutex);
+    g_cond_free (eos_cond);
+
+    g_unsetenv ("GST_OMX_SIM");
+}
+GST_END_TEST
+
+#define DECODE_FRAMES 0x10
+#define GOP_FRAMES 4
+#define FRAME_DURATION (GST_SECOND / 30)
+
+/*
+ * Decode DECODE_FRAMES numbered frames through omx_h264dec, in the order
+ * given, after a segment of the given rate and start.
+ */
+static void
+decode_helper (gdouble rate,
+               GstClockTime start,
+               const guint *order)
+{
+    GstElement *filter;
+    GstPad *mysrcpad;
+    GstPad *mysinkpad;
+    GstCaps *caps;
+    guint i;
+
+    g_setenv ("GST_OMX_SIM", "width=16,height=16", TRUE);
+
+    filter = gst_check_setup_element ("omx_h264dec");
+    mysrcpad = gst_check_setup_src_pad (filter, &srctemplate, NULL);
+    mysinkpad = gst_check_setup_sink_pad (filter, &sinktemplate, NULL);
+
+    gst_pad_set_active (mysrcpad, TRUE);
+    gst_pad_set_active (mysinkpad, TRUE);
+    gst_pad_set_event_function (mysinkpad, test_sink_event);
+
+    eos_mutex = g_mutex_new ();
+    eos_cond = g_cond_new ();
+    eos_arrived = FALSE;
+
+    g_object_set (G_OBJECT (filter),
+                  "library-name", "libomxil-sim.so",
+                  NULL);
+
+    fail_unless_equals_int (gst_element_set_state (filter, GST_STATE_PLAYING),
+                            GST_STATE_CHANGE_SUCCESS);
+
+    fail_unless (gst_pad_push_event (mysrcpad,
+                                     gst_event_new_new_segment_full (FALSE, rate, 1.0,
+                                                                     GST_FORMAT_TIME,
+                                                                     start,
+                                                                     DECODE_FRAMES * FRAME_DURATION,
+                                                                     start)));
+
+    caps = gst_caps_from_string ("video/x-h264,width=16,height=16,framerate=30/1");
+
+    for (i = 0; i < DECODE_FRAMES; i++)
+    {
+        GstBuffer *inbuffer;
+
+        inbuffer = gst_buffer_new_and_alloc (16);
+        memset (GST_BUFFER_DATA (inbuffer), 0xaa, GST_BUFFER_SIZE (inbuffer));
+        GST_BUFFER_DATA (inbuffer)[0] = order[i];
+        GST_BUFFER_TIMESTAMP (inbuffer) = order[i] * FRAME_DURATION;
+        GST_BUFFER_DURATION (inbuffer) = FRAME_DURATION;
+        gst_buffer_set_caps (inbuffer, caps);
+        fail_unless (gst_pad_push (mysrcpad, inbuffer) == GST_FLOW_OK);
+    }
+
+    gst_caps_unref (caps);
+
+    gst_pad_push_event (mysrcpad, gst_event_new_eos ());
+    g_mutex_lock (eos_mutex);
+    while (!eos_arrived)
+        g_cond_wait (eos_cond, eos_mutex);
+    g_mutex_unlock (eos_mutex);
+
+    gst_element_set_state (filter, GST_STATE_NULL);
+
+    gst_pad_set_active (mysrcpad, FALSE);
+    gst_pad_set_active (mysinkpad, FALSE);
+    gst_check_teardown_src_pad (filter);
+    gst_check_teardown_sink_pad (filter);
+    gst_check_teardown_element (filter);
+
+    g_mutex_free (eos_mutex);
+    g_cond_free (eos_cond);
+
+    g_unsetenv ("GST_OMX_SIM");
+}
+
+/*
+ * Played backwards, the demuxer sends the last GOP first, each in forward
+ * order; every frame must still come out latest first.
+ */
+GST_START_TEST (test_sim_reverse)
+{
+    guint order[DECODE_FRAMES];
+    GList *cur;
+    guint i;
+
+    for (i = 0; i < DECODE_FRAMES; i++)
+        order[i] = DECODE_FRAMES - GOP_FRAMES * (i / GOP_FRAMES + 1) + i % GOP_FRAMES;
+
+    decode_helper (-1.0, 0, order);
+
+    for (cur = buffers, i = 0; cur; cur = g_list_next (cur), i++)
+    {
+        GstBuffer *buffer = cur->data;
+
+        fail_unless_equals_int (GST_BUFFER_DATA (buffer)[0], DECODE_FRAMES - 1 - i);
+        fail_unless_equals_uint64 (GST_BUFFER_TIMESTAMP (buffer),
+                                   (DECODE_FRAMES - 1 - i) * FRAME_DURATION);
+    }
+    fail_unless_equals_int (i, DECODE_FRAMES);
+
+    gst_check_drop_buffers ();
+}
+GST_END_TEST
+
+#define SEGMENT_FRAME 4
+
+/*
+ * A segment starting mid-GOP: the frames before it are still decoded, but
+ * none of them may be pushed.
+ */
+GST_START_TEST (test_sim_decode_only)
+{
+    guint order[DECODE_FRAMES];
+    GList *cur;
+    guint i;
+
+    for (i = 0; i < DECODE_FRAMES; i++)
+        order[i] = i;
+
+    decode_helper (1.0, SEGMENT_FRAME * FRAME_DURATION + FRAME_DURATION / 2, order);
+
+    for (cur = buffers, i = SEGMENT_FRAME; cur; cur = g_list_next (cur), i++)
+        fail_unless_equals_int (GST_BUFFER_DATA (cur->data)[0], i);
+    fail_unless_equals_int (i, DECODE_FRAMES);
+
+    gst_check_drop_buffers ();
 }
 GST_END_TEST
 
@@ -216,6 +780,17 @@ gstomx_suite (void)
     tcase_set_timeout (tc_chain, 10);
     tcase_add_test (tc_chain, test_basic);
     tcase_add_test (tc_chain, test_flush);
+    tcase_add_test (tc_chain, test_sim);
+    tcase_add_test (tc_chain, test_sim_flush);
+    tcase_add_test (tc_chain, test_sim_reorder);
+    tcase_add_test (tc_chain, test_sim_tunnel);
+    tcase_add_test (tc_chain, test_sim_tunnel_flush);
+    tcase_add_test (tc_chain, test_sim_slices);
+    tcase_add_test (tc_chain, test_sim_slices_whole);
+    tcase_add_test (tc_chain, test_sim_handle_error);
+    tcase_add_test (tc_chain, test_sim_parallel);
+    tcase_add_test (tc_chain, test_sim_reverse);
+    tcase_add_test (tc_chain, test_sim_decode_only);
     suite_add_tcase (s, tc_chain);
 
     return s;
@@ -0,0 +1,287 @@
+/*
+ * Copyright (C) 2008-2009 Nokia Corporation.
+ *
+ * Author: Felipe Contreras <felipe.contreras@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/*
+ * Scalability stress test.
+ *
+ * Runs N concurrent pipelines for each N in GST_OMX_STRESS (a comma
+ * separated list, 10 to 5000 by default) and prints one CSV line per step:
+ *
+ *   instances       concurrent pipelines
+ *   startup_ms      mean time to preroll an instance (handle, Idle, Executing)
+ *   teardown_ms     mean time to take an instance back to NULL
+ *   buffers_per_s   aggregate throughput while all of them run
+ *   threads         extra threads per instance
+ *   rss_kb          extra resident memory per instance
+ *   csw             voluntary context switches per instance, which is
+ *                   mostly threads blocking on contended locks
+ *
+ * GST_OMX_STRESS_ELEMENT, _LIBRARY and _CAPS select what is run, e.g.
+ * omx_g711dec with "audio/x-alaw,rate=8000,channels=1".
+ * GST_OMX_STRESS_OUTPUT=<file> also writes the curve there.
+ *
+ * It takes minutes, so it is not part of 'make check'; use 'make stress'.
+ */
+
+#include <gst/check/gstcheck.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+
+#define DEFAULT_STEPS "10,50,100,500,1000,2000,5000"
+#define DEFAULT_ELEMENT "omx_dummy"
+#define DEFAULT_LIBRARY "libomxil-foo.so"
+#define BUFFER_SIZE 0x400
+#define BUFFER_COUNT 100
+
+typedef struct
+{
+    guint instances;
+    gdouble startup_ms;
+    gdouble teardown_ms;
+    gdouble buffers_per_s;
+    gdouble threads;
+    gdouble rss_kb;
+    gdouble csw;
+} Step;
+
+static const gchar *
+env_or (const gchar *name,
+        const gchar *fallback)
+{
+    const gchar *value;
+
+    value = g_getenv (name);
+
+    return value && *value ? value : fallback;
+}
+
+/* Monotonic, in us; wall clock steps would skew the timings. */
+static gint64
+now (void)
+{
+    return gst_util_get_timestamp () / GST_USECOND;
+}
+
+/* A numeric field of /proc/self/status, like "Threads" or "VmRSS". */
+static glong
+proc_status (const gchar *field)
+{
+    gchar *contents;
+    gchar *line;
+    glong value = 0;
+    gsize len;
+
+    if (!g_file_get_contents ("/proc/self/status", &contents, NULL, NULL))
+        return 0;
+
+    len = strlen (field);
+
+    for (line = contents; line; line = strchr (line, '\n'))
+    {
+        if (*line == '\n')
+            line++;
+
+        if (strncmp (line, field, len) == 0 && line[len] == ':')
+        {
+            value = atol (line + len + 1);
+            break;
+        }
+    }
+
+    g_free (contents);
+
+    return value;
+}
+
+static glong
+context_switches (void)
+{
+    struct rusage usage;
+
+    getrusage (RUSAGE_SELF, &usage);
+
+    return usage.ru_nvcsw;
+}
+
+static void
+wait_for_eos (GstElement *pipeline)
+{
+    GstBus *bus;
+    GstMessage *message;
+
+    bus = gst_element_get_bus (pipeline);
+    message = gst_bus_timed_pop_filtered (bus, GST_CLOCK_TIME_NONE,
+                                          GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+
+    fail_unless (GST_MESSAGE_TYPE (message) == GST_MESSAGE_EOS);
+
+    gst_message_unref (message);
+    gst_object_unref (bus);
+}
+
+static void
+run_step (guint n,
+          Step *step)
+{
+    GstElement **pipelines;
+    gchar *description;
+    const gchar *caps;
+    glong threads;
+    glong rss;
+    glong csw;
+    gint64 start;
+    guint i;
+
+    caps = g_getenv ("GST_OMX_STRESS_CAPS");
+
+    description = g_strdup_printf ("fakesrc num-buffers=%d sizetype=fixed sizemax=%d filltype=zero"
+                                   " %s%s ! %s library-name=%s ! fakesink sync=false",
+                                   BUFFER_COUNT, BUFFER_SIZE,
+                                   caps ? "! " : "", caps ? caps : "",
+                                   env_or ("GST_OMX_STRESS_ELEMENT", DEFAULT_ELEMENT),
+                                   env_or ("GST_OMX_STRESS_LIBRARY", DEFAULT_LIBRARY));
+
+    pipelines = g_new0 (GstElement *, n);
+
+    threads = proc_status ("Threads");
+    rss = proc_status ("VmRSS");
+    csw = context_switches ();
+
+    /* startup: everything up to the first buffer going through */
+    start = now ();
+    for (i = 0; i < n; i++)
+    {
+        GError *error = NULL;
+
+        pipelines[i] = gst_parse_launch (description, &error);
+        if (error)
+        {
+            g_warning ("'%s': %s", description, error->message);
+            g_error_free (error);
+        }
+        fail_unless (pipelines[i] != NULL, "could not create '%s'", description);
+        gst_element_set_state (pipelines[i], GST_STATE_PAUSED);
+    }
+    for (i = 0; i < n; i++)
+    {
+        fail_unless (gst_element_get_state (pipelines[i], NULL, NULL, GST_CLOCK_TIME_NONE) == GST_STATE_CHANGE_SUCCESS);
+    }
+    step->startup_ms = (now () - start) / 1000.0 / n;
+
+    step->threads = (gdouble) (proc_status ("Threads") - threads) / n;
+    step->rss_kb = (gdouble) (proc_status ("VmRSS") - rss) / n;
+
+    /* throughput, all of them at once */
+    start = now ();
+    for (i = 0; i < n; i++)
+        gst_element_set_state (pipelines[i], GST_STATE_PLAYING);
+    for (i = 0; i < n; i++)
+        wait_for_eos (pipelines[i]);
+    step->buffers_per_s = (gdouble) n * BUFFER_COUNT * G_USEC_PER_SEC / MAX (now () - start, 1);
+
+    start = now ();
+    for (i = 0; i < n; i++)
+    {
+        gst_element_set_state (pipelines[i], GST_STATE_NULL);
+        gst_object_unref (pipelines[i]);
+    }
+    step->teardown_ms = (now () - start) / 1000.0 / n;
+
+    step->csw = (gdouble) (context_switches () - csw) / n;
+    step->instances = n;
+
+    g_free (pipelines);
+    g_free (description);
+}
+
+static void
+print_step (FILE *file,
+            Step *step)
+{
+    fprintf (file, "%u,%.3f,%.3f,%.1f,%.2f,%.1f,%.1f\n",
+             step->instances, step->startup_ms, step->teardown_ms,
+             step->buffers_per_s, step->threads, step->rss_kb, step->csw);
+    fflush (file);
+}
+
+GST_START_TEST (test_scaling)
+{
+    gchar **steps;
+    gchar **cur;
+    const gchar *output;
+    FILE *file = NULL;
+
+    output = g_getenv ("GST_OMX_STRESS_OUTPUT");
+    if (output)
+    {
+        file = fopen (output, "w");
+        fail_unless (file != NULL, "could not open %s", output);
+    }
+
+#define HEADER "instances,startup_ms,teardown_ms,buffers_per_s,threads,rss_kb,csw\n"
+    printf (HEADER);
+    if (file)
+        fprintf (file, HEADER);
+#undef HEADER
+
+    steps = g_strsplit (env_or ("GST_OMX_STRESS", DEFAULT_STEPS), ",", 0);
+
+    for (cur = steps; *cur; cur++)
+    {
+        Step step;
+        guint n;
+
+        n = atoi (*cur);
+        if (n == 0)
+            continue;
+
+        run_step (n, &step);
+
+        print_step (stdout, &step);
+        if (file)
+            print_step (file, &step);
+    }
+
+    g_strfreev (steps);
+
+    if (file)
+        fclose (file);
+}
+GST_END_TEST
+
+static Suite *
+scaling_suite (void)
+{
+    Suite *s = suite_create ("scaling");
+    TCase *tc_chain = tcase_create ("general");
+
+    /* big runs take as long as they take */
+    tcase_set_timeout (tc_chain, 0);
+    tcase_add_test (tc_chain, test_scaling);
+    suite_add_tcase (s, tc_chain);
+
+    return s;
+}
+
+GST_CHECK_MAIN (scaling);
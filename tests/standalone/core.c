@@ -189,9 +189,22 @@ comp_SendCommand (OMX_HANDLETYPE handle,
                 }
                 g_mutex_unlock (private->flush_mutex);
 
-                private->callbacks->EventHandler (handle,
-                                                  private->app_data, OMX_EventCmdComplete,
-                                                  OMX_CommandFlush, param_1, data);
+                if (param_1 == OMX_ALL)
+                {
+                    /* one event per port */
+                    private->callbacks->EventHandler (handle,
+                                                      private->app_data, OMX_EventCmdComplete,
+                                                      OMX_CommandFlush, 0, data);
+                    private->callbacks->EventHandler (handle,
+                                                      private->app_data, OMX_EventCmdComplete,
+                                                      OMX_CommandFlush, 1, data);
+                }
+                else
+                {
+                    private->callbacks->EventHandler (handle,
+                                                      private->app_data, OMX_EventCmdComplete,
+                                                      OMX_CommandFlush, param_1, data);
+                }
             }
             break;
         default:
@@ -0,0 +1,1263 @@
+/*
+ * Copyright (C) 2008-2009 Nokia Corporation.
+ *
+ * Author: Felipe Contreras <felipe.contreras@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/*
+ * Simulated OpenMAX IL component.
+ *
+ * Behaves like a copy filter, but models the timing and the quirks of real
+ * hardware so the queueing, flushing and reconfiguration paths can be
+ * exercised without it.
+ *
+ * Options are read from, in order of precedence:
+ *   GST_OMX_SIM="key=value,key=value"
+ *   GST_OMX_SIM_FILE=<key file>, group [<component name>] then [default]
+ *
+ *   in_buffers, out_buffers   nBufferCountActual of each port (4)
+ *   buffer_size               nBufferSize (4096, or a frame if width is set)
+ *   alignment                 nBufferAlignment; UseBuffer rejects others (0)
+ *   width, height             make the output a YUV420 video port
+ *                             (the input stays an audio port)
+ *   stride_align              nStride/nSliceHeight rounding (16)
+ *   process_time, jitter      time spent on each input, in us (0)
+ *   depth                     inputs held before output starts (0)
+ *   reorder                   outputs come in reversed groups of this (0)
+ *   slices                    outputs split into this many buffers, like
+ *                             slice mode encoders, ENDOFFRAME on the last
+ *                             and SYNCFRAME on the first only (0)
+ *   slice_time                time between two slices of a frame, in us (0)
+ *   sync_every                every Nth input comes out as a sync frame (0)
+ *   settings_change           PortSettingsChanged every N inputs (0)
+ *   corrupt                   probability of OMX_ErrorStreamCorrupt (0)
+ *   hardware_error            OMX_ErrorHardware after N inputs (0)
+ *   handle_errors             the first N OMX_GetHandle calls in the process
+ *                             fail with OMX_ErrorInsufficientResources (0)
+ *   seed                      for the random parts (0)
+ *
+ * OMX_SetupTunnel connects the output of one simulated component to the
+ * input of another; the output port then supplies out_buffers headers of
+ * its own and hands them straight to the peer.
+ */
+
+#include <OMX_Core.h>
+#include <OMX_Component.h>
+
+#include <glib.h>
+
+#include <stdlib.h> /* For calloc, free, posix_memalign */
+#include <string.h> /* For memcpy */
+
+#define ROUND_UP(n, align) (((n) + (align) - 1) / (align) * (align))
+
+typedef struct SimConfig SimConfig;
+typedef struct SimOption SimOption;
+typedef struct SimFrame SimFrame;
+typedef struct CompPrivate CompPrivate;
+typedef struct CompPrivatePort CompPrivatePort;
+
+struct SimConfig
+{
+    gint in_buffers;
+    gint out_buffers;
+    gint buffer_size;
+    gint alignment;
+    gint width;
+    gint height;
+    gint stride_align;
+    gint process_time;
+    gint jitter;
+    gint depth;
+    gint reorder;
+    gint slices;
+    gint slice_time;
+    gint sync_every;
+    gint settings_change;
+    gdouble corrupt;
+    gint hardware_error;
+    gint handle_errors;
+    gint seed;
+};
+
+struct SimOption
+{
+    const gchar *name;
+    gsize offset;
+    gboolean is_double;
+};
+
+#define SIM_OPTION(name) { #name, G_STRUCT_OFFSET (SimConfig, name), FALSE }
+
+static SimOption options[] =
+{
+    SIM_OPTION (in_buffers),
+    SIM_OPTION (out_buffers),
+    SIM_OPTION (buffer_size),
+    SIM_OPTION (alignment),
+    SIM_OPTION (width),
+    SIM_OPTION (height),
+    SIM_OPTION (stride_align),
+    SIM_OPTION (process_time),
+    SIM_OPTION (jitter),
+    SIM_OPTION (depth),
+    SIM_OPTION (reorder),
+    SIM_OPTION (slices),
+    SIM_OPTION (slice_time),
+    SIM_OPTION (sync_every),
+    SIM_OPTION (settings_change),
+    { "corrupt", G_STRUCT_OFFSET (SimConfig, corrupt), TRUE },
+    SIM_OPTION (hardware_error),
+    SIM_OPTION (handle_errors),
+    SIM_OPTION (seed),
+    { NULL }
+};
+
+struct SimFrame
+{
+    gpointer data;
+    OMX_U32 size;
+    OMX_TICKS timestamp;
+    OMX_U32 flags;
+    gint delay; /**< us to wait before it comes out. */
+};
+
+struct CompPrivatePort
+{
+    OMX_PARAM_PORTDEFINITIONTYPE port_def;
+    GQueue *queue; /**< Headers the client gave us. */
+};
+
+struct CompPrivate
+{
+    OMX_STATETYPE state;
+    OMX_CALLBACKTYPE *callbacks;
+    OMX_PTR app_data;
+    CompPrivatePort *ports;
+    SimConfig config;
+    GRand *rand;
+
+    GThread *thread;
+    GMutex *mutex;
+    GCond *condition;
+    gboolean done;
+
+    OMX_BUFFERHEADERTYPE *in_process; /**< Input being worked on, unlocked. */
+    guint count; /**< Inputs processed. */
+    GQueue *pending; /**< Frames held back by depth/reorder. */
+    GQueue *ready; /**< Frames waiting for an output header. */
+
+    OMX_COMPONENTTYPE *tunnel_peer; /**< Takes our output, if tunneled. */
+    OMX_COMPONENTTYPE *tunnel_source; /**< Gives us input, if tunneled. */
+    GList *tunnel_buffers; /**< Headers we supply to tunnel_peer. */
+};
+
+OMX_ERRORTYPE
+OMX_Init (void)
+{
+    if (!g_thread_supported ())
+    {
+        g_thread_init (NULL);
+    }
+
+    return OMX_ErrorNone;
+}
+
+OMX_ERRORTYPE
+OMX_Deinit (void)
+{
+    return OMX_ErrorNone;
+}
+
+/* Configuration. */
+
+static void
+config_set (SimConfig *config,
+            const gchar *key,
+            const gchar *value)
+{
+    SimOption *option;
+
+    for (option = options; option->name; option++)
+    {
+        if (strcmp (option->name, key) != 0)
+            continue;
+
+        if (option->is_double)
+            G_STRUCT_MEMBER (gdouble, config, option->offset) = g_ascii_strtod (value, NULL);
+        else
+            G_STRUCT_MEMBER (gint, config, option->offset) = atoi (value);
+        return;
+    }
+
+    g_warning ("unknown simulator option '%s'", key);
+}
+
+static void
+config_load_group (SimConfig *config,
+                   GKeyFile *key_file,
+                   const gchar *group)
+{
+    gchar **keys;
+    gchar **key;
+
+    keys = g_key_file_get_keys (key_file, group, NULL, NULL);
+    if (!keys)
+        return;
+
+    for (key = keys; *key; key++)
+    {
+        gchar *value;
+
+        value = g_key_file_get_value (key_file, group, *key, NULL);
+        if (value)
+            config_set (config, *key, value);
+        g_free (value);
+    }
+
+    g_strfreev (keys);
+}
+
+static void
+config_load (SimConfig *config,
+             const gchar *component_name)
+{
+    const gchar *env;
+
+    config->in_buffers = 4;
+    config->out_buffers = 4;
+    config->buffer_size = 0x1000;
+    config->stride_align = 16;
+
+    env = g_getenv ("GST_OMX_SIM_FILE");
+    if (env)
+    {
+        GKeyFile *key_file;
+
+        key_file = g_key_file_new ();
+        if (g_key_file_load_from_file (key_file, env, G_KEY_FILE_NONE, NULL))
+        {
+            config_load_group (config, key_file, "default");
+            if (component_name)
+                config_load_group (config, key_file, component_name);
+        }
+        else
+        {
+            g_warning ("could not load simulator config '%s'", env);
+        }
+        g_key_file_free (key_file);
+    }
+
+    env = g_getenv ("GST_OMX_SIM");
+    if (env)
+    {
+        gchar **pairs;
+        gchar **pair;
+
+        pairs = g_strsplit (env, ",", 0);
+        for (pair = pairs; *pair; pair++)
+        {
+            gchar **kv;
+
+            kv = g_strsplit (*pair, "=", 2);
+            if (kv[0] && kv[1])
+                config_set (config, g_strstrip (kv[0]), g_strstrip (kv[1]));
+            g_strfreev (kv);
+        }
+        g_strfreev (pairs);
+    }
+
+    if (config->in_buffers < 1)
+        config->in_buffers = 1;
+    if (config->out_buffers < 1)
+        config->out_buffers = 1;
+    if (config->stride_align < 1)
+        config->stride_align = 1;
+}
+
+static void
+port_set_video (OMX_PARAM_PORTDEFINITIONTYPE *port_def,
+                SimConfig *config,
+                gint width,
+                gint height)
+{
+    OMX_VIDEO_PORTDEFINITIONTYPE *video;
+
+    video = &port_def->format.video;
+    port_def->eDomain = OMX_PortDomainVideo;
+    video->nFrameWidth = width;
+    video->nFrameHeight = height;
+    video->nStride = ROUND_UP (width, config->stride_align);
+    video->nSliceHeight = ROUND_UP (height, config->stride_align);
+    video->eColorFormat = OMX_COLOR_FormatYUV420PackedPlanar;
+    video->eCompressionFormat = OMX_VIDEO_CodingUnused;
+}
+
+static void
+port_init (CompPrivatePort *port,
+           SimConfig *config,
+           guint index)
+{
+    OMX_PARAM_PORTDEFINITIONTYPE *port_def;
+
+    port->queue = g_queue_new ();
+
+    port_def = &port->port_def;
+    port_def->nSize = sizeof (OMX_PARAM_PORTDEFINITIONTYPE);
+    port_def->nVersion.nVersion = 1;
+    port_def->nPortIndex = index;
+    port_def->eDir = index == 0 ? OMX_DirInput : OMX_DirOutput;
+    port_def->nBufferCountActual = index == 0 ? config->in_buffers : config->out_buffers;
+    port_def->nBufferCountMin = 1;
+    port_def->nBufferSize = config->buffer_size;
+    port_def->nBufferAlignment = config->alignment;
+    port_def->bEnabled = OMX_TRUE;
+    port_def->eDomain = OMX_PortDomainAudio;
+
+    if (index == 1 && config->width && config->height)
+    {
+        port_set_video (port_def, config, config->width, config->height);
+        /* room for either orientation, see sim_settings_change */
+        port_def->nBufferSize = MAX (port_def->format.video.nStride,
+                                     port_def->format.video.nSliceHeight);
+        port_def->nBufferSize *= port_def->nBufferSize * 3 / 2;
+    }
+}
+
+/* Frames. */
+
+static SimFrame *
+frame_new (OMX_BUFFERHEADERTYPE *buffer)
+{
+    SimFrame *frame;
+
+    frame = g_slice_new0 (SimFrame);
+    frame->size = buffer->nFilledLen;
+    frame->data = g_memdup (buffer->pBuffer + buffer->nOffset, buffer->nFilledLen);
+    frame->timestamp = buffer->nTimeStamp;
+    frame->flags = buffer->nFlags;
+
+    return frame;
+}
+
+static void
+frame_free (gpointer data,
+            gpointer user_data)
+{
+    SimFrame *frame = data;
+
+    g_free (frame->data);
+    g_slice_free (SimFrame, frame);
+}
+
+static void
+frames_clear (GQueue *queue)
+{
+    g_queue_foreach (queue, frame_free, NULL);
+    g_queue_clear (queue);
+}
+
+/*
+ * Queue a frame for output, cut in slices if asked to. Only the first
+ * slice carries SYNCFRAME, and only the last ENDOFFRAME, as encoders do.
+ */
+static void
+frames_ready (CompPrivate *private,
+              SimFrame *frame)
+{
+    guint slices;
+    guint slice_size;
+    guint offset;
+    guint i;
+
+    slices = private->config.slices;
+    if (slices < 2 || frame->size < slices)
+    {
+        g_queue_push_tail (private->ready, frame);
+        return;
+    }
+
+    slice_size = frame->size / slices;
+
+    for (i = 0, offset = 0; i < slices; i++, offset += slice_size)
+    {
+        SimFrame *slice;
+
+        slice = g_slice_new0 (SimFrame);
+        slice->size = i < slices - 1 ? slice_size : frame->size - offset;
+        slice->data = g_memdup ((guint8 *) frame->data + offset, slice->size);
+        slice->timestamp = frame->timestamp;
+        slice->flags = frame->flags & ~OMX_BUFFERFLAG_ENDOFFRAME;
+        if (i > 0)
+        {
+            slice->flags &= ~OMX_BUFFERFLAG_SYNCFRAME;
+            slice->delay = private->config.slice_time;
+        }
+        if (i == slices - 1)
+            slice->flags |= OMX_BUFFERFLAG_ENDOFFRAME;
+
+        g_queue_push_tail (private->ready, slice);
+    }
+
+    frame_free (frame, NULL);
+}
+
+/*
+ * Move frames that are no longer held back to the ready queue. With
+ * reorder set they come out in reversed groups, like B-frames do.
+ */
+static void
+frames_collect (CompPrivate *private,
+                gboolean drain)
+{
+    guint reorder;
+    guint hold;
+
+    reorder = MAX (private->config.reorder, 1);
+    hold = drain ? 0 : private->config.depth + reorder - 1;
+
+    while (g_queue_get_length (private->pending) > hold)
+    {
+        if (g_queue_get_length (private->pending) >= reorder)
+        {
+            GList *group = NULL;
+            guint i;
+
+            for (i = 0; i < reorder; i++)
+                group = g_list_prepend (group, g_queue_pop_head (private->pending));
+            for (; group; group = g_list_delete_link (group, group))
+                frames_ready (private, group->data);
+        }
+        else
+        {
+            frames_ready (private, g_queue_pop_head (private->pending));
+        }
+    }
+}
+
+/* Components. */
+
+static void
+send_event (OMX_COMPONENTTYPE *comp,
+            OMX_EVENTTYPE event,
+            OMX_U32 data_1,
+            OMX_U32 data_2)
+{
+    CompPrivate *private;
+
+    private = comp->pComponentPrivate;
+    private->callbacks->EventHandler (comp, private->app_data, event, data_1, data_2, NULL);
+}
+
+/* Output goes to the client, or to the peer of a tunnel. */
+static void
+output_done (OMX_COMPONENTTYPE *comp,
+             OMX_BUFFERHEADERTYPE *buffer)
+{
+    CompPrivate *private;
+
+    private = comp->pComponentPrivate;
+
+    if (buffer->nFlags & OMX_BUFFERFLAG_EOS)
+        send_event (comp, OMX_EventBufferFlag, 1, buffer->nFlags);
+
+    if (private->tunnel_peer)
+        private->tunnel_peer->EmptyThisBuffer (private->tunnel_peer, buffer);
+    else
+        private->callbacks->FillBufferDone (comp, private->app_data, buffer);
+}
+
+/* Emptied input goes back to the client, or to the supplier of a tunnel. */
+static void
+input_done (OMX_COMPONENTTYPE *comp,
+            OMX_BUFFERHEADERTYPE *buffer)
+{
+    CompPrivate *private;
+
+    private = comp->pComponentPrivate;
+
+    if (private->tunnel_source)
+        private->tunnel_source->FillThisBuffer (private->tunnel_source, buffer);
+    else
+        private->callbacks->EmptyBufferDone (comp, private->app_data, buffer);
+}
+
+/*
+ * Give back every header of a port; called locked, returns them in a list.
+ * A port disable keeps the frames in the works, a flush drops them.
+ */
+static GList *
+port_take_buffers (CompPrivate *private,
+                   guint index,
+                   gboolean drop_frames)
+{
+    GList *list = NULL;
+    OMX_BUFFERHEADERTYPE *buffer;
+
+    while ((buffer = g_queue_pop_head (private->ports[index].queue)))
+        list = g_list_append (list, buffer);
+
+    if (index == 0)
+    {
+        if (private->in_process)
+        {
+            list = g_list_append (list, private->in_process);
+            private->in_process = NULL;
+        }
+        if (drop_frames)
+            frames_clear (private->pending);
+    }
+    else if (drop_frames)
+    {
+        frames_clear (private->ready);
+    }
+
+    return list;
+}
+
+static void
+return_buffers (OMX_COMPONENTTYPE *comp,
+                GList *list,
+                guint index)
+{
+    CompPrivate *private;
+
+    private = comp->pComponentPrivate;
+
+    for (; list; list = g_list_delete_link (list, list))
+    {
+        OMX_BUFFERHEADERTYPE *buffer = list->data;
+
+        if (index == 0)
+            input_done (comp, buffer);
+        else if (private->tunnel_peer)
+        {
+            /* the supplier keeps its headers */
+            g_mutex_lock (private->mutex);
+            g_queue_push_tail (private->ports[1].queue, buffer);
+            g_mutex_unlock (private->mutex);
+        }
+        else
+        {
+            buffer->nFilledLen = 0;
+            private->callbacks->FillBufferDone (comp, private->app_data, buffer);
+        }
+    }
+}
+
+static void
+sim_work (CompPrivate *private)
+{
+    gint us;
+
+    us = private->config.process_time;
+    if (private->config.jitter > 0)
+        us += g_rand_int_range (private->rand, -private->config.jitter,
+                                private->config.jitter + 1);
+
+    if (us > 0)
+        g_usleep (us);
+}
+
+/* Called locked; flip the frame size so the client sees a real change. */
+static void
+sim_settings_change (CompPrivate *private)
+{
+    OMX_PARAM_PORTDEFINITIONTYPE *port_def;
+
+    port_def = &private->ports[1].port_def;
+
+    if (port_def->eDomain == OMX_PortDomainVideo)
+    {
+        port_set_video (port_def, &private->config,
+                        port_def->format.video.nFrameHeight,
+                        port_def->format.video.nFrameWidth);
+    }
+}
+
+static gpointer
+sim_thread (gpointer cb_data)
+{
+    OMX_COMPONENTTYPE *comp;
+    CompPrivate *private;
+    SimConfig *config;
+
+    comp = cb_data;
+    private = comp->pComponentPrivate;
+    config = &private->config;
+
+    g_mutex_lock (private->mutex);
+
+    while (!private->done)
+    {
+        if (private->state != OMX_StateExecuting)
+        {
+            g_cond_wait (private->condition, private->mutex);
+            continue;
+        }
+
+        /* finished frames first, so outputs are not starved */
+        if (!g_queue_is_empty (private->ready) &&
+            !g_queue_is_empty (private->ports[1].queue))
+        {
+            OMX_BUFFERHEADERTYPE *out_buffer;
+            SimFrame *frame;
+            OMX_U32 size;
+
+            /* wait with the frame still queued; a flush may drop it meanwhile */
+            frame = g_queue_peek_head (private->ready);
+            if (frame->delay > 0)
+            {
+                gint delay = frame->delay;
+
+                frame->delay = 0;
+                g_mutex_unlock (private->mutex);
+                g_usleep (delay);
+                g_mutex_lock (private->mutex);
+                continue;
+            }
+
+            frame = g_queue_pop_head (private->ready);
+            out_buffer = g_queue_pop_head (private->ports[1].queue);
+
+            size = MIN (frame->size, out_buffer->nAllocLen);
+            memcpy (out_buffer->pBuffer, frame->data, size);
+            out_buffer->nOffset = 0;
+            out_buffer->nFilledLen = size;
+            out_buffer->nTimeStamp = frame->timestamp;
+            out_buffer->nFlags = frame->flags;
+            frame_free (frame, NULL);
+
+            g_mutex_unlock (private->mutex);
+            output_done (comp, out_buffer);
+            g_mutex_lock (private->mutex);
+            continue;
+        }
+
+        if (!g_queue_is_empty (private->ports[0].queue))
+        {
+            OMX_BUFFERHEADERTYPE *in_buffer;
+            SimFrame *frame;
+            gboolean corrupt = FALSE;
+            gboolean hardware_error = FALSE;
+            gboolean settings_change = FALSE;
+
+            in_buffer = g_queue_pop_head (private->ports[0].queue);
+            private->in_process = in_buffer;
+
+            g_mutex_unlock (private->mutex);
+            sim_work (private);
+            g_mutex_lock (private->mutex);
+
+            /* flushed meanwhile, the header went back already */
+            if (private->in_process != in_buffer)
+                continue;
+            private->in_process = NULL;
+
+            private->count++;
+            frame = frame_new (in_buffer);
+
+            if (config->corrupt > 0 &&
+                g_rand_double (private->rand) < config->corrupt)
+            {
+                frame->flags |= OMX_BUFFERFLAG_DATACORRUPT;
+                corrupt = TRUE;
+            }
+
+            if (config->sync_every && (private->count - 1) % config->sync_every == 0)
+                frame->flags |= OMX_BUFFERFLAG_SYNCFRAME;
+
+            if (config->hardware_error && private->count == (guint) config->hardware_error)
+                hardware_error = TRUE;
+
+            if (config->settings_change && private->count % config->settings_change == 0)
+            {
+                sim_settings_change (private);
+                settings_change = TRUE;
+            }
+
+            g_queue_push_tail (private->pending, frame);
+
+            if (frame->flags & OMX_BUFFERFLAG_EOS)
+            {
+                SimFrame *last;
+
+                /* the EOS flag goes on whatever comes out last */
+                frame->flags &= ~OMX_BUFFERFLAG_EOS;
+                frames_collect (private, TRUE);
+                last = g_queue_peek_tail (private->ready);
+                last->flags |= OMX_BUFFERFLAG_EOS;
+            }
+            else
+            {
+                frames_collect (private, FALSE);
+            }
+
+            in_buffer->nFilledLen = 0;
+
+            g_mutex_unlock (private->mutex);
+
+            input_done (comp, in_buffer);
+
+            if (corrupt)
+                send_event (comp, OMX_EventError, OMX_ErrorStreamCorrupt, 0);
+            if (hardware_error)
+                send_event (comp, OMX_EventError, OMX_ErrorHardware, 0);
+            if (settings_change)
+                send_event (comp, OMX_EventPortSettingsChanged, 1, 0);
+
+            g_mutex_lock (private->mutex);
+            continue;
+        }
+
+        g_cond_wait (private->condition, private->mutex);
+    }
+
+    g_mutex_unlock (private->mutex);
+
+    return NULL;
+}
+
+static void
+sim_stop (CompPrivate *private)
+{
+    if (!private->thread)
+        return;
+
+    g_mutex_lock (private->mutex);
+    private->done = TRUE;
+    g_cond_signal (private->condition);
+    g_mutex_unlock (private->mutex);
+
+    g_thread_join (private->thread);
+    private->thread = NULL;
+}
+
+static OMX_ERRORTYPE
+comp_GetState (OMX_HANDLETYPE handle,
+               OMX_STATETYPE *state)
+{
+    OMX_COMPONENTTYPE *comp;
+    CompPrivate *private;
+
+    comp = handle;
+    private = comp->pComponentPrivate;
+
+    *state = private->state;
+
+    return OMX_ErrorNone;
+}
+
+static OMX_ERRORTYPE
+comp_GetParameter (OMX_HANDLETYPE handle,
+                   OMX_INDEXTYPE index,
+                   OMX_PTR param)
+{
+    OMX_COMPONENTTYPE *comp;
+    CompPrivate *private;
+
+    comp = handle;
+    private = comp->pComponentPrivate;
+
+    switch (index)
+    {
+        case OMX_IndexParamPortDefinition:
+            {
+                OMX_PARAM_PORTDEFINITIONTYPE *port_def;
+                port_def = param;
+                if (port_def->nPortIndex > 1)
+                    return OMX_ErrorBadPortIndex;
+                g_mutex_lock (private->mutex);
+                memcpy (port_def, &private->ports[port_def->nPortIndex].port_def, port_def->nSize);
+                g_mutex_unlock (private->mutex);
+                break;
+            }
+        case OMX_IndexParamAudioInit:
+        case OMX_IndexParamVideoInit:
+        case OMX_IndexParamImageInit:
+        case OMX_IndexParamOtherInit:
+            {
+                OMX_PORT_PARAM_TYPE *port_param;
+                OMX_PORTDOMAINTYPE domain;
+                guint i;
+
+                switch (index)
+                {
+                    case OMX_IndexParamAudioInit: domain = OMX_PortDomainAudio; break;
+                    case OMX_IndexParamVideoInit: domain = OMX_PortDomainVideo; break;
+                    case OMX_IndexParamImageInit: domain = OMX_PortDomainImage; break;
+                    default: domain = OMX_PortDomainOther; break;
+                }
+                port_param = param;
+                port_param->nPorts = 0;
+                port_param->nStartPortNumber = 0;
+                g_mutex_lock (private->mutex);
+                for (i = 0; i < 2; i++)
+                {
+                    if (private->ports[i].port_def.eDomain != domain)
+                        continue;
+                    if (!port_param->nPorts)
+                        port_param->nStartPortNumber = i;
+                    port_param->nPorts++;
+                }
+                g_mutex_unlock (private->mutex);
+                break;
+            }
+        default:
+            break;
+    }
+
+    return OMX_ErrorNone;
+}
+
+static OMX_ERRORTYPE
+comp_SetParameter (OMX_HANDLETYPE handle,
+                   OMX_INDEXTYPE index,
+                   OMX_PTR param)
+{
+    OMX_COMPONENTTYPE *comp;
+    CompPrivate *private;
+
+    comp = handle;
+    private = comp->pComponentPrivate;
+
+    switch (index)
+    {
+        case OMX_IndexParamPortDefinition:
+            {
+                OMX_PARAM_PORTDEFINITIONTYPE *port_def;
+                port_def = param;
+                if (port_def->nPortIndex > 1)
+                    return OMX_ErrorBadPortIndex;
+                g_mutex_lock (private->mutex);
+                memcpy (&private->ports[port_def->nPortIndex].port_def, port_def, port_def->nSize);
+                g_mutex_unlock (private->mutex);
+                break;
+            }
+        default:
+            break;
+    }
+
+    return OMX_ErrorNone;
+}
+
+static OMX_BUFFERHEADERTYPE *
+header_new (OMX_U32 index,
+            OMX_PTR data,
+            OMX_U32 size,
+            OMX_U8 *buffer)
+{
+    OMX_BUFFERHEADERTYPE *new;
+
+    new = calloc (1, sizeof (OMX_BUFFERHEADERTYPE));
+    new->nSize = sizeof (OMX_BUFFERHEADERTYPE);
+    new->nVersion.nVersion = 1;
+    new->pBuffer = buffer;
+    new->nAllocLen = size;
+    new->pAppPrivate = data;
+
+    switch (index)
+    {
+        case 0: new->nInputPortIndex = 0; break;
+        case 1: new->nOutputPortIndex = 1; break;
+        default: break;
+    }
+
+    return new;
+}
+
+static void
+flush_ports (OMX_COMPONENTTYPE *comp,
+             OMX_U32 port_index,
+             OMX_COMMANDTYPE command)
+{
+    CompPrivate *private;
+    GList *in_list = NULL;
+    GList *out_list = NULL;
+
+    private = comp->pComponentPrivate;
+
+    g_mutex_lock (private->mutex);
+    if (port_index == 0 || port_index == OMX_ALL)
+        in_list = port_take_buffers (private, 0, command == OMX_CommandFlush);
+    if (port_index == 1 || port_index == OMX_ALL)
+        out_list = port_take_buffers (private, 1, command == OMX_CommandFlush);
+    g_mutex_unlock (private->mutex);
+
+    return_buffers (comp, in_list, 0);
+    return_buffers (comp, out_list, 1);
+
+    if (port_index == OMX_ALL)
+    {
+        /* one event per port */
+        send_event (comp, OMX_EventCmdComplete, command, 0);
+        send_event (comp, OMX_EventCmdComplete, command, 1);
+    }
+    else
+    {
+        send_event (comp, OMX_EventCmdComplete, command, port_index);
+    }
+}
+
+static void
+tunnel_allocate (CompPrivate *private)
+{
+    OMX_PARAM_PORTDEFINITIONTYPE *port_def;
+    guint i;
+
+    port_def = &private->ports[1].port_def;
+
+    g_mutex_lock (private->mutex);
+    for (i = 0; i < port_def->nBufferCountActual; i++)
+    {
+        OMX_BUFFERHEADERTYPE *buffer;
+
+        buffer = header_new (1, NULL, port_def->nBufferSize,
+                             g_malloc (port_def->nBufferSize));
+        buffer->nInputPortIndex = 0;
+        private->tunnel_buffers = g_list_append (private->tunnel_buffers, buffer);
+        g_queue_push_tail (private->ports[1].queue, buffer);
+    }
+    g_cond_signal (private->condition);
+    g_mutex_unlock (private->mutex);
+}
+
+static void
+tunnel_free (CompPrivate *private)
+{
+    GList *l;
+
+    g_mutex_lock (private->mutex);
+    g_queue_clear (private->ports[1].queue);
+    frames_clear (private->ready);
+    for (l = private->tunnel_buffers; l; l = l->next)
+    {
+        OMX_BUFFERHEADERTYPE *buffer = l->data;
+
+        g_free (buffer->pBuffer);
+        free (buffer);
+    }
+    g_list_free (private->tunnel_buffers);
+    private->tunnel_buffers = NULL;
+    g_mutex_unlock (private->mutex);
+}
+
+static OMX_ERRORTYPE
+comp_SendCommand (OMX_HANDLETYPE handle,
+                  OMX_COMMANDTYPE command,
+                  OMX_U32 param_1,
+                  OMX_PTR data)
+{
+    OMX_COMPONENTTYPE *comp;
+    CompPrivate *private;
+    GList *in_list = NULL;
+    GList *out_list = NULL;
+
+    comp = handle;
+    private = comp->pComponentPrivate;
+
+    switch (command)
+    {
+        case OMX_CommandStateSet:
+            {
+                if (private->state == OMX_StateLoaded && param_1 == OMX_StateIdle)
+                {
+                    private->done = FALSE;
+                    private->thread = g_thread_create (sim_thread, comp, TRUE, NULL);
+                }
+                else if (param_1 == OMX_StateLoaded)
+                {
+                    sim_stop (private);
+                }
+
+                g_mutex_lock (private->mutex);
+                /* leaving Executing/Pause hands back every header */
+                if (param_1 == OMX_StateIdle && private->state != OMX_StateLoaded)
+                {
+                    in_list = port_take_buffers (private, 0, TRUE);
+                    out_list = port_take_buffers (private, 1, TRUE);
+                }
+                private->state = param_1;
+                g_cond_signal (private->condition);
+                g_mutex_unlock (private->mutex);
+
+                return_buffers (comp, in_list, 0);
+                return_buffers (comp, out_list, 1);
+
+                send_event (comp, OMX_EventCmdComplete, OMX_CommandStateSet, param_1);
+            }
+            break;
+        case OMX_CommandFlush:
+        case OMX_CommandPortDisable:
+            flush_ports (comp, param_1, command);
+            break;
+        case OMX_CommandPortEnable:
+            if ((param_1 == 1 || param_1 == OMX_ALL) && private->tunnel_peer)
+                tunnel_allocate (private);
+
+            if (param_1 == OMX_ALL)
+            {
+                send_event (comp, OMX_EventCmdComplete, command, 0);
+                send_event (comp, OMX_EventCmdComplete, command, 1);
+            }
+            else
+            {
+                send_event (comp, OMX_EventCmdComplete, command, param_1);
+            }
+            break;
+        default:
+            break;
+    }
+
+    return OMX_ErrorNone;
+}
+
+static OMX_ERRORTYPE
+comp_UseBuffer (OMX_HANDLETYPE handle,
+                OMX_BUFFERHEADERTYPE **buffer_header,
+                OMX_U32 index,
+                OMX_PTR data,
+                OMX_U32 size,
+                OMX_U8 *buffer)
+{
+    OMX_COMPONENTTYPE *comp;
+    CompPrivate *private;
+    OMX_U32 alignment;
+
+    comp = handle;
+    private = comp->pComponentPrivate;
+
+    if (index > 1)
+        return OMX_ErrorBadPortIndex;
+
+    /* like DMA engines, refuse what we can't use */
+    alignment = private->ports[index].port_def.nBufferAlignment;
+    if (alignment > 1 && ((gsize) buffer % alignment) != 0)
+        return OMX_ErrorBadParameter;
+
+    *buffer_header = header_new (index, data, size, buffer);
+
+    return OMX_ErrorNone;
+}
+
+static OMX_ERRORTYPE
+comp_AllocateBuffer (OMX_HANDLETYPE handle,
+                     OMX_BUFFERHEADERTYPE **buffer_header,
+                     OMX_U32 index,
+                     OMX_PTR data,
+                     OMX_U32 size)
+{
+    OMX_COMPONENTTYPE *comp;
+    CompPrivate *private;
+    OMX_U32 alignment;
+    void *buffer;
+
+    comp = handle;
+    private = comp->pComponentPrivate;
+
+    if (index > 1)
+        return OMX_ErrorBadPortIndex;
+
+    alignment = MAX (private->ports[index].port_def.nBufferAlignment, sizeof (void *));
+    if (posix_memalign (&buffer, alignment, size) != 0)
+        return OMX_ErrorInsufficientResources;
+
+    *buffer_header = header_new (index, data, size, buffer);
+    (*buffer_header)->pPlatformPrivate = buffer;
+
+    return OMX_ErrorNone;
+}
+
+static OMX_ERRORTYPE
+comp_FreeBuffer (OMX_HANDLETYPE handle,
+                 OMX_U32 index,
+                 OMX_BUFFERHEADERTYPE *buffer_header)
+{
+    /* only set when we allocated the data */
+    free (buffer_header->pPlatformPrivate);
+    free (buffer_header);
+
+    return OMX_ErrorNone;
+}
+
+static OMX_ERRORTYPE
+comp_EmptyThisBuffer (OMX_HANDLETYPE handle,
+                      OMX_BUFFERHEADERTYPE *buffer_header)
+{
+    OMX_COMPONENTTYPE *comp;
+    CompPrivate *private;
+
+    comp = handle;
+    private = comp->pComponentPrivate;
+
+    g_mutex_lock (private->mutex);
+    g_queue_push_tail (private->ports[0].queue, buffer_header);
+    g_cond_signal (private->condition);
+    g_mutex_unlock (private->mutex);
+
+    return OMX_ErrorNone;
+}
+
+static OMX_ERRORTYPE
+comp_FillThisBuffer (OMX_HANDLETYPE handle,
+                     OMX_BUFFERHEADERTYPE *buffer_header)
+{
+    OMX_COMPONENTTYPE *comp;
+    CompPrivate *private;
+
+    comp = handle;
+    private = comp->pComponentPrivate;
+
+    g_mutex_lock (private->mutex);
+    g_queue_push_tail (private->ports[1].queue, buffer_header);
+    g_cond_signal (private->condition);
+    g_mutex_unlock (private->mutex);
+
+    return OMX_ErrorNone;
+}
+
+OMX_ERRORTYPE
+OMX_GetHandle (OMX_HANDLETYPE *handle,
+               OMX_STRING component_name,
+               OMX_PTR data,
+               OMX_CALLBACKTYPE *callbacks)
+{
+    static gint handle_failures;
+    OMX_COMPONENTTYPE *comp;
+    CompPrivate *private;
+    SimConfig config = { 0 };
+
+    config_load (&config, component_name);
+
+    if (config.handle_errors > 0 &&
+        g_atomic_int_exchange_and_add (&handle_failures, 1) < config.handle_errors)
+        return OMX_ErrorInsufficientResources;
+
+    comp = calloc (1, sizeof (OMX_COMPONENTTYPE));
+    comp->nSize = sizeof (OMX_COMPONENTTYPE);
+    comp->nVersion.nVersion = 1;
+
+    comp->GetState = comp_GetState;
+    comp->GetParameter = comp_GetParameter;
+    comp->SetParameter = comp_SetParameter;
+    comp->SendCommand = comp_SendCommand;
+    comp->UseBuffer = comp_UseBuffer;
+    comp->AllocateBuffer = comp_AllocateBuffer;
+    comp->FreeBuffer = comp_FreeBuffer;
+    comp->EmptyThisBuffer = comp_EmptyThisBuffer;
+    comp->FillThisBuffer = comp_FillThisBuffer;
+
+    private = calloc (1, sizeof (CompPrivate));
+    private->state = OMX_StateLoaded;
+    private->callbacks = callbacks;
+    private->app_data = data;
+    private->mutex = g_mutex_new ();
+    private->condition = g_cond_new ();
+    private->pending = g_queue_new ();
+    private->ready = g_queue_new ();
+
+    private->config = config;
+    private->rand = g_rand_new_with_seed (private->config.seed);
+
+    private->ports = calloc (2, sizeof (CompPrivatePort));
+    port_init (&private->ports[0], &private->config, 0);
+    port_init (&private->ports[1], &private->config, 1);
+
+    comp->pComponentPrivate = private;
+
+    *handle = comp;
+
+    return OMX_ErrorNone;
+}
+
+/*
+ * Only simulated components can be tunneled, and the supplier doesn't go
+ * through UseBuffer on the peer; it doesn't track headers anyway.
+ */
+OMX_ERRORTYPE
+OMX_SetupTunnel (OMX_HANDLETYPE output,
+                 OMX_U32 output_index,
+                 OMX_HANDLETYPE input,
+                 OMX_U32 input_index)
+{
+    OMX_COMPONENTTYPE *out_comp = output;
+    OMX_COMPONENTTYPE *in_comp = input;
+
+    if ((out_comp && output_index != 1) || (in_comp && input_index != 0))
+        return OMX_ErrorBadPortIndex;
+
+    if (out_comp && in_comp)
+    {
+        CompPrivate *out_private = out_comp->pComponentPrivate;
+        CompPrivate *in_private = in_comp->pComponentPrivate;
+
+        out_private->tunnel_peer = in_comp;
+        in_private->tunnel_source = out_comp;
+    }
+    else if (out_comp)
+    {
+        CompPrivate *private = out_comp->pComponentPrivate;
+
+        tunnel_free (private);
+        private->tunnel_peer = NULL;
+    }
+    else if (in_comp)
+    {
+        CompPrivate *private = in_comp->pComponentPrivate;
+
+        /* the supplier freed whatever was left here */
+        g_mutex_lock (private->mutex);
+        g_queue_clear (private->ports[0].queue);
+        frames_clear (private->pending);
+        g_mutex_unlock (private->mutex);
+        private->tunnel_source = NULL;
+    }
+
+    return OMX_ErrorNone;
+}
+
+OMX_ERRORTYPE
+OMX_FreeHandle (OMX_HANDLETYPE handle)
+{
+    OMX_COMPONENTTYPE *comp;
+    CompPrivate *private;
+    guint i;
+
+    comp = handle;
+    private = comp->pComponentPrivate;
+
+    sim_stop (private);
+    tunnel_free (private);
+
+    for (i = 0; i < 2; i++)
+        g_queue_free (private->ports[i].queue);
+    free (private->ports);
+
+    frames_clear (private->pending);
+    frames_clear (private->ready);
+    g_queue_free (private->pending);
+    g_queue_free (private->ready);
+
+    g_rand_free (private->rand);
+    g_cond_free (private->condition);
+    g_mutex_free (private->mutex);
+    free (private);
+    free (comp);
+
+    return OMX_ErrorNone;
+}
@@ -0,0 +1,637 @@
+/*
+ * Copyright (C) 2007-2009 Nokia Corporation.
+ *
+ * Author: Felipe Contreras <felipe.contreras@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/*
+ * gst-omx-replay: play a buffer capture (see omx/gstomx_capture.h) back
+ * against an OpenMAX IL library.
+ *
+ * Headers are submitted on the captured timeline; whenever the component
+ * holds on to them longer than it did in the field, the replay stalls and
+ * says so. Without payload the data is left zeroed, which is enough for
+ * the simulator (tests/standalone/libomxil-sim.so).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dlfcn.h>
+
+#include <glib.h>
+
+#include <OMX_Core.h>
+#include <OMX_Component.h>
+
+#include "gstomx_capture.h"
+
+#define MAX_PORTS 2
+
+typedef struct
+{
+    GOmxCaptureRecord record;
+    guint8 *payload;
+} Record;
+
+typedef struct
+{
+    guint num_buffers;
+    gulong buffer_size;
+    OMX_BUFFERHEADERTYPE **buffers;
+    gint64 *submit_time;
+    GAsyncQueue *free; /**< Headers we may submit. */
+} Port;
+
+typedef struct
+{
+    guint64 count;
+    gint64 sum;
+    gint64 max;
+} Stat;
+
+typedef struct
+{
+    OMX_ERRORTYPE (*init) (void);
+    OMX_ERRORTYPE (*deinit) (void);
+    OMX_ERRORTYPE (*get_handle) (OMX_HANDLETYPE *handle, OMX_STRING name,
+                                 OMX_PTR data, OMX_CALLBACKTYPE *callbacks);
+    OMX_ERRORTYPE (*free_handle) (OMX_HANDLETYPE handle);
+} SymbolTable;
+
+static gchar *library_name = "libomxil-sim.so";
+static gchar *component_name;
+static gdouble speed = 1.0;
+static gint stall_ms = 5;
+
+static GOptionEntry entries[] = {
+    { "library", 'l', 0, G_OPTION_ARG_STRING, &library_name,
+      "OpenMAX IL library", "LIB" },
+    { "component", 'c', 0, G_OPTION_ARG_STRING, &component_name,
+      "Component to use instead of the captured one", "NAME" },
+    { "speed", 's', 0, G_OPTION_ARG_DOUBLE, &speed,
+      "Playback speed, 0 for as fast as possible", "FACTOR" },
+    { "stall", 't', 0, G_OPTION_ARG_INT, &stall_ms,
+      "Report waits for a header longer than this", "MS" },
+    { NULL }
+};
+
+static Port ports[MAX_PORTS];
+static GMutex *state_mutex;
+static GCond *state_cond;
+static OMX_STATETYPE state = OMX_StateLoaded;
+static gboolean eos;
+static Stat replay_stats[MAX_PORTS];
+static gint64 start_time;
+
+static gint64
+now (void)
+{
+    GTimeVal tv;
+
+    g_get_current_time (&tv);
+
+    return (gint64) tv.tv_sec * G_USEC_PER_SEC + tv.tv_usec;
+}
+
+static void
+stat_add (Stat *stat,
+          gint64 value)
+{
+    stat->count++;
+    stat->sum += value;
+    if (value > stat->max)
+        stat->max = value;
+}
+
+static void
+stat_print (const gchar *name,
+            Stat *stat)
+{
+    if (!stat->count)
+        return;
+
+    printf ("  %-28s %8" G_GUINT64_FORMAT " buffers, mean %8.2f ms, max %8.2f ms\n",
+            name, stat->count, stat->sum / 1000.0 / stat->count, stat->max / 1000.0);
+}
+
+/* Load the capture; returns the records in file order. */
+
+static GArray *
+capture_load (const gchar *filename,
+              GOmxCaptureHeader *header)
+{
+    GArray *records;
+    FILE *file;
+
+    file = fopen (filename, "rb");
+    if (!file)
+    {
+        g_printerr ("could not open %s\n", filename);
+        return NULL;
+    }
+
+    if (fread (header, sizeof (*header), 1, file) != 1 ||
+        memcmp (header->magic, GOMX_CAPTURE_MAGIC, sizeof (GOMX_CAPTURE_MAGIC)) != 0 ||
+        header->version != GOMX_CAPTURE_VERSION)
+    {
+        g_printerr ("%s is not a capture this tool understands\n", filename);
+        fclose (file);
+        return NULL;
+    }
+
+    records = g_array_new (FALSE, TRUE, sizeof (Record));
+
+    while (TRUE)
+    {
+        Record record;
+
+        memset (&record, 0, sizeof (record));
+        if (fread (&record.record, sizeof (record.record), 1, file) != 1)
+            break;
+
+        if (record.record.payload_len)
+        {
+            record.payload = g_malloc (record.record.payload_len);
+            if (fread (record.payload, record.record.payload_len, 1, file) != 1)
+            {
+                g_free (record.payload);
+                break;
+            }
+        }
+
+        g_array_append_val (records, record);
+    }
+
+    fclose (file);
+
+    return records;
+}
+
+/* What the component did in the field. */
+
+static void
+capture_stats (GArray *records,
+               Stat *stats)
+{
+    gint64 *submitted[MAX_PORTS];
+    guint num_buffers[MAX_PORTS];
+    guint i;
+
+    for (i = 0; i < MAX_PORTS; i++)
+    {
+        num_buffers[i] = 0;
+        submitted[i] = NULL;
+    }
+
+    for (i = 0; i < records->len; i++)
+    {
+        GOmxCaptureRecord *record = &g_array_index (records, Record, i).record;
+        guint port = record->port_index;
+
+        if (port >= MAX_PORTS)
+            continue;
+
+        switch (record->type)
+        {
+            case GOMX_CAPTURE_PORT:
+                g_free (submitted[port]);
+                num_buffers[port] = record->filled_len;
+                submitted[port] = g_new0 (gint64, num_buffers[port]);
+                break;
+            case GOMX_CAPTURE_EMPTY_THIS_BUFFER:
+            case GOMX_CAPTURE_FILL_THIS_BUFFER:
+                if (record->buffer_index < num_buffers[port])
+                    submitted[port][record->buffer_index] = record->time;
+                break;
+            case GOMX_CAPTURE_EMPTY_BUFFER_DONE:
+            case GOMX_CAPTURE_FILL_BUFFER_DONE:
+                if (record->buffer_index < num_buffers[port] &&
+                    submitted[port][record->buffer_index])
+                {
+                    stat_add (&stats[port], record->time - submitted[port][record->buffer_index]);
+                    submitted[port][record->buffer_index] = 0;
+                }
+                break;
+            default:
+                break;
+        }
+    }
+
+    for (i = 0; i < MAX_PORTS; i++)
+        g_free (submitted[i]);
+}
+
+/* Callbacks. */
+
+static OMX_ERRORTYPE
+EventHandler (OMX_HANDLETYPE omx_handle,
+              OMX_PTR app_data,
+              OMX_EVENTTYPE event,
+              OMX_U32 data_1,
+              OMX_U32 data_2,
+              OMX_PTR event_data)
+{
+    switch (event)
+    {
+        case OMX_EventCmdComplete:
+            if (data_1 == OMX_CommandStateSet)
+            {
+                g_mutex_lock (state_mutex);
+                state = data_2;
+                g_cond_signal (state_cond);
+                g_mutex_unlock (state_mutex);
+            }
+            break;
+        case OMX_EventError:
+            printf ("%10.3f ms: error 0x%x\n", (now () - start_time) / 1000.0, (guint) data_1);
+            break;
+        case OMX_EventPortSettingsChanged:
+            printf ("%10.3f ms: port %u settings changed\n", (now () - start_time) / 1000.0, (guint) data_1);
+            break;
+        default:
+            break;
+    }
+
+    return OMX_ErrorNone;
+}
+
+static void
+buffer_done (guint port_index,
+             OMX_BUFFERHEADERTYPE *omx_buffer)
+{
+    Port *port = &ports[port_index];
+    guint i;
+
+    for (i = 0; i < port->num_buffers; i++)
+    {
+        if (port->buffers[i] == omx_buffer && port->submit_time[i])
+        {
+            stat_add (&replay_stats[port_index], now () - port->submit_time[i]);
+            port->submit_time[i] = 0;
+            break;
+        }
+    }
+
+    if (omx_buffer->nFlags & OMX_BUFFERFLAG_EOS)
+    {
+        g_mutex_lock (state_mutex);
+        eos = TRUE;
+        g_cond_signal (state_cond);
+        g_mutex_unlock (state_mutex);
+    }
+
+    g_async_queue_push (port->free, omx_buffer);
+}
+
+static OMX_ERRORTYPE
+EmptyBufferDone (OMX_HANDLETYPE omx_handle,
+                 OMX_PTR app_data,
+                 OMX_BUFFERHEADERTYPE *omx_buffer)
+{
+    if (omx_buffer->nInputPortIndex < MAX_PORTS)
+        buffer_done (omx_buffer->nInputPortIndex, omx_buffer);
+
+    return OMX_ErrorNone;
+}
+
+static OMX_ERRORTYPE
+FillBufferDone (OMX_HANDLETYPE omx_handle,
+                OMX_PTR app_data,
+                OMX_BUFFERHEADERTYPE *omx_buffer)
+{
+    if (omx_buffer->nOutputPortIndex < MAX_PORTS)
+        buffer_done (omx_buffer->nOutputPortIndex, omx_buffer);
+
+    return OMX_ErrorNone;
+}
+
+static OMX_CALLBACKTYPE callbacks = { EventHandler, EmptyBufferDone, FillBufferDone };
+
+/* Component handling. */
+
+static void
+change_state (OMX_HANDLETYPE handle,
+              OMX_STATETYPE new_state)
+{
+    OMX_SendCommand (handle, OMX_CommandStateSet, new_state, NULL);
+}
+
+static void
+wait_for_state (OMX_STATETYPE new_state)
+{
+    g_mutex_lock (state_mutex);
+    while (state != new_state)
+        g_cond_wait (state_cond, state_mutex);
+    g_mutex_unlock (state_mutex);
+}
+
+static void
+ports_setup (OMX_HANDLETYPE handle)
+{
+    guint i;
+
+    for (i = 0; i < MAX_PORTS; i++)
+    {
+        Port *port = &ports[i];
+        OMX_PARAM_PORTDEFINITIONTYPE param;
+        guint j;
+
+        if (!port->num_buffers)
+            continue;
+
+        memset (&param, 0, sizeof (param));
+        param.nSize = sizeof (param);
+        param.nVersion.s.nVersionMajor = 1;
+        param.nVersion.s.nVersionMinor = 1;
+        param.nPortIndex = i;
+        OMX_GetParameter (handle, OMX_IndexParamPortDefinition, &param);
+
+        param.nBufferCountActual = port->num_buffers;
+        param.nBufferSize = MAX (param.nBufferSize, port->buffer_size);
+        OMX_SetParameter (handle, OMX_IndexParamPortDefinition, &param);
+
+        port->buffer_size = param.nBufferSize;
+        port->buffers = g_new0 (OMX_BUFFERHEADERTYPE *, port->num_buffers);
+        port->submit_time = g_new0 (gint64, port->num_buffers);
+        port->free = g_async_queue_new ();
+
+        for (j = 0; j < port->num_buffers; j++)
+        {
+            void *data;
+            gsize align;
+
+            align = MAX (param.nBufferAlignment, sizeof (void *));
+            if (posix_memalign (&data, align, port->buffer_size) != 0)
+                g_error ("out of memory");
+            memset (data, 0, port->buffer_size);
+
+            OMX_UseBuffer (handle, &port->buffers[j], i, NULL, port->buffer_size, data);
+
+            /* all headers start on our side; the capture has the initial FillThisBuffer calls */
+            g_async_queue_push (port->free, port->buffers[j]);
+        }
+    }
+}
+
+static void
+ports_free (OMX_HANDLETYPE handle)
+{
+    guint i;
+
+    for (i = 0; i < MAX_PORTS; i++)
+    {
+        Port *port = &ports[i];
+        guint j;
+
+        if (!port->buffers)
+            continue;
+
+        for (j = 0; j < port->num_buffers; j++)
+        {
+            gpointer data;
+
+            data = port->buffers[j]->pBuffer;
+            OMX_FreeBuffer (handle, i, port->buffers[j]);
+            free (data);
+        }
+
+        g_free (port->buffers);
+        g_free (port->submit_time);
+        g_async_queue_unref (port->free);
+    }
+}
+
+static void
+replay (OMX_HANDLETYPE handle,
+        GArray *records,
+        guint *stalls,
+        gint64 *stall_time)
+{
+    guint i;
+
+    start_time = now ();
+
+    for (i = 0; i < records->len; i++)
+    {
+        Record *record = &g_array_index (records, Record, i);
+        GOmxCaptureRecord *r = &record->record;
+        OMX_BUFFERHEADERTYPE *omx_buffer;
+        Port *port;
+        gint64 wait;
+        guint j;
+
+        if (r->type != GOMX_CAPTURE_EMPTY_THIS_BUFFER &&
+            r->type != GOMX_CAPTURE_FILL_THIS_BUFFER)
+            continue;
+
+        if (r->port_index >= MAX_PORTS || !ports[r->port_index].buffers)
+            continue;
+
+        port = &ports[r->port_index];
+
+        if (speed > 0)
+        {
+            gint64 target;
+
+            target = start_time + r->time / speed;
+            if (target > now ())
+                g_usleep (target - now ());
+        }
+
+        /* the component is slower than it was in the field */
+        wait = now ();
+        omx_buffer = g_async_queue_pop (port->free);
+        wait = now () - wait;
+
+        if (wait > stall_ms * 1000)
+        {
+            (*stalls)++;
+            *stall_time += wait;
+            printf ("%10.3f ms: stalled %.3f ms for a port %u header\n",
+                    (now () - start_time) / 1000.0, wait / 1000.0, r->port_index);
+        }
+
+        for (j = 0; j < port->num_buffers; j++)
+        {
+            if (port->buffers[j] == omx_buffer)
+                port->submit_time[j] = now ();
+        }
+
+        omx_buffer->nOffset = 0;
+        omx_buffer->nFlags = r->flags;
+        omx_buffer->nTimeStamp = r->timestamp;
+
+        if (r->type == GOMX_CAPTURE_EMPTY_THIS_BUFFER)
+        {
+            omx_buffer->nFilledLen = MIN (r->filled_len, omx_buffer->nAllocLen);
+            if (record->payload)
+                memcpy (omx_buffer->pBuffer, record->payload,
+                        MIN (r->payload_len, omx_buffer->nAllocLen));
+            OMX_EmptyThisBuffer (handle, omx_buffer);
+        }
+        else
+        {
+            omx_buffer->nFilledLen = 0;
+            OMX_FillThisBuffer (handle, omx_buffer);
+        }
+    }
+}
+
+int
+main (int argc, char **argv)
+{
+    GOptionContext *context;
+    GError *error = NULL;
+    GOmxCaptureHeader header;
+    GArray *records;
+    SymbolTable sym;
+    OMX_HANDLETYPE handle;
+    Stat capture_stat[MAX_PORTS];
+    guint stalls = 0;
+    gint64 stall_time = 0;
+    void *dl_handle;
+    guint i;
+
+    g_thread_init (NULL);
+
+    context = g_option_context_new ("FILE - replay captured OpenMAX buffer traffic");
+    g_option_context_add_main_entries (context, entries, NULL);
+    if (!g_option_context_parse (context, &argc, &argv, &error))
+    {
+        g_printerr ("%s\n", error->message);
+        g_error_free (error);
+        return 1;
+    }
+    g_option_context_free (context);
+
+    if (argc != 2)
+    {
+        g_printerr ("usage: %s [OPTION...] FILE\n", argv[0]);
+        return 1;
+    }
+
+    records = capture_load (argv[1], &header);
+    if (!records)
+        return 1;
+
+    if (!component_name)
+        component_name = header.component;
+
+    for (i = 0; i < records->len; i++)
+    {
+        GOmxCaptureRecord *r = &g_array_index (records, Record, i).record;
+
+        if (r->type == GOMX_CAPTURE_PORT && r->port_index < MAX_PORTS)
+        {
+            ports[r->port_index].num_buffers = r->filled_len;
+            ports[r->port_index].buffer_size = r->flags;
+        }
+    }
+
+    memset (capture_stat, 0, sizeof (capture_stat));
+    capture_stats (records, capture_stat);
+
+    dl_handle = dlopen (library_name, RTLD_LAZY);
+    if (!dl_handle)
+    {
+        g_printerr ("%s\n", dlerror ());
+        return 1;
+    }
+
+    sym.init = dlsym (dl_handle, "OMX_Init");
+    sym.deinit = dlsym (dl_handle, "OMX_Deinit");
+    sym.get_handle = dlsym (dl_handle, "OMX_GetHandle");
+    sym.free_handle = dlsym (dl_handle, "OMX_FreeHandle");
+
+    if (!sym.init || !sym.deinit || !sym.get_handle || !sym.free_handle)
+    {
+        g_printerr ("%s is not an OpenMAX IL library\n", library_name);
+        return 1;
+    }
+
+    state_mutex = g_mutex_new ();
+    state_cond = g_cond_new ();
+
+    sym.init ();
+
+    if (sym.get_handle (&handle, component_name, NULL, &callbacks) != OMX_ErrorNone)
+    {
+        g_printerr ("could not get %s from %s\n", component_name, library_name);
+        return 1;
+    }
+
+    printf ("replaying %u records on %s (%s)\n", records->len, component_name, library_name);
+
+    change_state (handle, OMX_StateIdle);
+    ports_setup (handle);
+    wait_for_state (OMX_StateIdle);
+
+    change_state (handle, OMX_StateExecuting);
+    wait_for_state (OMX_StateExecuting);
+
+    replay (handle, records, &stalls, &stall_time);
+
+    /* give the last buffers a chance to come out */
+    {
+        GTimeVal deadline;
+
+        g_get_current_time (&deadline);
+        g_time_val_add (&deadline, G_USEC_PER_SEC);
+
+        g_mutex_lock (state_mutex);
+        while (!eos)
+        {
+            if (!g_cond_timed_wait (state_cond, state_mutex, &deadline))
+                break;
+        }
+        g_mutex_unlock (state_mutex);
+    }
+
+    change_state (handle, OMX_StateIdle);
+    wait_for_state (OMX_StateIdle);
+
+    change_state (handle, OMX_StateLoaded);
+    ports_free (handle);
+    wait_for_state (OMX_StateLoaded);
+
+    sym.free_handle (handle);
+    sym.deinit ();
+
+    printf ("\nheader hold time in the component\n");
+    for (i = 0; i < MAX_PORTS; i++)
+    {
+        gchar *name;
+
+        name = g_strdup_printf ("port %u, captured", i);
+        stat_print (name, &capture_stat[i]);
+        g_free (name);
+
+        name = g_strdup_printf ("port %u, replayed", i);
+        stat_print (name, &replay_stats[i]);
+        g_free (name);
+    }
+
+    printf ("\n%u stalls, %.3f ms in total\n", stalls, stall_time / 1000.0);
+
+    for (i = 0; i < records->len; i++)
+        g_free (g_array_index (records, Record, i).payload);
+    g_array_free (records, TRUE);
+
+    return stalls ? 2 : 0;
+}
@@ -0,0 +1,307 @@
+/*
+ * Copyright (C) 2007-2009 Nokia Corporation.
+ *
+ * Author: Felipe Contreras <felipe.contreras@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/*
+ * gst-omx-top: live view of every OpenMAX component in use on the system.
+ *
+ * Reads the segments exported by the plugin (see omx/gstomx_metrics.h),
+ * without attaching to or slowing down the processes.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include <glib.h>
+
+#include "gstomx_metrics.h"
+
+#define SHM_DIR "/dev/shm"
+
+typedef struct
+{
+    gchar *name;
+    GOmxMetricsSegment *segment;
+    gsize size;
+    GOmxMetricsSlot *prev; /**< segment->n_slots of them. */
+    gboolean seen;
+} Process;
+
+static const gchar *state_names[] = {
+    "Invalid", "Loaded", "Idle", "Executing", "Pause", "WaitForResources"
+};
+
+static GHashTable *processes;
+static gdouble interval = 1.0;
+static gboolean once;
+
+static GOptionEntry entries[] = {
+    { "delay", 'd', 0, G_OPTION_ARG_DOUBLE, &interval,
+      "Seconds between updates", "SECS" },
+    { "once", '1', 0, G_OPTION_ARG_NONE, &once,
+      "Print one update and exit", NULL },
+    { NULL }
+};
+
+static const gchar *
+state_name (gint state)
+{
+    if (state >= 0 && state < (gint) G_N_ELEMENTS (state_names))
+        return state_names[state];
+    return "?";
+}
+
+static void
+process_free (gpointer data)
+{
+    Process *process = data;
+
+    if (process->segment)
+        munmap (process->segment, process->size);
+    g_free (process->prev);
+    g_free (process->name);
+    g_free (process);
+}
+
+/* The header says how many slots follow; size is set to what got mapped. */
+static GOmxMetricsSegment *
+segment_map (const gchar *name,
+             gsize *size)
+{
+    GOmxMetricsSegment *segment;
+    GOmxMetricsSegment header;
+    gchar *path;
+    int fd;
+
+    path = g_strdup_printf ("/%s", name);
+    fd = shm_open (path, O_RDONLY, 0);
+    g_free (path);
+
+    if (fd < 0)
+        return NULL;
+
+    if (read (fd, &header, sizeof (header)) != sizeof (header) ||
+        header.magic != GOMX_METRICS_MAGIC ||
+        header.version != GOMX_METRICS_VERSION ||
+        header.n_slots == 0 || header.n_slots > GOMX_METRICS_MAX_SLOTS)
+    {
+        close (fd);
+        return NULL;
+    }
+
+    *size = GOMX_METRICS_SEGMENT_SIZE (header.n_slots);
+    segment = mmap (NULL, *size, PROT_READ, MAP_SHARED, fd, 0);
+    close (fd);
+
+    if (segment == MAP_FAILED)
+        return NULL;
+
+    return segment;
+}
+
+static gboolean
+process_alive (GOmxMetricsSegment *segment)
+{
+    return kill (segment->pid, 0) == 0 || errno == EPERM;
+}
+
+static void
+scan (void)
+{
+    GDir *dir;
+    const gchar *name;
+
+    dir = g_dir_open (SHM_DIR, 0, NULL);
+    if (!dir)
+        return;
+
+    while ((name = g_dir_read_name (dir)))
+    {
+        Process *process;
+
+        if (!g_str_has_prefix (name, GOMX_METRICS_PREFIX))
+            continue;
+
+        process = g_hash_table_lookup (processes, name);
+        if (!process)
+        {
+            GOmxMetricsSegment *segment;
+            gsize size;
+
+            segment = segment_map (name, &size);
+            if (!segment)
+                continue;
+
+            process = g_new0 (Process, 1);
+            process->name = g_strdup (name);
+            process->segment = segment;
+            process->size = size;
+            process->prev = g_new0 (GOmxMetricsSlot, segment->n_slots);
+            g_hash_table_insert (processes, process->name, process);
+        }
+
+        process->seen = TRUE;
+    }
+
+    g_dir_close (dir);
+}
+
+static gboolean
+prune (gpointer key, gpointer value, gpointer user_data)
+{
+    Process *process = value;
+    gboolean gone;
+
+    /* crashed processes leave their segment behind */
+    gone = !process->seen || !process_alive (process->segment);
+    process->seen = FALSE;
+
+    return gone;
+}
+
+static inline gdouble
+rate (guint64 now, guint64 before, gdouble secs)
+{
+    return now >= before ? (now - before) / secs : 0;
+}
+
+static void
+print_process (gpointer key, gpointer value, gpointer user_data)
+{
+    Process *process = value;
+    gdouble *secs = user_data; /* NULL to only take a sample */
+    guint i;
+
+    for (i = 0; i < process->segment->n_slots; i++)
+    {
+        GOmxMetricsSlot now;
+        GOmxMetricsSlot *prev = &process->prev[i];
+        guint64 latency_count;
+        gdouble latency = 0;
+
+        if (!__atomic_load_n (&process->segment->slots[i].in_use, __ATOMIC_ACQUIRE))
+        {
+            prev->in_use = 0;
+            continue;
+        }
+
+        /* torn reads only skew one sample */
+        memcpy (&now, &process->segment->slots[i], sizeof (now));
+
+        /* a new instance took the slot */
+        if (!prev->in_use || strcmp (prev->component, now.component) != 0)
+        {
+            memcpy (prev, &now, sizeof (now));
+            prev->in_use = 1;
+        }
+
+        if (!secs)
+            goto next;
+
+        latency_count = now.latency_count - prev->latency_count;
+        if (latency_count)
+            latency = (now.latency_sum - prev->latency_sum) / 1000.0 / latency_count;
+
+        printf ("%6d %-16.16s %-32.32s %-9.9s %4u %4u %8.1f %8.1f %9.1f %9.1f %6" G_GUINT64_FORMAT " %7.2f\n",
+                process->segment->pid,
+                now.element,
+                now.component,
+                state_name (now.state),
+                now.in_queue,
+                now.out_queue,
+                rate (now.buffers_in, prev->buffers_in, *secs),
+                rate (now.buffers_out, prev->buffers_out, *secs),
+                rate (now.bytes_in, prev->bytes_in, *secs) / 1024,
+                rate (now.bytes_out, prev->bytes_out, *secs) / 1024,
+                now.errors,
+                latency);
+
+next:
+        memcpy (prev, &now, sizeof (now));
+        prev->in_use = 1;
+    }
+}
+
+static void
+update (gdouble secs)
+{
+    scan ();
+    g_hash_table_foreach_remove (processes, prune, NULL);
+
+    if (!once)
+        printf ("\033[H\033[2J");
+
+    printf ("%6s %-16s %-32s %-9s %4s %4s %8s %8s %9s %9s %6s %7s\n",
+            "PID", "ELEMENT", "COMPONENT", "STATE", "INQ", "OUTQ",
+            "IN/s", "OUT/s", "KB-IN/s", "KB-OUT/s", "ERR", "LAT-ms");
+
+    g_hash_table_foreach (processes, print_process, &secs);
+
+    fflush (stdout);
+}
+
+int
+main (int argc, char **argv)
+{
+    GOptionContext *context;
+    GError *error = NULL;
+
+    context = g_option_context_new ("- show OpenMAX component activity");
+    g_option_context_add_main_entries (context, entries, NULL);
+    if (!g_option_context_parse (context, &argc, &argv, &error))
+    {
+        g_printerr ("%s\n", error->message);
+        g_error_free (error);
+        return 1;
+    }
+    g_option_context_free (context);
+
+    if (interval <= 0)
+        interval = 1.0;
+
+    processes = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, process_free);
+
+    if (once)
+    {
+        /* rates need two samples */
+        scan ();
+        g_hash_table_foreach (processes, print_process, NULL);
+        g_usleep (interval * G_USEC_PER_SEC);
+        update (interval);
+    }
+    else
+    {
+        while (TRUE)
+        {
+            update (interval);
+            g_usleep (interval * G_USEC_PER_SEC);
+        }
+    }
+
+    g_hash_table_destroy (processes);
+
+    return 0;
+}
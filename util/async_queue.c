@@ -63,7 +63,8 @@ async_queue_push (AsyncQueue * queue, gpointer data)
     queue->tail = queue->head;
   queue->length++;
 
-  g_cond_signal (queue->condition);
+  /* poppers and async_queue_wait_length() may both be waiting */
+  g_cond_broadcast (queue->condition);
 
   g_mutex_unlock (queue->mutex);
   GST_CAT_LOG (GST_OMX_CAT, "Leave");
@@ -83,7 +84,8 @@ async_queue_pop (AsyncQueue * queue)
     goto leave;
   }
 
-  if (!queue->tail) {
+  /* only data or async_queue_disable() end the wait */
+  while (!queue->tail && queue->enabled) {
     GST_CAT_LOG (GST_OMX_CAT, "Before Wait");
     g_cond_wait (queue->condition, queue->mutex);
     GST_CAT_LOG (GST_OMX_CAT, "After Wait");
@@ -134,6 +136,44 @@ async_queue_pop_forced (AsyncQueue * queue)
   return data;
 }
 
+gpointer
+async_queue_try_pop (AsyncQueue * queue)
+{
+  gpointer data = NULL;
+
+  g_mutex_lock (queue->mutex);
+
+  if (queue->enabled && queue->tail) {
+    GList *node = queue->tail;
+    data = node->data;
+
+    queue->tail = node->prev;
+    if (queue->tail)
+      queue->tail->next = NULL;
+    else
+      queue->head = NULL;
+    queue->length--;
+    g_list_free_1 (node);
+  }
+
+  g_mutex_unlock (queue->mutex);
+
+  return data;
+}
+
+/* A snapshot; other threads may change it right after. */
+guint
+async_queue_length (AsyncQueue * queue)
+{
+  guint length;
+
+  g_mutex_lock (queue->mutex);
+  length = queue->length;
+  g_mutex_unlock (queue->mutex);
+
+  return length;
+}
+
 void
 async_queue_disable (AsyncQueue * queue)
 {
@@ -160,3 +200,23 @@ async_queue_flush (AsyncQueue * queue)
   queue->length = 0;
   g_mutex_unlock (queue->mutex);
 }
+
+/* Waits until the queue holds at least length items; FALSE if it timed out
+ * or the queue got disabled first. */
+gboolean
+async_queue_wait_length (AsyncQueue * queue, guint length, GTimeVal * deadline)
+{
+  gboolean ret;
+
+  g_mutex_lock (queue->mutex);
+
+  while (queue->length < length && queue->enabled) {
+    if (!g_cond_timed_wait (queue->condition, queue->mutex, deadline))
+      break;
+  }
+  ret = queue->length >= length;
+
+  g_mutex_unlock (queue->mutex);
+
+  return ret;
+}
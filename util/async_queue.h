@@ -41,8 +41,11 @@ void async_queue_free (AsyncQueue *queue);
 void async_queue_push (AsyncQueue *queue, gpointer data);
 gpointer async_queue_pop (AsyncQueue *queue);
 gpointer async_queue_pop_forced (AsyncQueue *queue);
+gpointer async_queue_try_pop (AsyncQueue *queue);
+guint async_queue_length (AsyncQueue *queue);
 void async_queue_disable (AsyncQueue *queue);
 void async_queue_enable (AsyncQueue *queue);
 void async_queue_flush (AsyncQueue *queue);
+gboolean async_queue_wait_length (AsyncQueue *queue, guint length, GTimeVal *deadline);
 
 #endif /* ASYNC_QUEUE_H */